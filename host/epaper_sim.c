@@ -0,0 +1,488 @@
+#include "epaper_sim.h"
+#include "spi_shared.h"
+#include "host_port.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "EPAPER_SIM";
+
+#define SIM_WIDTH           800
+#define SIM_HEIGHT          480
+#define SIM_ROW_BYTES       (SIM_WIDTH / 2)
+#define SIM_FRAME_BYTES     (SIM_ROW_BYTES * SIM_HEIGHT)
+#define SIM_MAX_ARGS        16
+
+#define CMD_PSR             0x00
+#define CMD_POF             0x02
+#define CMD_PON             0x04
+#define CMD_DSLP            0x07
+#define CMD_DTM             0x10
+#define CMD_DRF             0x12
+#define CMD_TRES            0x61
+#define CMD_PTL             0x83
+#define CMD_PTIN            0x91
+#define CMD_PTOUT           0x92
+
+// Spectra6 colour codes; 4 and 7 are not defined by the panel.
+static const uint8_t _palette[16][3] = {
+    {0x00, 0x00, 0x00},     // 0 black
+    {0xFF, 0xFF, 0xFF},     // 1 white
+    {0xFF, 0xE0, 0x00},     // 2 yellow
+    {0xC8, 0x10, 0x10},     // 3 red
+    {0x80, 0x80, 0x80},
+    {0x10, 0x40, 0xC8},     // 5 blue
+    {0x10, 0x8C, 0x3C},     // 6 green
+    {0x80, 0x80, 0x80},
+    {0x80, 0x80, 0x80}, {0x80, 0x80, 0x80}, {0x80, 0x80, 0x80}, {0x80, 0x80, 0x80},
+    {0x80, 0x80, 0x80}, {0x80, 0x80, 0x80}, {0x80, 0x80, 0x80}, {0x80, 0x80, 0x80},
+};
+
+static epaper_sim_config_t _config;
+static bool _configured = false;
+static epaper_sim_stats_t _stats;
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t _ram[SIM_FRAME_BYTES];
+static uint8_t _panel[SIM_FRAME_BYTES];
+
+// Command currently receiving parameters, and the parameters so far.
+static int _cmd = -1;
+static uint8_t _args[SIM_MAX_ARGS];
+static size_t _arg_len = 0;
+static bool _reg_written[256];
+
+static bool _reset_level = true;
+static bool _powered = false;
+static bool _sleeping = false;
+static bool _partial_mode = false;
+static uint16_t _win_x0 = 0;
+static uint16_t _win_x1 = SIM_WIDTH - 1;
+static uint16_t _win_y0 = 0;
+static uint16_t _win_y1 = SIM_HEIGHT - 1;
+static size_t _dtm_pos = 0;
+static bool _dtm_overflow = false;
+
+// Simulated time at which BUSY goes high again, and at which the wire is
+// free. Queued segments complete in order at _done_at[].
+static int64_t _busy_until = 0;
+static int64_t _wire_free_at = 0;
+static int64_t _done_at[EPAPER_TRANSPORT_QUEUE_DEPTH];
+static uint32_t _done_head = 0;
+static uint32_t _done_tail = 0;
+
+void epaper_sim_default_config(epaper_sim_config_t *config)
+{
+    config->spi_hz = 4 * 1000 * 1000;
+    config->write_overhead_us = 15;
+    config->queue_overhead_us = 3;
+    config->fill_ns_per_byte = 0;
+    config->max_transfer = SPI_SHARED_MAX_TRANSFER;
+    config->reset_busy_us = 10 * 1000;
+    config->pon_busy_us = 150 * 1000;
+    config->pof_busy_us = 100 * 1000;
+    config->drf_busy_us = 19 * 1000 * 1000;
+    config->partial_drf_busy_us = 19 * 1000 * 1000;
+}
+
+void epaper_sim_configure(const epaper_sim_config_t *config)
+{
+    pthread_mutex_lock(&_lock);
+    _config = *config;
+    _configured = true;
+    pthread_mutex_unlock(&_lock);
+}
+
+void epaper_sim_get_stats(epaper_sim_stats_t *stats)
+{
+    pthread_mutex_lock(&_lock);
+    *stats = _stats;
+    pthread_mutex_unlock(&_lock);
+}
+
+void epaper_sim_reset_stats(void)
+{
+    pthread_mutex_lock(&_lock);
+    memset(&_stats, 0, sizeof(_stats));
+    pthread_mutex_unlock(&_lock);
+}
+
+const uint8_t *epaper_sim_get_panel(void)
+{
+    return _panel;
+}
+
+const uint8_t *epaper_sim_get_ram(void)
+{
+    return _ram;
+}
+
+static void sim_error(const char *what)
+{
+    _stats.errors++;
+    ESP_LOGW(TAG, "Protocol error: %s", what);
+}
+
+static void sim_busy(uint32_t us)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t from = _busy_until > now ? _busy_until : now;
+    _busy_until = from + us;
+    _stats.busy_us += us;
+}
+
+static void sim_refresh(void)
+{
+    if (!_powered) {
+        sim_error("DRF while powered off");
+        return;
+    }
+
+    uint16_t x0 = 0, x1 = SIM_WIDTH - 1, y0 = 0, y1 = SIM_HEIGHT - 1;
+    if (_partial_mode) {
+        x0 = _win_x0;
+        x1 = _win_x1;
+        y0 = _win_y0;
+        y1 = _win_y1;
+        _stats.partial_refreshes++;
+        sim_busy(_config.partial_drf_busy_us);
+    } else {
+        _stats.refreshes++;
+        sim_busy(_config.drf_busy_us);
+    }
+
+    for (uint16_t y = y0; y <= y1; y++) {
+        size_t row = (size_t)y * SIM_ROW_BYTES;
+        memcpy(_panel + row + x0 / 2, _ram + row + x0 / 2, (x1 - x0 + 1) / 2);
+    }
+
+    _stats.undefined_pixels = 0;
+    for (size_t i = 0; i < SIM_FRAME_BYTES; i++) {
+        uint8_t hi = _panel[i] >> 4;
+        uint8_t lo = _panel[i] & 0x0F;
+        _stats.undefined_pixels += (hi == 4 || hi >= 7) + (lo == 4 || lo >= 7);
+    }
+}
+
+// Parameters are applied as they arrive, so a command is complete as soon
+// as its last byte has been seen.
+static void sim_param(uint8_t byte)
+{
+    if (_arg_len < SIM_MAX_ARGS) {
+        _args[_arg_len++] = byte;
+    }
+
+    switch (_cmd) {
+        case CMD_DSLP:
+            if (_arg_len == 1 && byte == 0xA5) {
+                _sleeping = true;
+                _powered = false;
+            }
+            break;
+        case CMD_TRES:
+            if (_arg_len == 4) {
+                uint16_t w = (_args[0] << 8) | _args[1];
+                uint16_t h = (_args[2] << 8) | _args[3];
+                if (w != SIM_WIDTH || h != SIM_HEIGHT) {
+                    sim_error("TRES does not match the panel");
+                }
+            }
+            break;
+        case CMD_PTL:
+            if (_arg_len == 9) {
+                _win_x0 = (_args[0] << 8) | _args[1];
+                _win_x1 = (_args[2] << 8) | _args[3];
+                _win_y0 = (_args[4] << 8) | _args[5];
+                _win_y1 = (_args[6] << 8) | _args[7];
+                if (_win_x1 >= SIM_WIDTH || _win_y1 >= SIM_HEIGHT ||
+                    _win_x0 > _win_x1 || _win_y0 > _win_y1 || (_win_x0 & 1) || !(_win_x1 & 1)) {
+                    sim_error("PTL window outside the panel");
+                    _win_x0 = 0;
+                    _win_x1 = SIM_WIDTH - 1;
+                    _win_y0 = 0;
+                    _win_y1 = SIM_HEIGHT - 1;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void sim_pixels(const uint8_t *data, size_t len)
+{
+    size_t win_bytes = _partial_mode ? (size_t)(_win_x1 - _win_x0 + 1) / 2 : SIM_ROW_BYTES;
+    size_t win_rows = _partial_mode ? (size_t)(_win_y1 - _win_y0 + 1) : SIM_HEIGHT;
+    size_t x0 = _partial_mode ? _win_x0 / 2 : 0;
+    size_t y0 = _partial_mode ? _win_y0 : 0;
+
+    _stats.pixel_bytes += len;
+
+    while (len > 0) {
+        if (_dtm_pos >= win_bytes * win_rows) {
+            if (!_dtm_overflow) {
+                sim_error("DTM data beyond the window");
+                _dtm_overflow = true;
+            }
+            return;
+        }
+
+        size_t row = _dtm_pos / win_bytes;
+        size_t col = _dtm_pos % win_bytes;
+        size_t n = win_bytes - col;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(_ram + (y0 + row) * SIM_ROW_BYTES + x0 + col, data, n);
+        _dtm_pos += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static void sim_command(uint8_t cmd)
+{
+    _stats.commands++;
+    _stats.cmd_count[cmd]++;
+    _cmd = cmd;
+    _arg_len = 0;
+
+    if (_sleeping) {
+        sim_error("command during deep sleep");
+        return;
+    }
+
+    switch (cmd) {
+        case CMD_PON:
+            _powered = true;
+            sim_busy(_config.pon_busy_us);
+            break;
+        case CMD_POF:
+            _powered = false;
+            sim_busy(_config.pof_busy_us);
+            break;
+        case CMD_DTM:
+            if (!_reg_written[CMD_PSR]) {
+                sim_error("DTM before the panel was configured");
+            }
+            _dtm_pos = 0;
+            _dtm_overflow = false;
+            break;
+        case CMD_DRF:
+            sim_refresh();
+            break;
+        case CMD_PTIN:
+            _partial_mode = true;
+            break;
+        case CMD_PTOUT:
+            _partial_mode = false;
+            break;
+        default:
+            break;
+    }
+
+    _reg_written[cmd] = true;
+}
+
+static void sim_segment(bool dc, const uint8_t *data, size_t len)
+{
+    if (!_configured) {
+        epaper_sim_default_config(&_config);
+        _configured = true;
+    }
+
+    if (!_reset_level) {
+        sim_error("SPI traffic while held in reset");
+        return;
+    }
+
+    if (!dc) {
+        for (size_t i = 0; i < len; i++) {
+            sim_command(data[i]);
+        }
+        return;
+    }
+
+    _stats.data_bytes += len;
+    if (_cmd < 0) {
+        sim_error("data before any command");
+    } else if (_sleeping) {
+        return;
+    } else if (_cmd == CMD_DTM) {
+        sim_pixels(data, len);
+    } else {
+        for (size_t i = 0; i < len; i++) {
+            sim_param(data[i]);
+        }
+    }
+}
+
+// Starts a segment on the simulated wire once the previous one is done;
+// returns the simulated time at which it completes.
+static int64_t sim_send(bool dc, const uint8_t *data, size_t len, uint32_t overhead_us)
+{
+    if (dc && _cmd == CMD_DTM) {
+        host_clock_advance((int64_t)len * _config.fill_ns_per_byte / 1000);
+    }
+    sim_segment(dc, data, len);
+
+    int64_t now = esp_timer_get_time();
+    int64_t start = _wire_free_at > now ? _wire_free_at : now;
+    int64_t wire = overhead_us + (int64_t)len * 8 * 1000000 / _config.spi_hz;
+    _wire_free_at = start + wire;
+    _stats.wire_us += wire;
+    return _wire_free_at;
+}
+
+static esp_err_t sim_open(epaper_handle_t *handle)
+{
+    pthread_mutex_lock(&_lock);
+    if (!_configured) {
+        epaper_sim_default_config(&_config);
+        _configured = true;
+    }
+    _done_head = _done_tail = 0;
+    _wire_free_at = 0;
+    pthread_mutex_unlock(&_lock);
+
+    ESP_LOGI(TAG, "Simulated panel: %u Hz SPI, DRF %u ms", (unsigned)_config.spi_hz,
+             (unsigned)(_config.drf_busy_us / 1000));
+    return ESP_OK;
+}
+
+static void sim_close(epaper_handle_t *handle)
+{
+}
+
+static bool sim_fits_bus(size_t len)
+{
+    if (len > _config.max_transfer) {
+        sim_error("segment longer than the bus's max transfer");
+        return false;
+    }
+    return true;
+}
+
+static esp_err_t sim_write(epaper_handle_t *handle, bool dc, const uint8_t *data, size_t len)
+{
+    pthread_mutex_lock(&_lock);
+    if (!sim_fits_bus(len)) {
+        pthread_mutex_unlock(&_lock);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    int64_t done = sim_send(dc, data, len, _config.write_overhead_us);
+    pthread_mutex_unlock(&_lock);
+
+    host_clock_advance(done - esp_timer_get_time());
+    return ESP_OK;
+}
+
+static esp_err_t sim_queue(epaper_handle_t *handle, bool dc, const uint8_t *data, size_t len)
+{
+    pthread_mutex_lock(&_lock);
+    if (_done_tail - _done_head == EPAPER_TRANSPORT_QUEUE_DEPTH) {
+        pthread_mutex_unlock(&_lock);
+        ESP_LOGE(TAG, "Queue overflow");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!sim_fits_bus(len)) {
+        pthread_mutex_unlock(&_lock);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    _done_at[_done_tail++ % EPAPER_TRANSPORT_QUEUE_DEPTH] = sim_send(dc, data, len, _config.queue_overhead_us);
+    pthread_mutex_unlock(&_lock);
+    return ESP_OK;
+}
+
+static esp_err_t sim_reclaim(epaper_handle_t *handle)
+{
+    pthread_mutex_lock(&_lock);
+    if (_done_head == _done_tail) {
+        pthread_mutex_unlock(&_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t done = _done_at[_done_head++ % EPAPER_TRANSPORT_QUEUE_DEPTH];
+    pthread_mutex_unlock(&_lock);
+
+    host_clock_advance(done - esp_timer_get_time());
+    return ESP_OK;
+}
+
+static void sim_set_reset(epaper_handle_t *handle, bool level)
+{
+    pthread_mutex_lock(&_lock);
+    if (level && !_reset_level) {
+        // Registers and power state are lost; RAM contents are undefined.
+        _stats.resets++;
+        memset(_reg_written, 0, sizeof(_reg_written));
+        _cmd = -1;
+        _powered = false;
+        _sleeping = false;
+        _partial_mode = false;
+        _busy_until = 0;
+        sim_busy(_config.reset_busy_us);
+    }
+    _reset_level = level;
+    pthread_mutex_unlock(&_lock);
+}
+
+static esp_err_t sim_wait_busy(epaper_handle_t *handle, uint32_t timeout_ms)
+{
+    pthread_mutex_lock(&_lock);
+    int64_t remaining = _busy_until - esp_timer_get_time();
+    pthread_mutex_unlock(&_lock);
+
+    if (remaining <= 0) {
+        return ESP_OK;
+    }
+
+    if (remaining > (int64_t)timeout_ms * 1000) {
+        host_clock_advance((int64_t)timeout_ms * 1000);
+        return EPAPER_ERR_TIMEOUT;
+    }
+
+    host_clock_advance(remaining);
+    return ESP_OK;
+}
+
+esp_err_t epaper_sim_write_ppm(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Cannot create %s", path);
+        return ESP_FAIL;
+    }
+
+    fprintf(f, "P6\n%d %d\n255\n", SIM_WIDTH, SIM_HEIGHT);
+
+    uint8_t row[SIM_WIDTH * 3];
+    for (int y = 0; y < SIM_HEIGHT; y++) {
+        const uint8_t *src = _panel + (size_t)y * SIM_ROW_BYTES;
+        for (int x = 0; x < SIM_WIDTH; x++) {
+            uint8_t code = (x & 1) ? (src[x / 2] & 0x0F) : (src[x / 2] >> 4);
+            memcpy(&row[x * 3], _palette[code], 3);
+        }
+        fwrite(row, 1, sizeof(row), f);
+    }
+
+    bool ok = (ferror(f) == 0);
+    fclose(f);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+const epaper_transport_t epaper_transport_sim = {
+    .name = "sim",
+    .open = sim_open,
+    .close = sim_close,
+    .write = sim_write,
+    .queue = sim_queue,
+    .reclaim = sim_reclaim,
+    .set_reset = sim_set_reset,
+    .wait_busy = sim_wait_busy
+};
@@ -0,0 +1,67 @@
+#ifndef EPAPER_SIM_H
+#define EPAPER_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "epaper_transport.h"
+
+// Simulated GDEP073E01 controller behind the transport interface. It
+// decodes the command stream, keeps controller RAM and the image on the
+// glass, and holds BUSY low for configurable phase durations. Wire time
+// and BUSY phases advance the simulated clock rather than sleeping.
+//
+// fill_ns_per_byte stands in for whatever produces the pixel data (a copy
+// out of PSRAM, a decoder, a band renderer): each DTM segment is charged
+// that much CPU time before it is handed over. A blocking write then waits
+// for the wire after paying it, while a queued segment pays it while the
+// previous one is still on the wire, as DMA does on the target.
+
+typedef struct {
+    uint32_t spi_hz;                // wire time charged per byte
+    uint32_t write_overhead_us;     // per blocking segment
+    uint32_t queue_overhead_us;     // per queued segment
+    uint32_t fill_ns_per_byte;      // CPU time to produce each pixel byte
+    uint32_t max_transfer;          // longest segment the bus takes
+    uint32_t reset_busy_us;
+    uint32_t pon_busy_us;
+    uint32_t pof_busy_us;
+    uint32_t drf_busy_us;
+    uint32_t partial_drf_busy_us;
+} epaper_sim_config_t;
+
+typedef struct {
+    uint32_t commands;
+    uint32_t data_bytes;
+    uint32_t pixel_bytes;           // DTM payload
+    uint32_t resets;
+    uint32_t refreshes;
+    uint32_t partial_refreshes;
+    uint32_t errors;                // protocol violations, each one logged
+    uint32_t undefined_pixels;      // codes other than the six colours, last refresh
+    int64_t wire_us;
+    int64_t busy_us;
+    uint32_t cmd_count[256];
+} epaper_sim_stats_t;
+
+extern const epaper_transport_t epaper_transport_sim;
+
+// 4 MHz and the shared bus's SPI_SHARED_MAX_TRANSFER like the SPI backend
+// (longer segments are refused, as spi_device_transmit does), and BUSY phases in the range the panel shows
+// on hardware (about 20 s per refresh). /api/timing gives real figures.
+void epaper_sim_default_config(epaper_sim_config_t *config);
+void epaper_sim_configure(const epaper_sim_config_t *config);
+
+void epaper_sim_get_stats(epaper_sim_stats_t *stats);
+void epaper_sim_reset_stats(void);
+
+// Packed 4bpp, 800x480: what the panel shows after the last DRF, and the
+// controller RAM that the next DRF would show.
+const uint8_t *epaper_sim_get_panel(void);
+const uint8_t *epaper_sim_get_ram(void);
+
+// Writes the panel image as a binary PPM in the Spectra6 colours.
+esp_err_t epaper_sim_write_ppm(const char *path);
+
+#endif
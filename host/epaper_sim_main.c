@@ -0,0 +1,1823 @@
+// Runs the display stack against the simulated panel: init, full, unchanged,
+// partial, banded and rotated updates, both transfer modes and the command
+// benchmark. Every update is checked against what ends up on the simulated
+// glass, so the exit status can gate changes; PPM snapshots go to the
+// output directory.
+
+#include "epaper_driver.h"
+#include "epaper_draw.h"
+#include "epaper_text.h"
+#include "epaper_rotate.h"
+#include "epaper_sim.h"
+#include "epaper_transport.h"
+#include "spi_shared.h"
+#include "tjpgd_sim.h"
+#include "bitmap.h"
+#include "epd_file.h"
+#include "frame_cache.h"
+#include "epaper_dither.h"
+#include "framebuffer.h"
+#include "host_port.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#define FRAME_BYTES     (800 * 480 / 2)
+
+static int _failures = 0;
+static const char *_out_dir = ".";
+
+static void check(bool ok, const char *what)
+{
+    printf("  %-44s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok) {
+        _failures++;
+    }
+}
+
+static void snapshot(const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.ppm", _out_dir, name);
+    if (epaper_sim_write_ppm(path) != ESP_OK) {
+        _failures++;
+    }
+}
+
+static bool panel_matches(const uint8_t *expect)
+{
+    return memcmp(epaper_sim_get_panel(), expect, FRAME_BYTES) == 0;
+}
+
+static void print_last_update(void)
+{
+    epaper_timing_record_t records[8];
+    size_t count = epaper_get_timing_records(records, 8);
+    if (count == 0) {
+        return;
+    }
+
+    const epaper_timing_record_t *rec = &records[count - 1];
+    printf("  %s update #%lu: %.1f ms\n", rec->kind, (unsigned long)rec->seq, rec->total_us / 1000.0);
+    for (uint8_t i = 0; i < rec->phase_count; i++) {
+        const epaper_timing_phase_t *phase = &rec->phases[i];
+        printf("      %-6s +%10.1f ms %10.1f ms%s\n", phase->name, phase->start_us / 1000.0,
+               phase->duration_us / 1000.0, phase->timed_out ? "  TIMEOUT" : "");
+    }
+}
+
+static void draw_pattern(uint8_t *buf, uint16_t width, uint16_t height, int seed)
+{
+    static const epaper_color_t bars[] = {
+        EPAPER_COLOR_BLACK, EPAPER_COLOR_WHITE, EPAPER_COLOR_YELLOW,
+        EPAPER_COLOR_RED, EPAPER_COLOR_BLUE, EPAPER_COLOR_GREEN
+    };
+    epaper_canvas_t canvas;
+    char text[64];
+
+    epaper_canvas_init(&canvas, buf, width, height);
+    epaper_draw_fill_rect(&canvas, 0, 0, width, height, EPAPER_COLOR_WHITE);
+
+    int bar_w = width / 6;
+    for (int i = 0; i < 6; i++) {
+        epaper_draw_fill_rect(&canvas, i * bar_w, height / 2, bar_w, height / 2, bars[(i + seed) % 6]);
+    }
+
+    epaper_draw_rect(&canvas, 8, 8, width - 16, height / 2 - 16, EPAPER_COLOR_BLACK);
+    snprintf(text, sizeof(text), "GDEP073E01 host simulation #%d\n%ux%u", seed, width, height);
+    epaper_draw_text(&canvas, &epaper_font_mono16, 24, 24, text, EPAPER_COLOR_BLACK, EPAPER_TEXT_TRANSPARENT);
+}
+
+// Stands in for a second HTTP request arriving while the panel is held.
+static void *refresh_from_other_task(void *arg)
+{
+    *(esp_err_t *)arg = epaper_refresh_async(epaper_session_get(), false, NULL, NULL);
+    return NULL;
+}
+
+static esp_err_t render_copy(uint8_t *band, uint16_t y, uint16_t rows, void *ctx)
+{
+    memcpy(band, (const uint8_t *)ctx + (size_t)y * 400, (size_t)rows * 400);
+    return ESP_OK;
+}
+
+// Writes frame as a bottom-up 4-bit BMP whose palette index i holds the
+// colour of panel code order[i]; pixels are stored as those indices.
+static bool write_bmp4(const char *path, const uint8_t *frame, uint16_t width, uint16_t height,
+                       const uint8_t order[6])
+{
+    static const uint8_t rgb[8][3] = {
+        {0, 0, 0}, {255, 255, 255}, {255, 255, 0}, {255, 0, 0}, {0, 0, 0}, {0, 0, 255}, {0, 255, 0}, {0, 0, 0}
+    };
+    uint32_t stride = width / 2;
+    uint32_t offset = sizeof(bmp_header_t) + sizeof(bmp_info_header_t) + 6 * 4;
+    bmp_header_t header = {
+        .type = 0x4D42,
+        .size = offset + stride * height,
+        .offset = offset
+    };
+    bmp_info_header_t info = {
+        .size = sizeof(bmp_info_header_t),
+        .width = width,
+        .height = height,
+        .planes = 1,
+        .bits_per_pixel = 4,
+        .image_size = stride * height,
+        .colors_used = 6
+    };
+    uint8_t palette[6 * 4] = {0};
+    uint8_t index[8] = {0};
+    uint8_t row[400];
+
+    for (int i = 0; i < 6; i++) {
+        palette[i * 4 + 0] = rgb[order[i]][2];
+        palette[i * 4 + 1] = rgb[order[i]][1];
+        palette[i * 4 + 2] = rgb[order[i]][0];
+        index[order[i]] = i;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(&info, sizeof(info), 1, file);
+    fwrite(palette, sizeof(palette), 1, file);
+    for (int y = height - 1; y >= 0; y--) {
+        const uint8_t *src = frame + (size_t)y * stride;
+        for (uint32_t x = 0; x < stride; x++) {
+            row[x] = (index[src[x] >> 4 & 7] << 4) | index[src[x] & 7];
+        }
+        fwrite(row, stride, 1, file);
+    }
+    return fclose(file) == 0;
+}
+
+// Test images for the format tests: blocks of the six panel colours (only
+// black and white for 1-bit), written with palettes in a different order
+// from the panel codes and with true-colour values a little off the pure
+// colours, so the nearest-colour matching is exercised too.
+static const uint8_t _six_codes[6] = {0, 1, 2, 3, 5, 6};
+static const uint8_t _six_rgb[6][3] = {
+    {10, 12, 8}, {245, 250, 240}, {240, 235, 20}, {230, 25, 15}, {20, 30, 225}, {15, 220, 40}
+};
+
+static int pattern_index(uint32_t x, uint32_t y, uint16_t bpp)
+{
+    return bpp == 1 ? ((x / 8) + (y / 8)) % 2 : ((x / 8) + (y / 8) * 3) % 6;
+}
+
+static bool write_bmp(const char *path, uint32_t width, uint32_t height, uint16_t bpp, bool top_down)
+{
+    static const uint8_t shuffle[6] = {4, 2, 5, 0, 3, 1};
+    uint32_t entries = bpp <= 8 ? 1u << bpp : 0;
+    uint32_t row_size = ((width * bpp + 31) / 32) * 4;
+    uint32_t offset = sizeof(bmp_header_t) + sizeof(bmp_info_header_t) + entries * 4;
+    bmp_header_t header = {
+        .type = 0x4D42,
+        .size = offset + row_size * height,
+        .offset = offset
+    };
+    bmp_info_header_t info = {
+        .size = sizeof(bmp_info_header_t),
+        .width = width,
+        .height = top_down ? -(int32_t)height : (int32_t)height,
+        .planes = 1,
+        .bits_per_pixel = bpp,
+        .image_size = row_size * height,
+        .colors_used = entries
+    };
+
+    FILE *file = fopen(path, "wb");
+    uint8_t *row = calloc(1, row_size);
+    if (file == NULL || row == NULL) {
+        free(row);
+        if (file != NULL) {
+            fclose(file);
+        }
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(&info, sizeof(info), 1, file);
+
+    // 1-bit: black, white. 4-bit: the six colours shuffled, rest grey.
+    // 8-bit: the six colours repeated through all 256 entries.
+    for (uint32_t i = 0; i < entries; i++) {
+        uint8_t bgra[4] = {128, 128, 128, 0};
+        int c = -1;
+        if (bpp == 1) {
+            c = i;
+        } else if (bpp == 4 && i < 6) {
+            c = shuffle[i];
+        } else if (bpp == 8) {
+            c = i % 6;
+        }
+        if (c >= 0) {
+            bgra[0] = _six_rgb[c][2];
+            bgra[1] = _six_rgb[c][1];
+            bgra[2] = _six_rgb[c][0];
+        }
+        fwrite(bgra, 4, 1, file);
+    }
+
+    uint8_t index_of[6];
+    for (int i = 0; i < 6; i++) {
+        index_of[shuffle[i]] = i;
+    }
+
+    for (uint32_t k = 0; k < height; k++) {
+        uint32_t y = top_down ? k : height - 1 - k;
+        memset(row, 0, row_size);
+        for (uint32_t x = 0; x < width; x++) {
+            int c = pattern_index(x, y, bpp);
+            switch (bpp) {
+                case 1:  row[x / 8] |= c << (7 - (x % 8)); break;
+                case 4:  row[x / 2] |= index_of[c] << ((x & 1) ? 0 : 4); break;
+                case 8:  row[x] = c + 6 * ((x + y) % 42); break;
+                default:
+                    row[x * (bpp / 8) + 0] = _six_rgb[c][2];
+                    row[x * (bpp / 8) + 1] = _six_rgb[c][1];
+                    row[x * (bpp / 8) + 2] = _six_rgb[c][0];
+                    break;
+            }
+        }
+        fwrite(row, row_size, 1, file);
+    }
+
+    free(row);
+    return fclose(file) == 0;
+}
+
+// Expected panel code at frame pixel (x, y), or -1 for border white.
+typedef int (*expect_fn_t)(uint32_t x, uint32_t y, uint16_t bpp);
+
+static int expect_same(uint32_t x, uint32_t y, uint16_t bpp)      { return pattern_index(x, y, bpp); }
+static int expect_double(uint32_t x, uint32_t y, uint16_t bpp)    { return pattern_index(x / 2, y / 2, bpp); }
+static int expect_half(uint32_t x, uint32_t y, uint16_t bpp)      { return pattern_index(2 * x + 1, 2 * y + 1, bpp); }
+static int expect_offset(uint32_t x, uint32_t y, uint16_t bpp)    { return pattern_index(x + 100, y + 60, bpp); }
+static int expect_crop_wide(uint32_t x, uint32_t y, uint16_t bpp) { return pattern_index(x + 200, y, bpp); }
+
+static int expect_inset(uint32_t x, uint32_t y, uint16_t bpp)
+{
+    if (x < 100 || x >= 700 || y < 60 || y >= 420) {
+        return -1;
+    }
+    return pattern_index(x - 100, y - 60, bpp);
+}
+
+static bool frame_matches(const uint8_t *frame, uint32_t width, uint32_t height, uint16_t bpp, expect_fn_t fn)
+{
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t byte = frame[(y * width + x) / 2];
+            uint8_t code = (x & 1) ? (byte & 0x0F) : (byte >> 4);
+            int c = fn(x, y, bpp);
+            if (code != (c < 0 ? 1 : _six_codes[c])) {
+                printf("      mismatch at %u,%u: %x\n", x, y, code);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void bmp_formats(uint8_t *frame)
+{
+    static const struct {
+        uint32_t width, height;
+        uint16_t bpp;
+        bool top_down;
+        bmp_fit_t fit;
+        expect_fn_t expect;
+    } cases[] = {
+        { 800,  480,  1, false, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480,  4, false, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480,  8, false, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 24, false, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 32, false, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480,  4, true,  BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 24, true,  BMP_FIT_DEFAULT,   expect_same},
+        { 400,  240, 24, false, BMP_FIT_LETTERBOX, expect_double},
+        { 400,  240,  8, true,  BMP_FIT_CROP,      expect_double},
+        {1600,  960, 24, false, BMP_FIT_LETTERBOX, expect_half},
+        {1600,  960, 32, true,  BMP_FIT_CROP,      expect_half},
+        {1000,  600,  4, false, BMP_FIT_CENTER,    expect_offset},
+        { 600,  360,  1, false, BMP_FIT_CENTER,    expect_inset},
+        { 600,  360, 24, true,  BMP_FIT_CENTER,    expect_inset},
+        {1200,  480,  8, false, BMP_FIT_CROP,      expect_crop_wide},
+        { 300,  500, 24, false, BMP_FIT_LETTERBOX, NULL},
+    };
+    char path[512];
+    char what[64];
+
+    snprintf(path, sizeof(path), "%s/format.bmp", _out_dir);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bmp_image_t image = {0};
+        bmp_load_stats_t load;
+
+        if (!write_bmp(path, cases[i].width, cases[i].height, cases[i].bpp, cases[i].top_down)) {
+            check(false, "write format.bmp");
+            continue;
+        }
+
+        memset(frame, 0, FRAME_BYTES);
+        bmp_load_opts_t opts = {.fit = cases[i].fit, .dither = EPAPER_DITHER_NONE};
+        esp_err_t ret = load_bmp_into_frame(path, frame, 800, 480, &opts, &image);
+        bmp_get_load_stats(&load);
+
+        bool portrait = cases[i].height > cases[i].width;
+        bool ok = ret == ESP_OK && image.width == (portrait ? 480 : 800) && image.height == (portrait ? 800 : 480);
+        if (ok && cases[i].expect != NULL) {
+            ok = frame_matches(frame, image.width, image.height, cases[i].bpp, cases[i].expect);
+        }
+
+        snprintf(what, sizeof(what), "%4lux%-4lu %2u-bit %-9s %s", (unsigned long)cases[i].width,
+                 (unsigned long)cases[i].height, cases[i].bpp, bmp_fit_name(cases[i].fit),
+                 cases[i].top_down ? "top-down" : "");
+        check(ok, what);
+        if (ret == ESP_OK) {
+            printf("      %7.2f ms, %6.1f MB/s file, %6.1f Mpx/s out, convert %.2f ms\n",
+                   load.elapsed_us / 1000.0, load.file_bytes / (double)load.elapsed_us,
+                   (double)image.width * image.height / load.elapsed_us, load.convert_us / 1000.0);
+        }
+    }
+}
+
+// Marker segments of a baseline (or progressive) JPEG, followed by filler
+// scan data; tjpgd_sim supplies the pixels from jpeg_source.
+static bool write_jpeg(const char *path, uint32_t width, uint32_t height, uint8_t msx, uint8_t msy,
+                       bool progressive)
+{
+    const uint8_t head[] = {
+        0xFF, 0xD8,
+        0xFF, progressive ? 0xC2 : 0xC0, 0x00, 0x11, 0x08,
+        height >> 8, height & 0xFF, width >> 8, width & 0xFF, 0x03,
+        0x01, (msx << 4) | msy, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01,
+        0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00
+    };
+    static const uint8_t tail[] = {0xFF, 0xD9};
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fwrite(head, sizeof(head), 1, file);
+    for (uint32_t i = 0; i < width * height / 16; i++) {
+        fputc(0x55, file);
+    }
+    fwrite(tail, sizeof(tail), 1, file);
+    return fclose(file) == 0;
+}
+
+static void jpeg_source(uint32_t x, uint32_t y, uint8_t rgb[3])
+{
+    memcpy(rgb, _six_rgb[pattern_index(x, y, 24)], 3);
+}
+
+static int expect_quarter(uint32_t x, uint32_t y, uint16_t bpp)   { return pattern_index(4 * x, 4 * y, bpp); }
+static int expect_eighth(uint32_t x, uint32_t y, uint16_t bpp)    { return pattern_index(8 * x, 8 * y, bpp); }
+static int expect_crop_tall(uint32_t x, uint32_t y, uint16_t bpp) { return pattern_index(2 * x, 2 * y + 120, bpp); }
+
+static void jpeg_formats(uint8_t *frame)
+{
+    static const struct {
+        uint32_t width, height;
+        uint8_t msx, msy;
+        bmp_fit_t fit;
+        uint8_t scale;
+        expect_fn_t expect;
+    } cases[] = {
+        { 800,  480, 2, 2, BMP_FIT_DEFAULT,   0, expect_same},
+        { 800,  480, 1, 1, BMP_FIT_DEFAULT,   0, expect_same},
+        {1600,  960, 2, 2, BMP_FIT_LETTERBOX, 1, expect_half},
+        {3200, 1920, 2, 1, BMP_FIT_CROP,      2, expect_quarter},
+        {6400, 3840, 2, 2, BMP_FIT_LETTERBOX, 3, expect_eighth},
+        {1600, 1200, 2, 2, BMP_FIT_CROP,      1, expect_crop_tall},
+        {1000,  600, 2, 2, BMP_FIT_CENTER,    0, expect_offset},
+        { 600,  360, 1, 1, BMP_FIT_CENTER,    0, expect_inset},
+        {1203,  721, 2, 1, BMP_FIT_LETTERBOX, 0, NULL},
+        {4001, 2999, 2, 2, BMP_FIT_CROP,      2, NULL},
+        {1080, 1920, 2, 2, BMP_FIT_LETTERBOX, 1, NULL},
+    };
+    char path[512];
+    char what[64];
+
+    tjpgd_sim_set_source(jpeg_source);
+    snprintf(path, sizeof(path), "%s/format.jpg", _out_dir);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bmp_image_t image = {0};
+        bmp_load_stats_t load;
+        tjpgd_sim_stats_t dec;
+        host_heap_stats_t heap;
+
+        if (!write_jpeg(path, cases[i].width, cases[i].height, cases[i].msx, cases[i].msy, false)) {
+            check(false, "write format.jpg");
+            continue;
+        }
+
+        memset(frame, 0, FRAME_BYTES);
+        host_heap_reset_peak();
+        host_heap_get_stats(&heap);
+        size_t base = heap.current;
+        bmp_load_opts_t opts = {.fit = cases[i].fit, .dither = EPAPER_DITHER_NONE};
+        esp_err_t ret = load_image_into_frame(path, frame, 800, 480, &opts, &image);
+        host_heap_get_stats(&heap);
+        bmp_get_load_stats(&load);
+        tjpgd_sim_get_stats(&dec);
+
+        bool portrait = cases[i].height > cases[i].width;
+        bool ok = ret == ESP_OK && load.decode_scale == cases[i].scale &&
+                  image.width == (portrait ? 480 : 800) && image.height == (portrait ? 800 : 480);
+        if (ok && cases[i].expect != NULL) {
+            ok = frame_matches(frame, image.width, image.height, 24, cases[i].expect);
+        }
+
+        snprintf(what, sizeof(what), "%4lux%-4lu %u:%u 1/%u %-9s", (unsigned long)cases[i].width,
+                 (unsigned long)cases[i].height, cases[i].msx, cases[i].msy, 1u << cases[i].scale,
+                 bmp_fit_name(cases[i].fit));
+        check(ok, what);
+        if (ret == ESP_OK) {
+            printf("      %7.2f ms, convert %.2f ms, peak heap +%lu bytes, %lu MCUs%s\n",
+                   load.elapsed_us / 1000.0, load.convert_us / 1000.0, (unsigned long)(heap.peak - base),
+                   (unsigned long)dec.mcus, dec.interrupted ? ", stopped early" : "");
+        }
+    }
+
+    bmp_image_t image = {0};
+    check(write_jpeg(path, 800, 480, 2, 2, true), "write progressive format.jpg");
+    check(load_image_into_frame(path, frame, 800, 480, NULL, &image) == ESP_ERR_NOT_SUPPORTED,
+          "progressive JPEG rejected");
+}
+
+static void png_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t be[4] = {len >> 24, len >> 16, len >> 8, len};
+    uLong crc = crc32(crc32(0, (const Bytef *)type, 4), data, len);
+    uint8_t crc_be[4] = {crc >> 24, crc >> 16, crc >> 8, crc};
+
+    fwrite(be, 4, 1, file);
+    fwrite(type, 4, 1, file);
+    if (len > 0) {
+        fwrite(data, len, 1, file);
+    }
+    fwrite(crc_be, 4, 1, file);
+}
+
+// PNG of the test pattern. Grey images and 1 and 2-bit palettes use the
+// two-colour pattern, everything else the six colours. Black cells are
+// fully transparent in RGBA and opaque black on transparent in grey+alpha,
+// so both should load as the expected pattern with white for clear
+// pixels. Rows cycle through the five filter types, the data is split
+// over several IDAT chunks, and a large unknown chunk has to be skipped.
+// Interlaced or 16-bit images get a header only.
+static bool write_png(const char *path, uint32_t width, uint32_t height, uint8_t color_type, uint8_t depth,
+                      bool interlace)
+{
+    static const uint8_t shuffle[6] = {4, 2, 5, 0, 3, 1};
+    static const uint8_t channels_of[7] = {1, 0, 3, 1, 2, 0, 4};
+    uint32_t channels = channels_of[color_type];
+    uint32_t row_bytes = (width * channels * depth + 7) / 8;
+    uint32_t dist = channels * depth >= 8 ? channels * depth / 8 : 1;
+    bool two = (color_type == 0 || color_type == 4 || (color_type == 3 && depth <= 2));
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 8, 1, file);
+    uint8_t ihdr[13] = {width >> 24, width >> 16, width >> 8, width, height >> 24, height >> 16, height >> 8, height,
+                        depth, color_type, 0, 0, interlace};
+    png_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+    if (interlace || depth == 16) {
+        png_chunk(file, "IEND", NULL, 0);
+        return fclose(file) == 0;
+    }
+
+    if (color_type == 3) {
+        uint8_t plte[6 * 3];
+        uint32_t entries = depth == 1 ? 2 : depth == 2 ? 4 : 6;
+        for (uint32_t i = 0; i < entries; i++) {
+            // 2-bit: black, yellow, red, white; the pattern uses 0 and 3.
+            int c = depth == 1 ? (int)i : depth == 2 ? (int)(i == 3 ? 1 : i == 0 ? 0 : i + 1) : shuffle[i];
+            memcpy(plte + i * 3, _six_rgb[c], 3);
+        }
+        png_chunk(file, "PLTE", plte, entries * 3);
+    }
+
+    size_t skip_len = 20000;
+    uint8_t *skip = calloc(1, skip_len);
+    png_chunk(file, "teST", skip, skip_len);
+    free(skip);
+
+    uint8_t index_of[6];
+    for (int i = 0; i < 6; i++) {
+        index_of[shuffle[i]] = i;
+    }
+
+    size_t raw_len = (size_t)(1 + row_bytes) * height;
+    uint8_t *raw = calloc(1, raw_len);
+    uint8_t *rows = calloc(2, row_bytes);
+    uLongf packed_len = compressBound(raw_len);
+    uint8_t *packed = malloc(packed_len);
+    if (raw == NULL || rows == NULL || packed == NULL) {
+        free(raw);
+        free(rows);
+        free(packed);
+        fclose(file);
+        return false;
+    }
+
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *cur = rows + (y & 1) * row_bytes;
+        uint8_t *up = rows + ((y + 1) & 1) * row_bytes;
+        memset(cur, 0, row_bytes);
+        for (uint32_t x = 0; x < width; x++) {
+            int c = pattern_index(x, y, two ? 1 : 24);
+            uint32_t v;
+            switch (color_type) {
+                case 0:
+                    v = c ? (1u << depth) - 1 : 0;
+                    break;
+                case 3:
+                    v = depth == 1 ? (uint32_t)c : depth == 2 ? (c ? 3u : 0u) : index_of[c];
+                    break;
+                case 2:
+                    memcpy(cur + x * 3, _six_rgb[c], 3);
+                    continue;
+                case 4:
+                    cur[x * 2] = 0;
+                    cur[x * 2 + 1] = c ? 0 : 255;
+                    continue;
+                default:
+                    memcpy(cur + x * 4, _six_rgb[c], 3);
+                    cur[x * 4 + 3] = c ? 255 : 0;
+                    continue;
+            }
+            uint32_t bit = x * depth;
+            cur[bit / 8] |= v << (8 - depth - bit % 8);
+        }
+
+        uint8_t filter = y % 5;
+        uint8_t *out = raw + (size_t)y * (1 + row_bytes);
+        out[0] = filter;
+        for (uint32_t i = 0; i < row_bytes; i++) {
+            int a = i >= dist ? cur[i - dist] : 0;
+            int b = y > 0 ? up[i] : 0;
+            int c = i >= dist && y > 0 ? up[i - dist] : 0;
+            int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+            int pred[5] = {0, a, b, (a + b) / 2, (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c)};
+            out[1 + i] = cur[i] - pred[filter];
+        }
+    }
+
+    bool ok = compress2(packed, &packed_len, raw, raw_len, 9) == Z_OK;
+    for (uLongf off = 0; ok && off < packed_len; off += 8192) {
+        png_chunk(file, "IDAT", packed + off, packed_len - off < 8192 ? packed_len - off : 8192);
+    }
+    png_chunk(file, "IEND", NULL, 0);
+
+    free(raw);
+    free(rows);
+    free(packed);
+    return fclose(file) == 0 && ok;
+}
+
+static int expect_clear_black(uint32_t x, uint32_t y, uint16_t bpp)
+{
+    int c = pattern_index(x, y, bpp);
+    return c == 0 ? 1 : c;
+}
+
+static void png_formats(uint8_t *frame)
+{
+    static const struct {
+        uint32_t width, height;
+        uint8_t color_type, depth;
+        bmp_fit_t fit;
+        expect_fn_t expect;
+    } cases[] = {
+        { 800,  480, 3, 1, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 3, 2, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 3, 4, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 3, 8, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 0, 1, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 0, 2, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 0, 4, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 0, 8, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 2, 8, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 4, 8, BMP_FIT_DEFAULT,   expect_same},
+        { 800,  480, 6, 8, BMP_FIT_DEFAULT,   expect_clear_black},
+        {1600,  960, 3, 8, BMP_FIT_LETTERBOX, expect_half},
+        { 400,  240, 2, 8, BMP_FIT_CROP,      expect_double},
+        {1000,  600, 3, 4, BMP_FIT_CENTER,    expect_offset},
+        { 601,  361, 0, 1, BMP_FIT_LETTERBOX, NULL},
+        { 480,  800, 3, 4, BMP_FIT_LETTERBOX, NULL},
+    };
+    char path[512];
+    char what[64];
+
+    snprintf(path, sizeof(path), "%s/format.png", _out_dir);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bmp_image_t image = {0};
+        bmp_load_stats_t load;
+        host_heap_stats_t heap;
+        struct stat st;
+
+        if (!write_png(path, cases[i].width, cases[i].height, cases[i].color_type, cases[i].depth, false) ||
+            stat(path, &st) != 0) {
+            check(false, "write format.png");
+            continue;
+        }
+
+        memset(frame, 0, FRAME_BYTES);
+        host_heap_reset_peak();
+        host_heap_get_stats(&heap);
+        size_t base = heap.current;
+        bmp_load_opts_t opts = {.fit = cases[i].fit, .dither = EPAPER_DITHER_NONE};
+        esp_err_t ret = load_image_into_frame(path, frame, 800, 480, &opts, &image);
+        host_heap_get_stats(&heap);
+        bmp_get_load_stats(&load);
+
+        bool portrait = cases[i].height > cases[i].width;
+        bool ok = ret == ESP_OK && image.width == (portrait ? 480 : 800) && image.height == (portrait ? 800 : 480);
+        bool two = cases[i].color_type == 0 || cases[i].color_type == 4 || cases[i].depth <= 2;
+        if (ok && cases[i].expect != NULL) {
+            ok = frame_matches(frame, image.width, image.height, two ? 1 : 24, cases[i].expect);
+        }
+
+        snprintf(what, sizeof(what), "%4lux%-4lu type %u, %u-bit %-9s", (unsigned long)cases[i].width,
+                 (unsigned long)cases[i].height, cases[i].color_type, cases[i].depth, bmp_fit_name(cases[i].fit));
+        check(ok, what);
+        if (ret == ESP_OK) {
+            printf("      %7.2f ms, convert %.2f ms, file %lu bytes, peak heap +%lu bytes\n",
+                   load.elapsed_us / 1000.0, load.convert_us / 1000.0, (unsigned long)st.st_size,
+                   (unsigned long)(heap.peak - base));
+        }
+    }
+
+    bmp_image_t image = {0};
+    check(write_png(path, 800, 480, 3, 4, true) &&
+          load_image_into_frame(path, frame, 800, 480, NULL, &image) == ESP_ERR_NOT_SUPPORTED,
+          "interlaced PNG rejected");
+    check(write_png(path, 800, 480, 2, 16, false) &&
+          load_image_into_frame(path, frame, 800, 480, NULL, &image) == ESP_ERR_NOT_SUPPORTED,
+          "16-bit PNG rejected");
+}
+
+// A 24-bit test photo: solid mid grey, or a hue sweep across x over a
+// dark-to-light ramp down y.
+static bool write_photo_bmp(const char *path, uint32_t width, uint32_t height, bool grey)
+{
+    uint32_t row_size = ((width * 24 + 31) / 32) * 4;
+    uint32_t offset = sizeof(bmp_header_t) + sizeof(bmp_info_header_t);
+    bmp_header_t header = {.type = 0x4D42, .size = offset + row_size * height, .offset = offset};
+    bmp_info_header_t info = {
+        .size = sizeof(bmp_info_header_t),
+        .width = width,
+        .height = height,
+        .planes = 1,
+        .bits_per_pixel = 24,
+        .image_size = row_size * height
+    };
+
+    FILE *file = fopen(path, "wb");
+    uint8_t *row = calloc(1, row_size);
+    if (file == NULL || row == NULL) {
+        free(row);
+        if (file != NULL) {
+            fclose(file);
+        }
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(&info, sizeof(info), 1, file);
+
+    for (uint32_t k = 0; k < height; k++) {
+        uint32_t y = height - 1 - k;
+        int level = 255 * y / height;
+        for (uint32_t x = 0; x < width; x++) {
+            int h = (x * 1536) / width, f = h & 255, c[3];
+            switch (h >> 8) {
+                case 0:  c[0] = 255;     c[1] = f;       c[2] = 0;       break;
+                case 1:  c[0] = 255 - f; c[1] = 255;     c[2] = 0;       break;
+                case 2:  c[0] = 0;       c[1] = 255;     c[2] = f;       break;
+                case 3:  c[0] = 0;       c[1] = 255 - f; c[2] = 255;     break;
+                case 4:  c[0] = f;       c[1] = 0;       c[2] = 255;     break;
+                default: c[0] = 255;     c[1] = 0;       c[2] = 255 - f; break;
+            }
+            for (int i = 0; i < 3; i++) {
+                // Bottom half darkens towards black, top half fades to white.
+                int v = level < 128 ? c[i] * level / 128 : c[i] + (255 - c[i]) * (level - 128) / 128;
+                row[x * 3 + 2 - i] = grey ? 128 : v;
+            }
+        }
+        fwrite(row, row_size, 1, file);
+    }
+
+    free(row);
+    return fclose(file) == 0;
+}
+
+static void dither_modes(epaper_handle_t *epaper, uint8_t *frame)
+{
+    char path[512];
+    char what[64];
+    bmp_image_t image = {0};
+    bmp_load_stats_t load;
+
+    epaper_dither_bench_t bench;
+    check(epaper_dither_bench(800, 480, &bench) == ESP_OK, "epaper_dither_bench 800x480");
+    for (int i = 0; i < EPAPER_DITHER_COUNT; i++) {
+        printf("      %-16s %7.2f ms, %6.1f Mpx/s\n", epaper_dither_name((epaper_dither_t)i),
+               bench.elapsed_us[i] / 1000.0, bench.mpix_per_s[i]);
+    }
+
+    // Mid grey has to come out as black and white only, about half each.
+    snprintf(path, sizeof(path), "%s/grey.bmp", _out_dir);
+    check(write_photo_bmp(path, 800, 480, true), "write grey.bmp");
+    for (int mode = EPAPER_DITHER_FLOYD_STEINBERG; mode < EPAPER_DITHER_COUNT; mode++) {
+        bmp_load_opts_t opts = {.fit = BMP_FIT_DEFAULT, .dither = (epaper_dither_t)mode};
+        uint32_t counts[16] = {0};
+
+        bool ok = load_bmp_into_frame(path, frame, 800, 480, &opts, &image) == ESP_OK;
+        for (size_t i = 0; ok && i < FRAME_BYTES; i++) {
+            counts[frame[i] >> 4]++;
+            counts[frame[i] & 0x0F]++;
+        }
+        double white = counts[EPAPER_COLOR_WHITE] / (800.0 * 480.0);
+        ok = ok && counts[EPAPER_COLOR_WHITE] + counts[EPAPER_COLOR_BLACK] == 800 * 480 && white > 0.4 && white < 0.6;
+        snprintf(what, sizeof(what), "grey, %s: %.0f%% white", epaper_dither_name(opts.dither), white * 100);
+        check(ok, what);
+    }
+
+    snprintf(path, sizeof(path), "%s/photo.bmp", _out_dir);
+    check(write_photo_bmp(path, 800, 480, false), "write photo.bmp");
+    for (int mode = 0; mode < EPAPER_DITHER_COUNT; mode++) {
+        bmp_load_opts_t opts = {.fit = BMP_FIT_DEFAULT, .dither = (epaper_dither_t)mode};
+        snprintf(what, sizeof(what), "photo, %s", epaper_dither_name(opts.dither));
+        check(load_bmp_into_frame(path, frame, 800, 480, &opts, &image) == ESP_OK, what);
+        bmp_get_load_stats(&load);
+        printf("      %7.2f ms load, convert %.2f ms\n", load.elapsed_us / 1000.0, load.convert_us / 1000.0);
+
+        check(epaper_display_frame(epaper, frame) == ESP_OK, "epaper_display_frame");
+        char name[32];
+        snprintf(name, sizeof(name), "dither-%s", epaper_dither_name(opts.dither));
+        snapshot(name);
+    }
+}
+
+// The loader as it was before streaming: a heap copy of the whole image,
+// filled with one fread per row. Kept here as the baseline.
+static uint8_t *load_bmp_rows(const char *path, uint16_t width, uint16_t height)
+{
+    uint32_t stride = width / 2;
+    bmp_header_t header;
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    uint8_t *data = heap_caps_malloc((size_t)stride * height, MALLOC_CAP_DEFAULT);
+    if (data == NULL || fread(&header, sizeof(header), 1, file) != 1 ||
+        fseek(file, header.offset, SEEK_SET) != 0) {
+        heap_caps_free(data);
+        fclose(file);
+        return NULL;
+    }
+    for (int y = height - 1; y >= 0; y--) {
+        if (fread(data + (size_t)y * stride, stride, 1, file) != 1) {
+            heap_caps_free(data);
+            data = NULL;
+            break;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+// Writes the pattern as .epd and checks both load paths against it: into
+// the frame (timed next to the same picture as a 4-bit BMP) and streamed
+// from the file through the staging buffers. A flipped byte must fail the
+// CRC on both.
+static void epd_frames(epaper_handle_t *epaper, uint8_t *frame, uint8_t *expect)
+{
+    static const uint8_t panel_order[6] = {0, 1, 2, 3, 5, 6};
+    char path[512];
+    char bmp_path[512];
+    bmp_image_t image = {0};
+    bmp_load_stats_t load;
+    host_heap_stats_t heap;
+
+    snprintf(path, sizeof(path), "%s/test.epd", _out_dir);
+    snprintf(bmp_path, sizeof(bmp_path), "%s/test.bmp", _out_dir);
+    draw_pattern(expect, 800, 480, 6);
+    check(epd_file_write(path, expect, 800, 480, EPD_COMPRESSION_NONE) == ESP_OK, "epd_file_write");
+    check(write_bmp4(bmp_path, expect, 800, 480, panel_order), "write test.bmp");
+
+    memset(frame, 0, FRAME_BYTES);
+    check(load_image_into_frame(bmp_path, frame, 800, 480, NULL, &image) == ESP_OK, "load the BMP");
+    bmp_get_load_stats(&load);
+    printf("  bmp           %7.2f ms, convert %.2f ms\n", load.elapsed_us / 1000.0, load.convert_us / 1000.0);
+
+    memset(frame, 0, FRAME_BYTES);
+    host_heap_reset_peak();
+    host_heap_get_stats(&heap);
+    size_t base = heap.current;
+    check(load_image_into_frame(path, frame, 800, 480, NULL, &image) == ESP_OK, "load the .epd");
+    host_heap_get_stats(&heap);
+    bmp_get_load_stats(&load);
+    check(image.data == frame && image.width == 800 && image.height == 480 &&
+          memcmp(frame, expect, FRAME_BYTES) == 0, "frame matches the .epd");
+    printf("  epd           %7.2f ms, CRC %.2f ms, peak heap +%lu bytes\n",
+           load.elapsed_us / 1000.0, load.convert_us / 1000.0, (unsigned long)(heap.peak - base));
+    check(load_epd_into_frame(path, frame, 480, 800, &image) == ESP_ERR_INVALID_SIZE, "wrong frame size rejected");
+
+    draw_pattern(frame, 800, 480, 7);
+    check(epaper_display_frame(epaper, frame) == ESP_OK, "clear the panel");
+    host_heap_reset_peak();
+    host_heap_get_stats(&heap);
+    base = heap.current;
+    check(epd_display_file_async(epaper, path, NULL, NULL) == ESP_OK, "epd_display_file_async");
+    check(epaper_wait_idle(60000) == ESP_OK, "epaper_wait_idle");
+    host_heap_get_stats(&heap);
+    check(panel_matches(expect), "panel shows the streamed .epd");
+    printf("  streamed without a frame buffer, peak heap +%lu bytes\n", (unsigned long)(heap.peak - base));
+    print_last_update();
+    snapshot("epd");
+
+    // The same file again: recognised by its CRC and skipped unread.
+    epaper_sim_stats_t before, after;
+    uint32_t hash = 0;
+    epaper_sim_get_stats(&before);
+    check(epd_display_file_async(epaper, path, NULL, NULL) == ESP_OK && epaper_last_frame_unchanged(&hash) &&
+          hash == epaper_frame_hash(expect, FRAME_BYTES), "same .epd skipped");
+    epaper_sim_get_stats(&after);
+    check(after.pixel_bytes == before.pixel_bytes && after.refreshes == before.refreshes, "nothing streamed for it");
+
+    FILE *file = fopen(path, "r+b");
+    bool flipped = file != NULL && fseek(file, sizeof(epd_file_header_t) + 1000, SEEK_SET) == 0 &&
+                   fputc(0x33, file) != EOF;
+    if (file != NULL) {
+        fclose(file);
+    }
+    check(flipped, "corrupt test.epd");
+    check(load_image_into_frame(path, frame, 800, 480, NULL, &image) == ESP_ERR_INVALID_CRC,
+          "CRC mismatch on load");
+    // The header CRC is unchanged, so forget the panel's frame to have the
+    // corrupt data read rather than skipped.
+    epaper_invalidate_frame_hash();
+    epaper_sim_get_stats(&before);
+    check(epd_display_file_async(epaper, path, NULL, NULL) == ESP_ERR_INVALID_CRC, "CRC mismatch on stream");
+    check(epaper_wait_idle(60000) == ESP_OK, "epaper_wait_idle");
+    epaper_sim_get_stats(&after);
+    check(after.refreshes == before.refreshes && panel_matches(expect), "corrupt stream not refreshed");
+}
+
+// A text-heavy status page: a title bar and rows of small coloured text.
+static void draw_dashboard(uint8_t *buf)
+{
+    static const epaper_color_t colors[] = {EPAPER_COLOR_BLACK, EPAPER_COLOR_RED, EPAPER_COLOR_BLUE};
+    epaper_canvas_t canvas;
+    char text[64];
+
+    epaper_canvas_init(&canvas, buf, 800, 480);
+    epaper_draw_fill_rect(&canvas, 0, 0, 800, 480, EPAPER_COLOR_WHITE);
+    epaper_draw_fill_rect(&canvas, 0, 0, 800, 40, EPAPER_COLOR_BLACK);
+    epaper_draw_text(&canvas, &epaper_font_mono16, 16, 12, "Status  2026-10-16 12:34", EPAPER_COLOR_WHITE,
+                     EPAPER_TEXT_TRANSPARENT);
+    for (int row = 0; row < 24; row++) {
+        snprintf(text, sizeof(text), "sensor-%02d  %5.1f C  %3d %%  battery %d.%02d V", row, 18.5 + row * 0.7,
+                 30 + row * 2, 3 + row % 2, (row * 7) % 100);
+        epaper_draw_text(&canvas, &epaper_font_mono16, 16 + (row / 12) * 400, 56 + (row % 12) * 34, text,
+                         colors[row % 3], EPAPER_TEXT_TRANSPARENT);
+    }
+    epaper_draw_fill_rect(&canvas, 600, 440, 180, 24, EPAPER_COLOR_GREEN);
+    epaper_draw_fill_rect(&canvas, 600, 440, 60, 24, EPAPER_COLOR_YELLOW);
+}
+
+// Compression ratio and decode speed of each codec over a few kinds of
+// frame, then a compressed file streamed to the panel and a corrupt one.
+static void epd_codecs(epaper_handle_t *epaper, uint8_t *frame, uint8_t *expect)
+{
+    static const char *const corpus[] = {"pattern", "dashboard", "photo", "photo fs", "photo atkinson",
+                                         "photo bayer"};
+    char path[512];
+    char photo[512];
+    char what[64];
+    bmp_image_t image = {0};
+    bmp_load_stats_t load;
+
+    snprintf(path, sizeof(path), "%s/codec.epd", _out_dir);
+    snprintf(photo, sizeof(photo), "%s/photo.bmp", _out_dir);
+    check(write_photo_bmp(photo, 800, 480, false), "write photo.bmp");
+
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++) {
+        if (i == 0) {
+            draw_pattern(expect, 800, 480, 8);
+        } else if (i == 1) {
+            draw_dashboard(expect);
+        } else {
+            bmp_load_opts_t opts = {.fit = BMP_FIT_DEFAULT, .dither = (epaper_dither_t)(i - 2)};
+            if (load_bmp_into_frame(photo, expect, 800, 480, &opts, &image) != ESP_OK) {
+                check(false, corpus[i]);
+                continue;
+            }
+        }
+
+        for (int c = EPD_COMPRESSION_NONE; c <= EPD_COMPRESSION_LZ; c++) {
+            struct stat st;
+            int64_t start = esp_timer_get_time();
+            bool ok = epd_file_write(path, expect, 800, 480, (epd_compression_t)c) == ESP_OK;
+            int64_t encode_us = esp_timer_get_time() - start;
+
+            memset(frame, 0, FRAME_BYTES);
+            ok = ok && stat(path, &st) == 0 && load_image_into_frame(path, frame, 800, 480, NULL, &image) == ESP_OK &&
+                 memcmp(frame, expect, FRAME_BYTES) == 0;
+            bmp_get_load_stats(&load);
+
+            snprintf(what, sizeof(what), "%-14s %-4s", corpus[i], epd_compression_name((epd_compression_t)c));
+            check(ok, what);
+            if (ok) {
+                printf("      %6ld bytes, %5.1f:1, encode %6.2f ms, decode %6.2f ms (%6.1f MB/s)\n",
+                       (long)st.st_size, (double)FRAME_BYTES / st.st_size, encode_us / 1000.0,
+                       load.read_us / 1000.0, load.read_us > 0 ? FRAME_BYTES / (double)load.read_us : 0.0);
+            }
+        }
+    }
+
+    host_heap_stats_t heap;
+    draw_pattern(expect, 800, 480, 9);
+    for (int c = EPD_COMPRESSION_RLE; c <= EPD_COMPRESSION_LZ; c++) {
+        check(epd_file_write(path, expect, 800, 480, (epd_compression_t)c) == ESP_OK, "epd_file_write");
+        host_heap_reset_peak();
+        host_heap_get_stats(&heap);
+        size_t base = heap.current;
+        snprintf(what, sizeof(what), "stream %s", epd_compression_name((epd_compression_t)c));
+        epaper_invalidate_frame_hash();
+        check(epd_display_file_async(epaper, path, NULL, NULL) == ESP_OK && !epaper_last_frame_unchanged(NULL), what);
+        check(epaper_wait_idle(60000) == ESP_OK, "epaper_wait_idle");
+        host_heap_get_stats(&heap);
+        check(panel_matches(expect), "panel shows the decoded frame");
+        printf("      peak heap +%lu bytes\n", (unsigned long)(heap.peak - base));
+    }
+
+    // Cut the LZ data short: both paths have to notice.
+    struct stat st;
+    bool cut = stat(path, &st) == 0 && truncate(path, st.st_size - 100) == 0;
+    check(cut, "truncate codec.epd");
+    check(load_image_into_frame(path, frame, 800, 480, NULL, &image) != ESP_OK, "truncated data on load");
+    epaper_sim_stats_t before, after;
+    epaper_invalidate_frame_hash();
+    epaper_sim_get_stats(&before);
+    check(epd_display_file_async(epaper, path, NULL, NULL) != ESP_OK, "truncated data on stream");
+    check(epaper_wait_idle(60000) == ESP_OK, "epaper_wait_idle");
+    epaper_sim_get_stats(&after);
+    check(after.refreshes == before.refreshes && panel_matches(expect), "truncated stream not refreshed");
+
+    draw_pattern(frame, 800, 480, 10);
+    check(epaper_display_frame(epaper, frame) == ESP_OK && panel_matches(frame), "next update after an abort");
+}
+
+// The word-wise pair conversion against the byte reference: every
+// alignment and tail length, in place and not, then both timed over a
+// frame. convert_bmp_to_epaper has to give the packed panel layout.
+static void lut_conversion(uint8_t *frame, uint8_t *expect)
+{
+    uint8_t lut[256];
+    uint8_t *src = malloc(FRAME_BYTES + 8);
+    if (src == NULL) {
+        check(false, "malloc");
+        return;
+    }
+
+    srand(24);
+    for (int i = 0; i < 256; i++) {
+        lut[i] = (uint8_t)rand();
+    }
+    for (size_t i = 0; i < FRAME_BYTES + 8; i++) {
+        src[i] = (uint8_t)rand();
+    }
+
+    bool ok = true;
+    for (size_t so = 0; so < 4; so++) {
+        for (size_t dof = 0; dof < 4; dof++) {
+            for (size_t len = 0; len < 40; len++) {
+                memset(frame, 0xAA, 64);
+                memset(expect, 0xAA, 64);
+                bmp_convert_pairs(frame + dof, src + so, len, lut);
+                bmp_convert_pairs_ref(expect + dof, src + so, len, lut);
+                ok = ok && memcmp(frame, expect, 64) == 0;
+            }
+        }
+    }
+    check(ok, "word conversion matches the reference");
+
+    memcpy(frame, src + 1, FRAME_BYTES);
+    bmp_convert_pairs(frame + 1, frame + 1, FRAME_BYTES - 1, lut);
+    bmp_convert_pairs_ref(expect, src + 2, FRAME_BYTES - 1, lut);
+    check(memcmp(frame + 1, expect, FRAME_BYTES - 1) == 0, "in place");
+
+    enum { RUNS = 20 };
+    int64_t start = esp_timer_get_time();
+    for (int r = 0; r < RUNS; r++) {
+        bmp_convert_pairs_ref(frame, src, FRAME_BYTES, lut);
+    }
+    int64_t ref_us = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+    for (int r = 0; r < RUNS; r++) {
+        bmp_convert_pairs(expect, src, FRAME_BYTES, lut);
+    }
+    int64_t word_us = esp_timer_get_time() - start;
+    check(memcmp(frame, expect, FRAME_BYTES) == 0, "full frame matches");
+    printf("      byte %6.3f ms, word %6.3f ms a frame (%.0f / %.0f Mpx/s)\n", ref_us / 1000.0 / RUNS,
+           word_us / 1000.0 / RUNS, 2.0 * FRAME_BYTES * RUNS / ref_us, 2.0 * FRAME_BYTES * RUNS / word_us);
+
+    // 798x4 with 400-byte padded rows and some codes that are not colours.
+    enum { W = 798, H = 4, ROW = 400 };
+    for (size_t i = 0; i < ROW * H; i++) {
+        src[i] = (uint8_t)(i * 37);
+    }
+    bmp_image_t image = {.data = src, .width = W, .height = H, .bits_per_pixel = 4};
+    ok = convert_bmp_to_epaper(&image, frame) == ESP_OK;
+    for (int y = 0; ok && y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            uint8_t in = (src[y * ROW + x / 2] >> (x % 2 ? 0 : 4)) & 0x0F;
+            uint8_t want = (in == 4 || in > EPAPER_COLOR_GREEN) ? EPAPER_COLOR_WHITE : in;
+            uint8_t got = (frame[y * (W / 2) + x / 2] >> (x % 2 ? 0 : 4)) & 0x0F;
+            ok = ok && got == want;
+        }
+    }
+    check(ok, "convert_bmp_to_epaper packs the panel layout");
+    image.width = 799;
+    check(convert_bmp_to_epaper(&image, frame) == ESP_ERR_INVALID_SIZE, "odd width rejected");
+
+    free(src);
+}
+
+// LRU behaviour of the decoded frame cache with a two-frame budget, and
+// what a hit saves over decoding the file again.
+static void frame_cache(uint8_t *frame, uint8_t *expect)
+{
+    static const uint8_t panel_order[6] = {0, 1, 2, 3, 5, 6};
+    char photo[512];
+    char pattern[512];
+    bmp_image_t image = {0};
+    frame_cache_stats_t stats;
+    bmp_load_opts_t fs = {.fit = BMP_FIT_DEFAULT, .dither = EPAPER_DITHER_FLOYD_STEINBERG};
+
+    snprintf(photo, sizeof(photo), "%s/cache-photo.bmp", _out_dir);
+    snprintf(pattern, sizeof(pattern), "%s/cache-pattern.bmp", _out_dir);
+    check(write_photo_bmp(photo, 800, 480, false), "write cache-photo.bmp");
+    draw_pattern(expect, 800, 480, 10);
+    check(write_bmp4(pattern, expect, 800, 480, panel_order), "write cache-pattern.bmp");
+
+    check(frame_cache_init(2 * FRAME_BYTES) == ESP_OK, "frame_cache_init, two frames");
+
+    int64_t start = esp_timer_get_time();
+    check(frame_cache_load(photo, expect, 800, 480, &fs, &image) == ESP_OK, "photo, fs: miss");
+    int64_t miss_us = esp_timer_get_time() - start;
+    memset(frame, 0, FRAME_BYTES);
+    start = esp_timer_get_time();
+    check(frame_cache_load(photo, frame, 800, 480, &fs, &image) == ESP_OK && image.data == frame &&
+          image.width == 800 && memcmp(frame, expect, FRAME_BYTES) == 0, "photo, fs: hit");
+    int64_t hit_us = esp_timer_get_time() - start;
+    printf("      miss %.2f ms, hit %.2f ms\n", miss_us / 1000.0, hit_us / 1000.0);
+
+    check(frame_cache_load(photo, frame, 800, 480, NULL, &image) == ESP_OK &&
+          memcmp(frame, expect, FRAME_BYTES) != 0, "photo, no dither: miss");
+    check(frame_cache_load(photo, frame, 800, 480, &fs, &image) == ESP_OK, "photo, fs: hit again");
+    check(frame_cache_load(pattern, frame, 800, 480, NULL, &image) == ESP_OK, "pattern: miss, evicts");
+    frame_cache_get_stats(&stats);
+    check(stats.hits == 2 && stats.misses == 3 && stats.evictions == 1 && stats.entries == 2 &&
+          stats.bytes == 2 * FRAME_BYTES, "two hits, three misses, one eviction");
+
+    // The unused no-dither photo went; the fs one is still there.
+    check(frame_cache_load(photo, frame, 800, 480, &fs, &image) == ESP_OK, "photo, fs");
+    frame_cache_get_stats(&stats);
+    check(stats.hits == 3, "least recently used was evicted");
+
+    // A rewritten file has a new mtime and must not come from the cache.
+    draw_pattern(expect, 800, 480, 11);
+    check(write_bmp4(pattern, expect, 800, 480, panel_order), "rewrite cache-pattern.bmp");
+    struct stat st;
+    bool touched = stat(pattern, &st) == 0;
+    struct timespec times[2] = {{.tv_nsec = UTIME_OMIT}, {.tv_sec = st.st_mtime + 10}};
+    check(touched && utimensat(AT_FDCWD, pattern, times, 0) == 0, "move the mtime of cache-pattern.bmp");
+    check(frame_cache_load(pattern, frame, 800, 480, NULL, &image) == ESP_OK &&
+          memcmp(frame, expect, FRAME_BYTES) == 0, "changed file reloaded");
+
+    frame_cache_invalidate(pattern);
+    check(frame_cache_set_budget(FRAME_BYTES / 2) == ESP_OK, "frame_cache_set_budget");
+    frame_cache_get_stats(&stats);
+    check(stats.entries == 0 && stats.bytes == 0, "shrunk to nothing");
+    check(frame_cache_load(pattern, frame, 800, 480, NULL, &image) == ESP_OK, "too big to cache, still loads");
+    frame_cache_get_stats(&stats);
+    printf("      %lu hits, %lu misses, %lu insertions, %lu evictions\n", (unsigned long)stats.hits,
+           (unsigned long)stats.misses, (unsigned long)stats.insertions, (unsigned long)stats.evictions);
+    check(stats.entries == 0, "nothing cached");
+    frame_cache_deinit();
+}
+
+// The span primitives against epaper_set_pixel one pixel at a time, on a
+// small canvas so random rectangles hit odd columns, odd widths and every
+// clipped edge; then the driver's own fill benchmark on the full frame.
+enum { DRAW_W = 46, DRAW_H = 14, DRAW_SRC_W = 64, DRAW_SRC_H = 24 };
+
+static uint8_t draw_px(const uint8_t *buf, int stride, int x, int y)
+{
+    uint8_t b = buf[(size_t)y * stride + x / 2];
+    return (x & 1) ? (b & 0x0F) : (b >> 4);
+}
+
+static void draw_random_codes(uint8_t *buf, size_t len)
+{
+    static const uint8_t codes[6] = {0, 1, 2, 3, 5, 6};
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((codes[rand() % 6] << 4) | codes[rand() % 6]);
+    }
+}
+
+static void draw_ref_blit(uint8_t *ref, int dx, int dy, const uint8_t *src, int sx, int sy, int w, int h,
+                          const uint8_t *mask)
+{
+    for (int r = 0; r < h; r++) {
+        for (int c = 0; c < w; c++) {
+            if (mask != NULL && !((mask[(size_t)r * (DRAW_SRC_W / 8) + c / 8] >> (7 - c % 8)) & 1)) {
+                continue;
+            }
+            // Out-of-canvas pixels wrap to huge uint16_t values and are refused.
+            epaper_set_pixel(ref, (uint16_t)(dx + c), (uint16_t)(dy + r),
+                             (epaper_color_t)draw_px(src, DRAW_SRC_W / 2, sx + c, sy + r), DRAW_W, DRAW_H);
+        }
+    }
+}
+
+static void draw_primitives(uint8_t *frame)
+{
+    uint8_t buf[DRAW_W / 2 * DRAW_H];
+    uint8_t ref[sizeof(buf)];
+    uint8_t src[DRAW_SRC_W / 2 * DRAW_SRC_H];
+    uint8_t mask[DRAW_SRC_W / 8 * DRAW_SRC_H];
+    bool fill_ok = true, blit_ok = true, masked_ok = true;
+    epaper_canvas_t canvas;
+
+    srand(11);
+    epaper_canvas_init(&canvas, buf, DRAW_W, DRAW_H);
+    for (int i = 0; i < 2000; i++) {
+        int x = rand() % (DRAW_W + 12) - 6;
+        int y = rand() % (DRAW_H + 6) - 3;
+        int w = rand() % (DRAW_W + 4) + 1;
+        int h = rand() % (DRAW_H / 2) + 1;
+        int sx = rand() % (DRAW_SRC_W - DRAW_W - 4);
+        int sy = rand() % (DRAW_SRC_H - DRAW_H - 3) + 3;
+        // 1 in 8 full width, which takes the memset path.
+        if (i % 8 == 0) {
+            x = 0;
+            w = DRAW_W;
+        }
+
+        draw_random_codes(buf, sizeof(buf));
+        draw_random_codes(src, sizeof(src));
+        for (size_t m = 0; m < sizeof(mask); m++) {
+            mask[m] = (i & 1) ? (uint8_t)rand() : (rand() & 1) ? 0xFF : 0x00;
+        }
+
+        memcpy(ref, buf, sizeof(buf));
+        epaper_color_t color = (epaper_color_t)(i % 2 ? EPAPER_COLOR_GREEN : EPAPER_COLOR_YELLOW);
+        for (int r = 0; r < h; r++) {
+            for (int c = 0; c < w; c++) {
+                epaper_set_pixel(ref, (uint16_t)(x + c), (uint16_t)(y + r), color, DRAW_W, DRAW_H);
+            }
+        }
+        epaper_draw_fill_rect(&canvas, x, y, w, h, color);
+        fill_ok = fill_ok && memcmp(buf, ref, sizeof(buf)) == 0;
+
+        memcpy(ref, buf, sizeof(buf));
+        draw_ref_blit(ref, x, y, src, sx, sy, w, h, NULL);
+        epaper_draw_blit(&canvas, x, y, src, DRAW_SRC_W / 2, sx, sy, w, h);
+        blit_ok = blit_ok && memcmp(buf, ref, sizeof(buf)) == 0;
+
+        draw_random_codes(src, sizeof(src));
+        memcpy(ref, buf, sizeof(buf));
+        draw_ref_blit(ref, x, y, src, sx, sy, w, h, mask);
+        epaper_draw_blit_masked(&canvas, x, y, src, DRAW_SRC_W / 2, sx, sy, w, h, mask, DRAW_SRC_W / 8);
+        masked_ok = masked_ok && memcmp(buf, ref, sizeof(buf)) == 0;
+    }
+    check(fill_ok, "fill_rect matches set_pixel");
+    check(blit_ok, "blit matches set_pixel");
+    check(masked_ok, "blit_masked matches set_pixel");
+
+    epaper_draw_bench_t bench;
+    epaper_canvas_init(&canvas, frame, 800, 480);
+    check(epaper_draw_bench(&canvas, 333, 201, 20, &bench) == ESP_OK, "epaper_draw_bench");
+    printf("  fill 333x201 x%lu: set_pixel %.2f ms, span %.2f ms (%.1fx)\n", (unsigned long)bench.iterations,
+           bench.pixel_us / 1000.0, bench.span_us / 1000.0, bench.speedup);
+}
+
+enum { TEXT_W = 160, TEXT_H = 48 };
+
+static const epaper_glyph_t *text_ref_find(const epaper_font_t *font, uint32_t cp, const epaper_font_t **owner)
+{
+    for (; font != NULL; font = font->fallback) {
+        for (int i = 0; i < font->glyph_count; i++) {
+            if (font->glyphs[i].codepoint == cp) {
+                *owner = font;
+                return &font->glyphs[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+// Text set one pixel at a time straight from the 1bpp glyph bitmaps, for
+// code points decoded by hand. Fallback glyphs sit on the primary font's
+// baseline.
+static int text_ref(uint8_t *ref, const epaper_font_t *font, int x, int y, const uint32_t *cps, int n,
+                    epaper_color_t fg, epaper_color_t bg)
+{
+    int pen = x;
+    int widest = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (cps[i] == '\n') {
+            widest = pen - x > widest ? pen - x : widest;
+            pen = x;
+            y += font->line_height;
+            continue;
+        }
+
+        const epaper_font_t *owner = font;
+        const epaper_glyph_t *g = text_ref_find(font, cps[i], &owner);
+        if (g == NULL) {
+            g = text_ref_find(font, 0xFFFD, &owner);
+        }
+        if (bg != EPAPER_TEXT_TRANSPARENT) {
+            for (int r = 0; r < font->line_height; r++) {
+                for (int c = 0; c < g->advance; c++) {
+                    epaper_set_pixel(ref, (uint16_t)(pen + c), (uint16_t)(y + r), bg, TEXT_W, TEXT_H);
+                }
+            }
+        }
+
+        int gx = pen + g->left;
+        int gy = y + font->ascent - owner->ascent + g->top;
+        int stride = (g->width + 7) / 8;
+        for (int r = 0; r < g->height; r++) {
+            for (int c = 0; c < g->width; c++) {
+                bool on = (owner->bitmap[g->offset + r * stride + c / 8] >> (7 - c % 8)) & 1;
+                if (on || bg != EPAPER_TEXT_TRANSPARENT) {
+                    epaper_set_pixel(ref, (uint16_t)(gx + c), (uint16_t)(gy + r), on ? fg : bg, TEXT_W, TEXT_H);
+                }
+            }
+        }
+        pen += g->advance;
+    }
+
+    return pen - x > widest ? pen - x : widest;
+}
+
+// The text renderer against text_ref: well-formed and malformed UTF-8, a
+// fallback font with another ascent and a glyph too big for the cache, odd
+// and even x, opaque and transparent, with the glyph cache and without;
+// then the cache's LRU counters.
+static void text_rendering(void)
+{
+    // U+2603 is 7x9 on a 10 px ascent; U+2588 expands to 540 bytes, past
+    // the 512-byte cache slot, so it is always drawn row by row.
+    static uint8_t bitmap[9 + 5 * 30];
+    static const epaper_glyph_t glyphs[] = {
+        {0x2588, 9, 36, 30, -1, 0, 36},
+        {0x2603, 0, 7, 9, 1, 2, 9},
+    };
+    static const struct {
+        const char *text;
+        uint32_t cps[8];
+        int n;
+    } cases[] = {
+        {"Hi\xC2\xB0!", {'H', 'i', 0xB0, '!'}, 4},
+        {"a\xFF" "b\xC3(c\xE2\x82", {'a', 0xFFFD, 'b', 0xFFFD, '(', 'c', 0xFFFD}, 7},
+        {"x\xE2\x98\x83\xC3\xA9y", {'x', 0x2603, 0xE9, 'y'}, 4},
+        {"q\xE2\x96\x88\nW%", {'q', 0x2588, '\n', 'W', '%'}, 5},
+    };
+    uint8_t buf[TEXT_W / 2 * TEXT_H];
+    uint8_t ref[sizeof(buf)];
+    epaper_canvas_t canvas;
+    char what[64];
+
+    srand(12);
+    for (size_t i = 0; i < sizeof(bitmap); i++) {
+        bitmap[i] = (uint8_t)rand();
+    }
+    epaper_font_t extra = {
+        .glyphs = glyphs,
+        .bitmap = bitmap,
+        .glyph_count = 2,
+        .ascent = 10,
+        .line_height = 14,
+        .fallback = NULL
+    };
+    epaper_font_t font = epaper_font_mono16;
+    font.fallback = &extra;
+
+    epaper_canvas_init(&canvas, buf, TEXT_W, TEXT_H);
+    for (int cached = 1; cached >= 0; cached--) {
+        epaper_text_deinit();
+        if (cached) {
+            epaper_text_init(EPAPER_TEXT_CACHE_DEFAULT);
+        }
+        bool pixels_ok = true, width_ok = true;
+        for (size_t t = 0; t < sizeof(cases) / sizeof(cases[0]); t++) {
+            for (int x = 3; x <= 4; x++) {
+                for (int opaque = 0; opaque <= 1; opaque++) {
+                    epaper_color_t fg = opaque ? EPAPER_COLOR_RED : EPAPER_COLOR_BLUE;
+                    epaper_color_t bg = opaque ? EPAPER_COLOR_WHITE : EPAPER_TEXT_TRANSPARENT;
+                    draw_random_codes(buf, sizeof(buf));
+                    memcpy(ref, buf, sizeof(buf));
+                    int ref_w = text_ref(ref, &font, x, 2, cases[t].cps, cases[t].n, fg, bg);
+                    int w = epaper_draw_text(&canvas, &font, x, 2, cases[t].text, fg, bg);
+                    pixels_ok = pixels_ok && memcmp(buf, ref, sizeof(buf)) == 0;
+                    width_ok = width_ok && w == ref_w && epaper_text_width(&font, cases[t].text) == ref_w;
+                }
+            }
+        }
+        snprintf(what, sizeof(what), "text matches the glyph bitmaps (%s)", cached ? "cached" : "uncached");
+        check(pixels_ok, what);
+        check(width_ok, "text width");
+    }
+
+    // Four slots: abc fill three, the repeat hits, d takes the free slot,
+    // e f g evict a b c, a evicts d, and a new colour is a new entry.
+    epaper_text_cache_stats_t stats;
+    epaper_text_init(4);
+    epaper_draw_text(&canvas, &font, 0, 0, "abcabc", EPAPER_COLOR_BLACK, EPAPER_TEXT_TRANSPARENT);
+    epaper_draw_text(&canvas, &font, 0, 0, "defga", EPAPER_COLOR_BLACK, EPAPER_TEXT_TRANSPARENT);
+    epaper_draw_text(&canvas, &font, 0, 0, "a", EPAPER_COLOR_GREEN, EPAPER_TEXT_TRANSPARENT);
+    check(epaper_text_get_cache_stats(&stats) == ESP_OK && stats.entries == 4 && stats.hits == 3 &&
+          stats.misses == 9 && stats.evictions == 5, "glyph cache hits, misses and evictions");
+    printf("  cache: %lu hits, %lu misses, %lu evictions\n", (unsigned long)stats.hits,
+           (unsigned long)stats.misses, (unsigned long)stats.evictions);
+
+    epaper_text_deinit();
+    epaper_text_init(EPAPER_TEXT_CACHE_DEFAULT);
+}
+
+// Clockwise rotation worked out one pixel at a time, independently of
+// epaper_rotate.c: output (x, y) shows this source pixel.
+static void rotate_ref(uint8_t *dst, const uint8_t *src, int src_w, int src_h, epaper_rotation_t rotation)
+{
+    bool swapped = rotation == EPAPER_ROTATE_90 || rotation == EPAPER_ROTATE_270;
+    int out_w = swapped ? src_h : src_w;
+    int out_h = swapped ? src_w : src_h;
+
+    for (int y = 0; y < out_h; y++) {
+        for (int x = 0; x < out_w; x++) {
+            int sx = x, sy = y;
+            switch (rotation) {
+                case EPAPER_ROTATE_90:  sx = y;             sy = src_h - 1 - x; break;
+                case EPAPER_ROTATE_180: sx = src_w - 1 - x; sy = src_h - 1 - y; break;
+                case EPAPER_ROTATE_270: sx = src_w - 1 - y; sy = x;             break;
+                default: break;
+            }
+            uint8_t c = draw_px(src, src_w / 2, sx, sy);
+            uint8_t *p = &dst[(size_t)y * (out_w / 2) + x / 2];
+            *p = (x & 1) ? ((*p & 0xF0) | c) : ((*p & 0x0F) | (c << 4));
+        }
+    }
+}
+
+// Every rotation against the reference: band by band with odd band heights,
+// so rows outside whole 8-row tiles take the per-pixel fallback, and on the
+// panel through epaper_display_rotated_async with an odd driver band height.
+static void rotations(epaper_handle_t *epaper, uint8_t *src, uint8_t *expect)
+{
+    static const uint16_t bands[] = {7, 10, 1, 13, 8, 3};
+    uint8_t *out = malloc(FRAME_BYTES);
+    uint16_t band_rows = epaper_get_band_height();
+    char what[64];
+
+    srand(13);
+    for (int r = EPAPER_ROTATE_0; r <= EPAPER_ROTATE_270; r++) {
+        epaper_rotation_t rotation = (epaper_rotation_t)r;
+        bool swapped = rotation == EPAPER_ROTATE_90 || rotation == EPAPER_ROTATE_270;
+        uint16_t src_w = swapped ? 480 : 800;
+        uint16_t src_h = swapped ? 800 : 480;
+        int degrees = epaper_rotation_degrees(rotation);
+
+        draw_random_codes(src, FRAME_BYTES);
+        rotate_ref(expect, src, src_w, src_h, rotation);
+        memset(out, 0xFF, FRAME_BYTES);
+        for (uint16_t y = 0, i = 0; y < 480; i++) {
+            uint16_t rows = bands[i % 6];
+            if (y + rows > 480) {
+                rows = 480 - y;
+            }
+            epaper_rotate_rows(out + (size_t)y * 400, y, rows, src, src_w, src_h, rotation);
+            y += rows;
+        }
+        snprintf(what, sizeof(what), "%d: odd bands match the reference", degrees);
+        check(memcmp(out, expect, FRAME_BYTES) == 0, what);
+
+        draw_pattern(src, src_w, src_h, 2 + r);
+        rotate_ref(expect, src, src_w, src_h, rotation);
+        epaper_set_band_height(7);
+        snprintf(what, sizeof(what), "%d: epaper_display_rotated_async", degrees);
+        check(epaper_display_rotated_async(epaper, src, src_w, src_h, rotation, NULL, NULL) == ESP_OK, what);
+        check(epaper_wait_idle(60000) == ESP_OK, "epaper_wait_idle");
+        snprintf(what, sizeof(what), "%d: panel shows the reference", degrees);
+        check(panel_matches(expect), what);
+        epaper_set_band_height(band_rows);
+
+        epaper_sim_stats_t before, after;
+        uint32_t hash = 0;
+        epaper_sim_get_stats(&before);
+        snprintf(what, sizeof(what), "%d: same image skipped", degrees);
+        check(epaper_display_rotated_async(epaper, src, src_w, src_h, rotation, NULL, NULL) == ESP_OK &&
+              epaper_last_frame_unchanged(&hash) && hash == epaper_frame_hash(expect, FRAME_BYTES), what);
+        epaper_sim_get_stats(&after);
+        check(after.pixel_bytes == before.pixel_bytes && after.refreshes == before.refreshes, "nothing sent for it");
+
+        if (rotation == EPAPER_ROTATE_90) {
+            print_last_update();
+            snapshot("rotated");
+        }
+    }
+    free(out);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-o dir] [-s spi_hz] [-r drf_ms] [-v]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    epaper_sim_config_t config;
+    bool verbose = false;
+    int opt;
+
+    epaper_sim_default_config(&config);
+    while ((opt = getopt(argc, argv, "o:s:r:v")) != -1) {
+        switch (opt) {
+            case 'o': _out_dir = optarg; break;
+            case 's': config.spi_hz = (uint32_t)atol(optarg); break;
+            case 'r': config.drf_busy_us = config.partial_drf_busy_us = (uint32_t)atol(optarg) * 1000; break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (config.spi_hz == 0) {
+        usage(argv[0]);
+    }
+
+    esp_log_level_set("*", verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    epaper_sim_configure(&config);
+
+    epaper_handle_t epaper = {
+        .transport = &epaper_transport_sim,
+        .cs_pin = 7,
+        .dc_pin = 6,
+        .rst_pin = 5,
+        .busy_pin = 4,
+        .width = 800,
+        .height = 480
+    };
+
+    uint8_t *expect = malloc(FRAME_BYTES);
+    uint8_t *portrait = malloc(FRAME_BYTES);
+    if (expect == NULL || portrait == NULL) {
+        return 1;
+    }
+
+    printf("init\n");
+    check(EPAPER_TRANSPORT_MAX_SEGMENT <= SPI_SHARED_MAX_TRANSFER, "pixel chunk fits the SPI bus max transfer");
+    check(epaper_init(&epaper) == ESP_OK, "epaper_init");
+    epaper_text_init(EPAPER_TEXT_CACHE_DEFAULT);
+    printf("  panel ready in %.1f ms\n", epaper_get_init_time_us() / 1000.0);
+
+    uint8_t *frame = fb_get_back();
+    check(frame != NULL, "frame buffer");
+    if (frame == NULL) {
+        return 1;
+    }
+
+    printf("full frame\n");
+    draw_pattern(frame, 800, 480, 0);
+    memcpy(expect, frame, FRAME_BYTES);
+    check(epaper_display_frame(&epaper, frame) == ESP_OK, "epaper_display_frame");
+    check(panel_matches(expect), "panel shows the frame");
+    print_last_update();
+    snapshot("full");
+
+    printf("unchanged frame\n");
+    epaper_sim_stats_t before, after;
+    epaper_sim_get_stats(&before);
+    check(epaper_display_frame(&epaper, frame) == ESP_OK, "epaper_display_frame");
+    epaper_sim_get_stats(&after);
+    check(epaper_last_frame_unchanged(NULL) && after.refreshes == before.refreshes, "refresh skipped");
+    {
+        // Fed in uneven pieces, including ones shorter than a 16-byte stripe.
+        static const size_t pieces[] = {1, 15, 16, 17, 3, 400, 4093};
+        epaper_hash_t state;
+        size_t done = 0;
+        epaper_hash_begin(&state);
+        for (int i = 0; done < FRAME_BYTES; i++) {
+            size_t len = pieces[i % 7] < FRAME_BYTES - done ? pieces[i % 7] : FRAME_BYTES - done;
+            epaper_hash_update(&state, frame + done, len);
+            done += len;
+        }
+        check(epaper_hash_end(&state) == epaper_frame_hash(frame, FRAME_BYTES), "hash in pieces matches");
+        epaper_hash_begin(&state);
+        epaper_hash_update(&state, frame, 13);
+        check(epaper_hash_end(&state) == epaper_frame_hash(frame, 13), "hash of a short piece matches");
+    }
+
+    printf("partial update\n");
+    {
+        enum { PX = 200, PY = 40, PW = 160, PH = 32 };
+        uint8_t *window = malloc(PW / 2 * PH);
+        epaper_canvas_t canvas;
+        epaper_canvas_init(&canvas, window, PW, PH);
+        epaper_draw_fill_rect(&canvas, 0, 0, PW, PH, EPAPER_COLOR_WHITE);
+        epaper_draw_text(&canvas, &epaper_font_mono16, 4, 6, "12:34", EPAPER_COLOR_RED, EPAPER_TEXT_TRANSPARENT);
+
+        for (int r = 0; r < PH; r++) {
+            memcpy(expect + (size_t)(PY + r) * 400 + PX / 2, window + r * (PW / 2), PW / 2);
+        }
+        check(epaper_partial_update(&epaper, PX, PY, PW, PH, window) == ESP_OK, "epaper_partial_update");
+        check(panel_matches(expect), "panel shows the merged frame");
+
+        epaper_partial_stats_t stats;
+        epaper_get_partial_stats(&stats);
+        printf("  %s, %lu rects, %lu bytes\n", stats.windowed ? "windowed" : "full fallback",
+               (unsigned long)stats.rects, (unsigned long)stats.bytes);
+        print_last_update();
+        snapshot("partial");
+        free(window);
+    }
+
+    printf("partial update failure\n");
+    {
+        enum { PX = 200, PY = 40, PW = 160, PH = 32 };
+        uint8_t *window = malloc(PW / 2 * PH);
+        uint32_t drf_us = config.drf_busy_us;
+        uint32_t partial_drf_us = config.partial_drf_busy_us;
+        epaper_canvas_t canvas;
+        epaper_canvas_init(&canvas, window, PW, PH);
+        epaper_draw_fill_rect(&canvas, 0, 0, PW, PH, EPAPER_COLOR_BLUE);
+
+        // DRF outlasts its 45 s timeout, so the merged window never shows.
+        config.drf_busy_us = config.partial_drf_busy_us = 50 * 1000 * 1000;
+        epaper_sim_configure(&config);
+        check(epaper_partial_update(&epaper, PX, PY, PW, PH, window) == EPAPER_ERR_TIMEOUT, "DRF timeout returned");
+        config.drf_busy_us = drf_us;
+        config.partial_drf_busy_us = partial_drf_us;
+        epaper_sim_configure(&config);
+
+        check(epaper_partial_update(&epaper, PX, PY, PW, PH, window) == EPAPER_ERR_INIT,
+              "shadow dropped, next window refused");
+        check(epaper_display_frame(&epaper, expect) == ESP_OK && panel_matches(expect), "full frame recovers");
+        free(window);
+    }
+
+    printf("banded\n");
+    draw_pattern(expect, 800, 480, 1);
+    check(epaper_display_banded(&epaper, render_copy, expect) == ESP_OK, "epaper_display_banded");
+    check(panel_matches(expect), "panel shows the banded frame");
+    print_last_update();
+    snapshot("banded");
+
+    printf("rotation\n");
+    rotations(&epaper, portrait, expect);
+
+    printf("busy\n");
+    {
+        pthread_t other;
+        esp_err_t other_ret = ESP_OK;
+
+        check(epaper_claim_update() == ESP_OK, "epaper_claim_update");
+        check(epaper_claim_update() == EPAPER_ERR_BUSY, "second claim refused");
+        pthread_create(&other, NULL, refresh_from_other_task, &other_ret);
+        pthread_join(other, NULL);
+        check(other_ret == EPAPER_ERR_BUSY, "async call from another task refused");
+
+        draw_pattern(expect, 800, 480, 7);
+        check(epaper_display_frame_async(&epaper, expect, NULL, NULL) == ESP_OK, "async display takes the claim");
+        epaper_release_update();
+        check(epaper_wait_idle(60000) == ESP_OK, "epaper_wait_idle");
+        check(panel_matches(expect), "panel shows the claimed update");
+
+        check(epaper_claim_update() == ESP_OK, "claim again once idle");
+        epaper_release_update();
+        check(epaper_wait_idle(0) == ESP_OK, "release without a display");
+    }
+
+    printf("power failures\n");
+    {
+        // BUSY held past the init table's 1 s PON limit, then past the
+        // refresh's 45 s one: neither may end in a refresh.
+        epaper_sim_stats_t before, after;
+        uint32_t pon_us = config.pon_busy_us;
+        memcpy(expect, epaper_sim_get_panel(), FRAME_BYTES);
+        draw_pattern(portrait, 800, 480, 8);
+
+        epaper_sleep(&epaper);
+        config.pon_busy_us = 2 * 1000 * 1000;
+        epaper_sim_configure(&config);
+        epaper_sim_get_stats(&before);
+        check(epaper_display_frame(&epaper, portrait) == EPAPER_ERR_TIMEOUT, "init timeout returned");
+        epaper_sim_get_stats(&after);
+        check(after.pixel_bytes == before.pixel_bytes && panel_matches(expect), "no frame sent after a failed init");
+        check(epaper_get_status() == EPAPER_STATUS_POWERED_OFF, "status powered off after a failed init");
+        check(epaper_display_frame_async(&epaper, portrait, NULL, NULL) == EPAPER_ERR_TIMEOUT &&
+              epaper_get_status() == EPAPER_STATUS_POWERED_OFF, "failed async init leaves it powered off");
+        check(epaper_display_banded_async(&epaper, render_copy, portrait, NULL, NULL) == EPAPER_ERR_TIMEOUT &&
+              epaper_get_status() == EPAPER_STATUS_POWERED_OFF, "failed banded init leaves it powered off");
+
+        config.pon_busy_us = pon_us;
+        epaper_sim_configure(&config);
+        draw_pattern(expect, 800, 480, 9);
+        check(epaper_display_frame(&epaper, expect) == ESP_OK, "epaper_display_frame");
+        check(epaper_get_power_state() == EPAPER_POWER_OFF, "panel in POF after the update");
+
+        config.pon_busy_us = 50 * 1000 * 1000;
+        epaper_sim_configure(&config);
+        epaper_sim_get_stats(&before);
+        check(epaper_display_frame(&epaper, portrait) == EPAPER_ERR_TIMEOUT, "PON timeout returned");
+        epaper_sim_get_stats(&after);
+        check(after.refreshes == before.refreshes && panel_matches(expect), "no refresh after a failed PON");
+        check(epaper_get_power_state() == EPAPER_POWER_OFF, "power state left unchanged");
+
+        config.pon_busy_us = pon_us;
+        epaper_sim_configure(&config);
+        check(epaper_display_frame(&epaper, portrait) == ESP_OK && panel_matches(portrait), "next update recovers");
+    }
+
+    printf("double buffering\n");
+    {
+        uint8_t *back = fb_get_back();
+        draw_pattern(back, 800, 480, 10);
+        check(epaper_display(&epaper) == ESP_OK && fb_get_back() == back, "sync display keeps the back frame");
+
+        draw_pattern(back, 800, 480, 11);
+        memcpy(expect, back, FRAME_BYTES);
+        check(epaper_display_frame_async(&epaper, back, NULL, NULL) == ESP_OK, "epaper_display_frame_async");
+        check(fb_get_front() == back && fb_get_back() != back, "async display makes it the front");
+        check(epaper_wait_idle(60000) == ESP_OK && panel_matches(expect), "panel shows the front frame");
+
+        // Two swaps bring the pool back to where the other tests expect it.
+        uint8_t *next = fb_get_back();
+        draw_pattern(next, 480, 800, 12);
+        check(epaper_display_rotated_async(&epaper, next, 480, 800, EPAPER_ROTATE_90, NULL, NULL) == ESP_OK &&
+              fb_get_front() == next && fb_get_back() == back, "rotated async display makes it the front");
+        check(epaper_wait_idle(60000) == ESP_OK, "epaper_wait_idle");
+    }
+
+    printf("bmp load\n");
+    {
+        char path[512];
+        host_heap_stats_t heap;
+        bmp_image_t image = {0};
+        bmp_load_stats_t load;
+
+        static const uint8_t panel_order[6] = {0, 1, 2, 3, 5, 6};
+        static const uint8_t shuffled_order[6] = {6, 3, 1, 5, 0, 2};
+
+        snprintf(path, sizeof(path), "%s/test.bmp", _out_dir);
+        draw_pattern(expect, 800, 480, 5);
+        check(write_bmp4(path, expect, 800, 480, panel_order), "write test.bmp");
+
+        host_heap_reset_peak();
+        host_heap_get_stats(&heap);
+        size_t base = heap.current;
+        int64_t start = esp_timer_get_time();
+        uint8_t *rows = load_bmp_rows(path, 800, 480);
+        int64_t rows_us = esp_timer_get_time() - start;
+        host_heap_get_stats(&heap);
+        check(rows != NULL, "row loader");
+        printf("  row by row    %7.2f ms, peak heap +%lu bytes\n", rows_us / 1000.0, (unsigned long)(heap.peak - base));
+        heap_caps_free(rows);
+
+        memset(frame, 0, FRAME_BYTES);
+        host_heap_reset_peak();
+        host_heap_get_stats(&heap);
+        base = heap.current;
+        check(load_bmp_into_frame(path, frame, 800, 480, NULL, &image) == ESP_OK, "load_bmp_into_frame");
+        host_heap_get_stats(&heap);
+        bmp_get_load_stats(&load);
+        check(image.data == frame && memcmp(frame, expect, FRAME_BYTES) == 0, "frame matches the bitmap");
+        printf("  into frame    %7.2f ms, peak heap +%lu bytes, %lu chunks, LUT %.2f ms\n",
+               load.elapsed_us / 1000.0, (unsigned long)(heap.peak - base), (unsigned long)load.chunks,
+               load.convert_us / 1000.0);
+
+        check(write_bmp4(path, expect, 800, 480, shuffled_order), "write test.bmp, shuffled palette");
+        memset(frame, 0, FRAME_BYTES);
+        check(load_bmp_into_frame(path, frame, 800, 480, NULL, &image) == ESP_OK &&
+              memcmp(frame, expect, FRAME_BYTES) == 0, "palette mapped to panel codes");
+
+        check(epaper_display_frame(&epaper, frame) == ESP_OK, "epaper_display_frame");
+        check(panel_matches(expect), "panel shows the bitmap");
+    }
+
+    printf("drawing\n");
+    draw_primitives(frame);
+
+    printf("text\n");
+    text_rendering();
+
+    printf("bmp formats\n");
+    bmp_formats(frame);
+
+    printf("jpeg\n");
+    jpeg_formats(frame);
+
+    printf("png\n");
+    png_formats(frame);
+
+    printf("lut conversion\n");
+    lut_conversion(frame, expect);
+
+    printf("epd\n");
+    epd_frames(&epaper, frame, expect);
+
+    printf("epd compression\n");
+    epd_codecs(&epaper, frame, expect);
+
+    printf("frame cache\n");
+    frame_cache(frame, expect);
+
+    printf("dithering\n");
+    dither_modes(&epaper, frame);
+
+    // With pixels already in memory the wire dominates and both modes move
+    // the frame at the SPI clock; queueing pays off once producing the data
+    // costs CPU time, which the simulator charges per pixel byte. 1000 ns/B
+    // is a stand-in for a decoder, not a measured figure: /api/xfer_mode
+    // and /api/timing on the target give the real numbers.
+    printf("transfer modes\n");
+    static const epaper_xfer_mode_t modes[] = {EPAPER_XFER_BLOCKING, EPAPER_XFER_QUEUED};
+    static const uint32_t fill_costs[] = {0, 1000};
+    for (int f = 0; f < 2; f++) {
+        float mbps[2];
+        config.fill_ns_per_byte = fill_costs[f];
+        epaper_sim_configure(&config);
+        for (int i = 0; i < 2; i++) {
+            epaper_xfer_stats_t xfer;
+            draw_pattern(frame, 800, 480, 3 + f * 2 + i);
+            epaper_set_xfer_mode(modes[i]);
+            check(epaper_display_frame(&epaper, frame) == ESP_OK, "epaper_display_frame");
+            epaper_get_xfer_stats(&xfer);
+            mbps[i] = xfer.mbps;
+            printf("  fill %4lu ns/B %-8s %lu bytes in %lu chunks, %.1f ms, %.3f MB/s\n",
+                   (unsigned long)fill_costs[f], modes[i] == EPAPER_XFER_QUEUED ? "queued" : "blocking",
+                   (unsigned long)xfer.bytes, (unsigned long)xfer.chunks, xfer.elapsed_us / 1000.0, xfer.mbps);
+        }
+        if (fill_costs[f] > 0) {
+            check(mbps[1] > mbps[0] * 1.3f, "queued transfer overlaps producing the data");
+        }
+    }
+    config.fill_ns_per_byte = 0;
+    epaper_sim_configure(&config);
+
+    printf("command throughput\n");
+    epaper_cmd_bench_t bench;
+    check(epaper_bench_commands(&epaper, 256, &bench) == ESP_OK, "epaper_bench_commands");
+    printf("  per-transaction %.0f cmd/s, queued burst %.0f cmd/s\n",
+           bench.single_cmds_per_s, bench.burst_cmds_per_s);
+
+    epaper_session_close();
+
+    epaper_sim_stats_t sim;
+    host_heap_stats_t heap;
+    epaper_sim_get_stats(&sim);
+    host_heap_get_stats(&heap);
+
+    printf("simulator\n");
+    printf("  %lu commands, %lu data bytes (%lu pixel), %lu resets, %lu full + %lu partial refreshes\n",
+           (unsigned long)sim.commands, (unsigned long)sim.data_bytes, (unsigned long)sim.pixel_bytes,
+           (unsigned long)sim.resets, (unsigned long)sim.refreshes, (unsigned long)sim.partial_refreshes);
+    printf("  wire %.1f ms, BUSY %.1f s, heap_caps peak %lu bytes\n",
+           sim.wire_us / 1000.0, sim.busy_us / 1e6, (unsigned long)heap.peak);
+    check(sim.errors == 0, "no protocol errors");
+    check(sim.undefined_pixels == 0, "only the six panel colour codes");
+
+    if (verbose) {
+        epaper_dump_timing();
+    }
+
+    free(expect);
+    free(portrait);
+
+    printf("%s\n", _failures == 0 ? "PASS" : "FAIL");
+    return _failures == 0 ? 0 : 1;
+}
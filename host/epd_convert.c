@@ -0,0 +1,108 @@
+// Converts a BMP or PNG into a panel-native .epd file with the firmware's
+// own loaders, so the device only has to copy it to the panel:
+//
+//   epd_convert [-f fit] [-d dither] [-r degrees] [-c none|rle|lz] input -o output.epd
+//
+// The frame is stored LZ compressed unless -c says otherwise. Portrait
+// pictures are rotated into the panel's 800x480 layout (90
+// degrees unless -r says otherwise). JPEG is not accepted here: the host
+// build only has a stand-in for the ROM decoder.
+
+#include "epd_file.h"
+#include "bitmap.h"
+#include "epaper_dither.h"
+#include "epaper_rotate.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PANEL_W         800
+#define PANEL_H         480
+#define FRAME_BYTES     (PANEL_W * PANEL_H / 2)
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-f center|crop|letterbox] [-d none|fs|atkinson|bayer] [-r 0|90|180|270] "
+            "[-c none|rle|lz] input.{bmp,png} -o output.epd\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    bmp_load_opts_t opts = BMP_LOAD_OPTS_DEFAULT;
+    const char *output = NULL;
+    bool rotation_given = false;
+    epaper_rotation_t rotation = EPAPER_ROTATE_0;
+    epd_compression_t compression = EPD_COMPRESSION_LZ;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:f:d:r:c:")) != -1) {
+        switch (opt) {
+            case 'o': output = optarg; break;
+            case 'f': if (bmp_fit_from_name(optarg, &opts.fit) != ESP_OK) usage(argv[0]); break;
+            case 'c': if (epd_compression_from_name(optarg, &compression) != ESP_OK) usage(argv[0]); break;
+            case 'd': if (epaper_dither_from_name(optarg, &opts.dither) != ESP_OK) usage(argv[0]); break;
+            case 'r':
+                if (epaper_rotation_from_degrees(atoi(optarg), &rotation) != ESP_OK) {
+                    usage(argv[0]);
+                }
+                rotation_given = true;
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    if (output == NULL || optind != argc - 1) {
+        usage(argv[0]);
+    }
+
+    const char *input = argv[optind];
+    const char *ext = strrchr(input, '.');
+    if (ext != NULL && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0)) {
+        fprintf(stderr, "%s: JPEG needs the device decoder; convert it to PNG or BMP first\n", input);
+        return 1;
+    }
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    uint8_t *src = malloc(FRAME_BYTES);
+    uint8_t *frame = malloc(FRAME_BYTES);
+    if (src == NULL || frame == NULL) {
+        return 1;
+    }
+
+    bmp_image_t image = {0};
+    esp_err_t ret = load_image_into_frame(input, src, PANEL_W, PANEL_H, &opts, &image);
+    if (ret != ESP_OK) {
+        fprintf(stderr, "%s: failed to load (%s)\n", input, esp_err_to_name(ret));
+        return 1;
+    }
+
+    if (!rotation_given) {
+        rotation = epaper_default_rotation_for(image.width, image.height);
+    }
+    bool portrait = rotation == EPAPER_ROTATE_90 || rotation == EPAPER_ROTATE_270;
+    if (image.width != (portrait ? PANEL_H : PANEL_W) || image.height != (portrait ? PANEL_W : PANEL_H)) {
+        fprintf(stderr, "%s: a %ux%u image cannot be rotated by %d\n", input, image.width, image.height,
+                epaper_rotation_degrees(rotation));
+        return 1;
+    }
+    epaper_rotate_rows(frame, 0, PANEL_H, image.data, image.width, image.height, rotation);
+
+    ret = epd_file_write(output, frame, PANEL_W, PANEL_H, compression);
+    if (ret != ESP_OK) {
+        fprintf(stderr, "%s: failed to write\n", output);
+        return 1;
+    }
+
+    struct stat st;
+    printf("%s: %ux%u, fit %s, dither %s, rotation %d -> %s (%s, %ld bytes)\n", input, image.width, image.height,
+           bmp_fit_name(opts.fit), epaper_dither_name(opts.dither), epaper_rotation_degrees(rotation), output,
+           epd_compression_name(compression), stat(output, &st) == 0 ? (long)st.st_size : -1L);
+    free(src);
+    free(frame);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef HOST_PORT_H
+#define HOST_PORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Moves the simulated clock forward without sleeping. Used for vTaskDelay,
+// SPI wire time and BUSY phases, so a 20 s refresh costs no real time but
+// still shows up in esp_timer_get_time() and the driver's timing records.
+void host_clock_advance(int64_t us);
+
+// Total time skipped over so far.
+int64_t host_clock_skipped_us(void);
+
+typedef struct {
+    size_t current;
+    size_t peak;
+    uint32_t allocations;
+} host_heap_stats_t;
+
+// Only heap_caps_* allocations are counted.
+void host_heap_get_stats(host_heap_stats_t *stats);
+void host_heap_reset_peak(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+// Pin numbers only; the simulated panel has no GPIOs.
+typedef int gpio_num_t;
+
+#define GPIO_NUM_NC     (-1)
+
+#endif
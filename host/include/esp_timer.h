@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+// Microseconds on the simulated clock: real time plus every delay and
+// BUSY phase the simulator skipped over (see host_clock_advance).
+int64_t esp_timer_get_time(void);
+
+#endif
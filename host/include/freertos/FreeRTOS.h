@@ -0,0 +1,33 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+// Host stand-in for FreeRTOS on top of pthreads. One tick is one
+// millisecond; delays advance the simulated clock instead of sleeping.
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      1
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFu)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdFAIL                  0
+#define pdPASS                  1
+
+typedef struct {
+    pthread_mutex_t lock;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { PTHREAD_MUTEX_INITIALIZER }
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(&(mux)->lock)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(&(mux)->lock)
+#define portYIELD_FROM_ISR(woken)       ((void)(woken))
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef HOST_ROM_MINIZ_H
+#define HOST_ROM_MINIZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The tinfl part of the miniz the ESP32-S3 ROM exports. On the host it is
+// backed by zlib in tinfl_zlib.c; the decompressor object differs in size
+// and layout from the ROM one, but callers only ever allocate it and call
+// tinfl_init.
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+#define TINFL_LZ_DICT_SIZE                      32768
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+    mz_uint32 m_state;
+    // zlib's stream and its allocations, carved from arena.
+    uint8_t stream[128] __attribute__((aligned(16)));
+    size_t arena_used;
+    uint8_t arena[48 * 1024] __attribute__((aligned(16)));
+} tinfl_decompressor;
+
+#define tinfl_init(r)   do { (r)->m_state = 0; } while (0)
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+                              mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags);
+
+#endif
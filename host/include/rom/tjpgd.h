@@ -0,0 +1,52 @@
+#ifndef HOST_ROM_TJPGD_H
+#define HOST_ROM_TJPGD_H
+
+#include <stdint.h>
+
+// The TJpgDec interface as the ESP32-S3 ROM exports it. On the host it is
+// backed by tjpgd_sim.c.
+
+typedef enum {
+    JDR_OK = 0,     // succeeded
+    JDR_INTR,       // interrupted by the output function
+    JDR_INP,        // input error or early end of stream
+    JDR_MEM1,       // work pool too small
+    JDR_MEM2,       // input buffer too small
+    JDR_PAR,        // parameter error
+    JDR_FMT1,       // data format error
+    JDR_FMT2,       // right format but not supported
+    JDR_FMT3        // not a supported JPEG standard
+} JRESULT;
+
+typedef struct {
+    uint16_t left, right, top, bottom;
+} JRECT;
+
+typedef struct JDEC JDEC;
+struct JDEC {
+    uint32_t dctr;
+    uint8_t *dptr;
+    uint8_t *inbuf;
+    uint8_t dmsk;
+    uint8_t scale;
+    uint8_t msx, msy;
+    uint8_t qtid[3];
+    int16_t dcv[3];
+    uint16_t nrst;
+    uint32_t width, height;
+    uint8_t *huffbits[2][2];
+    uint16_t *huffcode[2][2];
+    uint8_t *huffdata[2][2];
+    int32_t *qttbl[4];
+    void *workbuf;
+    uint8_t *mcubuf;
+    void *pool;
+    uint32_t sz_pool;
+    uint32_t (*infunc)(JDEC *, uint8_t *, uint32_t);
+    void *device;
+};
+
+JRESULT jd_prepare(JDEC *jd, uint32_t (*infunc)(JDEC *, uint8_t *, uint32_t), void *pool, uint32_t sz_pool, void *dev);
+JRESULT jd_decomp(JDEC *jd, uint32_t (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale);
+
+#endif
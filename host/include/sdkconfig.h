@@ -0,0 +1,9 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Mirrors the options of the checked-in sdkconfig that the display code reads.
+#define CONFIG_ENABLE_PARTIAL_UPDATE 1
+#define CONFIG_EPAPER_ROTATION 0
+#define CONFIG_FRAME_CACHE_BUDGET_KB 1536
+
+#endif
@@ -0,0 +1,436 @@
+#include "host_port.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+// ---- Clock ----
+
+static int64_t _skipped_us = 0;
+static int64_t _origin_us = 0;
+static pthread_once_t _origin_once = PTHREAD_ONCE_INIT;
+
+static int64_t host_monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void host_clock_start(void)
+{
+    _origin_us = host_monotonic_us();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    pthread_once(&_origin_once, host_clock_start);
+    return host_monotonic_us() - _origin_us + __atomic_load_n(&_skipped_us, __ATOMIC_RELAXED);
+}
+
+void host_clock_advance(int64_t us)
+{
+    if (us > 0) {
+        __atomic_fetch_add(&_skipped_us, us, __ATOMIC_RELAXED);
+    }
+}
+
+int64_t host_clock_skipped_us(void)
+{
+    return __atomic_load_n(&_skipped_us, __ATOMIC_RELAXED);
+}
+
+// Absolute CLOCK_REALTIME deadline for a real (not simulated) wait.
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// ---- Logging ----
+
+static esp_log_level_t _log_level = ESP_LOG_INFO;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    if (strcmp(tag, "*") == 0) {
+        _log_level = level;
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+    if (level > _log_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&lock);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    pthread_mutex_unlock(&lock);
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_FAIL:              return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC:   return "ESP_ERR_INVALID_CRC";
+        default:                    return "UNKNOWN ERROR";
+    }
+}
+
+// ---- ROM ----
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    return crc32(crc, buf, len);
+}
+
+// ---- Heap ----
+
+// Each block carries its size in front so frees can be accounted for.
+typedef struct {
+    size_t size;
+    size_t pad;
+} host_block_t;
+
+static host_heap_stats_t _heap;
+static pthread_mutex_t _heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    host_block_t *block = malloc(sizeof(host_block_t) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->size = size;
+    pthread_mutex_lock(&_heap_lock);
+    _heap.current += size;
+    _heap.allocations++;
+    if (_heap.current > _heap.peak) {
+        _heap.peak = _heap.current;
+    }
+    pthread_mutex_unlock(&_heap_lock);
+    return block + 1;
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    void *ptr = heap_caps_malloc(n * size, caps);
+    if (ptr != NULL) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    host_block_t *block = (host_block_t *)ptr - 1;
+    pthread_mutex_lock(&_heap_lock);
+    _heap.current -= block->size;
+    pthread_mutex_unlock(&_heap_lock);
+    free(block);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return 8 * 1024 * 1024;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+void host_heap_get_stats(host_heap_stats_t *stats)
+{
+    pthread_mutex_lock(&_heap_lock);
+    *stats = _heap;
+    pthread_mutex_unlock(&_heap_lock);
+}
+
+void host_heap_reset_peak(void)
+{
+    pthread_mutex_lock(&_heap_lock);
+    _heap.peak = _heap.current;
+    pthread_mutex_unlock(&_heap_lock);
+}
+
+// ---- Tasks ----
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+};
+
+// Threads not started through xTaskCreate (main) get a handle of their own.
+static __thread struct host_task *_current_task = NULL;
+static __thread struct host_task _thread_task;
+
+static void *host_task_entry(void *arg)
+{
+    struct host_task *task = arg;
+    _current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return pdFAIL;
+    }
+
+    task->fn = fn;
+    task->arg = arg;
+    if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+
+    if (handle != NULL) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_clock_advance((int64_t)ticks * 1000);
+    sched_yield();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return _current_task != NULL ? _current_task : &_thread_task;
+}
+
+// ---- Semaphores ----
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+};
+
+static SemaphoreHandle_t host_sem_create(int count)
+{
+    struct host_sem *sem = calloc(1, sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_sem_create(0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_sem_create(1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t ret = pdTRUE;
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (ticks == 0) {
+            ret = pdFALSE;
+            break;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&sem->cond, &sem->lock);
+        } else if (pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline) == ETIMEDOUT) {
+            ret = pdFALSE;
+            break;
+        }
+    }
+    if (ret == pdTRUE) {
+        sem->count = 0;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    BaseType_t ret = sem->count == 0 ? pdTRUE : pdFALSE;
+    sem->count = 1;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+
+    return ret;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    if (sem != NULL) {
+        pthread_cond_destroy(&sem->cond);
+        pthread_mutex_destroy(&sem->lock);
+        free(sem);
+    }
+}
+
+// ---- Queues ----
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    queue->items = calloc(length, item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+// Waits for space (or an item); false on timeout.
+static bool host_queue_wait(struct host_queue *queue, TickType_t ticks, bool for_space)
+{
+    struct timespec deadline = host_deadline(ticks);
+
+    while (for_space ? queue->count == queue->length : queue->count == 0) {
+        if (ticks == 0) {
+            return false;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&queue->cond, &queue->lock);
+        } else if (pthread_cond_timedwait(&queue->cond, &queue->lock, &deadline) == ETIMEDOUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->lock);
+    bool ok = host_queue_wait(queue, ticks, true);
+    if (ok) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + (size_t)tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return ok ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->lock);
+    bool ok = host_queue_wait(queue, ticks, false);
+    if (ok) {
+        memcpy(item, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return ok ? pdTRUE : pdFALSE;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue != NULL) {
+        pthread_cond_destroy(&queue->cond);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue->items);
+        free(queue);
+    }
+}
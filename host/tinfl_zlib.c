@@ -0,0 +1,85 @@
+#include "rom/miniz.h"
+#include <string.h>
+#include <zlib.h>
+
+// tinfl_decompress on top of zlib's inflate. zlib keeps its own window,
+// so output can go straight to wherever the caller's wrapping buffer is
+// up to. Its allocations come from the arena in the decompressor object,
+// so a decode that is abandoned half way leaks nothing.
+
+_Static_assert(sizeof(z_stream) <= sizeof(((tinfl_decompressor *)0)->stream), "z_stream does not fit");
+
+static voidpf tinfl_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    tinfl_decompressor *r = opaque;
+    size_t n = ((size_t)items * size + 15) & ~(size_t)15;
+    if (r->arena_used + n > sizeof(r->arena)) {
+        return Z_NULL;
+    }
+    void *p = r->arena + r->arena_used;
+    r->arena_used += n;
+    return p;
+}
+
+static void tinfl_zfree(voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    (void)address;
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+                              mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags)
+{
+    z_stream *zs = (z_stream *)r->stream;
+
+    if (r->m_state == 0) {
+        memset(zs, 0, sizeof(*zs));
+        zs->zalloc = tinfl_zalloc;
+        zs->zfree = tinfl_zfree;
+        zs->opaque = r;
+        r->arena_used = 0;
+        if (inflateInit2(zs, (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15) != Z_OK) {
+            return TINFL_STATUS_BAD_PARAM;
+        }
+        r->m_state = 1;
+    }
+    if (r->m_state == 2) {
+        *pIn_buf_size = *pOut_buf_size = 0;
+        return TINFL_STATUS_DONE;
+    }
+
+    // Same rule as tinfl: without a flat buffer, the space from the
+    // buffer start to the end of this call's output is the window size.
+    size_t window = (size_t)(pOut_buf_next - pOut_buf_start) + *pOut_buf_size;
+    if (!(decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF) && (window & (window - 1))) {
+        *pIn_buf_size = *pOut_buf_size = 0;
+        return TINFL_STATUS_BAD_PARAM;
+    }
+
+    zs->next_in = (Bytef *)pIn_buf_next;
+    zs->avail_in = *pIn_buf_size;
+    zs->next_out = pOut_buf_next;
+    zs->avail_out = *pOut_buf_size;
+
+    int res = inflate(zs, Z_NO_FLUSH);
+
+    *pIn_buf_size -= zs->avail_in;
+    *pOut_buf_size -= zs->avail_out;
+
+    switch (res) {
+        case Z_STREAM_END:
+            r->m_state = 2;
+            return TINFL_STATUS_DONE;
+        case Z_OK:
+        case Z_BUF_ERROR:
+            if (zs->avail_out == 0) {
+                return TINFL_STATUS_HAS_MORE_OUTPUT;
+            }
+            return (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+        case Z_DATA_ERROR:
+            return zs->msg != NULL && strstr(zs->msg, "check") ? TINFL_STATUS_ADLER32_MISMATCH : TINFL_STATUS_FAILED;
+        default:
+            return TINFL_STATUS_FAILED;
+    }
+}
@@ -0,0 +1,167 @@
+#include "tjpgd_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+// What the ROM decoder needs from the pool for baseline images.
+#define SIM_POOL_MIN    3100
+
+static tjpgd_sim_pixel_fn_t _source;
+static tjpgd_sim_stats_t _stats;
+
+void tjpgd_sim_set_source(tjpgd_sim_pixel_fn_t fn)
+{
+    _source = fn;
+}
+
+void tjpgd_sim_get_stats(tjpgd_sim_stats_t *stats)
+{
+    *stats = _stats;
+}
+
+static bool sim_read(JDEC *jd, uint8_t *buf, uint32_t len)
+{
+    return jd->infunc(jd, buf, len) == len;
+}
+
+static JRESULT sim_parse_sof(JDEC *jd, const uint8_t *seg, uint32_t len)
+{
+    if (len < 6 || seg[0] != 8) {
+        return JDR_FMT1;
+    }
+    jd->height = (seg[1] << 8) | seg[2];
+    jd->width = (seg[3] << 8) | seg[4];
+    uint8_t comps = seg[5];
+    if (jd->width == 0 || jd->height == 0 || (comps != 1 && comps != 3) || len < 6u + comps * 3) {
+        return JDR_FMT1;
+    }
+
+    // Chroma must not be subsampled more than luma: 4:4:4, 4:2:2 or 4:2:0.
+    uint8_t h = comps == 3 ? seg[7] >> 4 : 1;
+    uint8_t v = comps == 3 ? seg[7] & 0x0F : 1;
+    if (!((h == 1 && v == 1) || (h == 2 && v == 1) || (h == 2 && v == 2))) {
+        return JDR_FMT3;
+    }
+    jd->msx = h;
+    jd->msy = v;
+    return JDR_OK;
+}
+
+JRESULT jd_prepare(JDEC *jd, uint32_t (*infunc)(JDEC *, uint8_t *, uint32_t), void *pool, uint32_t sz_pool, void *dev)
+{
+    uint8_t seg[256];
+    bool have_sof = false;
+
+    memset(jd, 0, sizeof(*jd));
+    jd->infunc = infunc;
+    jd->device = dev;
+    jd->pool = pool;
+    jd->sz_pool = sz_pool;
+    memset(&_stats, 0, sizeof(_stats));
+
+    if (pool == NULL || sz_pool < SIM_POOL_MIN) {
+        return JDR_MEM1;
+    }
+    if (!sim_read(jd, seg, 2)) {
+        return JDR_INP;
+    }
+    if (seg[0] != 0xFF || seg[1] != 0xD8) {
+        return JDR_FMT1;
+    }
+
+    for (;;) {
+        if (!sim_read(jd, seg, 4)) {
+            return JDR_INP;
+        }
+        if (seg[0] != 0xFF) {
+            return JDR_FMT1;
+        }
+        uint8_t marker = seg[1];
+        uint32_t len = (seg[2] << 8) | seg[3];
+        if (len < 2) {
+            return JDR_FMT1;
+        }
+        len -= 2;
+
+        switch (marker) {
+            case 0xC0: {
+                if (len > sizeof(seg) || !sim_read(jd, seg, len)) {
+                    return JDR_INP;
+                }
+                JRESULT res = sim_parse_sof(jd, seg, len);
+                if (res != JDR_OK) {
+                    return res;
+                }
+                have_sof = true;
+                break;
+            }
+            case 0xC1: case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+            case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+                return JDR_FMT3;
+            case 0xDA:
+                if (!have_sof) {
+                    return JDR_FMT1;
+                }
+                return jd->infunc(jd, NULL, len) == len ? JDR_OK : JDR_INP;
+            default:
+                if (jd->infunc(jd, NULL, len) != len) {
+                    return JDR_INP;
+                }
+                break;
+        }
+    }
+}
+
+JRESULT jd_decomp(JDEC *jd, uint32_t (*outfunc)(JDEC *, void *, JRECT *), uint8_t scale)
+{
+    if (scale > 3 || _source == NULL) {
+        return JDR_PAR;
+    }
+    jd->scale = scale;
+
+    uint32_t mx = jd->msx * 8;
+    uint32_t my = jd->msy * 8;
+    uint8_t *block = malloc(mx * my * 3);
+    if (block == NULL) {
+        return JDR_MEM1;
+    }
+
+    JRESULT res = JDR_OK;
+
+    for (uint32_t y = 0; y < jd->height && res == JDR_OK; y += my) {
+        // Scan data is consumed a little per MCU row, until it runs out.
+        uint8_t scan[512];
+        _stats.scan_bytes += jd->infunc(jd, scan, sizeof(scan));
+
+        for (uint32_t x = 0; x < jd->width; x += mx) {
+            uint32_t rx = x + mx <= jd->width ? mx : jd->width - x;
+            uint32_t ry = y + my <= jd->height ? my : jd->height - y;
+            rx >>= scale;
+            ry >>= scale;
+            if (rx == 0 || ry == 0) {
+                continue;
+            }
+
+            for (uint32_t j = 0; j < ry; j++) {
+                for (uint32_t i = 0; i < rx; i++) {
+                    _source(x + (i << scale), y + (j << scale), block + (j * rx + i) * 3);
+                }
+            }
+
+            JRECT rect = {
+                .left = x >> scale,
+                .right = (x >> scale) + rx - 1,
+                .top = y >> scale,
+                .bottom = (y >> scale) + ry - 1
+            };
+            _stats.mcus++;
+            if (!outfunc(jd, block, &rect)) {
+                _stats.interrupted = true;
+                res = JDR_INTR;
+                break;
+            }
+        }
+    }
+
+    free(block);
+    return res;
+}
@@ -0,0 +1,26 @@
+#ifndef TJPGD_SIM_H
+#define TJPGD_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rom/tjpgd.h"
+
+// Stand-in for the ROM TJpgDec. jd_prepare parses the real marker
+// segments (SOI, SOF0, SOS, rejecting progressive and other SOF types),
+// and jd_decomp emits MCUs in the order and with the edge clipping and
+// scaling the ROM decoder uses, consuming the scan data as it goes. No
+// entropy decoding is done: pixel colours come from the source function,
+// evaluated at full-resolution coordinates.
+
+typedef void (*tjpgd_sim_pixel_fn_t)(uint32_t x, uint32_t y, uint8_t rgb[3]);
+
+typedef struct {
+    uint32_t mcus;              // blocks handed to the output function
+    uint32_t scan_bytes;        // entropy-coded bytes consumed
+    bool interrupted;           // the output function stopped the decode
+} tjpgd_sim_stats_t;
+
+void tjpgd_sim_set_source(tjpgd_sim_pixel_fn_t fn);
+void tjpgd_sim_get_stats(tjpgd_sim_stats_t *stats);
+
+#endif
@@ -1,8 +1,17 @@
 #include "bitmap.h"
+#include "epaper_driver.h"
+#include "epaper_dither.h"
+#include "jpeg.h"
+#include "png.h"
+#include "epd_file.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 static const char *TAG = "BITMAP";
 
@@ -14,21 +23,479 @@ static inline uint16_t read_le16(const unsigned char *p) {
     return p[0] | (p[1] << 8);
 }
 
-esp_err_t load_bmp_from_sd(const char *filename, bmp_image_t *image)
+// Sequential reader over the file in BMP_CHUNK_SIZE pieces. stdio
+// buffering is turned off, so every fread is one sector-aligned,
+// multi-sector read straight into buf.
+typedef struct {
+    FILE *file;
+    uint8_t *buf;
+    size_t len;         // valid bytes in buf
+    size_t pos;         // next unread byte in buf
+    uint32_t offset;    // file offset of buf[0]
+    uint32_t chunks;
+    int64_t read_us;
+} bmp_reader_t;
+
+static bmp_load_stats_t _stats;
+
+static bool bmp_reader_fill(bmp_reader_t *reader)
+{
+    int64_t start = esp_timer_get_time();
+
+    reader->offset += reader->len;
+    reader->pos = 0;
+    reader->len = fread(reader->buf, 1, BMP_CHUNK_SIZE, reader->file);
+
+    reader->read_us += esp_timer_get_time() - start;
+    reader->chunks++;
+    return reader->len > 0;
+}
+
+static bool bmp_reader_read(bmp_reader_t *reader, void *dst, size_t len)
+{
+    uint8_t *out = dst;
+
+    while (len > 0) {
+        if (reader->pos == reader->len && !bmp_reader_fill(reader)) {
+            return false;
+        }
+
+        size_t n = reader->len - reader->pos;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(out, reader->buf + reader->pos, n);
+        reader->pos += n;
+        out += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Moves forward to an absolute file offset. A target outside the current
+// chunk seeks to the sector holding it so later reads stay aligned.
+static bool bmp_reader_seek(bmp_reader_t *reader, uint32_t target)
+{
+    uint32_t current = reader->offset + reader->pos;
+    if (target < current) {
+        return false;
+    }
+
+    if (target < reader->offset + reader->len) {
+        reader->pos = target - reader->offset;
+        return true;
+    }
+
+    uint32_t aligned = target & ~(uint32_t)(BMP_SECTOR_SIZE - 1);
+    if (fseek(reader->file, aligned, SEEK_SET) != 0) {
+        return false;
+    }
+    reader->offset = aligned;
+    reader->len = 0;
+    if (!bmp_reader_fill(reader) || target - aligned > reader->len) {
+        return false;
+    }
+    reader->pos = target - aligned;
+    return true;
+}
+
+// Returns the next len bytes, in place in the chunk when they are
+// contiguous there and copied into scratch when they straddle two chunks.
+static const uint8_t *bmp_reader_take(bmp_reader_t *reader, uint8_t *scratch, size_t len)
+{
+    if (reader->pos == reader->len && !bmp_reader_fill(reader)) {
+        return NULL;
+    }
+
+    if (reader->len - reader->pos >= len) {
+        const uint8_t *p = reader->buf + reader->pos;
+        reader->pos += len;
+        return p;
+    }
+    return bmp_reader_read(reader, scratch, len) ? scratch : NULL;
+}
+
+static const char *_fit_names[] = {"center", "crop", "letterbox"};
+
+// What the row converters need to know about the file.
+typedef struct {
+    int32_t width;
+    int32_t height;
+    bool top_down;
+    uint16_t bpp;
+    uint32_t row_size;
+    uint8_t codes[256];         // palette index to panel code
+    uint8_t rgb[256][3];        // palette colours, used when dithering
+    const uint8_t *color_lut;   // true-colour images
+} bmp_source_t;
+
+// Matches each palette entry to the nearest panel code and keeps its
+// colour for dithering. Indices past the end of the palette show as white.
+static bool bmp_read_palette(bmp_reader_t *reader, uint32_t entries, bmp_source_t *source)
+{
+    memset(source->codes, EPAPER_COLOR_WHITE, sizeof(source->codes));
+    memset(source->rgb, 0xFF, sizeof(source->rgb));
+    for (uint32_t i = 0; i < entries; i++) {
+        uint8_t bgra[4];
+        if (!bmp_reader_read(reader, bgra, sizeof(bgra))) {
+            return false;
+        }
+        source->rgb[i][0] = bgra[2];
+        source->rgb[i][1] = bgra[1];
+        source->rgb[i][2] = bgra[0];
+        source->codes[i] = epaper_color_nearest(bgra[2], bgra[1], bgra[0]);
+    }
+    return true;
+}
+
+// Expands 4-bit codes to a table over whole bytes so a packed pixel pair
+// is converted in one lookup.
+static void bmp_build_pair_lut(const uint8_t *codes, uint8_t lut[256])
+{
+    for (uint32_t v = 0; v < 256; v++) {
+        lut[v] = (codes[v >> 4] << 4) | codes[v & 0x0F];
+    }
+}
+
+void bmp_convert_pairs_ref(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t lut[256])
+{
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+// The ESP32-S3 cannot load or store words at unaligned addresses, and the
+// word loop below is only worth it when both buffers can be walked a whole
+// word at a time.
+typedef uint32_t __attribute__((may_alias)) bmp_word_t;
+
+static inline uint32_t bmp_convert_word(uint32_t w, const uint8_t lut[256])
+{
+    return (uint32_t)lut[w & 0xFF] | ((uint32_t)lut[(w >> 8) & 0xFF] << 8) |
+           ((uint32_t)lut[(w >> 16) & 0xFF] << 16) | ((uint32_t)lut[w >> 24] << 24);
+}
+
+void bmp_convert_pairs(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t lut[256])
+{
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & 3) != 0) {
+        bmp_convert_pairs_ref(dst, src, len, lut);
+        return;
+    }
+
+    size_t head = (4 - ((uintptr_t)dst & 3)) & 3;
+    if (head > len) {
+        head = len;
+    }
+    bmp_convert_pairs_ref(dst, src, head, lut);
+
+    const bmp_word_t *in = (const bmp_word_t *)(src + head);
+    bmp_word_t *out = (bmp_word_t *)(dst + head);
+    size_t words = (len - head) / 4;
+    size_t i = 0;
+
+    // Two words per pass so the second pair of loads overlaps the lookups.
+    for (; i + 2 <= words; i += 2) {
+        uint32_t a = in[i];
+        uint32_t b = in[i + 1];
+        out[i] = bmp_convert_word(a, lut);
+        out[i + 1] = bmp_convert_word(b, lut);
+    }
+    if (i < words) {
+        out[i] = bmp_convert_word(in[i], lut);
+    }
+
+    size_t done = head + words * 4;
+    bmp_convert_pairs_ref(dst + done, src + done, len - done, lut);
+}
+
+void bmp_plan_layout(bmp_layout_t *layout, uint32_t src_w, uint32_t src_h, bmp_fit_t fit)
 {
-    FILE *file = NULL;
+    uint32_t dst_w = layout->dst_w;
+    uint32_t dst_h = layout->dst_h;
+    bool wider = src_w * dst_h >= src_h * dst_w;
+
+    layout->sx0 = 0;
+    layout->sy0 = 0;
+    layout->sw = src_w;
+    layout->sh = src_h;
+
+    switch (fit) {
+        case BMP_FIT_CROP:
+            layout->dw = dst_w;
+            layout->dh = dst_h;
+            if (wider) {
+                layout->sw = (src_h * dst_w + dst_h / 2) / dst_h;
+            } else {
+                layout->sh = (src_w * dst_h + dst_w / 2) / dst_w;
+            }
+            break;
+        case BMP_FIT_LETTERBOX:
+            layout->dw = wider ? dst_w : (src_w * dst_h + src_h / 2) / src_h;
+            layout->dh = wider ? (src_h * dst_w + src_w / 2) / src_w : dst_h;
+            break;
+        case BMP_FIT_CENTER:
+        default:
+            layout->dw = layout->sw = src_w < dst_w ? src_w : dst_w;
+            layout->dh = layout->sh = src_h < dst_h ? src_h : dst_h;
+            break;
+    }
+
+    if (layout->dw == 0) {
+        layout->dw = 1;
+    }
+    if (layout->dh == 0) {
+        layout->dh = 1;
+    }
+    if (layout->sw == 0) {
+        layout->sw = 1;
+    }
+    if (layout->sh == 0) {
+        layout->sh = 1;
+    }
+
+    layout->sx0 = (src_w - layout->sw) / 2;
+    layout->sy0 = (src_h - layout->sh) / 2;
+    // An even left edge keeps every output row byte-aligned in the frame.
+    layout->dx0 = ((dst_w - layout->dw) / 2) & ~1u;
+    layout->dy0 = (dst_h - layout->dh) / 2;
+}
+
+// Converts the sampled pixels of one source row into panel codes, one per
+// byte. xmap holds byte offsets for 8/24/32-bit rows and pixel indices for
+// 1 and 4-bit ones.
+static void bmp_convert_row(const uint8_t *src, const bmp_source_t *source, const uint16_t *xmap,
+                            uint16_t count, uint8_t *line)
+{
+    const uint8_t *codes = source->codes;
+
+    switch (source->bpp) {
+        case 1:
+            for (uint16_t i = 0; i < count; i++) {
+                uint32_t x = xmap[i];
+                line[i] = codes[(src[x >> 3] >> (7 - (x & 7))) & 1];
+            }
+            break;
+        case 4:
+            for (uint16_t i = 0; i < count; i++) {
+                uint32_t x = xmap[i];
+                line[i] = codes[(src[x >> 1] >> ((x & 1) ? 0 : 4)) & 0x0F];
+            }
+            break;
+        case 8:
+            for (uint16_t i = 0; i < count; i++) {
+                line[i] = codes[src[xmap[i]]];
+            }
+            break;
+        default:
+            for (uint16_t i = 0; i < count; i++) {
+                const uint8_t *p = src + xmap[i];
+                line[i] = source->color_lut[EPAPER_COLOR_LUT_INDEX(p[2], p[1], p[0])];
+            }
+            break;
+    }
+}
+
+// As bmp_convert_row, but gives R,G,B triplets for the dithering stage.
+static void bmp_sample_rgb(const uint8_t *src, const bmp_source_t *source, const uint16_t *xmap,
+                           uint16_t count, uint8_t *rgb)
+{
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t x = xmap[i];
+        const uint8_t *c;
+        uint8_t bgr[3];
+
+        switch (source->bpp) {
+            case 1:  c = source->rgb[(src[x >> 3] >> (7 - (x & 7))) & 1]; break;
+            case 4:  c = source->rgb[(src[x >> 1] >> ((x & 1) ? 0 : 4)) & 0x0F]; break;
+            case 8:  c = source->rgb[src[x]]; break;
+            default:
+                bgr[0] = src[x + 2];
+                bgr[1] = src[x + 1];
+                bgr[2] = src[x];
+                c = bgr;
+                break;
+        }
+        rgb[i * 3 + 0] = c[0];
+        rgb[i * 3 + 1] = c[1];
+        rgb[i * 3 + 2] = c[2];
+    }
+}
+
+void bmp_pack_row(uint8_t *dst, const uint8_t *line, uint16_t count)
+{
+    uint16_t i;
+    for (i = 0; i + 1 < count; i += 2) {
+        *dst++ = (line[i] << 4) | line[i + 1];
+    }
+    if (i < count) {
+        *dst = (line[i] << 4) | (*dst & 0x0F);
+    }
+}
+
+// Native-size 4-bit images: rows are read straight into the frame and
+// converted there a byte at a time.
+static bool bmp_load_native4(bmp_reader_t *reader, uint8_t *frame, const bmp_source_t *source,
+                             int64_t *convert_us)
+{
+    uint32_t stride = source->width / 2;
+    uint32_t row_size = source->row_size;
+    uint8_t lut[256];
+    bmp_build_pair_lut(source->codes, lut);
+
+    for (int32_t k = 0; k < source->height; k++) {
+        int32_t y = source->top_down ? k : source->height - 1 - k;
+        uint8_t *row = frame + (size_t)y * stride;
+        if (!bmp_reader_read(reader, row, stride) ||
+            (row_size > stride && !bmp_reader_seek(reader, reader->offset + reader->pos + row_size - stride))) {
+            ESP_LOGE(TAG, "Failed to read row %ld", (long)y);
+            return false;
+        }
+
+        int64_t convert_start = esp_timer_get_time();
+        bmp_convert_pairs(row, row, stride, lut);
+        *convert_us += esp_timer_get_time() - convert_start;
+    }
+    return true;
+}
+
+// Everything else: source rows are sampled as they stream past, skipped
+// ones are seeked over, and each output row is converted once and copied
+// to any further output rows that sample the same source row. With
+// dithering the sampled colours are kept instead and every output row is
+// dithered on its own.
+static esp_err_t bmp_load_scaled(bmp_reader_t *reader, uint8_t *frame, const bmp_layout_t *layout,
+                                 const bmp_source_t *source, epaper_dither_t dither, int64_t *convert_us)
+{
+    uint32_t stride = layout->dst_w / 2;
+    uint32_t bytes_pp = source->bpp / 8;
+    uint32_t row_size = source->row_size;
+    bool dithered = (dither != EPAPER_DITHER_NONE);
+    size_t rgb_size = dithered ? (size_t)layout->dw * 3 : 0;
+    uint8_t *scratch = heap_caps_malloc(layout->dw * (sizeof(uint16_t) + 1) + rgb_size + row_size, MALLOC_CAP_8BIT);
+    if (scratch == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate row buffers");
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint16_t *xmap = (uint16_t *)scratch;
+    uint8_t *line = scratch + layout->dw * sizeof(uint16_t);
+    uint8_t *rgb = line + layout->dw;
+    uint8_t *row_buf = rgb + rgb_size;
+
+    epaper_dither_ctx_t ctx;
+    esp_err_t ret = epaper_dither_begin(&ctx, dither, layout->dw);
+    if (ret != ESP_OK) {
+        heap_caps_free(scratch);
+        return ret;
+    }
+
+    for (uint32_t i = 0; i < layout->dw; i++) {
+        uint32_t x = bmp_src_pos(i, layout->sx0, layout->sw, layout->dw);
+        xmap[i] = source->bpp >= 8 ? x * bytes_pp : x;
+    }
+
+    if (layout->dw < layout->dst_w || layout->dh < layout->dst_h) {
+        memset(frame, (EPAPER_COLOR_WHITE << 4) | EPAPER_COLOR_WHITE, (size_t)stride * layout->dst_h);
+    }
+
+    // Output rows are visited in the order their source rows appear in
+    // the file: downwards for top-down files, upwards otherwise.
+    int32_t step = source->top_down ? 1 : -1;
+    int32_t i = source->top_down ? 0 : layout->dh - 1;
+    int32_t k = 0;
+    uint8_t *last = NULL;
+
+    while (i >= 0 && i < layout->dh) {
+        uint32_t sy = bmp_src_pos(i, layout->sy0, layout->sh, layout->dh);
+        int32_t target = source->top_down ? (int32_t)sy : source->height - 1 - (int32_t)sy;
+
+        if (target > k) {
+            if (!bmp_reader_seek(reader, reader->offset + reader->pos + (uint32_t)(target - k) * row_size)) {
+                ret = ESP_FAIL;
+                break;
+            }
+            k = target;
+        }
+
+        uint8_t *out = frame + (size_t)(layout->dy0 + i) * stride;
+        bool fresh = (target == k);
+        if (fresh) {
+            const uint8_t *src = bmp_reader_take(reader, row_buf, row_size);
+            if (src == NULL) {
+                ret = ESP_FAIL;
+                break;
+            }
+            k++;
+
+            int64_t convert_start = esp_timer_get_time();
+            if (dithered) {
+                bmp_sample_rgb(src, source, xmap, layout->dw, rgb);
+            } else {
+                bmp_convert_row(src, source, xmap, layout->dw, line);
+            }
+            *convert_us += esp_timer_get_time() - convert_start;
+        }
+
+        int64_t convert_start = esp_timer_get_time();
+        if (dithered) {
+            epaper_dither_row(&ctx, rgb, line);
+            bmp_pack_row(out + layout->dx0 / 2, line, layout->dw);
+        } else if (fresh) {
+            bmp_pack_row(out + layout->dx0 / 2, line, layout->dw);
+        } else {
+            // Upscaling: this output row samples the row just converted.
+            memcpy(out, last, stride);
+        }
+        *convert_us += esp_timer_get_time() - convert_start;
+
+        last = out;
+        i += step;
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read image data");
+    }
+    epaper_dither_end(&ctx);
+    heap_caps_free(scratch);
+    return ret;
+}
+
+esp_err_t load_bmp_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                              const bmp_load_opts_t *opts, bmp_image_t *image)
+{
+    if (filename == NULL || frame == NULL || image == NULL || (frame_w % 2) || (frame_h % 2)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    static const bmp_load_opts_t defaults = BMP_LOAD_OPTS_DEFAULT;
+    if (opts == NULL) {
+        opts = &defaults;
+    }
+
+    int64_t start = esp_timer_get_time();
     esp_err_t ret = ESP_FAIL;
+    bmp_reader_t reader = {0};
+    bmp_source_t *source = NULL;
 
     ESP_LOGI(TAG, "Loading BMP file: %s", filename);
 
-    file = fopen(filename, "rb");
-    if (!file) {
+    reader.file = fopen(filename, "rb");
+    if (!reader.file) {
         ESP_LOGE(TAG, "Failed to open file: %s", filename);
         return ESP_FAIL;
     }
+    setvbuf(reader.file, NULL, _IONBF, 0);
+
+    reader.buf = heap_caps_malloc(BMP_CHUNK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    source = heap_caps_calloc(1, sizeof(*source), MALLOC_CAP_8BIT);
+    if (!reader.buf || !source) {
+        ESP_LOGE(TAG, "Failed to allocate read buffer");
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
 
     bmp_header_t header;
-    if (fread(&header, sizeof(header), 1, file) != 1) {
+    if (!bmp_reader_read(&reader, &header, sizeof(header))) {
         ESP_LOGE(TAG, "Failed to read BMP header");
         goto cleanup;
     }
@@ -39,86 +506,180 @@ esp_err_t load_bmp_from_sd(const char *filename, bmp_image_t *image)
     }
 
     bmp_info_header_t info_header;
-    if (fread(&info_header, sizeof(info_header), 1, file) != 1) {
+    if (!bmp_reader_read(&reader, &info_header, sizeof(info_header))) {
         ESP_LOGE(TAG, "Failed to read BMP info header");
         goto cleanup;
     }
 
-    ESP_LOGI(TAG, "BMP info: %dx%d, %d bits", info_header.width, info_header.height, info_header.bits_per_pixel);
+    uint16_t bpp = info_header.bits_per_pixel;
+    int32_t width = info_header.width;
+    bool top_down = info_header.height < 0;
+    int32_t height = top_down ? -info_header.height : info_header.height;
 
-    if (info_header.bits_per_pixel != 4) {
-        ESP_LOGE(TAG, "Only 4-bit BMP files are supported");
-        goto cleanup;
-    }
+    ESP_LOGI(TAG, "BMP info: %ldx%ld%s, %d bits", (long)width, (long)height, top_down ? " top-down" : "", bpp);
 
-    if (info_header.width != 800 || info_header.height != 480) {
-        ESP_LOGE(TAG, "BMP dimensions must be 800x480");
+    if (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 24 && bpp != 32) {
+        ESP_LOGE(TAG, "Unsupported bit depth: %d", bpp);
+        ret = ESP_ERR_NOT_SUPPORTED;
         goto cleanup;
     }
 
-    uint32_t palette_size = (1 << info_header.bits_per_pixel) * 4;
-    uint8_t *palette = malloc(palette_size);
-    if (!palette) {
-        ESP_LOGE(TAG, "Failed to allocate palette memory");
+    if (width <= 0 || height <= 0 || width > BMP_MAX_DIMENSION || height > BMP_MAX_DIMENSION) {
+        ESP_LOGE(TAG, "BMP dimensions must be 1 to %d pixels", BMP_MAX_DIMENSION);
+        ret = ESP_ERR_NOT_SUPPORTED;
         goto cleanup;
     }
 
-    if (fread(palette, palette_size, 1, file) != 1) {
-        ESP_LOGE(TAG, "Failed to read palette");
-        free(palette);
+    // BI_RGB, or BI_BITFIELDS with the usual 8-8-8 masks on 32-bit images.
+    if (info_header.compression == 3 && bpp == 32) {
+        uint32_t masks[3];
+        if (!bmp_reader_seek(&reader, sizeof(header) + 40) || !bmp_reader_read(&reader, masks, sizeof(masks))) {
+            ESP_LOGE(TAG, "Failed to read colour masks");
+            goto cleanup;
+        }
+        if (masks[0] != 0x00FF0000 || masks[1] != 0x0000FF00 || masks[2] != 0x000000FF) {
+            ESP_LOGE(TAG, "Unsupported colour masks");
+            ret = ESP_ERR_NOT_SUPPORTED;
+            goto cleanup;
+        }
+    } else if (info_header.compression != 0) {
+        ESP_LOGE(TAG, "Compressed BMP files are not supported");
+        ret = ESP_ERR_NOT_SUPPORTED;
         goto cleanup;
     }
 
-    uint32_t row_size = ((info_header.width * info_header.bits_per_pixel + 31) / 32) * 4;
-    uint32_t image_data_size = row_size * info_header.height;
+    source->width = width;
+    source->height = height;
+    source->top_down = top_down;
+    source->bpp = bpp;
+    source->row_size = (((uint32_t)width * bpp + 31) / 32) * 4;
 
-    image->data = malloc(image_data_size);
-    if (!image->data) {
-        ESP_LOGE(TAG, "Failed to allocate image data memory");
-        free(palette);
-        goto cleanup;
+    // The palette follows the info header, whatever version it is.
+    if (bpp <= 8) {
+        uint32_t entries = info_header.colors_used;
+        if (entries == 0 || entries > (1u << bpp)) {
+            entries = 1u << bpp;
+        }
+        if (!bmp_reader_seek(&reader, sizeof(header) + info_header.size) ||
+            !bmp_read_palette(&reader, entries, source)) {
+            ESP_LOGE(TAG, "Failed to read palette");
+            goto cleanup;
+        }
+    } else {
+        source->color_lut = epaper_color_lut();
+        if (source->color_lut == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate colour table");
+            ret = ESP_ERR_NO_MEM;
+            goto cleanup;
+        }
     }
 
-    if (fseek(file, header.offset, SEEK_SET) != 0) {
+    if (!bmp_reader_seek(&reader, header.offset)) {
         ESP_LOGE(TAG, "Failed to seek to image data");
-        free(palette);
-        free(image->data);
-        image->data = NULL;
         goto cleanup;
     }
 
-    for (int y = info_header.height - 1; y >= 0; y--) {
-        uint8_t *row_ptr = image->data + y * row_size;
-        if (fread(row_ptr, row_size, 1, file) != 1) {
-            ESP_LOGE(TAG, "Failed to read row %d", y);
-            free(palette);
-            free(image->data);
-            image->data = NULL;
+    bmp_layout_t layout = {
+        .dst_w = height > width ? frame_h : frame_w,
+        .dst_h = height > width ? frame_w : frame_h
+    };
+
+    int64_t convert_us = 0;
+    if (bpp == 4 && width == layout.dst_w && height == layout.dst_h && opts->dither == EPAPER_DITHER_NONE) {
+        if (!bmp_load_native4(&reader, frame, source, &convert_us)) {
+            goto cleanup;
+        }
+    } else {
+        bmp_plan_layout(&layout, width, height, opts->fit);
+        ESP_LOGI(TAG, "Placing %lux%lu of the image at %u,%u as %ux%u (%s, %s dithering)",
+                 (unsigned long)layout.sw, (unsigned long)layout.sh, layout.dx0, layout.dy0,
+                 layout.dw, layout.dh, bmp_fit_name(opts->fit), epaper_dither_name(opts->dither));
+
+        ret = bmp_load_scaled(&reader, frame, &layout, source, opts->dither, &convert_us);
+        if (ret != ESP_OK) {
             goto cleanup;
         }
     }
 
-    image->width = info_header.width;
-    image->height = info_header.height;
-    image->bits_per_pixel = info_header.bits_per_pixel;
+    image->data = frame;
+    image->width = layout.dst_w;
+    image->height = layout.dst_h;
+    image->bits_per_pixel = bpp;
+
+    _stats.src_width = width;
+    _stats.src_height = height;
+    _stats.bits_per_pixel = bpp;
+    _stats.fit = opts->fit;
+    _stats.dither = opts->dither;
+    _stats.decode_scale = 0;
+    _stats.file_bytes = header.offset + source->row_size * height;
+    _stats.chunks = reader.chunks;
+    _stats.read_us = reader.read_us;
+    _stats.convert_us = convert_us;
+    _stats.elapsed_us = esp_timer_get_time() - start;
 
-    free(palette);
     ret = ESP_OK;
-    ESP_LOGI(TAG, "BMP file loaded successfully");
+    ESP_LOGI(TAG, "BMP file loaded in %lld us (%lu chunks, %lld us reading, %lld us converting)",
+             (long long)_stats.elapsed_us, (unsigned long)_stats.chunks, (long long)_stats.read_us,
+             (long long)_stats.convert_us);
 
 cleanup:
-    if (file) {
-        fclose(file);
-    }
+    heap_caps_free(source);
+    heap_caps_free(reader.buf);
+    fclose(reader.file);
     return ret;
 }
 
-void free_bmp_image(bmp_image_t *image)
+void bmp_record_load_stats(const bmp_load_stats_t *stats)
+{
+    _stats = *stats;
+}
+
+esp_err_t bmp_get_load_stats(bmp_load_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *stats = _stats;
+    return ESP_OK;
+}
+
+esp_err_t load_image_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                                const bmp_load_opts_t *opts, bmp_image_t *image)
 {
-    if (image && image->data) {
-        free(image->data);
-        image->data = NULL;
+    const char *ext = filename != NULL ? strrchr(filename, '.') : NULL;
+
+    if (ext != NULL && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0)) {
+        return load_jpeg_into_frame(filename, frame, frame_w, frame_h, opts, image);
+    }
+    if (ext != NULL && strcasecmp(ext, ".png") == 0) {
+        return load_png_into_frame(filename, frame, frame_w, frame_h, opts, image);
+    }
+    if (ext != NULL && strcasecmp(ext, ".epd") == 0) {
+        return load_epd_into_frame(filename, frame, frame_w, frame_h, image);
+    }
+    return load_bmp_into_frame(filename, frame, frame_w, frame_h, opts, image);
+}
+
+esp_err_t bmp_fit_from_name(const char *name, bmp_fit_t *fit)
+{
+    if (name == NULL || fit == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < sizeof(_fit_names) / sizeof(_fit_names[0]); i++) {
+        if (strcasecmp(name, _fit_names[i]) == 0) {
+            *fit = (bmp_fit_t)i;
+            return ESP_OK;
+        }
     }
+    return ESP_ERR_INVALID_ARG;
+}
+
+const char *bmp_fit_name(bmp_fit_t fit)
+{
+    return (unsigned)fit < sizeof(_fit_names) / sizeof(_fit_names[0]) ? _fit_names[fit] : "unknown";
 }
 
 esp_err_t convert_bmp_to_epaper(bmp_image_t *bmp, uint8_t *epaper_buffer)
@@ -127,25 +688,25 @@ esp_err_t convert_bmp_to_epaper(bmp_image_t *bmp, uint8_t *epaper_buffer)
         ESP_LOGE(TAG, "Invalid parameters for BMP to e-Paper conversion");
         return ESP_ERR_INVALID_ARG;
     }
+    if (bmp->bits_per_pixel != 4 || bmp->width <= 0 || bmp->height <= 0 || (bmp->width % 2)) {
+        ESP_LOGE(TAG, "Only even-width 4-bit images can be converted, got %dx%d at %d bits",
+                 bmp->width, bmp->height, bmp->bits_per_pixel);
+        return ESP_ERR_INVALID_SIZE;
+    }
 
-    uint32_t row_size = ((bmp->width * bmp->bits_per_pixel + 31) / 32) * 4;
+    // Panel codes pass through; the two unused ones and anything above
+    // green become white.
+    uint8_t codes[16];
+    uint8_t lut[256];
+    for (int i = 0; i < 16; i++) {
+        codes[i] = (i <= EPAPER_COLOR_GREEN && i != 4) ? i : EPAPER_COLOR_WHITE;
+    }
+    bmp_build_pair_lut(codes, lut);
 
+    uint32_t row_size = ((bmp->width * bmp->bits_per_pixel + 31) / 32) * 4;
+    uint32_t stride = bmp->width / 2;
     for (int y = 0; y < bmp->height; y++) {
-        uint8_t *row_ptr = bmp->data + y * row_size;
-
-        for (int x = 0; x < bmp->width; x += 2) {
-            uint8_t pixel_data = row_ptr[x / 2];
-            uint8_t pixel1 = (pixel_data >> 4) & 0x0F;
-            uint8_t pixel2 = pixel_data & 0x0F;
-
-            uint32_t epaper_index = y * bmp->width + x;
-            if (epaper_index < bmp->width * bmp->height) {
-                epaper_buffer[epaper_index] = pixel1;
-            }
-            if (x + 1 < bmp->width && epaper_index + 1 < bmp->width * bmp->height) {
-                epaper_buffer[epaper_index + 1] = pixel2;
-            }
-        }
+        bmp_convert_pairs(epaper_buffer + (size_t)y * stride, bmp->data + (size_t)y * row_size, stride, lut);
     }
 
     ESP_LOGI(TAG, "BMP to e-Paper conversion completed");
@@ -2,7 +2,9 @@
 #define BITMAP_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
+#include "epaper_dither.h"
 
 typedef struct {
     unsigned char *data;
@@ -33,8 +35,105 @@ typedef struct {
     uint32_t colors_important;
 } __attribute__((packed)) bmp_info_header_t;
 
-esp_err_t load_bmp_from_sd(const char *filename, bmp_image_t *image);
-void free_bmp_image(bmp_image_t *image);
+// How an image that is not exactly the frame size is placed in it.
+typedef enum {
+    BMP_FIT_CENTER = 0,     // unscaled, centred, cropped where it overflows
+    BMP_FIT_CROP,           // scaled to cover the frame, overflow cropped
+    BMP_FIT_LETTERBOX       // scaled to fit inside the frame, white bars
+} bmp_fit_t;
+
+#define BMP_FIT_DEFAULT     BMP_FIT_LETTERBOX
+
+typedef struct {
+    bmp_fit_t fit;
+    epaper_dither_t dither;
+} bmp_load_opts_t;
+
+#define BMP_LOAD_OPTS_DEFAULT   { .fit = BMP_FIT_DEFAULT, .dither = EPAPER_DITHER_NONE }
+
+typedef struct {
+    int32_t src_width;
+    int32_t src_height;
+    uint16_t bits_per_pixel;
+    bmp_fit_t fit;
+    epaper_dither_t dither;
+    uint8_t decode_scale;       // JPEG: decoded at 1/(1 << decode_scale)
+    uint32_t file_bytes;
+    uint32_t chunks;
+    int64_t read_us;
+    int64_t convert_us;
+    int64_t elapsed_us;
+} bmp_load_stats_t;
+
+// Reads are issued in whole chunks at sector-aligned file offsets, into one
+// chunk-sized buffer in internal RAM.
+#define BMP_SECTOR_SIZE     512
+#define BMP_CHUNK_SIZE      (32 * BMP_SECTOR_SIZE)
+#define BMP_MAX_DIMENSION   8192
+
+// Streams an uncompressed 1, 4, 8, 24 or 32-bit BMP, bottom-up or
+// top-down and of any size, into frame as packed 4bpp panel colour codes.
+// Images taller than wide are laid out as frame_h x frame_w (portrait),
+// others as frame_w x frame_h; image->width and height report the layout
+// so the caller can rotate it onto the panel. Without dithering, palette
+// entries are matched to the nearest panel colour and true-colour pixels
+// go through the 32x32x32 table in epaper_dither. opts may be NULL for
+// the defaults. image->data points at frame on success; the caller keeps
+// ownership, so there is nothing to free.
+esp_err_t load_bmp_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                              const bmp_load_opts_t *opts, bmp_image_t *image);
+esp_err_t bmp_get_load_stats(bmp_load_stats_t *stats);
+
+// Picks the loader by extension: .jpg and .jpeg go to load_jpeg_into_frame,
+// .png to load_png_into_frame, .epd to load_epd_into_frame (which ignores
+// opts), anything else is read as a BMP. Same contract as
+// load_bmp_into_frame.
+esp_err_t load_image_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                                const bmp_load_opts_t *opts, bmp_image_t *image);
+
+// "center", "crop" or "letterbox".
+esp_err_t bmp_fit_from_name(const char *name, bmp_fit_t *fit);
+const char *bmp_fit_name(bmp_fit_t fit);
+
+// Shared with the other image loaders.
+
+// Where the image lands in the frame and which part of the source it shows.
+typedef struct {
+    uint16_t dst_w, dst_h;
+    uint16_t dx0, dy0, dw, dh;
+    uint32_t sx0, sy0, sw, sh;
+} bmp_layout_t;
+
+// Fills in the placement for a src_w x src_h image; dst_w and dst_h must
+// be set by the caller.
+void bmp_plan_layout(bmp_layout_t *layout, uint32_t src_w, uint32_t src_h, bmp_fit_t fit);
+
+// Source row (or column) sampled for output position i, nearest neighbour
+// at pixel centres.
+static inline uint32_t bmp_src_pos(uint32_t i, uint32_t s0, uint32_t sn, uint32_t dn)
+{
+    return s0 + ((2 * i + 1) * sn) / (2 * dn);
+}
+
+// Packs count panel codes, one per byte, into 4bpp at dst.
+void bmp_pack_row(uint8_t *dst, const uint8_t *line, uint16_t count);
+
+// What bmp_get_load_stats reports until the next load.
+void bmp_record_load_stats(const bmp_load_stats_t *stats);
+
+// Maps packed pixel pairs through a 256-entry table, dst[i] = lut[src[i]],
+// a 32-bit word (four bytes, eight pixels) at a time when src and dst share
+// their word alignment. dst may be src.
+void bmp_convert_pairs(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t lut[256]);
+
+// The same a byte at a time; the reference the word version is checked
+// against.
+void bmp_convert_pairs_ref(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t lut[256]);
+
+// Copies a 4-bit image with 32-bit padded rows (bmp->data, top row first)
+// into epaper_buffer in the packed layout the panel takes, width / 2 bytes
+// a row. Nibbles that are not panel colour codes become white. The width
+// must be even.
 esp_err_t convert_bmp_to_epaper(bmp_image_t *bmp, uint8_t *epaper_buffer);
 
 #endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "config_parser.h"
 #include "logger.h"
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -52,6 +53,7 @@ esp_err_t config_parse_file(const char *content, wifi_config_data_t *config) {
     memset(config, 0, sizeof(wifi_config_data_t));
     config->is_valid = false;
     config->ip_mode = IP_MODE_DHCP; // デフォルトはDHCP
+    config->rotation = -1;
 
     char *content_copy = strdup(content);
     if (content_copy == NULL) {
@@ -107,6 +109,9 @@ esp_err_t config_parse_file(const char *content, wifi_config_data_t *config) {
             } else if (strcasecmp(key, "STATIC_DNS") == 0) {
                 strncpy(config->static_dns, value, MAX_IP_LEN - 1);
                 log_info(TAG, "Static DNS: %s", config->static_dns);
+            } else if (strcasecmp(key, "ROTATION") == 0) {
+                config->rotation = atoi(value);
+                log_info(TAG, "Rotation: %d", config->rotation);
             }
         }
 
@@ -25,6 +25,7 @@ typedef struct {
     char static_netmask[MAX_IP_LEN];
     char static_gateway[MAX_IP_LEN];
     char static_dns[MAX_IP_LEN];
+    int rotation;       // degrees, -1 if not set
     bool is_valid;
 } wifi_config_data_t;
 
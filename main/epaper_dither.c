@@ -0,0 +1,377 @@
+#include "epaper_dither.h"
+#include "epaper_driver.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "EPAPER_DITHER";
+
+#define COLOR_LUT_SIZE      (32 * 32 * 32)
+#define ERR_PAD             2       // pixels of slack either side of an error row
+#define BAYER_SPREAD        96      // peak-to-peak threshold offset, 0..255 scale
+
+// The six colours the panel can show. Error diffusion measures its error
+// against these, so they are also what the nearest-colour match targets.
+static const struct {
+    epaper_color_t code;
+    uint8_t r, g, b;
+} _panel_colors[] = {
+    {EPAPER_COLOR_BLACK,    0,   0,   0},
+    {EPAPER_COLOR_WHITE,  255, 255, 255},
+    {EPAPER_COLOR_YELLOW, 255, 255,   0},
+    {EPAPER_COLOR_RED,    255,   0,   0},
+    {EPAPER_COLOR_BLUE,     0,   0, 255},
+    {EPAPER_COLOR_GREEN,    0, 255,   0},
+};
+
+#define PANEL_COLORS    (sizeof(_panel_colors) / sizeof(_panel_colors[0]))
+
+static const uint8_t _bayer8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+static const char *_mode_names[EPAPER_DITHER_COUNT] = {"none", "floyd-steinberg", "atkinson", "bayer"};
+
+static uint8_t *_color_lut = NULL;
+static uint8_t _panel_rgb[16][3];       // indexed by panel code
+static float _linear[256];              // sRGB to linear light
+static float _panel_lab[PANEL_COLORS][3];
+static bool _tables_ready = false;
+
+static float lab_f(float t)
+{
+    return t > 0.008856f ? cbrtf(t) : 7.787f * t + 16.0f / 116.0f;
+}
+
+static void rgb_to_lab(uint8_t r, uint8_t g, uint8_t b, float lab[3])
+{
+    float rl = _linear[r];
+    float gl = _linear[g];
+    float bl = _linear[b];
+
+    // D65 white.
+    float fx = lab_f((0.4124f * rl + 0.3576f * gl + 0.1805f * bl) / 0.95047f);
+    float fy = lab_f(0.2126f * rl + 0.7152f * gl + 0.0722f * bl);
+    float fz = lab_f((0.0193f * rl + 0.1192f * gl + 0.9505f * bl) / 1.08883f);
+
+    lab[0] = 116.0f * fy - 16.0f;
+    lab[1] = 500.0f * (fx - fy);
+    lab[2] = 200.0f * (fy - fz);
+}
+
+static uint8_t nearest_lab(const float lab[3])
+{
+    float best_dist = INFINITY;
+    uint8_t best = EPAPER_COLOR_WHITE;
+
+    for (size_t i = 0; i < PANEL_COLORS; i++) {
+        float dl = lab[0] - _panel_lab[i][0];
+        float da = lab[1] - _panel_lab[i][1];
+        float db = lab[2] - _panel_lab[i][2];
+        float dist = dl * dl + da * da + db * db;
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = _panel_colors[i].code;
+        }
+    }
+    return best;
+}
+
+esp_err_t epaper_dither_tables_init(void)
+{
+    if (_tables_ready) {
+        return ESP_OK;
+    }
+
+    uint8_t *lut = heap_caps_malloc(COLOR_LUT_SIZE, MALLOC_CAP_SPIRAM);
+    if (lut == NULL) {
+        lut = heap_caps_malloc(COLOR_LUT_SIZE, MALLOC_CAP_8BIT);
+    }
+    if (lut == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate colour table");
+        return EPAPER_ERR_MEMORY;
+    }
+
+    int64_t start = esp_timer_get_time();
+
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+        _linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    memset(_panel_rgb, 0xFF, sizeof(_panel_rgb));
+    for (size_t i = 0; i < PANEL_COLORS; i++) {
+        _panel_rgb[_panel_colors[i].code][0] = _panel_colors[i].r;
+        _panel_rgb[_panel_colors[i].code][1] = _panel_colors[i].g;
+        _panel_rgb[_panel_colors[i].code][2] = _panel_colors[i].b;
+        rgb_to_lab(_panel_colors[i].r, _panel_colors[i].g, _panel_colors[i].b, _panel_lab[i]);
+    }
+
+    // Each cell is matched at its centre.
+    for (uint32_t i = 0; i < COLOR_LUT_SIZE; i++) {
+        float lab[3];
+        rgb_to_lab(((i >> 10) << 3) | 4, (((i >> 5) & 31) << 3) | 4, ((i & 31) << 3) | 4, lab);
+        lut[i] = nearest_lab(lab);
+    }
+
+    _color_lut = lut;
+    _tables_ready = true;
+    ESP_LOGI(TAG, "Colour tables built in %lld us", (long long)(esp_timer_get_time() - start));
+    return ESP_OK;
+}
+
+const uint8_t *epaper_color_lut(void)
+{
+    return epaper_dither_tables_init() == ESP_OK ? _color_lut : NULL;
+}
+
+uint8_t epaper_color_nearest(uint8_t r, uint8_t g, uint8_t b)
+{
+    if (epaper_dither_tables_init() != ESP_OK) {
+        return EPAPER_COLOR_WHITE;
+    }
+
+    float lab[3];
+    rgb_to_lab(r, g, b, lab);
+    return nearest_lab(lab);
+}
+
+esp_err_t epaper_dither_from_name(const char *name, epaper_dither_t *mode)
+{
+    if (name == NULL || mode == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    if (strcasecmp(name, "fs") == 0) {
+        *mode = EPAPER_DITHER_FLOYD_STEINBERG;
+        return ESP_OK;
+    }
+    for (int i = 0; i < EPAPER_DITHER_COUNT; i++) {
+        if (strcasecmp(name, _mode_names[i]) == 0) {
+            *mode = (epaper_dither_t)i;
+            return ESP_OK;
+        }
+    }
+    return EPAPER_ERR_INVALID_PARAM;
+}
+
+const char *epaper_dither_name(epaper_dither_t mode)
+{
+    return (unsigned)mode < EPAPER_DITHER_COUNT ? _mode_names[mode] : "unknown";
+}
+
+static size_t err_row_len(const epaper_dither_ctx_t *ctx)
+{
+    return (size_t)(ctx->width + 2 * ERR_PAD) * 3;
+}
+
+static int16_t *err_row(const epaper_dither_ctx_t *ctx, uint32_t y)
+{
+    return ctx->err + (y % ctx->ring_rows) * err_row_len(ctx) + ERR_PAD * 3;
+}
+
+esp_err_t epaper_dither_begin(epaper_dither_ctx_t *ctx, epaper_dither_t mode, uint16_t width)
+{
+    if (ctx == NULL || width == 0 || (unsigned)mode >= EPAPER_DITHER_COUNT) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    esp_err_t ret = epaper_dither_tables_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->mode = mode;
+    ctx->width = width;
+
+    if (mode == EPAPER_DITHER_FLOYD_STEINBERG || mode == EPAPER_DITHER_ATKINSON) {
+        ctx->ring_rows = (mode == EPAPER_DITHER_ATKINSON) ? 3 : 2;
+        ctx->err = heap_caps_calloc(ctx->ring_rows * err_row_len(ctx), sizeof(int16_t), MALLOC_CAP_8BIT);
+        if (ctx->err == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate error rows");
+            return EPAPER_ERR_MEMORY;
+        }
+    }
+    return ESP_OK;
+}
+
+static inline int clamp8(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Errors are kept in 1/16 units. Floyd-Steinberg passes on 7, 3, 5 and
+// 1 sixteenths; Atkinson passes 1/8 to six neighbours and drops the rest.
+static void dither_diffuse(epaper_dither_ctx_t *ctx, const uint8_t *rgb, uint8_t *codes)
+{
+    bool atkinson = (ctx->mode == EPAPER_DITHER_ATKINSON);
+    int16_t *cur = err_row(ctx, ctx->row);
+    int16_t *next = err_row(ctx, ctx->row + 1);
+    int16_t *next2 = atkinson ? err_row(ctx, ctx->row + 2) : NULL;
+
+    for (uint16_t x = 0; x < ctx->width; x++) {
+        int r = clamp8(rgb[0] + ((cur[0] + 8) >> 4));
+        int g = clamp8(rgb[1] + ((cur[1] + 8) >> 4));
+        int b = clamp8(rgb[2] + ((cur[2] + 8) >> 4));
+
+        uint8_t code = _color_lut[EPAPER_COLOR_LUT_INDEX(r, g, b)];
+        codes[x] = code;
+
+        int e[3] = {r - _panel_rgb[code][0], g - _panel_rgb[code][1], b - _panel_rgb[code][2]};
+        for (int c = 0; c < 3; c++) {
+            if (atkinson) {
+                int e2 = e[c] * 2;
+                cur[3 + c] += e2;
+                cur[6 + c] += e2;
+                next[-3 + c] += e2;
+                next[c] += e2;
+                next[3 + c] += e2;
+                next2[c] += e2;
+            } else {
+                cur[3 + c] += e[c] * 7;
+                next[-3 + c] += e[c] * 3;
+                next[c] += e[c] * 5;
+                next[3 + c] += e[c];
+            }
+        }
+
+        rgb += 3;
+        cur += 3;
+        next += 3;
+        if (next2 != NULL) {
+            next2 += 3;
+        }
+    }
+
+    // This row's slot comes round again as the furthest row ahead.
+    memset(err_row(ctx, ctx->row) - ERR_PAD * 3, 0, err_row_len(ctx) * sizeof(int16_t));
+}
+
+static void dither_bayer(epaper_dither_ctx_t *ctx, const uint8_t *rgb, uint8_t *codes)
+{
+    const uint8_t *thresholds = _bayer8[ctx->row & 7];
+
+    for (uint16_t x = 0; x < ctx->width; x++) {
+        int t = ((thresholds[x & 7] * 2 - 63) * BAYER_SPREAD) / 128;
+        int r = clamp8(rgb[0] + t);
+        int g = clamp8(rgb[1] + t);
+        int b = clamp8(rgb[2] + t);
+        codes[x] = _color_lut[EPAPER_COLOR_LUT_INDEX(r, g, b)];
+        rgb += 3;
+    }
+}
+
+void epaper_dither_row(epaper_dither_ctx_t *ctx, const uint8_t *rgb, uint8_t *codes)
+{
+    switch (ctx->mode) {
+        case EPAPER_DITHER_FLOYD_STEINBERG:
+        case EPAPER_DITHER_ATKINSON:
+            dither_diffuse(ctx, rgb, codes);
+            break;
+        case EPAPER_DITHER_BAYER:
+            dither_bayer(ctx, rgb, codes);
+            break;
+        default:
+            for (uint16_t x = 0; x < ctx->width; x++) {
+                codes[x] = _color_lut[EPAPER_COLOR_LUT_INDEX(rgb[0], rgb[1], rgb[2])];
+                rgb += 3;
+            }
+            break;
+    }
+    ctx->row++;
+}
+
+void epaper_dither_end(epaper_dither_ctx_t *ctx)
+{
+    if (ctx != NULL) {
+        heap_caps_free(ctx->err);
+        ctx->err = NULL;
+    }
+}
+
+// A hue sweep across x and a brightness ramp down y, so every mode sees
+// smooth gradients between and beyond the panel colours.
+static void bench_fill_row(uint8_t *rgb, uint16_t width, uint16_t y, uint16_t height)
+{
+    int level = 64 + (160 * y) / height;
+
+    for (uint16_t x = 0; x < width; x++) {
+        int h = (x * 1536) / width;
+        int f = h & 255;
+        int r, g, b;
+        switch (h >> 8) {
+            case 0:  r = 255;     g = f;       b = 0;       break;
+            case 1:  r = 255 - f; g = 255;     b = 0;       break;
+            case 2:  r = 0;       g = 255;     b = f;       break;
+            case 3:  r = 0;       g = 255 - f; b = 255;     break;
+            case 4:  r = f;       g = 0;       b = 255;     break;
+            default: r = 255;     g = 0;       b = 255 - f; break;
+        }
+        rgb[x * 3 + 0] = (r * level) / 255;
+        rgb[x * 3 + 1] = (g * level) / 255;
+        rgb[x * 3 + 2] = (b * level) / 255;
+    }
+}
+
+esp_err_t epaper_dither_bench(uint16_t width, uint16_t height, epaper_dither_bench_t *result)
+{
+    enum { BENCH_ROWS = 16 };
+
+    if (result == NULL || width == 0 || height == 0) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    esp_err_t ret = epaper_dither_tables_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // A handful of distinct rows cycled through, so only the dithering is timed.
+    uint8_t *rgb = heap_caps_malloc((size_t)width * 3 * BENCH_ROWS + width, MALLOC_CAP_8BIT);
+    if (rgb == NULL) {
+        return EPAPER_ERR_MEMORY;
+    }
+    uint8_t *codes = rgb + (size_t)width * 3 * BENCH_ROWS;
+    for (uint16_t i = 0; i < BENCH_ROWS; i++) {
+        bench_fill_row(rgb + (size_t)i * width * 3, width, i * (height / BENCH_ROWS), height);
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->width = width;
+    result->height = height;
+
+    for (int mode = 0; mode < EPAPER_DITHER_COUNT; mode++) {
+        epaper_dither_ctx_t ctx;
+        ret = epaper_dither_begin(&ctx, (epaper_dither_t)mode, width);
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        int64_t start = esp_timer_get_time();
+        for (uint16_t y = 0; y < height; y++) {
+            epaper_dither_row(&ctx, rgb + (size_t)(y % BENCH_ROWS) * width * 3, codes);
+        }
+        result->elapsed_us[mode] = esp_timer_get_time() - start;
+        epaper_dither_end(&ctx);
+
+        result->mpix_per_s[mode] = result->elapsed_us[mode] > 0 ?
+                                   (float)width * height / (float)result->elapsed_us[mode] : 0.0f;
+        ESP_LOGI(TAG, "%-15s %ux%u: %lld us, %.2f Mpixel/s", _mode_names[mode], width, height,
+                 (long long)result->elapsed_us[mode], result->mpix_per_s[mode]);
+    }
+
+    heap_caps_free(rgb);
+    return ret;
+}
@@ -0,0 +1,62 @@
+#ifndef EPAPER_DITHER_H
+#define EPAPER_DITHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef enum {
+    EPAPER_DITHER_NONE = 0,             // nearest colour only
+    EPAPER_DITHER_FLOYD_STEINBERG,
+    EPAPER_DITHER_ATKINSON,
+    EPAPER_DITHER_BAYER,                // 8x8 ordered
+    EPAPER_DITHER_COUNT
+} epaper_dither_t;
+
+// Panel code per 5-bit-per-channel RGB cell, matched in CIELAB.
+#define EPAPER_COLOR_LUT_INDEX(r, g, b)  ((((r) >> 3) << 10) | (((g) >> 3) << 5) | ((b) >> 3))
+
+// Streaming state for one image. Rows go in one at a time, in the order
+// they should be diffused; error diffusion keeps a small ring of error
+// rows (two for Floyd-Steinberg, three for Atkinson) in 1/16 units, so no
+// full-resolution buffer is needed.
+typedef struct {
+    epaper_dither_t mode;
+    uint16_t width;
+    uint32_t row;
+    uint8_t ring_rows;
+    int16_t *err;
+} epaper_dither_ctx_t;
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    int64_t elapsed_us[EPAPER_DITHER_COUNT];
+    float mpix_per_s[EPAPER_DITHER_COUNT];
+} epaper_dither_bench_t;
+
+// Builds the colour tables on first use (a 32 KB table, PSRAM preferred).
+// Everything below calls it, so calling it early only moves the cost.
+esp_err_t epaper_dither_tables_init(void);
+
+// The 32x32x32 table indexed with EPAPER_COLOR_LUT_INDEX, or NULL.
+const uint8_t *epaper_color_lut(void);
+
+// Exact nearest panel code in CIELAB, for palettes and single colours.
+uint8_t epaper_color_nearest(uint8_t r, uint8_t g, uint8_t b);
+
+// "none", "floyd-steinberg" (or "fs"), "atkinson" or "bayer".
+esp_err_t epaper_dither_from_name(const char *name, epaper_dither_t *mode);
+const char *epaper_dither_name(epaper_dither_t mode);
+
+esp_err_t epaper_dither_begin(epaper_dither_ctx_t *ctx, epaper_dither_t mode, uint16_t width);
+
+// Converts width R,G,B triplets into one panel code per byte.
+void epaper_dither_row(epaper_dither_ctx_t *ctx, const uint8_t *rgb, uint8_t *codes);
+
+void epaper_dither_end(epaper_dither_ctx_t *ctx);
+
+// Times each mode over a synthetic width x height photo-like gradient.
+esp_err_t epaper_dither_bench(uint16_t width, uint16_t height, epaper_dither_bench_t *result);
+
+#endif
@@ -0,0 +1,306 @@
+#include "epaper_draw.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const char *TAG = "EPAPER_DRAW";
+
+#define CANVAS_STRIDE(c)    ((c)->width / 2)
+
+static inline uint8_t px_get(const uint8_t *row, int x)
+{
+    return (x & 1) ? (row[x >> 1] & 0x0F) : (row[x >> 1] >> 4);
+}
+
+static inline void px_put(uint8_t *row, int x, uint8_t c)
+{
+    uint8_t *p = &row[x >> 1];
+    *p = (x & 1) ? ((*p & 0xF0) | c) : ((*p & 0x0F) | (c << 4));
+}
+
+// Fills pixels [x0, x1) of a row: nibbles at the edges, bytes up to the
+// first word boundary, then whole 32-bit words.
+static void span_fill(uint8_t *row, int x0, int x1, uint8_t c)
+{
+    if (x0 >= x1) {
+        return;
+    }
+
+    if (x0 & 1) {
+        px_put(row, x0++, c);
+    }
+    if (x0 < x1 && (x1 & 1)) {
+        px_put(row, --x1, c);
+    }
+
+    uint8_t cc = c | (c << 4);
+    uint8_t *p = row + (x0 >> 1);
+    size_t n = (size_t)(x1 - x0) >> 1;
+
+    while (n > 0 && ((uintptr_t)p & 3)) {
+        *p++ = cc;
+        n--;
+    }
+
+    uint32_t cw = cc * 0x01010101u;
+    uint32_t *w = (uint32_t *)p;
+    while (n >= 4) {
+        *w++ = cw;
+        n -= 4;
+    }
+
+    p = (uint8_t *)w;
+    while (n-- > 0) {
+        *p++ = cc;
+    }
+}
+
+// Copies n pixels from src pixel sx to dst pixel dx. With equal nibble
+// phase the middle is a plain byte copy; otherwise each byte is rebuilt
+// from two neighbouring source bytes.
+static void span_copy(uint8_t *dst, int dx, const uint8_t *src, int sx, int n)
+{
+    if (n <= 0) {
+        return;
+    }
+
+    if (dx & 1) {
+        px_put(dst, dx++, px_get(src, sx++));
+        n--;
+    }
+
+    uint8_t *d = dst + (dx >> 1);
+    size_t bytes = (size_t)n >> 1;
+
+    if ((sx & 1) == 0) {
+        memcpy(d, src + (sx >> 1), bytes);
+    } else {
+        const uint8_t *s = src + (sx >> 1);
+        for (size_t i = 0; i < bytes; i++) {
+            d[i] = (uint8_t)((s[i] << 4) | (s[i + 1] >> 4));
+        }
+    }
+
+    if (n & 1) {
+        px_put(dst, dx + n - 1, px_get(src, sx + n - 1));
+    }
+}
+
+// Clips a rectangle to the canvas; false if nothing is left.
+static bool clip_rect(const epaper_canvas_t *canvas, int *x, int *y, int *w, int *h)
+{
+    if (*x < 0) {
+        *w += *x;
+        *x = 0;
+    }
+    if (*y < 0) {
+        *h += *y;
+        *y = 0;
+    }
+    if (*x + *w > canvas->width) {
+        *w = canvas->width - *x;
+    }
+    if (*y + *h > canvas->height) {
+        *h = canvas->height - *y;
+    }
+
+    return *w > 0 && *h > 0;
+}
+
+esp_err_t epaper_canvas_init(epaper_canvas_t *canvas, uint8_t *buf, uint16_t width, uint16_t height)
+{
+    if (canvas == NULL || buf == NULL || width == 0 || height == 0 || (width & 1)) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    canvas->buf = buf;
+    canvas->width = width;
+    canvas->height = height;
+    return ESP_OK;
+}
+
+void epaper_draw_fill_rect(epaper_canvas_t *canvas, int x, int y, int w, int h, epaper_color_t color)
+{
+    if (!clip_rect(canvas, &x, &y, &w, &h)) {
+        return;
+    }
+
+    uint8_t c = epaper_color_code(color);
+    int stride = CANVAS_STRIDE(canvas);
+
+    // Full-width rectangles are one contiguous run.
+    if (w == canvas->width) {
+        memset(canvas->buf + (size_t)y * stride, c | (c << 4), (size_t)h * stride);
+        return;
+    }
+
+    uint8_t *row = canvas->buf + (size_t)y * stride;
+    for (int r = 0; r < h; r++, row += stride) {
+        span_fill(row, x, x + w, c);
+    }
+}
+
+void epaper_draw_hline(epaper_canvas_t *canvas, int x, int y, int w, epaper_color_t color)
+{
+    epaper_draw_fill_rect(canvas, x, y, w, 1, color);
+}
+
+void epaper_draw_vline(epaper_canvas_t *canvas, int x, int y, int h, epaper_color_t color)
+{
+    int w = 1;
+    if (!clip_rect(canvas, &x, &y, &w, &h)) {
+        return;
+    }
+
+    uint8_t c = epaper_color_code(color);
+    int stride = CANVAS_STRIDE(canvas);
+    uint8_t keep = (x & 1) ? 0xF0 : 0x0F;
+    uint8_t set = (x & 1) ? c : (c << 4);
+
+    uint8_t *p = canvas->buf + (size_t)y * stride + (x >> 1);
+    for (int r = 0; r < h; r++, p += stride) {
+        *p = (*p & keep) | set;
+    }
+}
+
+void epaper_draw_rect(epaper_canvas_t *canvas, int x, int y, int w, int h, epaper_color_t color)
+{
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    epaper_draw_hline(canvas, x, y, w, color);
+    if (h > 1) {
+        epaper_draw_hline(canvas, x, y + h - 1, w, color);
+    }
+    if (h > 2) {
+        epaper_draw_vline(canvas, x, y + 1, h - 2, color);
+        if (w > 1) {
+            epaper_draw_vline(canvas, x + w - 1, y + 1, h - 2, color);
+        }
+    }
+}
+
+// Clips a blit destination and moves the source origin by the same amount.
+static bool clip_blit(const epaper_canvas_t *canvas, int *dx, int *dy, int *sx, int *sy, int *w, int *h)
+{
+    int x0 = *dx;
+    int y0 = *dy;
+
+    if (!clip_rect(canvas, dx, dy, w, h)) {
+        return false;
+    }
+
+    *sx += *dx - x0;
+    *sy += *dy - y0;
+    return true;
+}
+
+void epaper_draw_blit(epaper_canvas_t *canvas, int dx, int dy,
+                      const uint8_t *src, int src_stride, int sx, int sy, int w, int h)
+{
+    if (src == NULL || !clip_blit(canvas, &dx, &dy, &sx, &sy, &w, &h)) {
+        return;
+    }
+
+    int stride = CANVAS_STRIDE(canvas);
+    uint8_t *drow = canvas->buf + (size_t)dy * stride;
+    const uint8_t *srow = src + (size_t)sy * src_stride;
+
+    for (int r = 0; r < h; r++, drow += stride, srow += src_stride) {
+        span_copy(drow, dx, srow, sx, w);
+    }
+}
+
+static inline bool mask_bit(const uint8_t *mrow, int i)
+{
+    return (mrow[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+void epaper_draw_blit_masked(epaper_canvas_t *canvas, int dx, int dy,
+                             const uint8_t *src, int src_stride, int sx, int sy, int w, int h,
+                             const uint8_t *mask, int mask_stride)
+{
+    if (src == NULL || mask == NULL) {
+        return;
+    }
+
+    int x0 = dx;
+    int y0 = dy;
+    if (!clip_blit(canvas, &dx, &dy, &sx, &sy, &w, &h)) {
+        return;
+    }
+
+    // Mask coordinates follow the clipped area.
+    int mx = dx - x0;
+    int my = dy - y0;
+    int stride = CANVAS_STRIDE(canvas);
+
+    for (int r = 0; r < h; r++) {
+        uint8_t *drow = canvas->buf + (size_t)(dy + r) * stride;
+        const uint8_t *srow = src + (size_t)(sy + r) * src_stride;
+        const uint8_t *mrow = mask + (size_t)(my + r) * mask_stride;
+        int end = mx + w;
+        int i = mx;
+
+        // Copy each run of set mask bits as one span, skipping whole
+        // empty or full mask bytes at a time.
+        while (i < end) {
+            while (i < end && !mask_bit(mrow, i)) {
+                i += ((i & 7) == 0 && mrow[i >> 3] == 0x00) ? 8 : 1;
+            }
+            if (i >= end) {
+                break;
+            }
+
+            int start = i;
+            while (i < end && mask_bit(mrow, i)) {
+                i += ((i & 7) == 0 && mrow[i >> 3] == 0xFF) ? 8 : 1;
+            }
+            if (i > end) {
+                i = end;
+            }
+
+            span_copy(drow, dx + (start - mx), srow, sx + (start - mx), i - start);
+        }
+    }
+}
+
+esp_err_t epaper_draw_bench(epaper_canvas_t *canvas, int w, int h, uint32_t iterations,
+                            epaper_draw_bench_t *result)
+{
+    if (canvas == NULL || result == NULL || iterations == 0 ||
+        w <= 0 || h <= 0 || w > canvas->width || h > canvas->height) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    // Start on an odd column so both paths have to handle nibble edges.
+    int x = (canvas->width - w) > 0 ? 1 : 0;
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++) {
+        epaper_color_t color = (i & 1) ? EPAPER_COLOR_RED : EPAPER_COLOR_BLUE;
+        for (int yy = 0; yy < h; yy++) {
+            for (int xx = x; xx < x + w; xx++) {
+                epaper_set_pixel(canvas->buf, xx, yy, color, canvas->width, canvas->height);
+            }
+        }
+    }
+    result->pixel_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++) {
+        epaper_color_t color = (i & 1) ? EPAPER_COLOR_RED : EPAPER_COLOR_BLUE;
+        epaper_draw_fill_rect(canvas, x, 0, w, h, color);
+    }
+    result->span_us = esp_timer_get_time() - start;
+
+    result->iterations = iterations;
+    result->speedup = (result->span_us > 0) ? (float)result->pixel_us / (float)result->span_us : 0.0f;
+
+    ESP_LOGI(TAG, "fill %dx%d x%lu: set_pixel %lld us, span %lld us (%.1fx)",
+             w, h, (unsigned long)iterations, (long long)result->pixel_us,
+             (long long)result->span_us, result->speedup);
+
+    return ESP_OK;
+}
@@ -0,0 +1,47 @@
+#ifndef EPAPER_DRAW_H
+#define EPAPER_DRAW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "epaper_driver.h"
+
+// A packed 4bpp surface: two pixels per byte, the even pixel in the high
+// nibble, width/2 bytes per row. Width must be even.
+typedef struct {
+    uint8_t *buf;
+    uint16_t width;
+    uint16_t height;
+} epaper_canvas_t;
+
+typedef struct {
+    uint32_t iterations;
+    int64_t pixel_us;
+    int64_t span_us;
+    float speedup;
+} epaper_draw_bench_t;
+
+esp_err_t epaper_canvas_init(epaper_canvas_t *canvas, uint8_t *buf, uint16_t width, uint16_t height);
+
+// All primitives clip against the canvas; coordinates may be negative.
+void epaper_draw_fill_rect(epaper_canvas_t *canvas, int x, int y, int w, int h, epaper_color_t color);
+void epaper_draw_hline(epaper_canvas_t *canvas, int x, int y, int w, epaper_color_t color);
+void epaper_draw_vline(epaper_canvas_t *canvas, int x, int y, int h, epaper_color_t color);
+void epaper_draw_rect(epaper_canvas_t *canvas, int x, int y, int w, int h, epaper_color_t color);
+
+// Copies a w x h area starting at (sx, sy) of a packed 4bpp source with
+// src_stride bytes per row to (dx, dy).
+void epaper_draw_blit(epaper_canvas_t *canvas, int dx, int dy,
+                      const uint8_t *src, int src_stride, int sx, int sy, int w, int h);
+
+// As epaper_draw_blit, but only pixels whose bit is set in a 1bpp mask
+// (MSB first, mask_stride bytes per row, aligned with the w x h area) are copied.
+void epaper_draw_blit_masked(epaper_canvas_t *canvas, int dx, int dy,
+                             const uint8_t *src, int src_stride, int sx, int sy, int w, int h,
+                             const uint8_t *mask, int mask_stride);
+
+// Times filling a w x h rectangle with epaper_set_pixel against epaper_draw_fill_rect.
+esp_err_t epaper_draw_bench(epaper_canvas_t *canvas, int w, int h, uint32_t iterations,
+                            epaper_draw_bench_t *result);
+
+#endif
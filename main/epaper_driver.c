@@ -1,454 +1,1574 @@
 #include "epaper_driver.h"
+#include "epaper_transport.h"
+#include "gdep073e01.h"
+#include "framebuffer.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
 #include <string.h>
 
 static const char *TAG = "EPAPER";
 
 #define EPAPER_WIDTH               800
 #define EPAPER_HEIGHT              480
+#define EPAPER_ROW_BYTES           (EPAPER_WIDTH / 2)
 #define MAX_DISPLAY_BUFFER_SIZE    (EPAPER_WIDTH * EPAPER_HEIGHT / 2)
 
+#define EPAPER_XFER_CHUNK_SIZE     EPAPER_TRANSPORT_MAX_SEGMENT
+#define EPAPER_XFER_QUEUE_DEPTH    3
+// Bands are rendered straight into the staging buffers, so one band can
+// be at most one chunk.
+#define EPAPER_BAND_MAX_ROWS       (EPAPER_XFER_CHUNK_SIZE / EPAPER_ROW_BYTES)
+#define EPAPER_BAND_DEFAULT_ROWS   8
+#define EPAPER_BUSY_LOG_SIZE       32
+#define EPAPER_TIMING_RING_SIZE    8
+#define EPAPER_BURST_MAX_CMDS      16
+
+#define EPAPER_REFRESH_TASK_STACK  4096
+#define EPAPER_REFRESH_TASK_PRIO   5
+#define EPAPER_IDLE_SLEEP_MS       (5 * 60 * 1000)
+
 #define EPAPER_CMD_POWER_ON        0x04
 #define EPAPER_CMD_POWER_OFF       0x02
-#define EPAPER_CMD_PANEL_SETTING   0x00
-#define EPAPER_CMD_RESOLUTION      0x61
 #define EPAPER_CMD_DATA_START      0x10
 #define EPAPER_CMD_DISPLAY_REFRESH 0x12
 #define EPAPER_CMD_DEEP_SLEEP      0x07
-#define EPAPER_CMD_PSR_1           0xAA
-#define EPAPER_CMD_PSR_2           0x01
-#define EPAPER_CMD_POF             0x05
-#define EPAPER_CMD_PFS             0x08
-#define EPAPER_CMD_PON             0x06
-#define EPAPER_CMD_PSET            0x03
-#define EPAPER_CMD_TSCON           0x60
-#define EPAPER_CMD_TCON            0xE0
-#define EPAPER_CMD_CDI             0x30
-#define EPAPER_CMD_PLL             0x50
-#define EPAPER_CMD_AUTO_MEASURING  0x84
-
-static bool _init_display_done = false;
-static uint8_t _pixel_buffer[MAX_DISPLAY_BUFFER_SIZE];
+#define EPAPER_CMD_PARTIAL_WINDOW  0x83
+#define EPAPER_CMD_PARTIAL_IN      0x91
+#define EPAPER_CMD_PARTIAL_OUT     0x92
+
+// Partial windows start and end on 8 pixel (4 byte) boundaries.
+#define EPAPER_WINDOW_ALIGN_BYTES  4
+#define EPAPER_MAX_DIRTY_RECTS     8
+#define EPAPER_DIRTY_ROW_GAP       8
+#define EPAPER_DIRTY_MAX_PERCENT   60
+
+// The host build links a simulated panel in place of the SPI backend.
+#ifndef EPAPER_DEFAULT_TRANSPORT
+#define EPAPER_DEFAULT_TRANSPORT   epaper_transport_spi
+#endif
+extern const epaper_transport_t EPAPER_DEFAULT_TRANSPORT;
+
+// The session owns the transport for the life of the firmware; the
+// controller is only re-initialised when it has actually lost its
+// register state (power-up, reset or deep sleep).
+static epaper_handle_t _session;
+static bool _session_open = false;
+static const epaper_transport_t *_transport = NULL;
+static volatile epaper_power_state_t _power_state = EPAPER_POWER_UNINITIALIZED;
+static uint32_t _idle_sleep_ms = EPAPER_IDLE_SLEEP_MS;
+static TickType_t _last_activity = 0;
+static int64_t _init_time_us = 0;
+
+// Hash of the frame the panel currently shows, so identical frames can be
+// skipped without a 20 s refresh. _pending_hash belongs to the frame that
+// has been transferred but whose refresh has not completed yet.
+static uint32_t _committed_hash = 0;
+static bool _committed_valid = false;
+static uint32_t _pending_hash = 0;
+static bool _pending_valid = false;
+static bool _last_unchanged = false;
+// Copy of the last frame sent to the controller. _ram_synced means the
+// controller RAM still holds it (lost on reset and deep sleep), which the
+// windowed transfers of partial updates depend on.
+static uint8_t *_shadow_frame = NULL;
+static bool _shadow_valid = false;
+static bool _ram_synced = false;
+static bool _window_active = false;
+static int64_t _full_xfer_us = 0;
+static int64_t _full_refresh_us = 0;
+static epaper_partial_stats_t _partial_stats;
+
+// Banded rendering: the frame is produced _page_height rows at a time by a
+// caller callback while earlier bands are still on the wire.
 static uint16_t _current_page = 0;
 static uint16_t _page_height = 0;
 static uint16_t _pages = 0;
 
+typedef struct {
+    epaper_band_render_fn_t render;
+    void *ctx;
+    esp_err_t result;           // first render error; the refresh is skipped
+    epaper_hash_t hash;         // of the bands sent so far
+} epaper_band_src_t;
+
+// DMA-capable staging buffers for the pixel data stream. While up to
+// EPAPER_XFER_QUEUE_DEPTH chunks are in flight, the next one is copied in.
+static uint8_t *_xfer_stage[EPAPER_XFER_QUEUE_DEPTH];
+static epaper_xfer_mode_t _xfer_mode = EPAPER_XFER_QUEUED;
+static epaper_xfer_stats_t _xfer_stats;
+
+// Command bursts are queued from here: one command and one data segment
+// per entry, with the data copied out of flash into DMA-capable memory.
+static uint8_t _burst_cmds[EPAPER_BURST_MAX_CMDS];
+static uint8_t _burst_data[EPAPER_BURST_MAX_CMDS][8];
+
+static epaper_busy_stats_t _busy_stats;
+static epaper_busy_record_t _busy_log[EPAPER_BUSY_LOG_SIZE];
+static uint32_t _busy_log_head = 0;
+
+// Per-update timing: phases are appended to _timing_cur while the panel
+// lock is held, and the finished record is pushed into the ring.
+static epaper_timing_record_t _timing_cur;
+static bool _timing_active = false;
+static uint32_t _timing_seq = 0;
+static epaper_timing_record_t _timing_ring[EPAPER_TIMING_RING_SIZE];
+static uint32_t _timing_head = 0;
+static portMUX_TYPE _timing_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Held from the start of a pixel transfer until the refresh that follows
+// it has finished; the refresh task releases it for async updates.
+static SemaphoreHandle_t _panel_sem = NULL;
+// Task holding the panel through epaper_claim_update, until its next async
+// display call takes the hold over or it releases the claim.
+static TaskHandle_t _claim_owner = NULL;
+static volatile epaper_status_t _status = EPAPER_STATUS_POWERED_OFF;
+static QueueHandle_t _refresh_queue = NULL;
+static TaskHandle_t _refresh_task = NULL;
+
+typedef struct {
+    epaper_handle_t *handle;
+    bool partial_update;
+    epaper_done_cb_t done_cb;
+    void *cb_arg;
+} epaper_refresh_job_t;
+
+typedef void (*epaper_fill_fn_t)(uint8_t *dst, size_t offset, size_t len, void *ctx);
+
+static esp_err_t epaper_start_refresh_task(void);
+static void epaper_do_sleep(epaper_handle_t *handle);
+
 static esp_err_t epaper_send_command(epaper_handle_t *handle, uint8_t cmd)
 {
-    gpio_set_level(handle->dc_pin, 0);
-    gpio_set_level(handle->cs_pin, 0);
+    return _transport->write(handle, false, &cmd, 1);
+}
 
-    spi_transaction_t trans = {
-        .length = 8,
-        .tx_buffer = &cmd
-    };
+static esp_err_t epaper_send_data(epaper_handle_t *handle, const uint8_t *data, size_t len)
+{
+    return _transport->write(handle, true, data, len);
+}
 
-    esp_err_t ret = spi_device_transmit(handle->spi, &trans);
-    gpio_set_level(handle->cs_pin, 1);
-    gpio_set_level(handle->dc_pin, 1);
+#define XXH_PRIME32_1  0x9E3779B1U
+#define XXH_PRIME32_2  0x85EBCA77U
+#define XXH_PRIME32_3  0xC2B2AE3DU
+#define XXH_PRIME32_4  0x27D4EB2FU
+#define XXH_PRIME32_5  0x165667B1U
 
-    return ret;
+static inline uint32_t xxh_rotl(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
 }
 
-static esp_err_t epaper_send_data(epaper_handle_t *handle, const uint8_t *data, size_t len)
+static inline uint32_t xxh_read32(const uint8_t *p)
 {
-    gpio_set_level(handle->dc_pin, 1);
-    gpio_set_level(handle->cs_pin, 0);
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
 
-    spi_transaction_t trans = {
-        .length = len * 8,
-        .tx_buffer = data
-    };
+static inline uint32_t xxh_round(uint32_t acc, uint32_t input)
+{
+    acc += input * XXH_PRIME32_2;
+    acc = xxh_rotl(acc, 13);
+    return acc * XXH_PRIME32_1;
+}
+
+// XXH32 with seed 0, consuming the data one 32-bit word per lane. Whole
+// 16-byte stripes go straight from data; only a partial one is buffered.
+void epaper_hash_begin(epaper_hash_t *state)
+{
+    state->v[0] = XXH_PRIME32_1 + XXH_PRIME32_2;
+    state->v[1] = XXH_PRIME32_2;
+    state->v[2] = 0;
+    state->v[3] = 0 - XXH_PRIME32_1;
+    state->buffered = 0;
+    state->total = 0;
+}
+
+static inline void xxh_stripe(uint32_t v[4], const uint8_t *p)
+{
+    v[0] = xxh_round(v[0], xxh_read32(p));
+    v[1] = xxh_round(v[1], xxh_read32(p + 4));
+    v[2] = xxh_round(v[2], xxh_read32(p + 8));
+    v[3] = xxh_round(v[3], xxh_read32(p + 12));
+}
+
+void epaper_hash_update(epaper_hash_t *state, const uint8_t *data, size_t len)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+
+    state->total += len;
+
+    if (state->buffered != 0) {
+        size_t take = sizeof(state->buf) - state->buffered;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(state->buf + state->buffered, p, take);
+        state->buffered += take;
+        p += take;
+        if (state->buffered < sizeof(state->buf)) {
+            return;
+        }
+        xxh_stripe(state->v, state->buf);
+        state->buffered = 0;
+    }
+
+    while (end - p >= 16) {
+        xxh_stripe(state->v, p);
+        p += 16;
+    }
+
+    memcpy(state->buf, p, end - p);
+    state->buffered = end - p;
+}
+
+uint32_t epaper_hash_end(const epaper_hash_t *state)
+{
+    const uint8_t *p = state->buf;
+    const uint8_t *end = state->buf + state->buffered;
+    uint32_t h;
+
+    if (state->total >= 16) {
+        h = xxh_rotl(state->v[0], 1) + xxh_rotl(state->v[1], 7) + xxh_rotl(state->v[2], 12) +
+            xxh_rotl(state->v[3], 18);
+    } else {
+        h = XXH_PRIME32_5;
+    }
+
+    h += (uint32_t)state->total;
+
+    while (p + 4 <= end) {
+        h += xxh_read32(p) * XXH_PRIME32_3;
+        h = xxh_rotl(h, 17) * XXH_PRIME32_4;
+        p += 4;
+    }
+
+    while (p < end) {
+        h += (*p) * XXH_PRIME32_5;
+        h = xxh_rotl(h, 11) * XXH_PRIME32_1;
+        p++;
+    }
+
+    h ^= h >> 15;
+    h *= XXH_PRIME32_2;
+    h ^= h >> 13;
+    h *= XXH_PRIME32_3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+uint32_t epaper_frame_hash(const uint8_t *buf, size_t len)
+{
+    epaper_hash_t state;
+
+    epaper_hash_begin(&state);
+    epaper_hash_update(&state, buf, len);
+    return epaper_hash_end(&state);
+}
+
+static esp_err_t epaper_lock(TickType_t timeout)
+{
+    if (_panel_sem == NULL) {
+        return ESP_OK;
+    }
+
+    return xSemaphoreTake(_panel_sem, timeout) == pdTRUE ? ESP_OK : EPAPER_ERR_BUSY;
+}
+
+static void epaper_unlock(void)
+{
+    if (_panel_sem != NULL) {
+        xSemaphoreGive(_panel_sem);
+    }
+}
+
+static bool epaper_claimed_by_me(void)
+{
+    return _claim_owner != NULL && _claim_owner == xTaskGetCurrentTaskHandle();
+}
+
+esp_err_t epaper_claim_update(void)
+{
+    if (epaper_lock(0) != ESP_OK) {
+        return EPAPER_ERR_BUSY;
+    }
+
+    _claim_owner = xTaskGetCurrentTaskHandle();
+    return ESP_OK;
+}
+
+void epaper_release_update(void)
+{
+    if (epaper_claimed_by_me()) {
+        _claim_owner = NULL;
+        epaper_unlock();
+    }
+}
+
+// Takes the panel for an async update without waiting: the caller's own
+// claim if it holds one, otherwise the lock if nobody has it right now.
+static esp_err_t epaper_lock_update(void)
+{
+    if (epaper_claimed_by_me()) {
+        _claim_owner = NULL;
+        return ESP_OK;
+    }
+
+    return epaper_lock(0);
+}
+
+// Starts a timing record unless one is already open, so an update that
+// falls back to another path keeps a single record.
+static void epaper_timing_begin(const char *kind)
+{
+    if (_timing_active) {
+        return;
+    }
+
+    memset(&_timing_cur, 0, sizeof(_timing_cur));
+    _timing_cur.seq = ++_timing_seq;
+    _timing_cur.kind = kind;
+    _timing_cur.start_us = esp_timer_get_time();
+    _timing_active = true;
+}
+
+static void epaper_timing_add(const char *name, int64_t start_us, int64_t duration_us, bool timed_out)
+{
+    if (!_timing_active || _timing_cur.phase_count >= EPAPER_TIMING_MAX_PHASES) {
+        return;
+    }
+
+    epaper_timing_phase_t *phase = &_timing_cur.phases[_timing_cur.phase_count++];
+    phase->name = name;
+    phase->start_us = (uint32_t)(start_us - _timing_cur.start_us);
+    phase->duration_us = (uint32_t)duration_us;
+    phase->timed_out = timed_out;
+}
+
+static void epaper_timing_end(esp_err_t result)
+{
+    if (!_timing_active) {
+        return;
+    }
 
-    esp_err_t ret = spi_device_transmit(handle->spi, &trans);
-    gpio_set_level(handle->cs_pin, 1);
+    _timing_cur.total_us = (uint32_t)(esp_timer_get_time() - _timing_cur.start_us);
+    _timing_cur.result = result;
+    _timing_active = false;
 
+    portENTER_CRITICAL(&_timing_mux);
+    _timing_ring[_timing_head % EPAPER_TIMING_RING_SIZE] = _timing_cur;
+    _timing_head++;
+    portEXIT_CRITICAL(&_timing_mux);
+
+    ESP_LOGI(TAG, "Update #%lu (%s): %lu us, %u phases", (unsigned long)_timing_cur.seq,
+             _timing_cur.kind, (unsigned long)_timing_cur.total_us, _timing_cur.phase_count);
+}
+
+static void epaper_busy_record(const char *phase, int64_t duration_us, bool timed_out)
+{
+    epaper_timing_add(phase, esp_timer_get_time() - duration_us, duration_us, timed_out);
+
+    epaper_busy_record_t *rec = &_busy_log[_busy_log_head % EPAPER_BUSY_LOG_SIZE];
+    rec->phase = phase;
+    rec->duration_us = duration_us;
+    rec->timed_out = timed_out;
+    _busy_log_head++;
+
+    _busy_stats.count++;
+    _busy_stats.last_us = duration_us;
+    _busy_stats.total_us += duration_us;
+    if (duration_us > _busy_stats.max_us) {
+        _busy_stats.max_us = duration_us;
+    }
+    if (timed_out) {
+        _busy_stats.timeouts++;
+    }
+
+    ESP_LOGD(TAG, "BUSY %s: %lld us%s", phase, (long long)duration_us, timed_out ? " (timeout)" : "");
+}
+
+static esp_err_t epaper_wait_busy_phase(epaper_handle_t *handle, uint32_t timeout_ms, const char *phase)
+{
+    if (handle == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    if (_transport == NULL) {
+        return EPAPER_ERR_INIT;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = _transport->wait_busy(handle, timeout_ms);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Timeout waiting for busy signal");
+    }
+
+    epaper_busy_record(phase, esp_timer_get_time() - start, ret != ESP_OK);
     return ret;
 }
 
+static esp_err_t epaper_alloc_xfer_buffers(void)
+{
+    for (int i = 0; i < EPAPER_XFER_QUEUE_DEPTH; i++) {
+        if (_xfer_stage[i] == NULL) {
+            _xfer_stage[i] = heap_caps_malloc(EPAPER_XFER_CHUNK_SIZE, MALLOC_CAP_DMA);
+            if (_xfer_stage[i] == NULL) {
+                ESP_LOGE(TAG, "Failed to allocate DMA staging buffer %d", i);
+                return EPAPER_ERR_MEMORY;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+static void epaper_free_xfer_buffers(void)
+{
+    for (int i = 0; i < EPAPER_XFER_QUEUE_DEPTH; i++) {
+        heap_caps_free(_xfer_stage[i]);
+        _xfer_stage[i] = NULL;
+    }
+}
+
+static void epaper_fill_from_buffer(uint8_t *dst, size_t offset, size_t len, void *ctx)
+{
+    memcpy(dst, (const uint8_t *)ctx + offset, len);
+}
+
+static esp_err_t epaper_stream_data(epaper_handle_t *handle, size_t total, size_t chunk,
+                                    epaper_fill_fn_t fill, void *ctx)
+{
+    esp_err_t ret = ESP_OK;
+    size_t inflight = 0;
+    size_t slot = 0;
+    size_t chunks = 0;
+    int64_t start = esp_timer_get_time();
+
+    for (size_t offset = 0; offset < total; offset += chunk) {
+        size_t len = (offset + chunk > total) ? (total - offset) : chunk;
+
+        if (_xfer_mode == EPAPER_XFER_BLOCKING) {
+            fill(_xfer_stage[0], offset, len, ctx);
+            ret = _transport->write(handle, true, _xfer_stage[0], len);
+            if (ret != ESP_OK) {
+                break;
+            }
+            chunks++;
+            continue;
+        }
+
+        // Reclaim the oldest slot before overwriting its staging buffer.
+        if (inflight == EPAPER_XFER_QUEUE_DEPTH) {
+            ret = _transport->reclaim(handle);
+            if (ret != ESP_OK) {
+                break;
+            }
+            inflight--;
+        }
+
+        fill(_xfer_stage[slot], offset, len, ctx);
+
+        ret = _transport->queue(handle, true, _xfer_stage[slot], len);
+        if (ret != ESP_OK) {
+            break;
+        }
+        inflight++;
+        chunks++;
+        slot = (slot + 1) % EPAPER_XFER_QUEUE_DEPTH;
+    }
+
+    while (inflight > 0) {
+        if (_transport->reclaim(handle) != ESP_OK) {
+            break;
+        }
+        inflight--;
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Pixel data transfer failed: %s", esp_err_to_name(ret));
+        return EPAPER_ERR_SPI;
+    }
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    epaper_timing_add("DTM", start, elapsed, false);
+    _xfer_stats.mode = _xfer_mode;
+    _xfer_stats.bytes = total;
+    _xfer_stats.chunks = chunks;
+    _xfer_stats.elapsed_us = elapsed;
+    _xfer_stats.mbps = (elapsed > 0) ? (float)total / (float)elapsed : 0.0f;
+
+    ESP_LOGI(TAG, "Pixel data: %u bytes in %u chunks, %lld us (%.2f MB/s, %s)",
+             (unsigned)total, (unsigned)chunks, (long long)elapsed, _xfer_stats.mbps,
+             _xfer_mode == EPAPER_XFER_QUEUED ? "queued" : "blocking");
+
+    return ESP_OK;
+}
+
 static esp_err_t epaper_reset(epaper_handle_t *handle)
 {
     if (handle->rst_pin >= 0) {
-        gpio_set_level(handle->rst_pin, 0);
+        int64_t start = esp_timer_get_time();
+        _transport->set_reset(handle, false);
         vTaskDelay(20 / portTICK_PERIOD_MS);
-        gpio_set_level(handle->rst_pin, 1);
+        _transport->set_reset(handle, true);
         vTaskDelay(20 / portTICK_PERIOD_MS);
+        epaper_timing_add("RST", start, esp_timer_get_time() - start, false);
+    }
+    return ESP_OK;
+}
+
+static bool epaper_needs_init(void)
+{
+    return _power_state == EPAPER_POWER_UNINITIALIZED || _power_state == EPAPER_POWER_DEEP_SLEEP;
+}
+
+// Queues one segment, first reclaiming the oldest when the transport
+// already has EPAPER_TRANSPORT_QUEUE_DEPTH in flight.
+static esp_err_t epaper_queue_segment(epaper_handle_t *handle, bool dc, const uint8_t *data, size_t len,
+                                      size_t *inflight)
+{
+    if (*inflight == EPAPER_TRANSPORT_QUEUE_DEPTH) {
+        esp_err_t ret = _transport->reclaim(handle);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        (*inflight)--;
+    }
+
+    esp_err_t ret = _transport->queue(handle, dc, data, len);
+    if (ret == ESP_OK) {
+        (*inflight)++;
+    }
+    return ret;
+}
+
+// Sends a run of register writes that need no BUSY check as a single
+// queued burst of command/data segments.
+static esp_err_t epaper_send_init_batch(epaper_handle_t *handle, const epaper_init_cmd_t *cmds, size_t count)
+{
+    while (count > 0) {
+        size_t n = count > EPAPER_BURST_MAX_CMDS ? EPAPER_BURST_MAX_CMDS : count;
+        size_t inflight = 0;
+        esp_err_t ret = ESP_OK;
+
+        for (size_t i = 0; i < n && ret == ESP_OK; i++) {
+            _burst_cmds[i] = cmds[i].cmd;
+            ret = epaper_queue_segment(handle, false, &_burst_cmds[i], 1, &inflight);
+
+            if (ret == ESP_OK && cmds[i].len > 0) {
+                memcpy(_burst_data[i], cmds[i].data, cmds[i].len);
+                ret = epaper_queue_segment(handle, true, _burst_data[i], cmds[i].len, &inflight);
+            }
+        }
+
+        while (inflight > 0) {
+            if (_transport->reclaim(handle) != ESP_OK) {
+                break;
+            }
+            inflight--;
+        }
+
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        cmds += n;
+        count -= n;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t epaper_run_init_table(epaper_handle_t *handle, const epaper_init_cmd_t *table, size_t count)
+{
+    size_t i = 0;
+
+    while (i < count) {
+        size_t end = i;
+        while (end < count && table[end].wait == EPAPER_WAIT_NONE && table[end].delay_ms == 0) {
+            end++;
+        }
+
+        if (end > i) {
+            int64_t start = esp_timer_get_time();
+            if (epaper_send_init_batch(handle, &table[i], end - i) != ESP_OK) {
+                ESP_LOGE(TAG, "Init batch starting at %s failed", table[i].name);
+                return EPAPER_ERR_SPI;
+            }
+            epaper_timing_add("INIT", start, esp_timer_get_time() - start, false);
+            i = end;
+            continue;
+        }
+
+        const epaper_init_cmd_t *entry = &table[i];
+        epaper_send_command(handle, entry->cmd);
+        if (entry->len > 0) {
+            epaper_send_data(handle, entry->data, entry->len);
+        }
+
+        if (entry->wait == EPAPER_WAIT_BUSY) {
+            esp_err_t ret = epaper_wait_busy_phase(handle, entry->timeout_ms, entry->name);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Init command %s timed out", entry->name);
+                return ret;
+            }
+        }
+
+        if (entry->delay_ms > 0) {
+            vTaskDelay(entry->delay_ms / portTICK_PERIOD_MS);
+        }
+        i++;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t epaper_init_display_sequence(epaper_handle_t *handle)
+{
+    if (!epaper_needs_init()) return ESP_OK;
+
+    ESP_LOGI(TAG, "function: epaper_init_display_sequence()");
+
+    int64_t start = esp_timer_get_time();
+    _ram_synced = false;
+
+    epaper_reset(handle);
+    epaper_wait_busy_phase(handle, 1000, "RESET");
+    epaper_reset(handle);
+    epaper_wait_busy_phase(handle, 1000, "RESET");
+
+    esp_err_t ret = epaper_run_init_table(handle, gdep073e01_init_table, gdep073e01_init_table_len);
+    if (ret != ESP_OK) {
+        _power_state = EPAPER_POWER_UNINITIALIZED;
+        return ret;
+    }
+
+    _init_time_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Panel ready in %lld us", (long long)_init_time_us);
+
+    _power_state = EPAPER_POWER_ACTIVE;
+    _status = EPAPER_STATUS_POWERED_ON;
+    return ESP_OK;
+}
+
+esp_err_t epaper_session_open(const epaper_handle_t *config)
+{
+    if (config == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    if (_session_open) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Opening e-Paper session...");
+
+    _session = *config;
+    epaper_handle_t *handle = &_session;
+
+    if (handle->transport == NULL) {
+        handle->transport = &EPAPER_DEFAULT_TRANSPORT;
+    }
+    _transport = handle->transport;
+
+    if (_panel_sem == NULL) {
+        _panel_sem = xSemaphoreCreateBinary();
+        if (_panel_sem == NULL) {
+            return EPAPER_ERR_MEMORY;
+        }
+        xSemaphoreGive(_panel_sem);
+    }
+
+    esp_err_t ret = _transport->open(handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open %s transport", _transport->name);
+        return ret;
+    }
+
+    ret = epaper_alloc_xfer_buffers();
+    if (ret != ESP_OK) {
+        epaper_free_xfer_buffers();
+        _transport->close(handle);
+        return ret;
+    }
+
+    // Drawing buffers live in PSRAM; a no-op if the app already sized the pool.
+    if (fb_pool_init(MAX_DISPLAY_BUFFER_SIZE, FB_DEFAULT_FRAMES) != ESP_OK) {
+        ESP_LOGW(TAG, "Frame buffer pool unavailable");
+    }
+
+    // Partial updates merge into this copy; without it they need a full frame.
+    _shadow_frame = heap_caps_malloc(MAX_DISPLAY_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (_shadow_frame == NULL) {
+        ESP_LOGW(TAG, "No PSRAM for the shadow frame, partial updates disabled");
+    }
+    _shadow_valid = false;
+    _ram_synced = false;
+
+    handle->width = EPAPER_WIDTH;
+    handle->height = EPAPER_HEIGHT;
+
+    epaper_set_band_height(EPAPER_BAND_DEFAULT_ROWS);
+
+    // Controller state is unknown until the first reset + init sequence.
+    _power_state = EPAPER_POWER_UNINITIALIZED;
+    _session_open = true;
+
+    if (epaper_start_refresh_task() != ESP_OK) {
+        ESP_LOGW(TAG, "Refresh task unavailable, async updates disabled");
+    }
+
+    ESP_LOGI(TAG, "e-Paper session opened (%s transport)", _transport->name);
+    return ESP_OK;
+}
+
+epaper_handle_t *epaper_session_get(void)
+{
+    return _session_open ? &_session : NULL;
+}
+
+esp_err_t epaper_session_close(void)
+{
+    if (!_session_open) {
+        return ESP_OK;
+    }
+
+    epaper_sleep(&_session);
+
+    epaper_lock(portMAX_DELAY);
+    _transport->close(&_session);
+    epaper_free_xfer_buffers();
+    heap_caps_free(_shadow_frame);
+    _shadow_frame = NULL;
+    _shadow_valid = false;
+    _session_open = false;
+    epaper_unlock();
+
+    ESP_LOGI(TAG, "e-Paper session closed");
+    return ESP_OK;
+}
+
+epaper_power_state_t epaper_get_power_state(void)
+{
+    return _power_state;
+}
+
+void epaper_session_set_idle_sleep(uint32_t idle_ms)
+{
+    _idle_sleep_ms = idle_ms;
+}
+
+int64_t epaper_get_init_time_us(void)
+{
+    return _init_time_us;
+}
+
+// Rewrites TRES with its current value, which is harmless at any time,
+// once per transaction (the pre-batching path) and as queued bursts.
+esp_err_t epaper_bench_commands(epaper_handle_t *handle, uint32_t iterations, epaper_cmd_bench_t *result)
+{
+    if (handle == NULL || result == NULL || iterations == 0) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    static const epaper_init_cmd_t tres = {0x61, 4, {0x03, 0x20, 0x01, 0xE0}, EPAPER_WAIT_NONE, 0, 0, "TRES"};
+    epaper_init_cmd_t burst[EPAPER_BURST_MAX_CMDS];
+    for (int i = 0; i < EPAPER_BURST_MAX_CMDS; i++) {
+        burst[i] = tres;
+    }
+
+    epaper_lock(portMAX_DELAY);
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint8_t data[4];
+        memcpy(data, tres.data, sizeof(data));
+        epaper_send_command(handle, tres.cmd);
+        epaper_send_data(handle, data, sizeof(data));
+    }
+    int64_t single_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t done = 0; done < iterations; ) {
+        uint32_t n = iterations - done;
+        if (n > EPAPER_BURST_MAX_CMDS) {
+            n = EPAPER_BURST_MAX_CMDS;
+        }
+        epaper_send_init_batch(handle, burst, n);
+        done += n;
+    }
+    int64_t burst_us = esp_timer_get_time() - start;
+
+    epaper_unlock();
+
+    result->iterations = iterations;
+    result->single_us = single_us;
+    result->burst_us = burst_us;
+    result->single_cmds_per_s = single_us > 0 ? (float)iterations * 1e6f / (float)single_us : 0.0f;
+    result->burst_cmds_per_s = burst_us > 0 ? (float)iterations * 1e6f / (float)burst_us : 0.0f;
+
+    ESP_LOGI(TAG, "Command throughput: per-transaction %.0f cmd/s, queued burst %.0f cmd/s (%u cmds)",
+             result->single_cmds_per_s, result->burst_cmds_per_s, (unsigned)iterations);
+
+    return ESP_OK;
+}
+
+esp_err_t epaper_init(epaper_handle_t *handle)
+{
+    if (handle == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    ESP_LOGI(TAG, "Initializing e-Paper display...");
+
+    esp_err_t ret = epaper_session_open(handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    *handle = _session;
+
+    uint8_t *pixel_buffer = fb_get_back();
+    if (pixel_buffer != NULL) {
+        memset(pixel_buffer, 0x11, MAX_DISPLAY_BUFFER_SIZE);
+    }
+
+    epaper_lock(portMAX_DELAY);
+    epaper_timing_begin("init");
+    esp_err_t init_ret = epaper_init_display_sequence(&_session);
+    epaper_timing_end(init_ret);
+    epaper_unlock();
+    if (init_ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize display sequence");
+        return init_ret;
+    }
+
+    ESP_LOGI(TAG, "e-Paper initialized successfully");
+    return ESP_OK;
+}
+
+esp_err_t epaper_deinit(epaper_handle_t *handle)
+{
+    if (handle == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    return epaper_session_close();
+}
+
+// The enum values are the panel's Spectra6 codes.
+static uint8_t color7(epaper_color_t color)
+{
+    switch (color) {
+        case EPAPER_COLOR_BLACK:  return 0x00;
+        case EPAPER_COLOR_WHITE:  return 0x01;
+        case EPAPER_COLOR_YELLOW: return 0x02;
+        case EPAPER_COLOR_RED:    return 0x03;
+        case EPAPER_COLOR_BLUE:   return 0x05;
+        case EPAPER_COLOR_GREEN:  return 0x06;
+        default: return 0x01;
+    }
+}
+
+uint8_t epaper_color_code(epaper_color_t color)
+{
+    return color7(color);
+}
+
+esp_err_t epaper_clear(epaper_handle_t *handle, epaper_color_t color)
+{
+    if (handle == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    uint8_t pv = color7(color);
+    uint8_t pv2 = pv | (pv << 4);
+
+    uint8_t *pixel_buffer = fb_get_back();
+    if (pixel_buffer == NULL) {
+        return EPAPER_ERR_MEMORY;
+    }
+
+    memset(pixel_buffer, pv2, MAX_DISPLAY_BUFFER_SIZE);
+
+    // A clear is also used to wipe ghosting, so never skip it.
+    epaper_invalidate_frame_hash();
+
+    esp_err_t ret = epaper_display_frame(handle, pixel_buffer);
+    if (ret == ESP_OK) {
+        epaper_sleep(handle);
+    }
+
+    return ret;
+}
+
+// Called with the panel lock held. Records the hash of the frame about to
+// be sent, or reports that the panel already shows exactly this frame.
+static bool epaper_hash_unchanged(uint32_t hash)
+{
+    _pending_hash = hash;
+    _pending_valid = true;
+    _last_unchanged = _committed_valid && _pending_hash == _committed_hash;
+
+    if (_last_unchanged) {
+        ESP_LOGI(TAG, "Frame unchanged (hash %08lx), skipping refresh", (unsigned long)_pending_hash);
+    }
+
+    return _last_unchanged;
+}
+
+static bool epaper_frame_unchanged(const uint8_t *frame_buffer)
+{
+    int64_t start = esp_timer_get_time();
+    uint32_t hash = epaper_frame_hash(frame_buffer, MAX_DISPLAY_BUFFER_SIZE);
+
+    ESP_LOGD(TAG, "Frame hash %08lx in %lld us", (unsigned long)hash, (long long)(esp_timer_get_time() - start));
+    return epaper_hash_unchanged(hash);
+}
+
+static esp_err_t epaper_transfer_frame(epaper_handle_t *handle, const uint8_t *frame_buffer)
+{
+    epaper_timing_begin("full");
+
+    // Nothing is sent to a controller that did not come up.
+    esp_err_t ret = epaper_init_display_sequence(handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    _status = EPAPER_STATUS_TRANSFERRING;
+    _committed_valid = false;
+    _ram_synced = false;
+
+    epaper_send_command(handle, EPAPER_CMD_DATA_START);
+
+    ret = epaper_stream_data(handle, MAX_DISPLAY_BUFFER_SIZE, EPAPER_XFER_CHUNK_SIZE,
+                             epaper_fill_from_buffer, (void *)frame_buffer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    _full_xfer_us = _xfer_stats.elapsed_us;
+    if (_shadow_frame != NULL) {
+        if (frame_buffer != _shadow_frame) {
+            memcpy(_shadow_frame, frame_buffer, MAX_DISPLAY_BUFFER_SIZE);
+        }
+        _shadow_valid = true;
+        _ram_synced = true;
+    }
+
+    return ESP_OK;
+}
+
+static void epaper_fill_from_band(uint8_t *dst, size_t offset, size_t len, void *ctx)
+{
+    epaper_band_src_t *src = ctx;
+    uint16_t y = offset / EPAPER_ROW_BYTES;
+
+    _current_page = y / _page_height;
+    if (src->result == ESP_OK) {
+        src->result = src->render(dst, y, len / EPAPER_ROW_BYTES, src->ctx);
+    }
+    if (src->result != ESP_OK) {
+        memset(dst, (EPAPER_COLOR_WHITE << 4) | EPAPER_COLOR_WHITE, len);
+    }
+    epaper_hash_update(&src->hash, dst, len);
+
+    if (_shadow_frame != NULL) {
+        memcpy(_shadow_frame + offset, dst, len);
+    }
+}
+
+// Like epaper_transfer_frame, but the pixel data comes from the render
+// callback one band at a time, and is hashed band by band on the way out.
+static esp_err_t epaper_transfer_bands(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx)
+{
+    epaper_timing_begin("banded");
+
+    esp_err_t ret = epaper_init_display_sequence(handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    _status = EPAPER_STATUS_TRANSFERRING;
+    _committed_valid = false;
+    _ram_synced = false;
+    _shadow_valid = false;
+    _pending_valid = false;
+    _last_unchanged = false;
+
+    epaper_band_src_t src = {
+        .render = render,
+        .ctx = ctx,
+        .result = ESP_OK
+    };
+    epaper_hash_begin(&src.hash);
+
+    epaper_send_command(handle, EPAPER_CMD_DATA_START);
+
+    ret = epaper_stream_data(handle, MAX_DISPLAY_BUFFER_SIZE, (size_t)_page_height * EPAPER_ROW_BYTES,
+                             epaper_fill_from_band, &src);
+    _current_page = 0;
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    // Controller RAM now holds a frame that must not be shown; the panel
+    // keeps its old image and nothing below is marked as in sync.
+    if (src.result != ESP_OK) {
+        ESP_LOGE(TAG, "Band render failed (%s), refresh skipped", esp_err_to_name(src.result));
+        return src.result;
+    }
+
+    _full_xfer_us = _xfer_stats.elapsed_us;
+    _pending_hash = epaper_hash_end(&src.hash);
+    _pending_valid = true;
+    if (_shadow_frame != NULL) {
+        _shadow_valid = true;
+        _ram_synced = true;
+    }
+
+    ESP_LOGI(TAG, "Streamed %u bands of %u rows", (unsigned)_pages, (unsigned)_page_height);
+    return ESP_OK;
+}
+
+// What the status settles to once an update is over or has failed.
+static epaper_status_t epaper_idle_status(void)
+{
+    return (_power_state == EPAPER_POWER_ACTIVE) ? EPAPER_STATUS_POWERED_ON : EPAPER_STATUS_POWERED_OFF;
+}
+
+static esp_err_t epaper_do_refresh(epaper_handle_t *handle, bool partial_update)
+{
+    _status = EPAPER_STATUS_REFRESHING;
+
+    if (_power_state != EPAPER_POWER_ACTIVE) {
+        epaper_send_command(handle, EPAPER_CMD_POWER_ON);
+        esp_err_t ret = epaper_wait_busy_phase(handle, 45000, "PON");
+        if (ret != ESP_OK) {
+            // The pixel data stays in controller RAM; the power state is
+            // left as it was so the next attempt powers on again.
+            ESP_LOGE(TAG, "Panel did not power on, refresh skipped");
+            if (_window_active) {
+                epaper_send_command(handle, EPAPER_CMD_PARTIAL_OUT);
+                _window_active = false;
+            }
+            _committed_valid = false;
+            _status = EPAPER_STATUS_POWERED_OFF;
+            _last_activity = xTaskGetTickCount();
+            epaper_timing_end(ret);
+            return ret;
+        }
+        _power_state = EPAPER_POWER_ACTIVE;
+    }
+
+    int64_t start = esp_timer_get_time();
+    epaper_send_command(handle, EPAPER_CMD_DISPLAY_REFRESH);
+    uint8_t refresh_data[] = {0x00};
+    epaper_send_data(handle, refresh_data, sizeof(refresh_data));
+    esp_err_t ret = epaper_wait_busy_phase(handle, 45000, "DRF");
+
+    if (_window_active) {
+        epaper_send_command(handle, EPAPER_CMD_PARTIAL_OUT);
+        _window_active = false;
+        _partial_stats.refresh_us = esp_timer_get_time() - start;
+    } else if (ret == ESP_OK) {
+        _full_refresh_us = esp_timer_get_time() - start;
+    }
+
+    if (ret != ESP_OK) {
+        // A wedged controller cannot be trusted to hold its registers.
+        _power_state = EPAPER_POWER_UNINITIALIZED;
+        _committed_valid = false;
+        _ram_synced = false;
+    } else {
+        _committed_hash = _pending_hash;
+        _committed_valid = _pending_valid;
+    }
+
+    if (ret == ESP_OK && !partial_update) {
+        epaper_send_command(handle, EPAPER_CMD_POWER_OFF);
+        epaper_wait_busy_phase(handle, 5000, "POF");
+        _power_state = EPAPER_POWER_OFF;
+    }
+
+    _status = epaper_idle_status();
+    _last_activity = xTaskGetTickCount();
+    epaper_timing_end(ret);
+
+    return ret;
+}
+
+esp_err_t epaper_display_frame(epaper_handle_t *handle, uint8_t *frame_buffer)
+{
+    if (handle == NULL || frame_buffer == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    epaper_lock(portMAX_DELAY);
+
+    if (epaper_frame_unchanged(frame_buffer)) {
+        epaper_unlock();
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Displaying frame...");
+
+    esp_err_t ret = epaper_transfer_frame(handle, frame_buffer);
+    if (ret == ESP_OK) {
+        ret = epaper_do_refresh(handle, false);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to refresh display");
+        }
+    } else {
+        _status = epaper_idle_status();
+    }
+    epaper_timing_end(ret);
+
+    epaper_unlock();
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Frame displayed successfully");
+    return ESP_OK;
+}
+
+esp_err_t epaper_display_banded(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx)
+{
+    if (handle == NULL || render == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    epaper_lock(portMAX_DELAY);
+
+    ESP_LOGI(TAG, "Displaying banded frame...");
+
+    esp_err_t ret = epaper_transfer_bands(handle, render, ctx);
+    if (ret == ESP_OK) {
+        ret = epaper_do_refresh(handle, false);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to refresh display");
+        }
+    } else {
+        _status = epaper_idle_status();
+    }
+    epaper_timing_end(ret);
+
+    epaper_unlock();
+    return ret;
+}
+
+esp_err_t epaper_refresh(epaper_handle_t *handle, bool partial_update)
+{
+    if (handle == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    epaper_lock(portMAX_DELAY);
+    epaper_timing_begin("refresh");
+    esp_err_t ret = epaper_do_refresh(handle, partial_update);
+    epaper_unlock();
+
+    return ret;
+}
+
+static void epaper_refresh_task(void *arg)
+{
+    epaper_refresh_job_t job;
+
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+        if (_idle_sleep_ms > 0 && _session_open && _power_state == EPAPER_POWER_OFF) {
+            TickType_t idle = xTaskGetTickCount() - _last_activity;
+            TickType_t limit = pdMS_TO_TICKS(_idle_sleep_ms);
+            wait = (idle < limit) ? (limit - idle) : 0;
+        }
+
+        if (xQueueReceive(_refresh_queue, &job, wait) != pdTRUE) {
+            // Idle long enough in POF: drop into deep sleep. The next update
+            // pays for a reset + init sequence.
+            if (_session_open && _power_state == EPAPER_POWER_OFF &&
+                xTaskGetTickCount() - _last_activity >= pdMS_TO_TICKS(_idle_sleep_ms) &&
+                epaper_lock(0) == ESP_OK) {
+                ESP_LOGI(TAG, "Panel idle, entering deep sleep");
+                epaper_do_sleep(&_session);
+                epaper_unlock();
+            }
+            continue;
+        }
+
+        esp_err_t ret = epaper_do_refresh(job.handle, job.partial_update);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Async refresh failed");
+        } else {
+            ESP_LOGI(TAG, "Async refresh completed");
+        }
+
+        epaper_unlock();
+
+        if (job.done_cb) {
+            job.done_cb(ret, job.cb_arg);
+        }
     }
-    return ESP_OK;
 }
 
-#define PSR         0x00
-#define PWRR        0x01
-#define POF         0x02
-#define POFS        0x03
-#define PON         0x04
-#define BTST1       0x05
-#define BTST2       0x06
-#define DSLP        0x07
-#define BTST3       0x08
-#define DTM         0x10
-#define DRF         0x12
-#define PLL         0x30
-#define CDI         0x50
-#define TCON        0x60
-#define TRES        0x61
-#define REV         0x70
-#define VDCS        0x82
-#define T_VDCS      0x84
-#define PWS         0xE3
-
-static esp_err_t epaper_init_display_sequence(epaper_handle_t *handle)
+static esp_err_t epaper_start_refresh_task(void)
 {
-    if (_init_display_done) return ESP_OK;
-
-    ESP_LOGI(TAG, "function: epaper_init_display_sequence()");
-
-    gpio_set_direction(GPIO_NUM_16, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_NUM_16, 1);
+    if (_refresh_task != NULL) {
+        return ESP_OK;
+    }
 
-    gpio_set_direction(handle->cs_pin, GPIO_MODE_OUTPUT);
-    gpio_set_direction(handle->dc_pin, GPIO_MODE_OUTPUT);
-    gpio_set_direction(handle->rst_pin, GPIO_MODE_OUTPUT);
-    gpio_set_direction(handle->busy_pin, GPIO_MODE_INPUT);
+    _refresh_queue = xQueueCreate(1, sizeof(epaper_refresh_job_t));
+    if (_refresh_queue == NULL) {
+        return EPAPER_ERR_MEMORY;
+    }
 
-    // SD_EN(IO16)
-    gpio_set_direction(GPIO_NUM_16, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_NUM_16, 1);
+    if (xTaskCreate(epaper_refresh_task, "epaper_refresh", EPAPER_REFRESH_TASK_STACK,
+                    NULL, EPAPER_REFRESH_TASK_PRIO, &_refresh_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create refresh task");
+        return EPAPER_ERR_MEMORY;
+    }
 
-    epaper_reset(handle);
-    epaper_wait_busy(handle, 1000);
-    epaper_reset(handle);
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, 0xAA);
-    uint8_t psr1_data[] = {0x49, 0x55, 0x20, 0x08, 0x09, 0x18};
-    epaper_send_data(handle, psr1_data, sizeof(psr1_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, PWRR);
-    uint8_t pwrr_data[] = {0x3F};
-    epaper_send_data(handle, pwrr_data, sizeof(pwrr_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, PSR);
-    uint8_t psr_data[] = {0x5F, 0x69};
-    epaper_send_data(handle, psr_data, sizeof(psr_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, POFS);
-    uint8_t pofs_data[] = {0x00, 0x54, 0x00, 0x44};
-    epaper_send_data(handle, pofs_data, sizeof(pofs_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, BTST1);
-    uint8_t btst1_data[] = {0x40, 0x1F, 0x1F, 0x2C};
-    epaper_send_data(handle, btst1_data, sizeof(btst1_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, BTST2);
-    uint8_t btst2_data[] = {0x6F, 0x1F, 0x17, 0x49};
-    epaper_send_data(handle, btst2_data, sizeof(btst2_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, BTST3);
-    uint8_t btst3_data[] = {0x6F, 0x1F, 0x1F, 0x22};
-    epaper_send_data(handle, btst3_data, sizeof(btst3_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, PLL);
-    uint8_t pll_data[] = {0x00};
-    epaper_send_data(handle, pll_data, sizeof(pll_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, CDI);
-    uint8_t cdi_data[] = {0x3F};
-    epaper_send_data(handle, cdi_data, sizeof(cdi_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, TCON);
-    uint8_t tcon_data[] = {0x02, 0x00};
-    epaper_send_data(handle, tcon_data, sizeof(tcon_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, TRES);
-    uint8_t tres_data[] = {0x03, 0x20, 0x01, 0xe0};
-    epaper_send_data(handle, tres_data, sizeof(tres_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, T_VDCS);
-    uint8_t vdcs_data[] = {0x01};
-    epaper_send_data(handle, vdcs_data, sizeof(vdcs_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, PWS);
-    uint8_t pws_data[] = {0x2F};
-    epaper_send_data(handle, pws_data, sizeof(pws_data));
-    epaper_wait_busy(handle, 1000);
-
-    // PON
-    epaper_send_command(handle, 0x04);
-//    uint8_t pon_data[] = {0x00};
-//    epaper_send_data(handle, pon_data, sizeof(pon_data));
-    epaper_wait_busy(handle, 1000);
-
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-
-    _init_display_done = true;
     return ESP_OK;
 }
-#if 0
-static esp_err_t epaper_init_display_sequence(epaper_handle_t *handle)
+
+static esp_err_t epaper_queue_refresh(epaper_handle_t *handle, bool partial_update,
+                                      epaper_done_cb_t done_cb, void *cb_arg)
 {
-    if (_init_display_done) return ESP_OK;
+    epaper_refresh_job_t job = {
+        .handle = handle,
+        .partial_update = partial_update,
+        .done_cb = done_cb,
+        .cb_arg = cb_arg
+    };
 
-    ESP_LOGI(TAG, "function: epaper_init_display_sequence()");
+    // The panel lock is held by the caller, so the single queue slot is free.
+    if (xQueueSend(_refresh_queue, &job, 0) != pdTRUE) {
+        return EPAPER_ERR_BUSY;
+    }
 
-    epaper_reset(handle);
-    epaper_wait_busy(handle, 1000);
-    epaper_reset(handle);
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_PSR_1);
-    uint8_t psr1_data[] = {0x49, 0x55, 0x20, 0x08, 0x09, 0x18};
-    epaper_send_data(handle, psr1_data, sizeof(psr1_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_PSR_2);
-    uint8_t psr2_data[] = {0x3F};
-    epaper_send_data(handle, psr2_data, sizeof(psr2_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_PANEL_SETTING);
-    uint8_t panel_data[] = {0x5F, 0x69};
-    epaper_send_data(handle, panel_data, sizeof(panel_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_POF);
-    uint8_t pof_data[] = {0x00, 0x54, 0x00, 0x44};
-    epaper_send_data(handle, pof_data, sizeof(pof_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_PFS);
-    uint8_t pfs_data[] = {0x40, 0x1F, 0x1F, 0x22};
-    epaper_send_data(handle, pfs_data, sizeof(pfs_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_PON);
-    uint8_t pon_data[] = {0x6F, 0x1F, 0x14, 0x00};
-    epaper_send_data(handle, pon_data, sizeof(pon_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_PSET);
-    uint8_t pset_data[] = {0x00, 0x54, 0x00, 0x44};
-    epaper_send_data(handle, pset_data, sizeof(pset_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_TSCON);
-    uint8_t tscon_data[] = {0x02, 0x00};
-    epaper_send_data(handle, tscon_data, sizeof(tscon_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_TCON);
-    uint8_t tcon_data[] = {0x00};
-    epaper_send_data(handle, tcon_data, sizeof(tcon_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_CDI);
-    uint8_t cdi_data[] = {0x08};
-    epaper_send_data(handle, cdi_data, sizeof(cdi_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_PLL);
-    uint8_t pll_data[] = {0x3F};
-    epaper_send_data(handle, pll_data, sizeof(pll_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_RESOLUTION);
-    uint8_t resolution_data[] = {0x03, 0x20, 0x01, 0xE0};
-    epaper_send_data(handle, resolution_data, sizeof(resolution_data));
-    epaper_wait_busy(handle, 1000);
-
-    epaper_send_command(handle, EPAPER_CMD_AUTO_MEASURING);
-    uint8_t auto_data[] = {0x01};
-    epaper_send_data(handle, auto_data, sizeof(auto_data));
-    epaper_wait_busy(handle, 1000);
-
-    _init_display_done = true;
     return ESP_OK;
 }
-#endif
-esp_err_t epaper_init(epaper_handle_t *handle)
+
+esp_err_t epaper_display_frame_async(epaper_handle_t *handle, const uint8_t *frame_buffer,
+                                     epaper_done_cb_t done_cb, void *cb_arg)
 {
-    if (handle == NULL) {
+    if (handle == NULL || frame_buffer == NULL) {
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    ESP_LOGI(TAG, "Initializing e-Paper display...");
+    esp_err_t ret = epaper_start_refresh_task();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    gpio_set_direction(handle->cs_pin, GPIO_MODE_OUTPUT);
-    gpio_set_direction(handle->dc_pin, GPIO_MODE_OUTPUT);
-    gpio_set_direction(handle->rst_pin, GPIO_MODE_OUTPUT);
-    gpio_set_direction(handle->busy_pin, GPIO_MODE_INPUT);
-
-    gpio_set_level(handle->cs_pin, 1);
-    gpio_set_level(handle->dc_pin, 1);
-    gpio_set_level(handle->rst_pin, 1);
-
-    spi_bus_config_t buscfg = {
-        .miso_io_num = -1,
-        .mosi_io_num = 9,
-        .sclk_io_num = 7,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
-        .max_transfer_sz = 4096
-    };
+    ret = epaper_lock_update();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    spi_device_interface_config_t devcfg = {
-        .clock_speed_hz = 4 * 1000 * 1000,
-        .mode = 0,
-        .spics_io_num = -1,
-        .queue_size = 7
-    };
+    if (epaper_frame_unchanged(frame_buffer)) {
+        epaper_unlock();
+        if (done_cb) {
+            done_cb(ESP_OK, cb_arg);
+        }
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Displaying frame (async)...");
+
+    ret = epaper_transfer_frame(handle, frame_buffer);
+    if (ret == ESP_OK) {
+        fb_present(frame_buffer);
+        ret = epaper_queue_refresh(handle, false, done_cb, cb_arg);
+    }
 
-    esp_err_t ret = spi_bus_initialize(SPI2_HOST, &buscfg, SPI_DMA_CH_AUTO);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize SPI bus");
-        return EPAPER_ERR_SPI;
+        _status = epaper_idle_status();
+        epaper_timing_end(ret);
+        epaper_unlock();
+    }
+
+    return ret;
+}
+
+static esp_err_t epaper_banded_async(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx,
+                                     const uint32_t *frame_hash, epaper_done_cb_t done_cb, void *cb_arg)
+{
+    if (handle == NULL || render == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
     }
 
-    ret = spi_bus_add_device(SPI2_HOST, &devcfg, &handle->spi);
+    esp_err_t ret = epaper_start_refresh_task();
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to add SPI device");
-        return EPAPER_ERR_SPI;
+        return ret;
     }
 
-    handle->width = EPAPER_WIDTH;
-    handle->height = EPAPER_HEIGHT;
+    ret = epaper_lock_update();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    _page_height = EPAPER_HEIGHT;
-    _pages = 1;
-    _current_page = 0;
+    if (frame_hash != NULL && epaper_hash_unchanged(*frame_hash)) {
+        epaper_unlock();
+        if (done_cb) {
+            done_cb(ESP_OK, cb_arg);
+        }
+        return ESP_OK;
+    }
 
-    memset(_pixel_buffer, 0x11, sizeof(_pixel_buffer));
+    ESP_LOGI(TAG, "Displaying banded frame (async)...");
 
-    esp_err_t init_ret = epaper_init_display_sequence(handle);
-    if (init_ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize display sequence");
-        return init_ret;
+    ret = epaper_transfer_bands(handle, render, ctx);
+    if (ret == ESP_OK) {
+        ret = epaper_queue_refresh(handle, false, done_cb, cb_arg);
     }
 
-    ESP_LOGI(TAG, "e-Paper initialized successfully");
-    return ESP_OK;
+    if (ret != ESP_OK) {
+        _status = epaper_idle_status();
+        epaper_timing_end(ret);
+        epaper_unlock();
+    }
+
+    return ret;
 }
 
-esp_err_t epaper_deinit(epaper_handle_t *handle)
+esp_err_t epaper_display_banded_async(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx,
+                                      epaper_done_cb_t done_cb, void *cb_arg)
 {
-    if (handle == NULL) {
+    return epaper_banded_async(handle, render, ctx, NULL, done_cb, cb_arg);
+}
+
+esp_err_t epaper_display_banded_hashed_async(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx,
+                                             uint32_t frame_hash, epaper_done_cb_t done_cb, void *cb_arg)
+{
+    return epaper_banded_async(handle, render, ctx, &frame_hash, done_cb, cb_arg);
+}
+
+esp_err_t epaper_set_band_height(uint16_t rows)
+{
+    if (rows == 0 || rows > EPAPER_BAND_MAX_ROWS) {
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    epaper_sleep(handle);
-    spi_bus_remove_device(handle->spi);
-    spi_bus_free(SPI2_HOST);
+    epaper_lock(portMAX_DELAY);
+    _page_height = rows;
+    _pages = (EPAPER_HEIGHT + rows - 1) / rows;
+    _current_page = 0;
+    epaper_unlock();
 
     return ESP_OK;
 }
 
-static uint8_t color7(epaper_color_t color)
+uint16_t epaper_get_band_height(void)
 {
-    switch (color) {
-        case EPAPER_COLOR_BLACK:  return 0x00;
-        case EPAPER_COLOR_WHITE:  return 0x01;
-        case EPAPER_COLOR_GREEN:  return 0x02;
-        case EPAPER_COLOR_BLUE:   return 0x03;
-        case EPAPER_COLOR_RED:    return 0x04;
-        case EPAPER_COLOR_YELLOW: return 0x05;
-        default: return 0x01;
-    }
+    return _page_height;
 }
 
-esp_err_t epaper_clear(epaper_handle_t *handle, epaper_color_t color)
+esp_err_t epaper_refresh_async(epaper_handle_t *handle, bool partial_update,
+                               epaper_done_cb_t done_cb, void *cb_arg)
 {
     if (handle == NULL) {
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    uint8_t pv = color7(color);
-    uint8_t pv2 = pv | (pv << 4);
+    esp_err_t ret = epaper_start_refresh_task();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    memset(_pixel_buffer, pv2, sizeof(_pixel_buffer));
+    ret = epaper_lock_update();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    epaper_timing_begin("refresh");
 
-    esp_err_t ret = epaper_display_frame(handle, _pixel_buffer);
-    if (ret == ESP_OK) {
-        epaper_sleep(handle);
+    ret = epaper_queue_refresh(handle, partial_update, done_cb, cb_arg);
+    if (ret != ESP_OK) {
+        epaper_timing_end(ret);
+        epaper_unlock();
     }
 
     return ret;
 }
 
-esp_err_t epaper_display_frame(epaper_handle_t *handle, uint8_t *frame_buffer)
+bool epaper_last_frame_unchanged(uint32_t *hash)
 {
-    if (handle == NULL || frame_buffer == NULL) {
-        return EPAPER_ERR_INVALID_PARAM;
+    if (hash != NULL) {
+        *hash = _pending_hash;
     }
 
-    if (!_init_display_done) {
-        epaper_init_display_sequence(handle);
+    return _last_unchanged;
+}
+
+bool epaper_get_frame_hash(uint32_t *hash)
+{
+    if (hash != NULL) {
+        *hash = _committed_hash;
     }
 
-    ESP_LOGI(TAG, "Displaying frame...");
+    return _committed_valid;
+}
 
-    epaper_send_command(handle, EPAPER_CMD_DATA_START);
+void epaper_invalidate_frame_hash(void)
+{
+    _committed_valid = false;
+}
 
-    gpio_set_level(handle->cs_pin, 0);
+epaper_status_t epaper_get_status(void)
+{
+    return _status;
+}
 
-    uint32_t frame_size = sizeof(_pixel_buffer);
-    const size_t chunk_size = 4096;
+esp_err_t epaper_wait_idle(uint32_t timeout_ms)
+{
+    esp_err_t ret = epaper_lock(pdMS_TO_TICKS(timeout_ms));
+    if (ret != ESP_OK) {
+        return EPAPER_ERR_TIMEOUT;
+    }
 
-    for (size_t i = 0; i < frame_size; i += chunk_size) {
-        size_t len = (i + chunk_size > frame_size) ? (frame_size - i) : chunk_size;
+    epaper_unlock();
+    return ESP_OK;
+}
 
-        spi_transaction_t trans = {
-            .length = len * 8,
-            .tx_buffer = frame_buffer + i
-        };
+typedef struct {
+    uint16_t x0, x1;    // byte columns, x1 exclusive
+    uint16_t y0, y1;    // rows, y1 exclusive
+} epaper_rect_t;
 
-        spi_device_transmit(handle->spi, &trans);
+typedef struct {
+    const uint8_t *frame;
+    epaper_rect_t rect;
+} epaper_window_src_t;
+
+static void epaper_fill_from_window(uint8_t *dst, size_t offset, size_t len, void *ctx)
+{
+    const epaper_window_src_t *src = ctx;
+    size_t row_bytes = src->rect.x1 - src->rect.x0;
+
+    while (len > 0) {
+        size_t row = offset / row_bytes;
+        size_t col = offset % row_bytes;
+        size_t n = row_bytes - col;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(dst, src->frame + (src->rect.y0 + row) * EPAPER_ROW_BYTES + src->rect.x0 + col, n);
+        dst += n;
+        offset += n;
+        len -= n;
     }
+}
 
-    gpio_set_level(handle->cs_pin, 1);
+// Compares the window against the shadow frame row by row and groups
+// changed rows that are close together into rectangles, widened to the
+// controller's window alignment. Returns 0 if nothing changed.
+static size_t epaper_find_dirty_rects(const uint8_t *buffer, uint16_t bx, uint16_t y,
+                                      uint16_t bw, uint16_t height, epaper_rect_t *rects)
+{
+    size_t count = 0;
+    epaper_rect_t *cur = NULL;
 
-    esp_err_t ret = epaper_refresh(handle, false);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to refresh display");
-        return ret;
+    for (uint16_t r = 0; r < height; r++) {
+        const uint8_t *src = buffer + (size_t)r * bw;
+        const uint8_t *old = _shadow_frame + (size_t)(y + r) * EPAPER_ROW_BYTES + bx;
+
+        if (memcmp(src, old, bw) == 0) {
+            continue;
+        }
+
+        uint16_t first = 0;
+        uint16_t last = bw - 1;
+        while (src[first] == old[first]) first++;
+        while (src[last] == old[last]) last--;
+
+        uint16_t x0 = bx + first;
+        uint16_t x1 = bx + last + 1;
+        uint16_t row = y + r;
+
+        if (cur == NULL || (row - cur->y1 > EPAPER_DIRTY_ROW_GAP && count < EPAPER_MAX_DIRTY_RECTS)) {
+            cur = &rects[count++];
+            cur->x0 = x0;
+            cur->x1 = x1;
+            cur->y0 = row;
+        } else {
+            if (x0 < cur->x0) cur->x0 = x0;
+            if (x1 > cur->x1) cur->x1 = x1;
+        }
+        cur->y1 = row + 1;
     }
 
-    ESP_LOGI(TAG, "Frame displayed successfully");
-    return ESP_OK;
+    for (size_t i = 0; i < count; i++) {
+        rects[i].x0 &= ~(EPAPER_WINDOW_ALIGN_BYTES - 1);
+        rects[i].x1 = (rects[i].x1 + EPAPER_WINDOW_ALIGN_BYTES - 1) & ~(EPAPER_WINDOW_ALIGN_BYTES - 1);
+    }
+
+    return count;
 }
 
-esp_err_t epaper_refresh(epaper_handle_t *handle, bool partial_update)
+static void epaper_set_window(epaper_handle_t *handle, const epaper_rect_t *rect)
 {
-    if (handle == NULL) {
-        return EPAPER_ERR_INVALID_PARAM;
-    }
+    uint16_t hrst = rect->x0 * 2;
+    uint16_t hred = rect->x1 * 2 - 1;
+    uint16_t vrst = rect->y0;
+    uint16_t vred = rect->y1 - 1;
+
+    uint8_t data[] = {
+        hrst >> 8, hrst & 0xFF, hred >> 8, hred & 0xFF,
+        vrst >> 8, vrst & 0xFF, vred >> 8, vred & 0xFF,
+        0x01
+    };
 
-    epaper_send_command(handle, EPAPER_CMD_POWER_ON);
-    epaper_wait_busy(handle, 45000);
+    epaper_send_command(handle, EPAPER_CMD_PARTIAL_WINDOW);
+    epaper_send_data(handle, data, sizeof(data));
+}
 
-    epaper_send_command(handle, EPAPER_CMD_DISPLAY_REFRESH);
-    uint8_t refresh_data[] = {0x00};
-    epaper_send_data(handle, refresh_data, sizeof(refresh_data));
-    epaper_wait_busy(handle, 45000);
+// Sends each dirty rectangle through its own partial window, then leaves
+// the window set to their union so the following DRF covers all of them.
+static esp_err_t epaper_transfer_windows(epaper_handle_t *handle, const epaper_rect_t *rects, size_t count)
+{
+    _status = EPAPER_STATUS_TRANSFERRING;
+    _committed_valid = false;
+
+    epaper_send_command(handle, EPAPER_CMD_PARTIAL_IN);
+    _window_active = true;
+
+    epaper_rect_t bounds = rects[0];
+    for (size_t i = 0; i < count; i++) {
+        const epaper_rect_t *rect = &rects[i];
+        epaper_window_src_t src = {
+            .frame = _shadow_frame,
+            .rect = *rect
+        };
 
-    if (!partial_update) {
-        epaper_send_command(handle, EPAPER_CMD_POWER_OFF);
-        epaper_wait_busy(handle, 5000);
+        epaper_set_window(handle, rect);
+        epaper_send_command(handle, EPAPER_CMD_DATA_START);
+
+        size_t len = (size_t)(rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+        esp_err_t ret = epaper_stream_data(handle, len, EPAPER_XFER_CHUNK_SIZE,
+                                           epaper_fill_from_window, &src);
+        if (ret != ESP_OK) {
+            epaper_send_command(handle, EPAPER_CMD_PARTIAL_OUT);
+            _window_active = false;
+            _ram_synced = false;
+            return ret;
+        }
+
+        if (rect->x0 < bounds.x0) bounds.x0 = rect->x0;
+        if (rect->x1 > bounds.x1) bounds.x1 = rect->x1;
+        if (rect->y1 > bounds.y1) bounds.y1 = rect->y1;
     }
 
+    epaper_set_window(handle, &bounds);
     return ESP_OK;
 }
 
@@ -465,60 +1585,173 @@ esp_err_t epaper_partial_update(epaper_handle_t *handle,
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    ESP_LOGI(TAG, "Partial update not yet implemented");
-    return EPAPER_ERR_INIT;
-}
-
-esp_err_t epaper_sleep(epaper_handle_t *handle)
-{
-    if (handle == NULL) {
+    // Two pixels per byte: the window has to start and end on a byte.
+    if (width == 0 || height == 0 || (x & 1) || (width & 1)) {
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    ESP_LOGI(TAG, "Entering sleep mode...");
+    if (_shadow_frame == NULL) {
+        return EPAPER_ERR_MEMORY;
+    }
+
+    epaper_lock(portMAX_DELAY);
+
+    uint16_t bx = x / 2;
+    uint16_t bw = width / 2;
+    bool known = _shadow_valid;
+
+    if (!known && (width != handle->width || height != handle->height)) {
+        ESP_LOGE(TAG, "Panel content unknown, a full frame is needed first");
+        epaper_unlock();
+        return EPAPER_ERR_INIT;
+    }
+
+    epaper_rect_t rects[EPAPER_MAX_DIRTY_RECTS];
+    size_t count = 0;
+    size_t dirty_bytes = MAX_DISPLAY_BUFFER_SIZE;
+
+    if (known) {
+        count = epaper_find_dirty_rects(buffer, bx, y, bw, height, rects);
+        if (count == 0) {
+            ESP_LOGI(TAG, "Partial update: window unchanged, skipping refresh");
+            _last_unchanged = true;
+            epaper_unlock();
+            return ESP_OK;
+        }
+
+        dirty_bytes = 0;
+        for (size_t i = 0; i < count; i++) {
+            dirty_bytes += (size_t)(rects[i].x1 - rects[i].x0) * (rects[i].y1 - rects[i].y0);
+        }
+    }
+
+    // The shadow becomes the frame to display; everything is sent from it.
+    for (uint16_t r = 0; r < height; r++) {
+        memcpy(_shadow_frame + (size_t)(y + r) * EPAPER_ROW_BYTES + bx, buffer + (size_t)r * bw, bw);
+    }
+    _pending_hash = epaper_frame_hash(_shadow_frame, MAX_DISPLAY_BUFFER_SIZE);
+    _pending_valid = true;
+    _last_unchanged = false;
+
+    const char *fallback = NULL;
+#ifdef CONFIG_ENABLE_PARTIAL_UPDATE
+    if (!known) {
+        fallback = "no previous frame";
+    } else if (!_ram_synced || epaper_needs_init()) {
+        fallback = "controller RAM lost";
+    } else if (dirty_bytes * 100 > (size_t)MAX_DISPLAY_BUFFER_SIZE * EPAPER_DIRTY_MAX_PERCENT) {
+        fallback = "dirty area too large";
+    }
+#else
+    fallback = "partial windows disabled";
+#endif
+
+    memset(&_partial_stats, 0, sizeof(_partial_stats));
+    epaper_timing_begin("partial");
+    int64_t start = esp_timer_get_time();
+
+    esp_err_t ret;
+    if (fallback == NULL) {
+        ret = epaper_transfer_windows(handle, rects, count);
+    } else {
+        ESP_LOGI(TAG, "Partial update: full refresh (%s)", fallback);
+        ret = epaper_transfer_frame(handle, _shadow_frame);
+    }
+
+    _partial_stats.xfer_us = esp_timer_get_time() - start;
+
+    if (ret == ESP_OK) {
+        ret = epaper_do_refresh(handle, false);
+    } else {
+        _status = epaper_idle_status();
+    }
+
+    if (ret == ESP_OK) {
+        _partial_stats.windowed = (fallback == NULL);
+        _partial_stats.rects = _partial_stats.windowed ? count : 0;
+        _partial_stats.bytes = _partial_stats.windowed ? dirty_bytes : MAX_DISPLAY_BUFFER_SIZE;
+        if (_partial_stats.windowed) {
+            ESP_LOGI(TAG, "Partial update: %u rects, %u/%u bytes, %lld us transfer + %lld us refresh",
+                     (unsigned)count, (unsigned)dirty_bytes, (unsigned)MAX_DISPLAY_BUFFER_SIZE,
+                     (long long)_partial_stats.xfer_us, (long long)_partial_stats.refresh_us);
+            // Only comparable once this session has timed a full update.
+            if (_full_xfer_us > 0 && _full_refresh_us > 0) {
+                _partial_stats.saved_us = (_full_xfer_us + _full_refresh_us) -
+                                          (_partial_stats.xfer_us + _partial_stats.refresh_us);
+                ESP_LOGI(TAG, "Partial update: %lld us saved over a full update",
+                         (long long)_partial_stats.saved_us);
+            }
+        } else {
+            _partial_stats.refresh_us = _full_refresh_us;
+        }
+    } else {
+        // The window was merged into the shadow before sending, so neither
+        // it nor controller RAM can be trusted to match the panel any more;
+        // the next update has to be a full one.
+        _shadow_valid = false;
+        _ram_synced = false;
+        _pending_valid = false;
+        _committed_valid = false;
+        ESP_LOGE(TAG, "Partial update failed");
+    }
+    epaper_timing_end(ret);
 
+    epaper_unlock();
+    return ret;
+}
+
+static void epaper_do_sleep(epaper_handle_t *handle)
+{
     epaper_send_command(handle, EPAPER_CMD_DEEP_SLEEP);
     uint8_t sleep_data[] = {0xA5};
     epaper_send_data(handle, sleep_data, sizeof(sleep_data));
 
     vTaskDelay(200 / portTICK_PERIOD_MS);
-    _init_display_done = false;
-
-    return ESP_OK;
+    _power_state = EPAPER_POWER_DEEP_SLEEP;
+    _ram_synced = false;
+    _status = EPAPER_STATUS_POWERED_OFF;
 }
 
-esp_err_t epaper_wake(epaper_handle_t *handle)
+esp_err_t epaper_sleep(epaper_handle_t *handle)
 {
     if (handle == NULL) {
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    ESP_LOGI(TAG, "Waking up from sleep...");
+    ESP_LOGI(TAG, "Entering sleep mode...");
 
-    epaper_reset(handle);
-    epaper_wait_busy(handle, 1000);
+    epaper_lock(portMAX_DELAY);
+    epaper_do_sleep(handle);
+    epaper_unlock();
 
-    return epaper_init_display_sequence(handle);
+    return ESP_OK;
 }
 
-esp_err_t epaper_wait_busy(epaper_handle_t *handle, uint32_t timeout_ms)
+esp_err_t epaper_wake(epaper_handle_t *handle)
 {
     if (handle == NULL) {
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    uint32_t start = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    ESP_LOGI(TAG, "Waking up from sleep...");
 
-    while (gpio_get_level(handle->busy_pin) == 0) {
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+    epaper_lock(portMAX_DELAY);
+    epaper_timing_begin("wake");
 
-        if ((xTaskGetTickCount() * portTICK_PERIOD_MS - start) > timeout_ms) {
-            ESP_LOGE(TAG, "Timeout waiting for busy signal");
-            return EPAPER_ERR_TIMEOUT;
-        }
-    }
+    epaper_reset(handle);
+    epaper_wait_busy_phase(handle, 1000, "RESET");
+    _power_state = EPAPER_POWER_UNINITIALIZED;
 
-    return ESP_OK;
+    esp_err_t ret = epaper_init_display_sequence(handle);
+    epaper_timing_end(ret);
+
+    epaper_unlock();
+    return ret;
+}
+
+esp_err_t epaper_wait_busy(epaper_handle_t *handle, uint32_t timeout_ms)
+{
+    return epaper_wait_busy_phase(handle, timeout_ms, "BUSY");
 }
 
 esp_err_t epaper_set_pixel(uint8_t *buffer, uint16_t x, uint16_t y,
@@ -553,14 +1786,24 @@ esp_err_t epaper_fill_screen(epaper_handle_t *handle, epaper_color_t color)
     uint8_t pv = color7(color);
     uint8_t pv2 = pv | (pv << 4);
 
-    memset(_pixel_buffer, pv2, sizeof(_pixel_buffer));
+    uint8_t *pixel_buffer = fb_get_back();
+    if (pixel_buffer == NULL) {
+        return EPAPER_ERR_MEMORY;
+    }
+
+    memset(pixel_buffer, pv2, MAX_DISPLAY_BUFFER_SIZE);
 
     return ESP_OK;
 }
 
 esp_err_t epaper_display(epaper_handle_t *handle)
 {
-    return epaper_display_frame(handle, _pixel_buffer);
+    uint8_t *pixel_buffer = fb_get_back();
+    if (pixel_buffer == NULL) {
+        return EPAPER_ERR_MEMORY;
+    }
+
+    return epaper_display_frame(handle, pixel_buffer);
 }
 
 esp_err_t epaper_display_partial(epaper_handle_t *handle, bool partial_update)
@@ -569,27 +1812,121 @@ esp_err_t epaper_display_partial(epaper_handle_t *handle, bool partial_update)
         return EPAPER_ERR_INVALID_PARAM;
     }
 
-    esp_err_t ret = epaper_display_frame(handle, _pixel_buffer);
-    if (ret == ESP_OK && !partial_update) {
-        epaper_sleep(handle);
+    uint8_t *pixel_buffer = fb_get_back();
+    if (pixel_buffer == NULL) {
+        return EPAPER_ERR_MEMORY;
+    }
+
+    esp_err_t ret = epaper_display_frame(handle, pixel_buffer);
+    if (ret == ESP_OK) {
+        if (!partial_update) {
+            epaper_sleep(handle);
+        }
     }
 
     return ret;
 }
 
-esp_err_t gdep073e01_init_specific(epaper_handle_t *handle)
+esp_err_t epaper_set_xfer_mode(epaper_xfer_mode_t mode)
+{
+    if (mode != EPAPER_XFER_BLOCKING && mode != EPAPER_XFER_QUEUED) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    _xfer_mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t epaper_get_xfer_stats(epaper_xfer_stats_t *stats)
+{
+    if (stats == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    *stats = _xfer_stats;
+    return ESP_OK;
+}
+
+esp_err_t epaper_get_partial_stats(epaper_partial_stats_t *stats)
 {
-    ESP_LOGI(TAG, "Initializing GDEP073E01 specific settings...");
+    if (stats == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    *stats = _partial_stats;
+    return ESP_OK;
+}
 
-    handle->width = 800;
-    handle->height = 480;
+esp_err_t epaper_get_busy_stats(epaper_busy_stats_t *stats)
+{
+    if (stats == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
 
+    *stats = _busy_stats;
     return ESP_OK;
 }
 
-esp_err_t gdep073e01_clear_white(epaper_handle_t *handle)
+size_t epaper_get_busy_log(epaper_busy_record_t *records, size_t max_records)
+{
+    if (records == NULL) {
+        return 0;
+    }
+
+    size_t count = _busy_log_head < EPAPER_BUSY_LOG_SIZE ? _busy_log_head : EPAPER_BUSY_LOG_SIZE;
+    if (count > max_records) {
+        count = max_records;
+    }
+
+    // Oldest first.
+    uint32_t first = _busy_log_head - count;
+    for (size_t i = 0; i < count; i++) {
+        records[i] = _busy_log[(first + i) % EPAPER_BUSY_LOG_SIZE];
+    }
+
+    return count;
+}
+
+size_t epaper_get_timing_records(epaper_timing_record_t *records, size_t max_records)
+{
+    if (records == NULL) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&_timing_mux);
+    size_t count = _timing_head < EPAPER_TIMING_RING_SIZE ? _timing_head : EPAPER_TIMING_RING_SIZE;
+    if (count > max_records) {
+        count = max_records;
+    }
+
+    // Oldest first.
+    uint32_t first = _timing_head - count;
+    for (size_t i = 0; i < count; i++) {
+        records[i] = _timing_ring[(first + i) % EPAPER_TIMING_RING_SIZE];
+    }
+    portEXIT_CRITICAL(&_timing_mux);
+
+    return count;
+}
+
+void epaper_dump_timing(void)
 {
-    ESP_LOGI(TAG, "Clearing GDEP073E01 to white...");
+    static epaper_timing_record_t records[EPAPER_TIMING_RING_SIZE];
+    size_t count = epaper_get_timing_records(records, EPAPER_TIMING_RING_SIZE);
+
+    if (count == 0) {
+        ESP_LOGI(TAG, "No display updates recorded");
+        return;
+    }
 
-    return epaper_clear(handle, EPAPER_COLOR_WHITE);
-}
\ No newline at end of file
+    for (size_t i = 0; i < count; i++) {
+        const epaper_timing_record_t *rec = &records[i];
+        ESP_LOGI(TAG, "#%lu %s: %lu us total, result %s", (unsigned long)rec->seq, rec->kind,
+                 (unsigned long)rec->total_us, esp_err_to_name(rec->result));
+        for (uint8_t p = 0; p < rec->phase_count; p++) {
+            const epaper_timing_phase_t *phase = &rec->phases[p];
+            ESP_LOGI(TAG, "    %-6s +%8lu us  %8lu us%s", phase->name, (unsigned long)phase->start_us,
+                     (unsigned long)phase->duration_us, phase->timed_out ? "  TIMEOUT" : "");
+        }
+    }
+}
@@ -2,12 +2,17 @@
 #define EPAPER_DRIVER_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
 
+typedef struct epaper_transport epaper_transport_t;
+
 typedef struct {
     spi_device_handle_t spi;
+    const epaper_transport_t *transport;    // NULL selects the SPI backend
     gpio_num_t cs_pin;
     gpio_num_t dc_pin;
     gpio_num_t rst_pin;
@@ -44,6 +49,129 @@ typedef enum {
     EPAPER_ERR_INVALID_PARAM = -6
 } epaper_error_t;
 
+typedef enum {
+    EPAPER_XFER_BLOCKING = 0,
+    EPAPER_XFER_QUEUED
+} epaper_xfer_mode_t;
+
+typedef struct {
+    epaper_xfer_mode_t mode;
+    uint32_t bytes;
+    uint32_t chunks;
+    int64_t elapsed_us;
+    float mbps;
+} epaper_xfer_stats_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t timeouts;
+    int64_t last_us;
+    int64_t max_us;
+    int64_t total_us;
+} epaper_busy_stats_t;
+
+#define EPAPER_TIMING_MAX_PHASES   24
+
+// One timed step of a display update. start_us is relative to the start
+// of the record.
+typedef struct {
+    const char *name;
+    uint32_t start_us;
+    uint32_t duration_us;
+    bool timed_out;
+} epaper_timing_phase_t;
+
+// Timeline of one update: reset, init batches, BUSY waits (RESET, PON,
+// DRF, POF), pixel data transfer (DTM), in the order they happened.
+typedef struct {
+    uint32_t seq;
+    const char *kind;       // "init", "full", "banded", "partial", "refresh" or "wake"
+    int64_t start_us;
+    uint32_t total_us;
+    esp_err_t result;
+    uint8_t phase_count;
+    epaper_timing_phase_t phases[EPAPER_TIMING_MAX_PHASES];
+} epaper_timing_record_t;
+
+typedef struct {
+    const char *phase;
+    int64_t duration_us;
+    bool timed_out;
+} epaper_busy_record_t;
+
+typedef enum {
+    EPAPER_STATUS_POWERED_OFF = 0,
+    EPAPER_STATUS_POWERED_ON,
+    EPAPER_STATUS_TRANSFERRING,
+    EPAPER_STATUS_REFRESHING
+} epaper_status_t;
+
+typedef enum {
+    EPAPER_POWER_UNINITIALIZED = 0,
+    EPAPER_POWER_ACTIVE,
+    EPAPER_POWER_OFF,
+    EPAPER_POWER_DEEP_SLEEP
+} epaper_power_state_t;
+
+typedef enum {
+    EPAPER_WAIT_NONE = 0,
+    EPAPER_WAIT_BUSY
+} epaper_wait_t;
+
+// One controller command of a compile-time init table.
+typedef struct {
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t data[6];
+    uint8_t wait;
+    uint16_t timeout_ms;
+    uint16_t delay_ms;
+    const char *name;
+} epaper_init_cmd_t;
+
+typedef struct {
+    uint32_t iterations;
+    int64_t single_us;
+    int64_t burst_us;
+    float single_cmds_per_s;
+    float burst_cmds_per_s;
+} epaper_cmd_bench_t;
+
+typedef struct {
+    bool windowed;          // false: fell back to a full transfer and refresh
+    uint32_t rects;
+    uint32_t bytes;
+    int64_t xfer_us;
+    int64_t refresh_us;
+    int64_t saved_us;       // against the last full update; 0 until one has been timed
+} epaper_partial_stats_t;
+
+typedef void (*epaper_done_cb_t)(esp_err_t result, void *arg);
+
+// Fills rows [y, y + rows) of the frame into band, packed 4bpp with
+// width/2 bytes per row. The last band of a frame may be shorter. An error
+// aborts the update: later bands are sent white without calling render,
+// no refresh runs, and the display call returns the error.
+typedef esp_err_t (*epaper_band_render_fn_t)(uint8_t *band, uint16_t y, uint16_t rows, void *ctx);
+
+// Opens the long-lived panel session: SPI bus/device, BUSY interrupt and
+// staging buffers. The controller init sequence runs lazily on first use.
+esp_err_t epaper_session_open(const epaper_handle_t *config);
+
+epaper_handle_t *epaper_session_get(void);
+
+esp_err_t epaper_session_close(void);
+
+epaper_power_state_t epaper_get_power_state(void);
+
+// Idle time in POF before the session puts the panel into deep sleep; 0 disables.
+void epaper_session_set_idle_sleep(uint32_t idle_ms);
+
+// Reset-to-ready time of the last init sequence.
+int64_t epaper_get_init_time_us(void);
+
+esp_err_t epaper_bench_commands(epaper_handle_t *handle, uint32_t iterations, epaper_cmd_bench_t *result);
+
 esp_err_t epaper_init(epaper_handle_t *handle);
 
 esp_err_t epaper_init_fast(epaper_handle_t *handle);
@@ -54,6 +182,49 @@ esp_err_t epaper_clear(epaper_handle_t *handle, epaper_color_t color);
 
 esp_err_t epaper_display_frame(epaper_handle_t *handle, uint8_t *frame_buffer);
 
+// Takes the panel for an update without waiting, EPAPER_ERR_BUSY while a
+// transfer or refresh has it. Claim before loading the next image into the
+// back buffer: the calling task's next async display call takes the claim
+// over as its own hold, and epaper_release_update gives it back when no
+// display follows (a no-op once the display call has taken it).
+esp_err_t epaper_claim_update(void);
+void epaper_release_update(void);
+
+// Returns once the pixel data has been sent; the refresh then runs in the
+// background and done_cb is called from the refresh task when it finishes.
+// The async calls never wait for the panel: unless the caller has claimed
+// it they fail with EPAPER_ERR_BUSY while another update holds it.
+esp_err_t epaper_display_frame_async(epaper_handle_t *handle, const uint8_t *frame_buffer,
+                                     epaper_done_cb_t done_cb, void *cb_arg);
+
+// Produces the frame band by band, with no frame buffer: render is called
+// top to bottom with consecutive bands of epaper_get_band_height() rows,
+// each written straight into a DMA staging buffer that goes to the
+// controller while render fills the next. The band is only valid for the
+// duration of the call. The bands are hashed as they go out, so the frame
+// hash is known afterwards, but the frame itself is never skipped as
+// unchanged: it is only seen once it has been sent.
+esp_err_t epaper_display_banded(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx);
+
+// As above, returning once the last band has been sent; the refresh then
+// runs in the background as with epaper_display_frame_async.
+esp_err_t epaper_display_banded_async(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx,
+                                      epaper_done_cb_t done_cb, void *cb_arg);
+
+// For callers that know the epaper_frame_hash of the frame render will
+// produce: a frame identical to the one on the panel is skipped before
+// anything is sent, as in epaper_display_frame_async.
+esp_err_t epaper_display_banded_hashed_async(epaper_handle_t *handle, epaper_band_render_fn_t render, void *ctx,
+                                             uint32_t frame_hash, epaper_done_cb_t done_cb, void *cb_arg);
+
+// Rows per band, 1 to 10 (one 4 KB staging chunk).
+esp_err_t epaper_set_band_height(uint16_t rows);
+
+uint16_t epaper_get_band_height(void);
+
+// Updates a window of the panel from a packed 4bpp buffer of width/2 bytes
+// per row; x and width must be even. Only the changed rectangles are sent
+// through partial windows, otherwise it falls back to a full refresh.
 esp_err_t epaper_partial_update(epaper_handle_t *handle,
                                 uint16_t x, uint16_t y,
                                 uint16_t width, uint16_t height,
@@ -65,15 +236,64 @@ esp_err_t epaper_wake(epaper_handle_t *handle);
 
 esp_err_t epaper_wait_busy(epaper_handle_t *handle, uint32_t timeout_ms);
 
+// The 4-bit code the controller expects for a colour.
+uint8_t epaper_color_code(epaper_color_t color);
+
 esp_err_t epaper_set_pixel(uint8_t *buffer, uint16_t x, uint16_t y,
                            epaper_color_t color, uint16_t width, uint16_t height);
 
 esp_err_t epaper_refresh(epaper_handle_t *handle, bool partial_update);
 
+uint32_t epaper_frame_hash(const uint8_t *buf, size_t len);
+
+// epaper_frame_hash over data that arrives in pieces, e.g. band by band.
+typedef struct {
+    uint32_t v[4];
+    uint8_t buf[16];
+    size_t buffered;
+    size_t total;
+} epaper_hash_t;
+
+void epaper_hash_begin(epaper_hash_t *state);
+void epaper_hash_update(epaper_hash_t *state, const uint8_t *data, size_t len);
+uint32_t epaper_hash_end(const epaper_hash_t *state);
+
+// True when the last display call found the frame identical to the one on
+// the panel and returned without refreshing. *hash receives that frame's hash.
+bool epaper_last_frame_unchanged(uint32_t *hash);
+
+// Hash of the frame currently on the panel; false if it is not known.
+bool epaper_get_frame_hash(uint32_t *hash);
+
+void epaper_invalidate_frame_hash(void);
+
+esp_err_t epaper_refresh_async(epaper_handle_t *handle, bool partial_update,
+                               epaper_done_cb_t done_cb, void *cb_arg);
+
+epaper_status_t epaper_get_status(void);
+
+esp_err_t epaper_wait_idle(uint32_t timeout_ms);
+
 esp_err_t epaper_fill_screen(epaper_handle_t *handle, epaper_color_t color);
 
 esp_err_t epaper_display(epaper_handle_t *handle);
 
 esp_err_t epaper_display_partial(epaper_handle_t *handle, bool partial_update);
 
+esp_err_t epaper_set_xfer_mode(epaper_xfer_mode_t mode);
+
+esp_err_t epaper_get_xfer_stats(epaper_xfer_stats_t *stats);
+
+esp_err_t epaper_get_partial_stats(epaper_partial_stats_t *stats);
+
+esp_err_t epaper_get_busy_stats(epaper_busy_stats_t *stats);
+
+size_t epaper_get_busy_log(epaper_busy_record_t *records, size_t max_records);
+
+// Copies the most recent completed updates, oldest first.
+size_t epaper_get_timing_records(epaper_timing_record_t *records, size_t max_records);
+
+// Prints the recorded updates and their phases to the log.
+void epaper_dump_timing(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "epaper_rotate.h"
+#include "framebuffer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "EPAPER_ROTATE";
+
+#ifndef CONFIG_EPAPER_ROTATION
+#define CONFIG_EPAPER_ROTATION 0
+#endif
+
+#define TILE    8
+
+static epaper_rotation_t _default_rotation = (epaper_rotation_t)(CONFIG_EPAPER_ROTATION / 90);
+static epaper_rotate_stats_t _stats;
+
+typedef struct {
+    const uint8_t *src;
+    uint16_t src_w;
+    uint16_t src_h;
+    epaper_rotation_t rotation;
+} rotate_ctx_t;
+
+esp_err_t epaper_rotation_from_degrees(int degrees, epaper_rotation_t *rotation)
+{
+    if (rotation == NULL || degrees < 0 || degrees > 270 || degrees % 90 != 0) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    *rotation = (epaper_rotation_t)(degrees / 90);
+    return ESP_OK;
+}
+
+int epaper_rotation_degrees(epaper_rotation_t rotation)
+{
+    return (int)rotation * 90;
+}
+
+void epaper_set_default_rotation(epaper_rotation_t rotation)
+{
+    _default_rotation = rotation;
+}
+
+epaper_rotation_t epaper_get_default_rotation(void)
+{
+    return _default_rotation;
+}
+
+epaper_rotation_t epaper_default_rotation_for(uint16_t src_w, uint16_t src_h)
+{
+    bool portrait = src_h > src_w;
+    bool swapped = (_default_rotation == EPAPER_ROTATE_90 || _default_rotation == EPAPER_ROTATE_270);
+
+    if (portrait != swapped) {
+        return (epaper_rotation_t)((_default_rotation + 1) % 4);
+    }
+    return _default_rotation;
+}
+
+static inline uint8_t px_get(const uint8_t *row, int x)
+{
+    return (x & 1) ? (row[x >> 1] & 0x0F) : (row[x >> 1] >> 4);
+}
+
+static inline void px_put(uint8_t *row, int x, uint8_t c)
+{
+    uint8_t *p = &row[x >> 1];
+    *p = (x & 1) ? ((*p & 0xF0) | c) : ((*p & 0x0F) | (c << 4));
+}
+
+static inline uint32_t load_row(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store_row(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// Transposes an 8x8 block of nibbles held as eight rows of eight pixels,
+// first pixel in the top nibble: swap 4x4 quadrants, then 2x2, then 1x1.
+static void transpose8x8(uint32_t w[TILE])
+{
+    for (int r = 0; r < 4; r++) {
+        uint32_t a = w[r];
+        uint32_t b = w[r + 4];
+        w[r] = (a & 0xFFFF0000) | (b >> 16);
+        w[r + 4] = (a << 16) | (b & 0x0000FFFF);
+    }
+
+    for (int r = 0; r < TILE; r += (r & 1) ? 3 : 1) {
+        uint32_t a = w[r];
+        uint32_t b = w[r + 2];
+        w[r] = (a & 0xFF00FF00) | ((b >> 8) & 0x00FF00FF);
+        w[r + 2] = ((a << 8) & 0xFF00FF00) | (b & 0x00FF00FF);
+    }
+
+    for (int r = 0; r < TILE; r += 2) {
+        uint32_t a = w[r];
+        uint32_t b = w[r + 1];
+        w[r] = (a & 0xF0F0F0F0) | ((b >> 4) & 0x0F0F0F0F);
+        w[r + 1] = ((a << 4) & 0xF0F0F0F0) | (b & 0x0F0F0F0F);
+    }
+}
+
+// Source pixel shown at output (ox, oy).
+static inline void source_xy(int ox, int oy, uint16_t src_w, uint16_t src_h,
+                             epaper_rotation_t rotation, int *sx, int *sy)
+{
+    switch (rotation) {
+        case EPAPER_ROTATE_90:
+            *sx = oy;
+            *sy = src_h - 1 - ox;
+            break;
+        case EPAPER_ROTATE_180:
+            *sx = src_w - 1 - ox;
+            *sy = src_h - 1 - oy;
+            break;
+        case EPAPER_ROTATE_270:
+            *sx = src_w - 1 - oy;
+            *sy = ox;
+            break;
+        default:
+            *sx = ox;
+            *sy = oy;
+            break;
+    }
+}
+
+// One 8-row output strip starting at output row oy, for 90 or 270 degrees.
+// Each tile reads 8 source rows of 4 bytes, so every PSRAM cache line
+// fetched is used for the whole strip before moving on.
+static void rotate_strip(uint8_t *dst, int dst_stride, int oy,
+                         const uint8_t *src, uint16_t src_w, uint16_t src_h,
+                         epaper_rotation_t rotation)
+{
+    int src_stride = src_w / 2;
+    int out_w = src_h;
+    uint32_t w[TILE];
+
+    for (int ox = 0; ox < out_w; ox += TILE) {
+        if (rotation == EPAPER_ROTATE_90) {
+            // Output columns run up the source: load the tile bottom-up.
+            int sx = oy;
+            int sy = src_h - TILE - ox;
+            for (int r = 0; r < TILE; r++) {
+                w[r] = load_row(src + (size_t)(sy + TILE - 1 - r) * src_stride + sx / 2);
+            }
+            transpose8x8(w);
+            for (int r = 0; r < TILE; r++) {
+                store_row(dst + (size_t)r * dst_stride + ox / 2, w[r]);
+            }
+        } else {
+            // Output rows run right to left across the source: store bottom-up.
+            int sx = src_w - TILE - oy;
+            int sy = ox;
+            for (int r = 0; r < TILE; r++) {
+                w[r] = load_row(src + (size_t)(sy + r) * src_stride + sx / 2);
+            }
+            transpose8x8(w);
+            for (int r = 0; r < TILE; r++) {
+                store_row(dst + (size_t)(TILE - 1 - r) * dst_stride + ox / 2, w[r]);
+            }
+        }
+    }
+}
+
+static void rotate_row_180(uint8_t *dst, const uint8_t *src_row, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        uint8_t b = src_row[bytes - 1 - i];
+        dst[i] = (uint8_t)((b << 4) | (b >> 4));
+    }
+}
+
+void epaper_rotate_rows(uint8_t *dst, uint16_t y, uint16_t rows,
+                        const uint8_t *src, uint16_t src_w, uint16_t src_h,
+                        epaper_rotation_t rotation)
+{
+    int64_t start = esp_timer_get_time();
+    bool swapped = (rotation == EPAPER_ROTATE_90 || rotation == EPAPER_ROTATE_270);
+    int out_w = swapped ? src_h : src_w;
+    int stride = out_w / 2;
+    int src_stride = src_w / 2;
+    int end = y + rows;
+    int oy = y;
+
+    while (oy < end) {
+        uint8_t *out = dst + (size_t)(oy - y) * stride;
+
+        if (rotation == EPAPER_ROTATE_0) {
+            memcpy(out, src + (size_t)oy * src_stride, stride);
+            oy++;
+        } else if (rotation == EPAPER_ROTATE_180) {
+            rotate_row_180(out, src + (size_t)(src_h - 1 - oy) * src_stride, stride);
+            oy++;
+        } else if ((oy % TILE) == 0 && oy + TILE <= end) {
+            rotate_strip(out, stride, oy, src, src_w, src_h, rotation);
+            oy += TILE;
+        } else {
+            // Rows outside a whole tile, e.g. with a 10-row band.
+            for (int ox = 0; ox < out_w; ox++) {
+                int sx, sy;
+                source_xy(ox, oy, src_w, src_h, rotation, &sx, &sy);
+                px_put(out, ox, px_get(src + (size_t)sy * src_stride, sx));
+            }
+            oy++;
+        }
+    }
+
+    _stats.rows += rows;
+    _stats.elapsed_us += esp_timer_get_time() - start;
+}
+
+static esp_err_t rotate_render(uint8_t *band, uint16_t y, uint16_t rows, void *ctx)
+{
+    const rotate_ctx_t *rc = ctx;
+    epaper_rotate_rows(band, y, rows, rc->src, rc->src_w, rc->src_h, rc->rotation);
+
+    // The last band was the last read of src.
+    uint16_t out_h = (rc->rotation == EPAPER_ROTATE_90 || rc->rotation == EPAPER_ROTATE_270) ? rc->src_w : rc->src_h;
+    if (y + rows >= out_h) {
+        fb_present(rc->src);
+    }
+    return ESP_OK;
+}
+
+// epaper_frame_hash of the rotated image, built one tile-high band at a
+// time, so an unchanged image can be skipped before any of it is sent.
+static esp_err_t rotated_hash(const rotate_ctx_t *rc, uint16_t out_w, uint16_t out_h, uint32_t *hash)
+{
+    size_t band_bytes = (size_t)TILE * out_w / 2;
+    uint8_t *band = heap_caps_malloc(band_bytes, MALLOC_CAP_8BIT);
+    if (band == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    epaper_hash_t state;
+    epaper_hash_begin(&state);
+    for (uint16_t y = 0; y < out_h; y += TILE) {
+        epaper_rotate_rows(band, y, TILE, rc->src, rc->src_w, rc->src_h, rc->rotation);
+        epaper_hash_update(&state, band, band_bytes);
+    }
+    heap_caps_free(band);
+
+    *hash = epaper_hash_end(&state);
+    return ESP_OK;
+}
+
+esp_err_t epaper_display_rotated_async(epaper_handle_t *handle, const uint8_t *src,
+                                       uint16_t src_w, uint16_t src_h, epaper_rotation_t rotation,
+                                       epaper_done_cb_t done_cb, void *cb_arg)
+{
+    if (handle == NULL || src == NULL || (src_w % TILE) || (src_h % TILE)) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    bool swapped = (rotation == EPAPER_ROTATE_90 || rotation == EPAPER_ROTATE_270);
+    uint16_t out_w = swapped ? src_h : src_w;
+    uint16_t out_h = swapped ? src_w : src_h;
+    if (out_w != handle->width || out_h != handle->height) {
+        ESP_LOGE(TAG, "%ux%u source does not fit the panel at %d degrees",
+                 src_w, src_h, epaper_rotation_degrees(rotation));
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    if (rotation == EPAPER_ROTATE_0) {
+        return epaper_display_frame_async(handle, src, done_cb, cb_arg);
+    }
+
+    rotate_ctx_t ctx = {
+        .src = src,
+        .src_w = src_w,
+        .src_h = src_h,
+        .rotation = rotation
+    };
+
+    // Hashing costs a rotation pass of its own, so it is only done when the
+    // panel's frame is known and the image could match it.
+    int64_t start = esp_timer_get_time();
+    uint32_t hash = 0;
+    bool hashed = epaper_get_frame_hash(NULL) && rotated_hash(&ctx, out_w, out_h, &hash) == ESP_OK;
+    if (hashed) {
+        ESP_LOGI(TAG, "Rotated frame hash %08lx in %lld us", (unsigned long)hash,
+                 (long long)(esp_timer_get_time() - start));
+    }
+
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.rotation = rotation;
+
+    // The transfer (and with it every render call) is done on return.
+    esp_err_t ret = hashed ? epaper_display_banded_hashed_async(handle, rotate_render, &ctx, hash, done_cb, cb_arg)
+                           : epaper_display_banded_async(handle, rotate_render, &ctx, done_cb, cb_arg);
+
+    ESP_LOGI(TAG, "Rotated %d degrees: %lu rows in %lld us",
+             epaper_rotation_degrees(rotation), (unsigned long)_stats.rows, (long long)_stats.elapsed_us);
+    return ret;
+}
+
+esp_err_t epaper_rotate_get_stats(epaper_rotate_stats_t *stats)
+{
+    if (stats == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    *stats = _stats;
+    return ESP_OK;
+}
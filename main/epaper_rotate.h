@@ -0,0 +1,52 @@
+#ifndef EPAPER_ROTATE_H
+#define EPAPER_ROTATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "epaper_driver.h"
+
+// Clockwise rotation applied to the source image before it reaches the panel.
+typedef enum {
+    EPAPER_ROTATE_0 = 0,
+    EPAPER_ROTATE_90,
+    EPAPER_ROTATE_180,
+    EPAPER_ROTATE_270
+} epaper_rotation_t;
+
+typedef struct {
+    epaper_rotation_t rotation;
+    uint32_t rows;
+    int64_t elapsed_us;
+} epaper_rotate_stats_t;
+
+// Maps 0/90/180/270 to a rotation; other values are rejected.
+esp_err_t epaper_rotation_from_degrees(int degrees, epaper_rotation_t *rotation);
+int epaper_rotation_degrees(epaper_rotation_t rotation);
+
+void epaper_set_default_rotation(epaper_rotation_t rotation);
+epaper_rotation_t epaper_get_default_rotation(void);
+
+// The default rotation, turned a further 90 degrees if the image is in the
+// other orientation (a 480x800 image with a landscape default, or vice versa).
+epaper_rotation_t epaper_default_rotation_for(uint16_t src_w, uint16_t src_h);
+
+// Produces rows [y, y + rows) of the rotated image into dst from a packed
+// 4bpp src_w x src_h source. Source sizes must be multiples of 8; rows
+// inside 8-row tiles are built with 8x8 nibble transposes.
+void epaper_rotate_rows(uint8_t *dst, uint16_t y, uint16_t rows,
+                        const uint8_t *src, uint16_t src_w, uint16_t src_h,
+                        epaper_rotation_t rotation);
+
+// Streams src to the panel through banded rendering, rotating one band at
+// a time, so only the driver's staging band is used as scratch. src_w x
+// src_h is the source size: 480x800 for 90/270, 800x480 otherwise. When
+// the panel's frame hash is known the rotated image is hashed first (one
+// extra rotation pass into an 8-row band) and skipped if it is unchanged.
+esp_err_t epaper_display_rotated_async(epaper_handle_t *handle, const uint8_t *src,
+                                       uint16_t src_w, uint16_t src_h, epaper_rotation_t rotation,
+                                       epaper_done_cb_t done_cb, void *cb_arg);
+
+esp_err_t epaper_rotate_get_stats(epaper_rotate_stats_t *stats);
+
+#endif
@@ -0,0 +1,331 @@
+#include "epaper_text.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static const char *TAG = "EPAPER_TEXT";
+
+// Glyphs up to 32x32 are cached; larger ones are expanded row by row.
+#define TEXT_GLYPH_MAX_BYTES    512
+#define TEXT_ROW_MAX_BYTES      128
+#define TEXT_REPLACEMENT_CHAR   0xFFFD
+
+typedef struct {
+    const epaper_glyph_t *glyph;
+    uint8_t fg;
+    uint8_t bg;
+    uint32_t stamp;
+    uint8_t *pixels;
+} text_cache_entry_t;
+
+static text_cache_entry_t *_cache = NULL;
+static uint8_t *_cache_slab = NULL;
+static size_t _cache_entries = 0;
+static uint32_t _cache_clock = 0;
+static epaper_text_cache_stats_t _cache_stats;
+
+esp_err_t epaper_text_init(size_t entries)
+{
+    if (entries == 0) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    if (_cache != NULL) {
+        return ESP_OK;
+    }
+
+    _cache_slab = heap_caps_malloc(entries * TEXT_GLYPH_MAX_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (_cache_slab == NULL) {
+        ESP_LOGW(TAG, "No PSRAM for the glyph cache, using internal RAM");
+        _cache_slab = heap_caps_malloc(entries * TEXT_GLYPH_MAX_BYTES, MALLOC_CAP_8BIT);
+    }
+
+    _cache = heap_caps_calloc(entries, sizeof(text_cache_entry_t), MALLOC_CAP_8BIT);
+    if (_cache_slab == NULL || _cache == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate glyph cache");
+        epaper_text_deinit();
+        return EPAPER_ERR_MEMORY;
+    }
+
+    for (size_t i = 0; i < entries; i++) {
+        _cache[i].pixels = _cache_slab + i * TEXT_GLYPH_MAX_BYTES;
+    }
+
+    _cache_entries = entries;
+    memset(&_cache_stats, 0, sizeof(_cache_stats));
+    _cache_stats.entries = entries;
+
+    ESP_LOGI(TAG, "Glyph cache: %u entries, %u bytes", (unsigned)entries,
+             (unsigned)(entries * TEXT_GLYPH_MAX_BYTES));
+    return ESP_OK;
+}
+
+void epaper_text_deinit(void)
+{
+    heap_caps_free(_cache);
+    heap_caps_free(_cache_slab);
+    _cache = NULL;
+    _cache_slab = NULL;
+    _cache_entries = 0;
+}
+
+esp_err_t epaper_text_get_cache_stats(epaper_text_cache_stats_t *stats)
+{
+    if (stats == NULL) {
+        return EPAPER_ERR_INVALID_PARAM;
+    }
+
+    *stats = _cache_stats;
+    return ESP_OK;
+}
+
+// Decodes one code point and advances *p; malformed input yields U+FFFD.
+static uint32_t utf8_next(const char **p)
+{
+    const uint8_t *s = (const uint8_t *)*p;
+    uint32_t cp;
+    int extra;
+
+    if (s[0] < 0x80) {
+        *p += 1;
+        return s[0];
+    } else if ((s[0] & 0xE0) == 0xC0) {
+        cp = s[0] & 0x1F;
+        extra = 1;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        cp = s[0] & 0x0F;
+        extra = 2;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        cp = s[0] & 0x07;
+        extra = 3;
+    } else {
+        *p += 1;
+        return TEXT_REPLACEMENT_CHAR;
+    }
+
+    for (int i = 1; i <= extra; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *p += i;
+            return TEXT_REPLACEMENT_CHAR;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+
+    *p += extra + 1;
+    return cp;
+}
+
+static const epaper_glyph_t *font_find(const epaper_font_t *font, uint32_t cp, const epaper_font_t **owner)
+{
+    for (; font != NULL; font = font->fallback) {
+        int lo = 0;
+        int hi = (int)font->glyph_count - 1;
+
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            uint32_t c = font->glyphs[mid].codepoint;
+            if (c == cp) {
+                *owner = font;
+                return &font->glyphs[mid];
+            }
+            if (c < cp) {
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static const epaper_glyph_t *font_lookup(const epaper_font_t *font, uint32_t cp, const epaper_font_t **owner)
+{
+    const epaper_glyph_t *glyph = font_find(font, cp, owner);
+    if (glyph == NULL) {
+        glyph = font_find(font, TEXT_REPLACEMENT_CHAR, owner);
+    }
+    if (glyph == NULL) {
+        glyph = font_find(font, '?', owner);
+    }
+    return glyph;
+}
+
+// Every pixel pair of a 1bpp row becomes one packed byte through lut.
+static void expand_row(uint8_t *dst, const uint8_t *src, int width, const uint8_t lut[4])
+{
+    int bytes = (width + 1) / 2;
+
+    for (int k = 0; k < bytes; k++) {
+        dst[k] = lut[(src[k >> 2] >> (6 - 2 * (k & 3))) & 3];
+    }
+}
+
+static void make_lut(uint8_t lut[4], uint8_t fg, uint8_t bg)
+{
+    lut[0] = (bg << 4) | bg;
+    lut[1] = (bg << 4) | fg;
+    lut[2] = (fg << 4) | bg;
+    lut[3] = (fg << 4) | fg;
+}
+
+static const uint8_t *cache_get(const epaper_font_t *font, const epaper_glyph_t *glyph, uint8_t fg, uint8_t bg)
+{
+    size_t stride = (glyph->width + 1) / 2;
+    if (_cache == NULL || stride * glyph->height > TEXT_GLYPH_MAX_BYTES) {
+        return NULL;
+    }
+
+    text_cache_entry_t *victim = &_cache[0];
+    for (size_t i = 0; i < _cache_entries; i++) {
+        text_cache_entry_t *e = &_cache[i];
+        if (e->glyph == glyph && e->fg == fg && e->bg == bg) {
+            e->stamp = ++_cache_clock;
+            _cache_stats.hits++;
+            return e->pixels;
+        }
+        if (e->stamp < victim->stamp) {
+            victim = e;
+        }
+    }
+
+    _cache_stats.misses++;
+    if (victim->glyph != NULL) {
+        _cache_stats.evictions++;
+    }
+
+    uint8_t lut[4];
+    make_lut(lut, fg, bg);
+
+    size_t src_stride = (glyph->width + 7) / 8;
+    const uint8_t *src = font->bitmap + glyph->offset;
+    for (int r = 0; r < glyph->height; r++) {
+        expand_row(victim->pixels + r * stride, src + r * src_stride, glyph->width, lut);
+    }
+
+    victim->glyph = glyph;
+    victim->fg = fg;
+    victim->bg = bg;
+    victim->stamp = ++_cache_clock;
+    return victim->pixels;
+}
+
+static void draw_glyph(epaper_canvas_t *canvas, const epaper_font_t *font, const epaper_glyph_t *glyph,
+                       int x, int y, uint8_t fg, uint8_t bg, bool opaque)
+{
+    int gx = x + glyph->left;
+    int gy = y + glyph->top;
+    int stride = (glyph->width + 1) / 2;
+    int mask_stride = (glyph->width + 7) / 8;
+    const uint8_t *mask = font->bitmap + glyph->offset;
+
+    if (glyph->width == 0 || glyph->height == 0) {
+        return;
+    }
+
+    const uint8_t *pixels = cache_get(font, glyph, fg, bg);
+    if (pixels != NULL) {
+        if (opaque) {
+            epaper_draw_blit(canvas, gx, gy, pixels, stride, 0, 0, glyph->width, glyph->height);
+        } else {
+            epaper_draw_blit_masked(canvas, gx, gy, pixels, stride, 0, 0, glyph->width, glyph->height,
+                                    mask, mask_stride);
+        }
+        return;
+    }
+
+    // Too large for the cache (or no cache): expand one row at a time.
+    uint8_t row[TEXT_ROW_MAX_BYTES];
+    uint8_t lut[4];
+    make_lut(lut, fg, bg);
+
+    for (int r = 0; r < glyph->height; r++) {
+        expand_row(row, mask + r * mask_stride, glyph->width, lut);
+        if (opaque) {
+            epaper_draw_blit(canvas, gx, gy + r, row, stride, 0, 0, glyph->width, 1);
+        } else {
+            epaper_draw_blit_masked(canvas, gx, gy + r, row, stride, 0, 0, glyph->width, 1,
+                                    mask + r * mask_stride, mask_stride);
+        }
+    }
+}
+
+int epaper_draw_text(epaper_canvas_t *canvas, const epaper_font_t *font, int x, int y,
+                     const char *text, epaper_color_t fg, epaper_color_t bg)
+{
+    if (canvas == NULL || font == NULL || text == NULL) {
+        return 0;
+    }
+
+    bool opaque = (bg != EPAPER_TEXT_TRANSPARENT);
+    uint8_t fg_code = epaper_color_code(fg);
+    // Transparent text only uses the foreground, so share cache entries.
+    uint8_t bg_code = opaque ? epaper_color_code(bg) : fg_code;
+
+    int pen = x;
+    int widest = 0;
+
+    while (*text != '\0') {
+        uint32_t cp = utf8_next(&text);
+
+        if (cp == '\n') {
+            if (pen - x > widest) {
+                widest = pen - x;
+            }
+            pen = x;
+            y += font->line_height;
+            continue;
+        }
+
+        const epaper_font_t *owner = font;
+        const epaper_glyph_t *glyph = font_lookup(font, cp, &owner);
+        if (glyph == NULL) {
+            continue;
+        }
+
+        if (opaque) {
+            epaper_draw_fill_rect(canvas, pen, y, glyph->advance, font->line_height, bg);
+        }
+
+        // Fallback fonts are aligned on the baseline of the primary font.
+        int top = y + font->ascent - owner->ascent;
+        draw_glyph(canvas, owner, glyph, pen, top, fg_code, bg_code, opaque);
+        pen += glyph->advance;
+    }
+
+    if (pen - x > widest) {
+        widest = pen - x;
+    }
+
+    return widest;
+}
+
+int epaper_text_width(const epaper_font_t *font, const char *text)
+{
+    if (font == NULL || text == NULL) {
+        return 0;
+    }
+
+    int width = 0;
+    int widest = 0;
+
+    while (*text != '\0') {
+        uint32_t cp = utf8_next(&text);
+
+        if (cp == '\n') {
+            if (width > widest) {
+                widest = width;
+            }
+            width = 0;
+            continue;
+        }
+
+        const epaper_font_t *owner = font;
+        const epaper_glyph_t *glyph = font_lookup(font, cp, &owner);
+        if (glyph != NULL) {
+            width += glyph->advance;
+        }
+    }
+
+    return width > widest ? width : widest;
+}
@@ -0,0 +1,59 @@
+#ifndef EPAPER_TEXT_H
+#define EPAPER_TEXT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "epaper_draw.h"
+
+// Pass as background to draw only the glyph pixels.
+#define EPAPER_TEXT_TRANSPARENT    ((epaper_color_t)0xFF)
+
+#define EPAPER_TEXT_CACHE_DEFAULT  64
+
+// One glyph of a font generated by tools/bdf2font.py. The bitmap is 1bpp,
+// MSB first, (width + 7) / 8 bytes per row. left/top place the bitmap
+// relative to the pen position and the top of the line.
+typedef struct {
+    uint32_t codepoint;
+    uint32_t offset;
+    uint8_t width;
+    uint8_t height;
+    int8_t left;
+    int8_t top;
+    uint8_t advance;
+} epaper_glyph_t;
+
+typedef struct epaper_font {
+    const epaper_glyph_t *glyphs;   // sorted by codepoint
+    const uint8_t *bitmap;
+    uint16_t glyph_count;
+    uint8_t ascent;
+    uint8_t line_height;
+    const struct epaper_font *fallback;
+} epaper_font_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entries;
+} epaper_text_cache_stats_t;
+
+extern const epaper_font_t epaper_font_mono16;
+
+// Allocates the expanded glyph cache, preferring PSRAM. Drawing works
+// without it, expanding every glyph on the fly.
+esp_err_t epaper_text_init(size_t entries);
+void epaper_text_deinit(void);
+
+// Draws UTF-8 text with the top of the first line at y; '\n' starts a new
+// line. Returns the width in pixels of the longest line.
+int epaper_draw_text(epaper_canvas_t *canvas, const epaper_font_t *font, int x, int y,
+                     const char *text, epaper_color_t fg, epaper_color_t bg);
+
+int epaper_text_width(const epaper_font_t *font, const char *text);
+
+esp_err_t epaper_text_get_cache_stats(epaper_text_cache_stats_t *stats);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef EPAPER_TRANSPORT_H
+#define EPAPER_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "epaper_driver.h"
+
+// Most segments a caller may have queued and not yet reclaimed.
+#define EPAPER_TRANSPORT_QUEUE_DEPTH   16
+
+// Longest segment the driver hands to write or queue; pixel data goes out
+// in chunks of this size, so a transport has to take it in one piece.
+#define EPAPER_TRANSPORT_MAX_SEGMENT   4096
+
+// Everything the driver needs from the wire: command/data segments, the
+// reset line and the BUSY line. The SPI backend drives the real panel; the
+// host build plugs in a simulated controller instead.
+struct epaper_transport {
+    const char *name;
+
+    // Claims the bus and control pins when the session opens.
+    esp_err_t (*open)(epaper_handle_t *handle);
+    void (*close)(epaper_handle_t *handle);
+
+    // Sends a command (dc = false) or data (dc = true) segment and waits
+    // for it to leave.
+    esp_err_t (*write)(epaper_handle_t *handle, bool dc, const uint8_t *data, size_t len);
+
+    // Starts a segment and returns at once. data must stay untouched until
+    // reclaim has handed the segment back; segments come back in order.
+    esp_err_t (*queue)(epaper_handle_t *handle, bool dc, const uint8_t *data, size_t len);
+    esp_err_t (*reclaim)(epaper_handle_t *handle);
+
+    void (*set_reset)(epaper_handle_t *handle, bool level);
+
+    // Returns once BUSY is high (idle), or EPAPER_ERR_TIMEOUT.
+    esp_err_t (*wait_busy)(epaper_handle_t *handle, uint32_t timeout_ms);
+};
+
+extern const epaper_transport_t epaper_transport_spi;
+
+#endif
@@ -0,0 +1,242 @@
+#include "epaper_transport.h"
+#include "spi_shared.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "EPAPER_SPI";
+
+#define EPAPER_SPI_CLOCK_HZ        (4 * 1000 * 1000)
+#define EPAPER_SD_EN_PIN           GPIO_NUM_16
+// Longer data segments are sent interrupt-driven rather than polled.
+#define EPAPER_SPI_POLL_MAX_BYTES  32
+
+// DC is driven from the transaction's user field just before the SPI
+// peripheral asserts CS, so commands and data can be queued back to back.
+#define EPAPER_DC_COMMAND          ((void *)0)
+#define EPAPER_DC_DATA             ((void *)1)
+
+_Static_assert(EPAPER_TRANSPORT_MAX_SEGMENT <= SPI_SHARED_MAX_TRANSFER,
+               "pixel chunks must fit in one transaction on the shared bus");
+
+static gpio_num_t _dc_pin = GPIO_NUM_NC;
+
+static spi_transaction_t _trans[EPAPER_TRANSPORT_QUEUE_DEPTH];
+static uint32_t _trans_head = 0;
+
+// BUSY is active low; the rising edge at the end of a phase gives this
+// semaphore so waiters sleep instead of polling the pin.
+static SemaphoreHandle_t _busy_sem = NULL;
+static gpio_num_t _busy_irq_pin = GPIO_NUM_NC;
+
+static void IRAM_ATTR epaper_spi_pre_cb(spi_transaction_t *trans)
+{
+    gpio_set_level(_dc_pin, (uint32_t)(uintptr_t)trans->user);
+}
+
+// Command bytes travel in tx_data, so callers need not keep them around.
+static void epaper_spi_prepare(spi_transaction_t *trans, bool dc, const uint8_t *data, size_t len)
+{
+    memset(trans, 0, sizeof(*trans));
+    trans->length = len * 8;
+    trans->user = dc ? EPAPER_DC_DATA : EPAPER_DC_COMMAND;
+
+    if (!dc && len <= sizeof(trans->tx_data)) {
+        trans->flags = SPI_TRANS_USE_TXDATA;
+        memcpy(trans->tx_data, data, len);
+    } else {
+        trans->tx_buffer = data;
+    }
+}
+
+static esp_err_t epaper_spi_write(epaper_handle_t *handle, bool dc, const uint8_t *data, size_t len)
+{
+    spi_transaction_t trans;
+    epaper_spi_prepare(&trans, dc, data, len);
+
+    if (len > EPAPER_SPI_POLL_MAX_BYTES) {
+        return spi_device_transmit(handle->spi, &trans);
+    }
+    return spi_device_polling_transmit(handle->spi, &trans);
+}
+
+static esp_err_t epaper_spi_queue(epaper_handle_t *handle, bool dc, const uint8_t *data, size_t len)
+{
+    spi_transaction_t *trans = &_trans[_trans_head % EPAPER_TRANSPORT_QUEUE_DEPTH];
+    epaper_spi_prepare(trans, dc, data, len);
+
+    esp_err_t ret = spi_device_queue_trans(handle->spi, trans, portMAX_DELAY);
+    if (ret == ESP_OK) {
+        _trans_head++;
+    }
+    return ret;
+}
+
+static esp_err_t epaper_spi_reclaim(epaper_handle_t *handle)
+{
+    spi_transaction_t *done;
+    return spi_device_get_trans_result(handle->spi, &done, portMAX_DELAY);
+}
+
+static void epaper_spi_set_reset(epaper_handle_t *handle, bool level)
+{
+    gpio_set_level(handle->rst_pin, level ? 1 : 0);
+}
+
+static void IRAM_ATTR epaper_busy_isr(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(_busy_sem, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static esp_err_t epaper_busy_irq_init(epaper_handle_t *handle)
+{
+    if (_busy_sem == NULL) {
+        _busy_sem = xSemaphoreCreateBinary();
+        if (_busy_sem == NULL) {
+            return EPAPER_ERR_MEMORY;
+        }
+    }
+
+    gpio_set_intr_type(handle->busy_pin, GPIO_INTR_POSEDGE);
+
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to install GPIO ISR service");
+        return EPAPER_ERR_INIT;
+    }
+
+    ret = gpio_isr_handler_add(handle->busy_pin, epaper_busy_isr, NULL);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add BUSY ISR handler");
+        return EPAPER_ERR_INIT;
+    }
+
+    gpio_intr_disable(handle->busy_pin);
+    _busy_irq_pin = handle->busy_pin;
+    return ESP_OK;
+}
+
+static void epaper_busy_irq_deinit(void)
+{
+    if (_busy_irq_pin != GPIO_NUM_NC) {
+        gpio_intr_disable(_busy_irq_pin);
+        gpio_isr_handler_remove(_busy_irq_pin);
+        _busy_irq_pin = GPIO_NUM_NC;
+    }
+}
+
+static esp_err_t epaper_spi_wait_busy(epaper_handle_t *handle, uint32_t timeout_ms)
+{
+    int64_t start = esp_timer_get_time();
+    bool use_irq = (_busy_irq_pin == handle->busy_pin);
+
+    if (use_irq) {
+        // Drop a stale edge, then arm before sampling so no edge is missed.
+        xSemaphoreTake(_busy_sem, 0);
+        gpio_intr_enable(handle->busy_pin);
+    }
+
+    esp_err_t ret = ESP_OK;
+    while (gpio_get_level(handle->busy_pin) == 0) {
+        uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+
+        if (elapsed_ms > timeout_ms) {
+            ret = EPAPER_ERR_TIMEOUT;
+            break;
+        }
+
+        if (use_irq) {
+            xSemaphoreTake(_busy_sem, pdMS_TO_TICKS(timeout_ms - elapsed_ms) + 1);
+        } else {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+
+    if (use_irq) {
+        gpio_intr_disable(handle->busy_pin);
+    }
+
+    return ret;
+}
+
+static esp_err_t epaper_spi_open(epaper_handle_t *handle)
+{
+    // SD_EN(IO16)
+    gpio_set_direction(EPAPER_SD_EN_PIN, GPIO_MODE_OUTPUT);
+    gpio_set_level(EPAPER_SD_EN_PIN, 1);
+
+    // CS is owned by the SPI peripheral; DC is driven by epaper_spi_pre_cb.
+    gpio_set_direction(handle->dc_pin, GPIO_MODE_OUTPUT);
+    gpio_set_direction(handle->rst_pin, GPIO_MODE_OUTPUT);
+    gpio_set_direction(handle->busy_pin, GPIO_MODE_INPUT);
+
+    gpio_set_level(handle->dc_pin, 1);
+    gpio_set_level(handle->rst_pin, 1);
+    _dc_pin = handle->dc_pin;
+
+    if (epaper_busy_irq_init(handle) != ESP_OK) {
+        ESP_LOGW(TAG, "BUSY interrupt unavailable, falling back to polling");
+    }
+
+    spi_device_interface_config_t devcfg = {
+        .clock_speed_hz = EPAPER_SPI_CLOCK_HZ,
+        .mode = 0,
+        .spics_io_num = handle->cs_pin,
+        .queue_size = EPAPER_TRANSPORT_QUEUE_DEPTH,
+        .pre_cb = epaper_spi_pre_cb
+    };
+
+    esp_err_t ret = spi_shared_acquire();
+    if (ret != ESP_OK) {
+        epaper_busy_irq_deinit();
+        return EPAPER_ERR_SPI;
+    }
+
+    ret = spi_bus_add_device(SPI_SHARED_HOST, &devcfg, &handle->spi);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add SPI device");
+        spi_shared_release();
+        epaper_busy_irq_deinit();
+        return EPAPER_ERR_SPI;
+    }
+
+    // The DMA descriptors round the configured size up, never down.
+    size_t max_len = 0;
+    if (spi_bus_get_max_transaction_len(SPI_SHARED_HOST, &max_len) == ESP_OK &&
+        max_len < EPAPER_TRANSPORT_MAX_SEGMENT) {
+        ESP_LOGE(TAG, "SPI bus takes %u bytes per transaction, the driver sends %d",
+                 (unsigned)max_len, EPAPER_TRANSPORT_MAX_SEGMENT);
+        spi_bus_remove_device(handle->spi);
+        handle->spi = NULL;
+        spi_shared_release();
+        epaper_busy_irq_deinit();
+        return EPAPER_ERR_SPI;
+    }
+
+    return ESP_OK;
+}
+
+static void epaper_spi_close(epaper_handle_t *handle)
+{
+    spi_bus_remove_device(handle->spi);
+    handle->spi = NULL;
+    spi_shared_release();
+    epaper_busy_irq_deinit();
+}
+
+const epaper_transport_t epaper_transport_spi = {
+    .name = "spi",
+    .open = epaper_spi_open,
+    .close = epaper_spi_close,
+    .write = epaper_spi_write,
+    .queue = epaper_spi_queue,
+    .reclaim = epaper_spi_reclaim,
+    .set_reset = epaper_spi_set_reset,
+    .wait_busy = epaper_spi_wait_busy
+};
@@ -0,0 +1,390 @@
+#include "epd_codec.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "EPD_CODEC";
+
+#define LZ_MIN_MATCH    4
+#define LZ_HASH_BITS    12
+#define RLE_MAX_RUN     130
+#define RLE_MAX_LITERAL 128
+
+static const char *const _compression_names[] = {"none", "rle", "lz"};
+
+esp_err_t epd_compression_from_name(const char *name, epd_compression_t *compression)
+{
+    for (size_t i = 0; i < sizeof(_compression_names) / sizeof(_compression_names[0]); i++) {
+        if (strcasecmp(name, _compression_names[i]) == 0) {
+            *compression = (epd_compression_t)i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+const char *epd_compression_name(epd_compression_t compression)
+{
+    return compression <= EPD_COMPRESSION_LZ ? _compression_names[compression] : "unknown";
+}
+
+size_t epd_encode_bound(epd_compression_t compression, size_t len)
+{
+    switch (compression) {
+        case EPD_COMPRESSION_RLE: return len + len / RLE_MAX_LITERAL + 1;
+        case EPD_COMPRESSION_LZ:  return len + len / 255 + 16;
+        default:                  return len;
+    }
+}
+
+static size_t rle_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t run = 1;
+        while (i + run < len && run < RLE_MAX_RUN && src[i + run] == src[i]) {
+            run++;
+        }
+        if (run >= 3) {
+            dst[out++] = (uint8_t)(run + 125);
+            dst[out++] = src[i];
+            i += run;
+            continue;
+        }
+
+        // Literals up to the next run of three.
+        size_t j = i;
+        while (j < len && j - i < RLE_MAX_LITERAL &&
+               !(j + 2 < len && src[j] == src[j + 1] && src[j] == src[j + 2])) {
+            j++;
+        }
+        dst[out++] = (uint8_t)(j - i - 1);
+        memcpy(dst + out, src + i, j - i);
+        out += j - i;
+        i = j;
+    }
+    return out;
+}
+
+static size_t lz_put_length(uint8_t *dst, size_t len)
+{
+    size_t out = 0;
+    while (len >= 255) {
+        dst[out++] = 255;
+        len -= 255;
+    }
+    dst[out++] = (uint8_t)len;
+    return out;
+}
+
+static size_t lz_put_sequence(uint8_t *dst, const uint8_t *literals, size_t lit_len, size_t offset, size_t match)
+{
+    size_t out = 1;
+    size_t match_code = match ? match - LZ_MIN_MATCH : 0;
+
+    dst[0] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (lit_len >= 15) {
+        out += lz_put_length(dst + out, lit_len - 15);
+    }
+    memcpy(dst + out, literals, lit_len);
+    out += lit_len;
+
+    if (match) {
+        dst[out++] = offset & 0xFF;
+        dst[out++] = offset >> 8;
+        if (match_code >= 15) {
+            out += lz_put_length(dst + out, match_code - 15);
+        }
+    }
+    return out;
+}
+
+static inline uint32_t lz_hash(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static esp_err_t lz_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t *out_len)
+{
+    // Positions + 1, so zero means empty.
+    uint32_t *table = heap_caps_calloc(1 << LZ_HASH_BITS, sizeof(uint32_t), MALLOC_CAP_DEFAULT);
+    if (table == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t out = 0;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    while (i + LZ_MIN_MATCH <= len) {
+        uint32_t h = lz_hash(src + i);
+        size_t cand = table[h];
+        table[h] = i + 1;
+
+        if (cand == 0 || i - (cand - 1) > EPD_LZ_WINDOW || memcmp(src + cand - 1, src + i, LZ_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+        cand--;
+
+        size_t match = LZ_MIN_MATCH;
+        while (i + match < len && src[cand + match] == src[i + match]) {
+            match++;
+        }
+        out += lz_put_sequence(dst + out, src + anchor, i - anchor, i - cand, match);
+
+        // Keep the table fresh at the end of the match, where the next
+        // one is most likely to start.
+        if (i + match + LZ_MIN_MATCH <= len && match > 2) {
+            table[lz_hash(src + i + match - 2)] = i + match - 2 + 1;
+        }
+        i += match;
+        anchor = i;
+    }
+
+    if (anchor < len) {
+        out += lz_put_sequence(dst + out, src + anchor, len - anchor, 0, 0);
+    }
+
+    heap_caps_free(table);
+    *out_len = out;
+    return ESP_OK;
+}
+
+esp_err_t epd_encode(epd_compression_t compression, const uint8_t *src, size_t len,
+                     uint8_t *dst, size_t *out_len)
+{
+    if (src == NULL || dst == NULL || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (compression) {
+        case EPD_COMPRESSION_NONE:
+            memcpy(dst, src, len);
+            *out_len = len;
+            return ESP_OK;
+        case EPD_COMPRESSION_RLE:
+            *out_len = rle_encode(src, len, dst);
+            return ESP_OK;
+        case EPD_COMPRESSION_LZ:
+            return lz_encode(src, len, dst, out_len);
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+esp_err_t epd_decoder_init(epd_decoder_t *dec, FILE *file, epd_compression_t compression,
+                           uint32_t data_bytes, uint32_t total)
+{
+    memset(dec, 0, sizeof(*dec));
+    if (compression > EPD_COMPRESSION_LZ) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (compression != EPD_COMPRESSION_NONE) {
+        size_t size = EPD_CODEC_CHUNK_SIZE + (compression == EPD_COMPRESSION_LZ ? EPD_LZ_WINDOW : 0);
+        dec->in = heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+        if (dec->in == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        dec->history = dec->in + EPD_CODEC_CHUNK_SIZE;
+    }
+
+    dec->file = file;
+    dec->compression = compression;
+    dec->in_remaining = data_bytes;
+    dec->produced = 0;
+    dec->total = total;
+    return ESP_OK;
+}
+
+void epd_decoder_deinit(epd_decoder_t *dec)
+{
+    heap_caps_free(dec->in);
+    dec->in = NULL;
+    dec->history = NULL;
+}
+
+static bool dec_refill(epd_decoder_t *dec)
+{
+    size_t want = dec->in_remaining < EPD_CODEC_CHUNK_SIZE ? dec->in_remaining : EPD_CODEC_CHUNK_SIZE;
+    if (want == 0 || fread(dec->in, 1, want, dec->file) != want) {
+        return false;
+    }
+    dec->in_remaining -= want;
+    dec->in_pos = 0;
+    dec->in_len = want;
+    return true;
+}
+
+static inline bool dec_byte(epd_decoder_t *dec, uint8_t *b)
+{
+    if (dec->in_pos == dec->in_len && !dec_refill(dec)) {
+        return false;
+    }
+    *b = dec->in[dec->in_pos++];
+    return true;
+}
+
+static bool dec_length(epd_decoder_t *dec, uint32_t *len)
+{
+    uint8_t b;
+    do {
+        if (!dec_byte(dec, &b)) {
+            return false;
+        }
+        *len += b;
+    } while (b == 255 && *len < dec->total);
+    return true;
+}
+
+static void dec_remember(epd_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    if (len >= EPD_LZ_WINDOW) {
+        data += len - EPD_LZ_WINDOW;
+        len = EPD_LZ_WINDOW;
+    }
+    size_t pos = (dec->produced - len) & (EPD_LZ_WINDOW - 1);
+    size_t first = EPD_LZ_WINDOW - pos < len ? EPD_LZ_WINDOW - pos : len;
+    memcpy(dec->history + pos, data, first);
+    memcpy(dec->history, data + first, len - first);
+}
+
+// Copies n pending literal bytes from the input to out.
+static bool dec_literals(epd_decoder_t *dec, uint8_t *out, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        if (dec->in_pos == dec->in_len && !dec_refill(dec)) {
+            return false;
+        }
+        size_t take = dec->in_len - dec->in_pos;
+        if (take > n - done) {
+            take = n - done;
+        }
+        memcpy(out + done, dec->in + dec->in_pos, take);
+        dec->in_pos += take;
+        done += take;
+    }
+    return true;
+}
+
+static bool rle_next(epd_decoder_t *dec)
+{
+    uint8_t c;
+    if (!dec_byte(dec, &c)) {
+        return false;
+    }
+    if (c < 128) {
+        dec->literal = c + 1;
+        return true;
+    }
+    dec->match = c - 125;
+    return dec_byte(dec, &dec->value);
+}
+
+static bool lz_next(epd_decoder_t *dec)
+{
+    uint8_t b;
+
+    if (dec->need_match) {
+        uint8_t hi;
+        if (!dec_byte(dec, &b) || !dec_byte(dec, &hi)) {
+            return false;
+        }
+        dec->offset = b | (hi << 8);
+        if (dec->match == 15 + LZ_MIN_MATCH && !dec_length(dec, &dec->match)) {
+            return false;
+        }
+        dec->need_match = false;
+        return dec->offset != 0 && dec->offset <= EPD_LZ_WINDOW && dec->offset <= dec->produced;
+    }
+
+    if (!dec_byte(dec, &b)) {
+        return false;
+    }
+    dec->literal = b >> 4;
+    if (dec->literal == 15 && !dec_length(dec, &dec->literal)) {
+        return false;
+    }
+    // The match length is kept aside until the literals are out; the
+    // offset only follows if the frame is not complete by then.
+    dec->match = (b & 0x0F) + LZ_MIN_MATCH;
+    dec->need_match = true;
+    if (dec->literal == 0) {
+        return lz_next(dec);
+    }
+    return true;
+}
+
+esp_err_t epd_decoder_read(epd_decoder_t *dec, uint8_t *out, size_t len)
+{
+    if (len > dec->total - dec->produced) {
+        return ESP_FAIL;
+    }
+
+    if (dec->compression == EPD_COMPRESSION_NONE) {
+        if (len > dec->in_remaining || fread(out, 1, len, dec->file) != len) {
+            return ESP_FAIL;
+        }
+        dec->in_remaining -= len;
+        dec->produced += len;
+        return ESP_OK;
+    }
+
+    bool lz = dec->compression == EPD_COMPRESSION_LZ;
+    while (len > 0) {
+        if (dec->literal > 0) {
+            size_t n = dec->literal < len ? dec->literal : len;
+            if (!dec_literals(dec, out, n)) {
+                return ESP_FAIL;
+            }
+            dec->literal -= n;
+            dec->produced += n;
+            if (lz) {
+                dec_remember(dec, out, n);
+            }
+            out += n;
+            len -= n;
+        } else if (dec->match > 0 && !dec->need_match) {
+            size_t n = dec->match < len ? dec->match : len;
+            if (!lz) {
+                memset(out, dec->value, n);
+                dec->produced += n;
+            } else if (dec->offset == 1) {
+                memset(out, dec->history[(dec->produced - 1) & (EPD_LZ_WINDOW - 1)], n);
+                dec->produced += n;
+                dec_remember(dec, out, n);
+            } else {
+                // Pieces no longer than the offset never read bytes they
+                // have just written, so each one is a plain copy.
+                for (size_t done = 0; done < n;) {
+                    size_t src = (dec->produced - dec->offset) & (EPD_LZ_WINDOW - 1);
+                    size_t piece = n - done;
+                    if (piece > dec->offset) {
+                        piece = dec->offset;
+                    }
+                    if (piece > EPD_LZ_WINDOW - src) {
+                        piece = EPD_LZ_WINDOW - src;
+                    }
+                    memcpy(out + done, dec->history + src, piece);
+                    dec->produced += piece;
+                    dec_remember(dec, out + done, piece);
+                    done += piece;
+                }
+            }
+            dec->match -= n;
+            out += n;
+            len -= n;
+        } else if (!(lz ? lz_next(dec) : rle_next(dec))) {
+            ESP_LOGE(TAG, "Corrupt %s data at output byte %lu", epd_compression_name(dec->compression),
+                     (unsigned long)dec->produced);
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
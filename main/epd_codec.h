@@ -0,0 +1,74 @@
+#ifndef EPD_CODEC_H
+#define EPD_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+// Compressed .epd frame data. Spectra6 frames are mostly flat colour, so
+// both codecs work on the packed 4bpp bytes directly:
+//
+//   RLE  PackBits-style: a control byte c < 128 is followed by c + 1
+//        literal bytes, c >= 128 repeats the next byte c - 125 times.
+//   LZ   LZ4-style sequences: a token with the literal count in the high
+//        nibble and match length - 4 in the low one (15 = more length
+//        bytes follow, each added until one is below 255), the literals,
+//        then a little-endian 16-bit offset and any extra length bytes.
+//        The last sequence has literals only. Offsets are limited to
+//        EPD_LZ_WINDOW, which covers the row above and the 8-row period
+//        of the Bayer dither, so the decoder only keeps that much history.
+
+#define EPD_LZ_WINDOW           4096
+#define EPD_CODEC_CHUNK_SIZE    4096
+
+typedef enum {
+    EPD_COMPRESSION_NONE = 0,
+    EPD_COMPRESSION_RLE = 1,
+    EPD_COMPRESSION_LZ = 2
+} epd_compression_t;
+
+// Decodes a compressed stream read from a FILE in EPD_CODEC_CHUNK_SIZE
+// pieces. Output is asked for in any amounts, e.g. one DMA band at a time;
+// besides the input chunk and the LZ history nothing is held. Uncompressed
+// data is read straight into the caller's buffer and needs no workspace.
+typedef struct {
+    FILE *file;
+    epd_compression_t compression;
+    uint32_t in_remaining;      // compressed bytes not yet read from the file
+    uint32_t produced;
+    uint32_t total;
+    uint32_t literal;           // literal bytes still to copy
+    uint32_t match;             // RLE repeat or LZ match bytes still to emit
+    uint16_t offset;
+    uint8_t value;
+    bool need_match;            // an LZ offset follows the current literals
+    size_t in_pos;
+    size_t in_len;
+    uint8_t *in;                // EPD_CODEC_CHUNK_SIZE
+    uint8_t *history;           // EPD_LZ_WINDOW, ring indexed by produced
+} epd_decoder_t;
+
+esp_err_t epd_compression_from_name(const char *name, epd_compression_t *compression);
+const char *epd_compression_name(epd_compression_t compression);
+
+// Worst-case encoded size of len bytes.
+size_t epd_encode_bound(epd_compression_t compression, size_t len);
+
+// Encodes src into dst (at least epd_encode_bound bytes). LZ uses a 16 KB
+// hash table from the heap.
+esp_err_t epd_encode(epd_compression_t compression, const uint8_t *src, size_t len,
+                     uint8_t *dst, size_t *out_len);
+
+// Starts decoding data_bytes of compressed data at the file's position
+// into total bytes of output, allocating the workspace it needs.
+esp_err_t epd_decoder_init(epd_decoder_t *dec, FILE *file, epd_compression_t compression,
+                           uint32_t data_bytes, uint32_t total);
+void epd_decoder_deinit(epd_decoder_t *dec);
+
+// Produces the next len bytes. ESP_FAIL if the data is corrupt or ends
+// early, or if more than total bytes are asked for.
+esp_err_t epd_decoder_read(epd_decoder_t *dec, uint8_t *out, size_t len);
+
+#endif
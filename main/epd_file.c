@@ -0,0 +1,334 @@
+#include "epd_file.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "EPD_FILE";
+
+// One streamed display: the band callback reads into the staging buffer
+// and the done callback reports the refresh result, then frees this.
+typedef struct {
+    FILE *file;
+    epd_file_header_t header;
+    epd_decoder_t dec;
+    uint32_t crc;
+    uint32_t remaining;
+    epaper_done_cb_t done_cb;
+    void *cb_arg;
+} epd_stream_t;
+
+esp_err_t epd_file_write(const char *filename, const uint8_t *frame, uint16_t width, uint16_t height,
+                         epd_compression_t compression)
+{
+    if (filename == NULL || frame == NULL || width == 0 || height == 0 || (width % 2) ||
+        compression > EPD_COMPRESSION_LZ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t frame_bytes = (uint32_t)width * height / 2;
+    const uint8_t *data = frame;
+    uint8_t *encoded = NULL;
+    size_t data_bytes = frame_bytes;
+
+    if (compression != EPD_COMPRESSION_NONE) {
+        encoded = heap_caps_malloc(epd_encode_bound(compression, frame_bytes), MALLOC_CAP_DEFAULT);
+        if (encoded == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t ret = epd_encode(compression, frame, frame_bytes, encoded, &data_bytes);
+        if (ret != ESP_OK) {
+            heap_caps_free(encoded);
+            return ret;
+        }
+        data = encoded;
+    }
+
+    epd_file_header_t header = {
+        .version = EPD_FILE_VERSION,
+        .pixel_format = EPD_PIXEL_SPECTRA6_4BPP,
+        .compression = compression,
+        .header_size = sizeof(epd_file_header_t),
+        .width = width,
+        .height = height,
+        .frame_bytes = frame_bytes,
+        .data_bytes = data_bytes,
+        .crc32 = esp_rom_crc32_le(0, frame, frame_bytes)
+    };
+    memcpy(header.magic, EPD_FILE_MAGIC, sizeof(header.magic));
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Failed to create file: %s", filename);
+        heap_caps_free(encoded);
+        return ESP_FAIL;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, data_bytes, file) == data_bytes;
+    heap_caps_free(encoded);
+    if (fclose(file) != 0 || !ok) {
+        ESP_LOGE(TAG, "Failed to write file: %s", filename);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t epd_file_read_header(FILE *file, epd_file_header_t *header)
+{
+    if (file == NULL || header == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        memcmp(header->magic, EPD_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        ESP_LOGE(TAG, "Not an .epd file");
+        return ESP_FAIL;
+    }
+
+    if (header->version != EPD_FILE_VERSION || header->header_size < sizeof(*header) ||
+        header->pixel_format != EPD_PIXEL_SPECTRA6_4BPP) {
+        ESP_LOGE(TAG, "Unsupported .epd version %d, pixel format %d", header->version, header->pixel_format);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (header->width == 0 || header->height == 0 || (header->width % 2) ||
+        header->frame_bytes != (uint32_t)header->width * header->height / 2) {
+        ESP_LOGE(TAG, "Invalid .epd dimensions %ux%u", header->width, header->height);
+        return ESP_FAIL;
+    }
+
+    if (header->compression > EPD_COMPRESSION_LZ) {
+        ESP_LOGE(TAG, "Unsupported .epd compression %d", header->compression);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (header->compression == EPD_COMPRESSION_NONE ? header->data_bytes != header->frame_bytes
+                                                     : header->data_bytes == 0) {
+        ESP_LOGE(TAG, "Data size %lu does not match the frame", (unsigned long)header->data_bytes);
+        return ESP_FAIL;
+    }
+
+    if (header->header_size > sizeof(*header) && fseek(file, header->header_size, SEEK_SET) != 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t load_epd_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                              bmp_image_t *image)
+{
+    if (filename == NULL || frame == NULL || image == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    epd_file_header_t header;
+
+    ESP_LOGI(TAG, "Loading .epd file: %s", filename);
+
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Failed to open file: %s", filename);
+        return ESP_FAIL;
+    }
+    // One read of the whole frame; stdio would only add a copy.
+    setvbuf(file, NULL, _IONBF, 0);
+
+    esp_err_t ret = epd_file_read_header(file, &header);
+    if (ret == ESP_OK && (header.width != frame_w || header.height != frame_h)) {
+        ESP_LOGE(TAG, ".epd is %ux%u, the frame %ux%u", header.width, header.height, frame_w, frame_h);
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret != ESP_OK) {
+        fclose(file);
+        return ret;
+    }
+
+    // Uncompressed data goes in with a single fread; compressed data is
+    // decoded into the frame as it is read.
+    epd_decoder_t dec;
+    int64_t read_start = esp_timer_get_time();
+    ret = epd_decoder_init(&dec, file, header.compression, header.data_bytes, header.frame_bytes);
+    if (ret == ESP_OK) {
+        ret = epd_decoder_read(&dec, frame, header.frame_bytes);
+        epd_decoder_deinit(&dec);
+    }
+    int64_t read_us = esp_timer_get_time() - read_start;
+    fclose(file);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read the %s frame data", epd_compression_name(header.compression));
+        return ret;
+    }
+
+    int64_t crc_start = esp_timer_get_time();
+    uint32_t crc = esp_rom_crc32_le(0, frame, header.frame_bytes);
+    int64_t crc_us = esp_timer_get_time() - crc_start;
+    if (crc != header.crc32) {
+        ESP_LOGE(TAG, "CRC mismatch: %08lx, expected %08lx", (unsigned long)crc, (unsigned long)header.crc32);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    image->data = frame;
+    image->width = header.width;
+    image->height = header.height;
+    image->bits_per_pixel = 4;
+
+    bmp_load_stats_t stats = {
+        .src_width = header.width,
+        .src_height = header.height,
+        .bits_per_pixel = 4,
+        .fit = BMP_FIT_CENTER,
+        .dither = EPAPER_DITHER_NONE,
+        .file_bytes = header.header_size + header.data_bytes,
+        .chunks = header.compression == EPD_COMPRESSION_NONE ? 1
+                  : (header.data_bytes + EPD_CODEC_CHUNK_SIZE - 1) / EPD_CODEC_CHUNK_SIZE,
+        .read_us = read_us,
+        .convert_us = crc_us,
+        .elapsed_us = esp_timer_get_time() - start
+    };
+    bmp_record_load_stats(&stats);
+
+    ESP_LOGI(TAG, ".epd file (%s, %lu bytes) loaded in %lld us (%lld us reading, %lld us CRC)",
+             epd_compression_name(header.compression), (unsigned long)header.data_bytes,
+             (long long)stats.elapsed_us, (long long)read_us, (long long)crc_us);
+    return ESP_OK;
+}
+
+// A read or decode error, or a CRC mismatch once the last band is in,
+// aborts the update before the refresh, so the panel keeps its old image.
+static esp_err_t epd_render_band(uint8_t *band, uint16_t y, uint16_t rows, void *ctx)
+{
+    epd_stream_t *stream = ctx;
+    uint32_t len = (uint32_t)rows * stream->header.width / 2;
+
+    esp_err_t ret = epd_decoder_read(&stream->dec, band, len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    stream->crc = esp_rom_crc32_le(stream->crc, band, len);
+    stream->remaining -= len;
+
+    if (stream->remaining == 0 && stream->crc != stream->header.crc32) {
+        ESP_LOGE(TAG, "CRC mismatch: %08lx, expected %08lx", (unsigned long)stream->crc,
+                 (unsigned long)stream->header.crc32);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+// Frame hash of the .epd streamed last, keyed by its header CRC. The panel
+// hash is a different function of the same bytes, and a file is only read
+// as it is sent, so this is how an identical file is recognised in time to
+// skip it.
+static struct {
+    bool valid;
+    uint32_t crc32;
+    uint32_t frame_bytes;
+    uint32_t hash;
+} _last_stream;
+
+static void epd_stream_done(esp_err_t result, void *arg)
+{
+    epd_stream_t *stream = arg;
+
+    if (stream->done_cb != NULL) {
+        stream->done_cb(result, stream->cb_arg);
+    }
+    epd_decoder_deinit(&stream->dec);
+    heap_caps_free(stream);
+}
+
+esp_err_t epd_display_file_async(epaper_handle_t *handle, const char *filename,
+                                 epaper_done_cb_t done_cb, void *cb_arg)
+{
+    if (handle == NULL || filename == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    epd_stream_t *stream = heap_caps_calloc(1, sizeof(*stream), MALLOC_CAP_8BIT);
+    if (stream == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Streaming .epd file: %s", filename);
+
+    stream->file = fopen(filename, "rb");
+    if (stream->file == NULL) {
+        ESP_LOGE(TAG, "Failed to open file: %s", filename);
+        heap_caps_free(stream);
+        return ESP_FAIL;
+    }
+    // Band-sized reads go straight into the staging buffer.
+    setvbuf(stream->file, NULL, _IONBF, 0);
+
+    esp_err_t ret = epd_file_read_header(stream->file, &stream->header);
+    if (ret == ESP_OK && (stream->header.width != handle->width || stream->header.height != handle->height)) {
+        ESP_LOGE(TAG, ".epd is %ux%u, the panel %ux%u", stream->header.width, stream->header.height,
+                 handle->width, handle->height);
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK) {
+        ret = epd_decoder_init(&stream->dec, stream->file, stream->header.compression,
+                               stream->header.data_bytes, stream->header.frame_bytes);
+    }
+    if (ret != ESP_OK) {
+        fclose(stream->file);
+        heap_caps_free(stream);
+        return ret;
+    }
+
+    FILE *file = stream->file;
+    epd_compression_t stream_compression = stream->header.compression;
+    uint32_t crc32 = stream->header.crc32;
+    uint32_t frame_bytes = stream->header.frame_bytes;
+    stream->remaining = stream->header.frame_bytes;
+    stream->done_cb = done_cb;
+    stream->cb_arg = cb_arg;
+
+    bmp_load_stats_t stats = {
+        .src_width = stream->header.width,
+        .src_height = stream->header.height,
+        .bits_per_pixel = 4,
+        .fit = BMP_FIT_CENTER,
+        .dither = EPAPER_DITHER_NONE,
+        .file_bytes = stream->header.header_size + stream->header.data_bytes,
+        .chunks = 1
+    };
+    // Once this succeeds the done callback owns stream, and may already
+    // have freed it by the time it returns.
+    if (_last_stream.valid && _last_stream.crc32 == crc32 && _last_stream.frame_bytes == frame_bytes) {
+        ret = epaper_display_banded_hashed_async(handle, epd_render_band, stream, _last_stream.hash,
+                                                 epd_stream_done, stream);
+    } else {
+        ret = epaper_display_banded_async(handle, epd_render_band, stream, epd_stream_done, stream);
+    }
+    if (ret != ESP_OK) {
+        epd_decoder_deinit(&stream->dec);
+        heap_caps_free(stream);
+    }
+    fclose(file);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to stream %s, the panel was not refreshed", filename);
+        return ret;
+    }
+
+    uint32_t hash = 0;
+    bool unchanged = epaper_last_frame_unchanged(&hash);
+    _last_stream.valid = true;
+    _last_stream.crc32 = crc32;
+    _last_stream.frame_bytes = frame_bytes;
+    _last_stream.hash = hash;
+    if (unchanged) {
+        ESP_LOGI(TAG, "%s is already on the panel, nothing streamed", filename);
+        return ESP_OK;
+    }
+
+    stats.elapsed_us = esp_timer_get_time() - start;
+    bmp_record_load_stats(&stats);
+    ESP_LOGI(TAG, ".epd file (%s) streamed in %lld us", epd_compression_name(stream_compression),
+             (long long)stats.elapsed_us);
+    return ESP_OK;
+}
@@ -0,0 +1,65 @@
+#ifndef EPD_FILE_H
+#define EPD_FILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "bitmap.h"
+#include "epaper_driver.h"
+#include "epd_codec.h"
+
+// .epd: a panel-native frame. A 24-byte little-endian header is followed
+// by the packed 4bpp bytes exactly as epaper_display_frame sends them
+// (even pixel in the high nibble, rows top to bottom), so loading needs
+// no per-pixel work at all. The bytes may be stored RLE or LZ compressed
+// (see epd_codec.h), in which case they are decoded on the way in.
+
+#define EPD_FILE_MAGIC          "EPDF"
+#define EPD_FILE_VERSION        1
+
+typedef enum {
+    EPD_PIXEL_SPECTRA6_4BPP = 0     // GDEP073E01 colour codes, two per byte
+} epd_pixel_format_t;
+
+typedef struct {
+    char magic[4];
+    uint8_t version;
+    uint8_t pixel_format;       // epd_pixel_format_t
+    uint8_t compression;        // epd_compression_t
+    uint8_t header_size;        // sizeof(epd_file_header_t); data starts here
+    uint16_t width;
+    uint16_t height;
+    uint32_t frame_bytes;       // width * height / 2
+    uint32_t data_bytes;        // stored after the header
+    uint32_t crc32;             // of the frame_bytes of pixel data
+} __attribute__((packed)) epd_file_header_t;
+
+// Writes frame (width x height, packed 4bpp) with a fresh header, encoded
+// with compression.
+esp_err_t epd_file_write(const char *filename, const uint8_t *frame, uint16_t width, uint16_t height,
+                         epd_compression_t compression);
+
+// Reads and checks the header; the file is left at the start of the data.
+esp_err_t epd_file_read_header(FILE *file, epd_file_header_t *header);
+
+// Reads (or decodes) the frame straight into frame and checks its CRC
+// (ESP_ERR_INVALID_CRC on a mismatch). The file must be frame_w x
+// frame_h; image reports that size, as the other loaders do, and
+// bmp_get_load_stats covers it with the CRC check as convert_us.
+esp_err_t load_epd_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                              bmp_image_t *image);
+
+// Streams the file to the panel through the banded path: each band is
+// read from the card, or decoded from the compressed data, directly into
+// the driver's DMA staging buffer, so no frame buffer is used. The CRC is
+// only known once the last band has gone out; a mismatch (or a read or
+// decode error) aborts the update before the refresh, so the panel keeps
+// its old image, and this returns ESP_ERR_INVALID_CRC (or that error)
+// without calling done_cb. Otherwise the refresh runs in the background as
+// with epaper_display_banded_async. A file with the same CRC as the one
+// streamed last is skipped unread if the panel still shows that frame;
+// epaper_last_frame_unchanged tells which happened and gives the hash.
+esp_err_t epd_display_file_async(epaper_handle_t *handle, const char *filename,
+                                 epaper_done_cb_t done_cb, void *cb_arg);
+
+#endif
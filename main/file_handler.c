@@ -1,7 +1,13 @@
 #include "file_handler.h"
 #include "sdio.h"
+#include "epaper_rotate.h"
+#include "framebuffer.h"
+#include "epaper_dither.h"
+#include "epd_file.h"
+#include "frame_cache.h"
 #include "esp_log.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <dirent.h>
@@ -10,6 +16,8 @@
 
 static const char *TAG = "FILE_HANDLER";
 
+static esp_err_t handle_api_cache(httpd_req_t *req);
+
 typedef struct {
     const char *ext;
     const char *mime;
@@ -69,6 +77,11 @@ esp_err_t handle_file_get(httpd_req_t *req) {
 
     ESP_LOGI(TAG, "GET request for URI: %s", req->uri);
 
+    // Check if this is an API request
+    if (strncmp(req->uri, "/api/", 5) == 0) {
+        return handle_api_get(req);
+    }
+
     // Initialize and mount SDIO
     ret = sdio_init(&sdio_ctx);
     if (ret != ESP_OK) {
@@ -172,6 +185,10 @@ esp_err_t handle_file_post(httpd_req_t *req) {
         return handle_api_update(req);
     }
 
+    if (strncmp(req->uri, "/api/cache", 10) == 0) {
+        return handle_api_cache(req);
+    }
+
     // Initialize and mount SDIO
     ret = sdio_init(&sdio_ctx);
     if (ret != ESP_OK) {
@@ -286,6 +303,9 @@ esp_err_t handle_file_post(httpd_req_t *req) {
     fclose(fd);
     free(buf);
 
+    // A decoded copy of the old file must not outlive it.
+    frame_cache_invalidate(filepath);
+
     httpd_resp_send(req, "File uploaded successfully", HTTPD_RESP_USE_STRLEN);
     ESP_LOGI(TAG, "File uploaded: %s (%d bytes)", filepath, req->content_len);
     sdio_deinit(&sdio_ctx);
@@ -377,21 +397,282 @@ esp_err_t handle_file_delete(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
+    frame_cache_invalidate(filepath);
     httpd_resp_send(req, "File deleted successfully", HTTPD_RESP_USE_STRLEN);
     ESP_LOGI(TAG, "File deleted: %s", filepath);
     return ESP_OK;
 }
 
+// Success reply for /api/update, saying whether the refresh was skipped
+// because the panel already showed the frame.
+static esp_err_t api_send_update_success(httpd_req_t *req, const char *sent_message) {
+    char resp[128];
+    uint32_t hash = 0;
+    bool unchanged = epaper_last_frame_unchanged(&hash);
+    snprintf(resp, sizeof(resp),
+             "{\"status\":\"success\",\"message\":\"%s\",\"unchanged\":%s,\"hash\":\"%08lx\"}",
+             unchanged ? "Image unchanged, refresh skipped" : sent_message,
+             unchanged ? "true" : "false",
+             (unsigned long)hash);
+    return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+}
+
+static void api_update_refresh_done(esp_err_t result, void *arg) {
+    if (result == ESP_OK) {
+        ESP_LOGI(TAG, "Image displayed successfully");
+    } else {
+        ESP_LOGE(TAG, "e-Paper refresh failed");
+    }
+}
+
+static esp_err_t handle_api_hash(httpd_req_t *req) {
+    char resp[64];
+    uint32_t hash = 0;
+    bool valid = epaper_get_frame_hash(&hash);
+
+    snprintf(resp, sizeof(resp), "{\"hash\":\"%08lx\",\"valid\":%s}",
+             (unsigned long)hash, valid ? "true" : "false");
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handle_api_timing(httpd_req_t *req) {
+    static epaper_timing_record_t records[8];
+    size_t count = epaper_get_timing_records(records, sizeof(records) / sizeof(records[0]));
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *updates = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "updates", updates);
+
+    for (size_t i = 0; i < count; i++) {
+        const epaper_timing_record_t *rec = &records[i];
+        cJSON *update = cJSON_CreateObject();
+        cJSON_AddNumberToObject(update, "seq", rec->seq);
+        cJSON_AddStringToObject(update, "kind", rec->kind);
+        cJSON_AddNumberToObject(update, "start_us", (double)rec->start_us);
+        cJSON_AddNumberToObject(update, "total_us", rec->total_us);
+        cJSON_AddStringToObject(update, "result", esp_err_to_name(rec->result));
+
+        cJSON *phases = cJSON_CreateArray();
+        for (uint8_t p = 0; p < rec->phase_count; p++) {
+            cJSON *phase = cJSON_CreateObject();
+            cJSON_AddStringToObject(phase, "name", rec->phases[p].name);
+            cJSON_AddNumberToObject(phase, "start_us", rec->phases[p].start_us);
+            cJSON_AddNumberToObject(phase, "duration_us", rec->phases[p].duration_us);
+            if (rec->phases[p].timed_out) {
+                cJSON_AddBoolToObject(phase, "timeout", true);
+            }
+            cJSON_AddItemToArray(phases, phase);
+        }
+        cJSON_AddItemToObject(update, "phases", phases);
+        cJSON_AddItemToArray(updates, update);
+    }
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t ret = httpd_resp_send(req, json_str, strlen(json_str));
+
+    cJSON_Delete(root);
+    free(json_str);
+    return ret;
+}
+
+// Runs the dithering benchmark over a panel-sized image; takes a second or so.
+static esp_err_t handle_api_dither_bench(httpd_req_t *req) {
+    epaper_dither_bench_t bench;
+    if (epaper_dither_bench(800, 480, &bench) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Benchmark failed");
+        return ESP_FAIL;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "width", bench.width);
+    cJSON_AddNumberToObject(root, "height", bench.height);
+    cJSON *modes = cJSON_CreateArray();
+    for (int i = 0; i < EPAPER_DITHER_COUNT; i++) {
+        cJSON *mode = cJSON_CreateObject();
+        cJSON_AddStringToObject(mode, "name", epaper_dither_name((epaper_dither_t)i));
+        cJSON_AddNumberToObject(mode, "elapsed_us", (double)bench.elapsed_us[i]);
+        cJSON_AddNumberToObject(mode, "mpix_per_s", bench.mpix_per_s[i]);
+        cJSON_AddItemToArray(modes, mode);
+    }
+    cJSON_AddItemToObject(root, "modes", modes);
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t ret = httpd_resp_send(req, json_str, strlen(json_str));
+
+    cJSON_Delete(root);
+    free(json_str);
+    return ret;
+}
+
+// GET reports the frame cache counters; POST takes ?budget_kb=<n> to
+// resize it and ?clear=1 to drop every frame, then reports them too.
+static esp_err_t handle_api_cache(httpd_req_t *req) {
+    char query[64];
+    char value[16];
+
+    if (req->method == HTTP_POST && httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "budget_kb", value, sizeof(value)) == ESP_OK &&
+            frame_cache_set_budget((size_t)strtoul(value, NULL, 10) * 1024) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Frame cache not available");
+            return ESP_FAIL;
+        }
+        if (httpd_query_key_value(query, "clear", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0) {
+            frame_cache_invalidate(NULL);
+        }
+    }
+
+    frame_cache_stats_t stats;
+    if (frame_cache_get_stats(&stats) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Frame cache not available");
+        return ESP_FAIL;
+    }
+
+    char resp[192];
+    snprintf(resp, sizeof(resp),
+             "{\"hits\":%lu,\"misses\":%lu,\"insertions\":%lu,\"evictions\":%lu,"
+             "\"entries\":%lu,\"bytes\":%u,\"budget\":%u}",
+             (unsigned long)stats.hits, (unsigned long)stats.misses, (unsigned long)stats.insertions,
+             (unsigned long)stats.evictions, (unsigned long)stats.entries, (unsigned)stats.bytes,
+             (unsigned)stats.budget);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t handle_api_get(httpd_req_t *req) {
+    ESP_LOGI(TAG, "API GET request for URI: %s", req->uri);
+
+    if (strcmp(req->uri, "/api/hash") == 0) {
+        return handle_api_hash(req);
+    }
+
+    if (strcmp(req->uri, "/api/timing") == 0) {
+        return handle_api_timing(req);
+    }
+
+    if (strcmp(req->uri, "/api/bench/dither") == 0) {
+        return handle_api_dither_bench(req);
+    }
+
+    if (strncmp(req->uri, "/api/cache", 10) == 0) {
+        return handle_api_cache(req);
+    }
+
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown API endpoint");
+    return ESP_FAIL;
+}
+
+// Reads ?rotate=<degrees>; false if the parameter is absent.
+static bool api_get_rotation(httpd_req_t *req, epaper_rotation_t *rotation, bool *valid) {
+    char query[192];
+    char value[8];
+
+    *valid = true;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "rotate", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+
+    *valid = (epaper_rotation_from_degrees(atoi(value), rotation) == ESP_OK);
+    return true;
+}
+
+// Reads ?fit=center|crop|letterbox and ?dither=none|fs|atkinson|bayer;
+// absent parameters keep the defaults, false if either is unknown.
+static bool api_get_load_opts(httpd_req_t *req, bmp_load_opts_t *opts) {
+    char query[192];
+    char value[24];
+
+    *opts = (bmp_load_opts_t)BMP_LOAD_OPTS_DEFAULT;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        return true;
+    }
+
+    if (httpd_query_key_value(query, "fit", value, sizeof(value)) == ESP_OK &&
+        bmp_fit_from_name(value, &opts->fit) != ESP_OK) {
+        return false;
+    }
+    if (httpd_query_key_value(query, "dither", value, sizeof(value)) == ESP_OK &&
+        epaper_dither_from_name(value, &opts->dither) != ESP_OK) {
+        return false;
+    }
+    return true;
+}
+
+// Reads ?file=<path on the card>, test.bmp when absent; false if the
+// path is unsafe. The extension picks the loader.
+static bool api_get_image_path(httpd_req_t *req, char *path, size_t size) {
+    char query[192];
+    char value[96];
+
+    snprintf(path, size, "%s/test.bmp", MOUNT_POINT);
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "file", value, sizeof(value)) != ESP_OK) {
+        return true;
+    }
+
+    snprintf(path, size, "%s%s%s", MOUNT_POINT, value[0] == '/' ? "" : "/", value);
+    return is_safe_path(path + strlen(MOUNT_POINT));
+}
+
+static esp_err_t api_send_busy(httpd_req_t *req) {
+    ESP_LOGW(TAG, "e-Paper is busy, rejecting update");
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_send(req, "{\"status\":\"busy\",\"message\":\"Display refresh in progress\"}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
 esp_err_t handle_api_update(httpd_req_t *req) {
     esp_err_t ret;
     bmp_image_t image;
+    epaper_rotation_t rotation;
+    bool rotation_valid;
+    bool rotation_given = api_get_rotation(req, &rotation, &rotation_valid);
+    bmp_load_opts_t opts;
+    bool opts_valid = api_get_load_opts(req, &opts);
+    char path[128];
+    bool path_valid = api_get_image_path(req, path, sizeof(path));
 
     ESP_LOGI(TAG, "API UPDATE request received");
 
+    epaper_handle_t *epaper = epaper_session_get();
+    if (epaper == NULL) {
+        ESP_LOGE(TAG, "e-Paper session not open");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "e-Paper not available");
+        return ESP_FAIL;
+    }
+
+    if (!rotation_valid) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "rotate must be 0, 90, 180 or 270");
+        return ESP_FAIL;
+    }
+
+    if (!opts_valid) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                            "fit must be center, crop or letterbox; dither none, fs, atkinson or bayer");
+        return ESP_FAIL;
+    }
+
+    if (!path_valid) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid file path");
+        return ESP_FAIL;
+    }
+
+    // Claiming the panel up front keeps a second request from loading into
+    // the back buffer while this one is still using it.
+    if (epaper_claim_update() == EPAPER_ERR_BUSY) {
+        return api_send_busy(req);
+    }
+
     // Initialize SDIO
     ret = sdio_init(&sdio_ctx);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize SDIO");
+        epaper_release_update();
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "SD card initialization failed");
         return ESP_FAIL;
     }
@@ -400,57 +681,79 @@ esp_err_t handle_api_update(httpd_req_t *req) {
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to mount SD card");
         sdio_deinit(&sdio_ctx);
+        epaper_release_update();
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "SD card mount failed");
         return ESP_FAIL;
     }
     sdio_ctx.is_mounted = true;
 
-    // Load BMP image from SD card
-    ESP_LOGI(TAG, "Loading BMP image from SD card...");
-    ret = load_bmp_from_sd("/sdcard/test.bmp", &image);
+    // A panel-native .epd goes straight from the card into the DMA staging
+    // buffers; only a rotation needs it loaded into a frame first.
+    const char *ext = strrchr(path, '.');
+    if (!rotation_given && ext != NULL && strcasecmp(ext, ".epd") == 0) {
+        ESP_LOGI(TAG, "Streaming %s from SD card...", path);
+        ret = epd_display_file_async(epaper, path, api_update_refresh_done, NULL);
+        epaper_release_update();
+        sdio_deinit(&sdio_ctx);
+
+        if (ret == EPAPER_ERR_BUSY) {
+            return api_send_busy(req);
+        } else if (ret == ESP_OK) {
+            api_send_update_success(req, "Image streamed, display refresh started");
+        } else if (ret == ESP_ERR_INVALID_SIZE || ret == ESP_ERR_NOT_SUPPORTED) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unsupported .epd file");
+        } else {
+            ESP_LOGE(TAG, "Failed to stream image");
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                                ret == ESP_ERR_INVALID_CRC ? ".epd CRC mismatch, display not updated"
+                                                           : "Failed to display image on e-Paper");
+        }
+        return ret == ESP_OK ? ESP_OK : ESP_FAIL;
+    }
+
+    // Load the image from SD card
+    ESP_LOGI(TAG, "Loading %s from SD card...", path);
+    uint8_t *frame = fb_get_back();
+    ret = frame != NULL ? frame_cache_load(path, frame, epaper->width, epaper->height, &opts, &image)
+                         : ESP_ERR_NO_MEM;
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to load BMP image");
+        ESP_LOGE(TAG, "Failed to load image");
         sdio_deinit(&sdio_ctx);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to load test.bmp");
+        epaper_release_update();
+        httpd_resp_send_err(req, ret == ESP_ERR_NOT_SUPPORTED ? HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR,
+                            ret == ESP_ERR_NOT_SUPPORTED ? "Unsupported image format" : "Failed to load image");
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "BMP image loaded successfully");
+    ESP_LOGI(TAG, "Image loaded successfully");
     sdio_deinit(&sdio_ctx);
 
-    // Initialize e-Paper display
-    epaper_handle_t epaper = {
-        .cs_pin = 10,
-        .dc_pin = 11,
-        .rst_pin = 12,
-        .busy_pin = 13,
-        .width = 800,
-        .height = 480
-    };
-
-    ESP_LOGI(TAG, "Initializing e-Paper display...");
-    ret = epaper_init(&epaper);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "e-Paper initialization failed");
-        free_bmp_image(&image);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "e-Paper initialization failed");
+    if (!rotation_given) {
+        rotation = epaper_default_rotation_for(image.width, image.height);
+    }
+
+    // Send the image; the panel refresh continues in the background and
+    // api_update_refresh_done reports the result when it is finished.
+    ESP_LOGI(TAG, "Displaying image on e-Paper (rotation %d)...", epaper_rotation_degrees(rotation));
+    ret = epaper_display_rotated_async(epaper, image.data, image.width, image.height, rotation,
+                                       api_update_refresh_done, NULL);
+    epaper_release_update();
+
+    if (ret == EPAPER_ERR_BUSY) {
+        return api_send_busy(req);
+    }
+
+    if (ret == EPAPER_ERR_INVALID_PARAM) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image size does not match the rotation");
         return ESP_FAIL;
     }
 
-    // Display image on e-Paper
-    ESP_LOGI(TAG, "Displaying image on e-Paper...");
-    ret = epaper_display_frame(&epaper, image.data);
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Image displayed successfully");
-        httpd_resp_send(req, "{\"status\":\"success\",\"message\":\"Image displayed successfully\"}", HTTPD_RESP_USE_STRLEN);
+        api_send_update_success(req, "Image sent, display refresh started");
     } else {
         ESP_LOGE(TAG, "Failed to display image");
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to display image on e-Paper");
     }
 
-    // Cleanup
-    epaper_deinit(&epaper);
-    free_bmp_image(&image);
-
     return ret == ESP_OK ? ESP_OK : ESP_FAIL;
 }
\ No newline at end of file
@@ -12,6 +12,7 @@ esp_err_t handle_file_post(httpd_req_t *req);
 esp_err_t handle_directory_list(httpd_req_t *req);
 esp_err_t handle_file_delete(httpd_req_t *req);
 esp_err_t handle_api_update(httpd_req_t *req);
+esp_err_t handle_api_get(httpd_req_t *req);
 
 const char* get_mime_type(const char *filename);
 
@@ -0,0 +1,329 @@
+// Generated by tools/bdf2font.py from DejaVuSansMono-16.bdf. Do not edit.
+#include "epaper_text.h"
+
+static const uint8_t epaper_font_mono16_bitmap[] = {
+    // U+0020
+    0x00,
+    // U+0021
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x80, 0x80,
+    // U+0022
+    0x90, 0x90, 0x90, 0x90,
+    // U+0023
+    0x09, 0x80, 0x09, 0x00, 0x09, 0x00, 0x7F, 0xC0, 0x13, 0x00, 0x12, 0x00,
+    0x12, 0x00, 0xFF, 0x80, 0x26, 0x00, 0x24, 0x00, 0x64, 0x00,
+    // U+0024
+    0x10, 0x10, 0x7C, 0xD2, 0x90, 0x90, 0x70, 0x1C, 0x12, 0x12, 0x92, 0x7C,
+    0x10, 0x10,
+    // U+0025
+    0x70, 0x00, 0x88, 0x00, 0x88, 0x00, 0x88, 0x00, 0x71, 0x00, 0x06, 0x00,
+    0x18, 0x00, 0x67, 0x00, 0x08, 0x80, 0x08, 0x80, 0x08, 0x80, 0x07, 0x00,
+    // U+0026
+    0x3C, 0x40, 0x40, 0x40, 0x20, 0x50, 0xD9, 0x89, 0x85, 0x86, 0x46, 0x3D,
+    // U+0027
+    0x80, 0x80, 0x80, 0x80,
+    // U+0028
+    0x30, 0x60, 0x40, 0x40, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x40, 0x40,
+    0x60, 0x30,
+    // U+0029
+    0xC0, 0x60, 0x20, 0x20, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x20, 0x20,
+    0x60, 0xC0,
+    // U+002A
+    0x10, 0x10, 0x92, 0x7C, 0x38, 0xD6, 0x10, 0x10,
+    // U+002B
+    0x10, 0x10, 0x10, 0xFE, 0x10, 0x10, 0x10,
+    // U+002C
+    0x60, 0x60, 0x60, 0xC0, 0x80,
+    // U+002D
+    0xF0,
+    // U+002E
+    0xC0, 0xC0,
+    // U+002F
+    0x02, 0x04, 0x04, 0x08, 0x08, 0x10, 0x10, 0x10, 0x20, 0x20, 0x40, 0x40,
+    0x80,
+    // U+0030
+    0x3C, 0x42, 0x42, 0x81, 0x81, 0x99, 0x99, 0x81, 0x81, 0x42, 0x42, 0x3C,
+    // U+0031
+    0x70, 0xD0, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x7C,
+    // U+0032
+    0x7C, 0xC2, 0x81, 0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x60, 0xFF,
+    // U+0033
+    0x7C, 0x82, 0x01, 0x01, 0x03, 0x3C, 0x02, 0x01, 0x01, 0x01, 0x82, 0x7C,
+    // U+0034
+    0x0C, 0x1C, 0x14, 0x34, 0x24, 0x44, 0x44, 0x84, 0xFF, 0x04, 0x04, 0x04,
+    // U+0035
+    0x7E, 0x40, 0x40, 0x40, 0x7C, 0x42, 0x01, 0x01, 0x01, 0x01, 0x82, 0x7C,
+    // U+0036
+    0x3C, 0x62, 0x40, 0x80, 0xBC, 0xC2, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C,
+    // U+0037
+    0xFF, 0x01, 0x02, 0x02, 0x04, 0x04, 0x08, 0x08, 0x08, 0x10, 0x10, 0x20,
+    // U+0038
+    0x3C, 0xC3, 0x81, 0x81, 0xC3, 0x3C, 0x43, 0x81, 0x81, 0x81, 0x42, 0x3C,
+    // U+0039
+    0x3C, 0x42, 0x81, 0x81, 0x81, 0x81, 0x43, 0x3D, 0x01, 0x02, 0x46, 0x3C,
+    // U+003A
+    0xC0, 0xC0, 0x00, 0x00, 0x00, 0x00, 0xC0, 0xC0,
+    // U+003B
+    0x60, 0x60, 0x00, 0x00, 0x00, 0x00, 0x60, 0x60, 0x60, 0xC0, 0x80,
+    // U+003C
+    0x01, 0x0F, 0x38, 0xE0, 0xE0, 0x38, 0x0F, 0x01,
+    // U+003D
+    0xFF, 0x00, 0x00, 0xFF,
+    // U+003E
+    0x80, 0xF0, 0x1C, 0x07, 0x07, 0x1C, 0xF0, 0x80,
+    // U+003F
+    0x78, 0x8C, 0x04, 0x04, 0x0C, 0x18, 0x20, 0x20, 0x20, 0x00, 0x20, 0x20,
+    // U+0040
+    0x1E, 0x23, 0x41, 0x4F, 0x9B, 0x91, 0x91, 0x91, 0x91, 0x9B, 0x4F, 0x40,
+    0x20, 0x1E,
+    // U+0041
+    0x18, 0x18, 0x3C, 0x24, 0x24, 0x24, 0x42, 0x42, 0x7E, 0x42, 0x81, 0x81,
+    // U+0042
+    0xFC, 0x83, 0x81, 0x81, 0x83, 0xFC, 0x83, 0x81, 0x81, 0x81, 0x83, 0xFC,
+    // U+0043
+    0x1E, 0x63, 0x40, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x40, 0x63, 0x1E,
+    // U+0044
+    0xF8, 0x86, 0x82, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x82, 0x86, 0xF8,
+    // U+0045
+    0xFF, 0x80, 0x80, 0x80, 0x80, 0xFF, 0x80, 0x80, 0x80, 0x80, 0x80, 0xFF,
+    // U+0046
+    0xFF, 0x80, 0x80, 0x80, 0x80, 0xFE, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    // U+0047
+    0x1E, 0x63, 0x40, 0x80, 0x80, 0x80, 0x87, 0x81, 0x81, 0x41, 0x61, 0x1E,
+    // U+0048
+    0x81, 0x81, 0x81, 0x81, 0x81, 0xFF, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81,
+    // U+0049
+    0xF8, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xF8,
+    // U+004A
+    0x1E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0xC4, 0x7C,
+    // U+004B
+    0x82, 0x84, 0x88, 0x90, 0xA0, 0xD0, 0x90, 0x88, 0x84, 0x84, 0x82, 0x81,
+    // U+004C
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0xFF,
+    // U+004D
+    0xC3, 0xC3, 0xE7, 0xA5, 0xA5, 0x99, 0x99, 0x99, 0x81, 0x81, 0x81, 0x81,
+    // U+004E
+    0xC1, 0xC1, 0xA1, 0xA1, 0x91, 0x91, 0x89, 0x89, 0x85, 0x85, 0x83, 0x83,
+    // U+004F
+    0x3C, 0x42, 0xC3, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0xC3, 0x42, 0x3C,
+    // U+0050
+    0xFC, 0x82, 0x81, 0x81, 0x81, 0x82, 0xFC, 0x80, 0x80, 0x80, 0x80, 0x80,
+    // U+0051
+    0x3C, 0x42, 0xC2, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0xC3, 0x42, 0x3E,
+    0x06, 0x02,
+    // U+0052
+    0xFC, 0x00, 0x82, 0x00, 0x81, 0x00, 0x81, 0x00, 0x81, 0x00, 0x83, 0x00,
+    0xFC, 0x00, 0x82, 0x00, 0x81, 0x00, 0x81, 0x00, 0x81, 0x00, 0x80, 0x80,
+    // U+0053
+    0x3C, 0x46, 0x80, 0x80, 0x80, 0x70, 0x1E, 0x01, 0x01, 0x81, 0xC3, 0x7C,
+    // U+0054
+    0xFF, 0x80, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00,
+    0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00,
+    // U+0055
+    0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C,
+    // U+0056
+    0x81, 0x81, 0x42, 0x42, 0x42, 0x42, 0x24, 0x24, 0x24, 0x3C, 0x18, 0x18,
+    // U+0057
+    0x80, 0x40, 0x80, 0x40, 0x80, 0x40, 0x4C, 0x80, 0x4C, 0x80, 0x4C, 0x80,
+    0x4C, 0x80, 0x52, 0x80, 0x52, 0x80, 0x52, 0x80, 0x21, 0x00, 0x21, 0x00,
+    // U+0058
+    0x81, 0x42, 0x42, 0x24, 0x24, 0x18, 0x18, 0x24, 0x24, 0x42, 0x42, 0x81,
+    // U+0059
+    0x80, 0x80, 0x41, 0x00, 0x22, 0x00, 0x22, 0x00, 0x14, 0x00, 0x14, 0x00,
+    0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00, 0x08, 0x00,
+    // U+005A
+    0xFF, 0x01, 0x02, 0x04, 0x0C, 0x08, 0x10, 0x30, 0x20, 0x40, 0x80, 0xFF,
+    // U+005B
+    0xE0, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0xE0,
+    // U+005C
+    0x80, 0x40, 0x40, 0x20, 0x20, 0x10, 0x10, 0x10, 0x08, 0x08, 0x04, 0x04,
+    0x02,
+    // U+005D
+    0xE0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0xE0,
+    // U+005E
+    0x1C, 0x00, 0x36, 0x00, 0x63, 0x00, 0xC1, 0x80,
+    // U+005F
+    0xFF, 0xC0,
+    // U+0060
+    0xC0, 0x60, 0x30,
+    // U+0061
+    0x3E, 0x43, 0x01, 0x3F, 0xC1, 0x81, 0x83, 0xC7, 0x7D,
+    // U+0062
+    0x80, 0x80, 0x80, 0xBC, 0xC2, 0x81, 0x81, 0x81, 0x81, 0x81, 0xC2, 0xBC,
+    // U+0063
+    0x3C, 0x42, 0x80, 0x80, 0x80, 0x80, 0x80, 0x42, 0x3C,
+    // U+0064
+    0x01, 0x01, 0x01, 0x3D, 0x43, 0x81, 0x81, 0x81, 0x81, 0x81, 0x43, 0x3D,
+    // U+0065
+    0x3C, 0x42, 0x81, 0x81, 0xFF, 0x80, 0x80, 0x41, 0x3E,
+    // U+0066
+    0x1C, 0x20, 0x20, 0xFC, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+    // U+0067
+    0x3D, 0x43, 0x81, 0x81, 0x81, 0x81, 0x81, 0x43, 0x3D, 0x01, 0x42, 0x3C,
+    // U+0068
+    0x80, 0x80, 0x80, 0xBE, 0xC3, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81,
+    // U+0069
+    0x10, 0x10, 0x00, 0x70, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0xFE,
+    // U+006A
+    0x10, 0x10, 0x00, 0x70, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x10, 0xE0,
+    // U+006B
+    0x80, 0x80, 0x80, 0x84, 0x88, 0x90, 0xA0, 0xD0, 0x88, 0x84, 0x82, 0x81,
+    // U+006C
+    0xF0, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x0E,
+    // U+006D
+    0xFC, 0x92, 0x92, 0x92, 0x92, 0x92, 0x92, 0x92, 0x92,
+    // U+006E
+    0xBE, 0xC3, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81,
+    // U+006F
+    0x3C, 0x42, 0x81, 0x81, 0x81, 0x81, 0x81, 0x42, 0x3C,
+    // U+0070
+    0xBC, 0xC2, 0x81, 0x81, 0x81, 0x81, 0x81, 0xC2, 0xBC, 0x80, 0x80, 0x80,
+    // U+0071
+    0x3D, 0x43, 0x81, 0x81, 0x81, 0x81, 0x81, 0x43, 0x3D, 0x01, 0x01, 0x01,
+    // U+0072
+    0xB8, 0xC4, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    // U+0073
+    0x3E, 0xC1, 0x80, 0xC0, 0x7E, 0x03, 0x01, 0x83, 0x7C,
+    // U+0074
+    0x20, 0x20, 0xFC, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x1C,
+    // U+0075
+    0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0x81, 0xC3, 0x7D,
+    // U+0076
+    0x81, 0x42, 0x42, 0x42, 0x24, 0x24, 0x24, 0x18, 0x18,
+    // U+0077
+    0x80, 0x40, 0x80, 0x40, 0x4C, 0x80, 0x4C, 0x80, 0x54, 0x80, 0x52, 0x80,
+    0x52, 0x80, 0x21, 0x00, 0x21, 0x00,
+    // U+0078
+    0xC3, 0x42, 0x24, 0x18, 0x18, 0x18, 0x24, 0x42, 0xC3,
+    // U+0079
+    0x81, 0x42, 0x42, 0x42, 0x24, 0x24, 0x14, 0x18, 0x18, 0x08, 0x10, 0x70,
+    // U+007A
+    0xFF, 0x01, 0x02, 0x04, 0x18, 0x20, 0x40, 0x80, 0xFF,
+    // U+007B
+    0x18, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xC0, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0x20, 0x18,
+    // U+007C
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80,
+    // U+007D
+    0xC0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x18, 0x20, 0x20, 0x20, 0x20,
+    0x20, 0x20, 0xC0,
+    // U+007E
+    0x71, 0x8E,
+    // U+00B0
+    0x70, 0x88, 0x88, 0x88, 0x70,
+    // U+FFFD
+    0x18, 0x3C, 0x42, 0x99, 0xFD, 0xFD, 0xF9, 0xF3, 0xE7, 0xE7, 0xE7, 0xFF,
+    0x66, 0x24, 0x18,
+};
+
+static const epaper_glyph_t epaper_font_mono16_glyphs[] = {
+    {0x0020,      0,  1,  1,   0,  14, 10},
+    {0x0021,      1,  1, 12,   4,   3, 10},
+    {0x0022,     13,  4,  4,   3,   3, 10},
+    {0x0023,     17, 10, 11,   0,   4, 10},
+    {0x0024,     39,  7, 14,   2,   3, 10},
+    {0x0025,     53,  9, 12,   0,   3, 10},
+    {0x0026,     77,  8, 12,   1,   3, 10},
+    {0x0027,     89,  1,  4,   4,   3, 10},
+    {0x0028,     93,  4, 14,   3,   3, 10},
+    {0x0029,    107,  4, 14,   2,   3, 10},
+    {0x002A,    121,  7,  8,   1,   3, 10},
+    {0x002B,    129,  7,  7,   1,   7, 10},
+    {0x002C,    136,  3,  5,   3,  13, 10},
+    {0x002D,    141,  4,  1,   3,  10, 10},
+    {0x002E,    142,  2,  2,   4,  13, 10},
+    {0x002F,    144,  7, 13,   1,   3, 10},
+    {0x0030,    157,  8, 12,   1,   3, 10},
+    {0x0031,    169,  6, 12,   2,   3, 10},
+    {0x0032,    181,  8, 12,   1,   3, 10},
+    {0x0033,    193,  8, 12,   1,   3, 10},
+    {0x0034,    205,  8, 12,   1,   3, 10},
+    {0x0035,    217,  8, 12,   1,   3, 10},
+    {0x0036,    229,  8, 12,   1,   3, 10},
+    {0x0037,    241,  8, 12,   1,   3, 10},
+    {0x0038,    253,  8, 12,   1,   3, 10},
+    {0x0039,    265,  8, 12,   1,   3, 10},
+    {0x003A,    277,  2,  8,   4,   7, 10},
+    {0x003B,    285,  3, 11,   3,   7, 10},
+    {0x003C,    296,  8,  8,   1,   6, 10},
+    {0x003D,    304,  8,  4,   1,   8, 10},
+    {0x003E,    308,  8,  8,   1,   6, 10},
+    {0x003F,    316,  6, 12,   2,   3, 10},
+    {0x0040,    328,  8, 14,   1,   4, 10},
+    {0x0041,    342,  8, 12,   1,   3, 10},
+    {0x0042,    354,  8, 12,   1,   3, 10},
+    {0x0043,    366,  8, 12,   1,   3, 10},
+    {0x0044,    378,  8, 12,   1,   3, 10},
+    {0x0045,    390,  8, 12,   1,   3, 10},
+    {0x0046,    402,  8, 12,   1,   3, 10},
+    {0x0047,    414,  8, 12,   1,   3, 10},
+    {0x0048,    426,  8, 12,   1,   3, 10},
+    {0x0049,    438,  5, 12,   2,   3, 10},
+    {0x004A,    450,  7, 12,   1,   3, 10},
+    {0x004B,    462,  8, 12,   1,   3, 10},
+    {0x004C,    474,  8, 12,   1,   3, 10},
+    {0x004D,    486,  8, 12,   1,   3, 10},
+    {0x004E,    498,  8, 12,   1,   3, 10},
+    {0x004F,    510,  8, 12,   1,   3, 10},
+    {0x0050,    522,  8, 12,   1,   3, 10},
+    {0x0051,    534,  8, 14,   1,   3, 10},
+    {0x0052,    548,  9, 12,   1,   3, 10},
+    {0x0053,    572,  8, 12,   1,   3, 10},
+    {0x0054,    584,  9, 12,   0,   3, 10},
+    {0x0055,    608,  8, 12,   1,   3, 10},
+    {0x0056,    620,  8, 12,   1,   3, 10},
+    {0x0057,    632, 10, 12,   0,   3, 10},
+    {0x0058,    656,  8, 12,   1,   3, 10},
+    {0x0059,    668,  9, 12,   0,   3, 10},
+    {0x005A,    692,  8, 12,   1,   3, 10},
+    {0x005B,    704,  3, 14,   4,   3, 10},
+    {0x005C,    718,  7, 13,   1,   3, 10},
+    {0x005D,    731,  3, 14,   3,   3, 10},
+    {0x005E,    745,  9,  4,   1,   3, 10},
+    {0x005F,    753, 10,  1,   0,  18, 10},
+    {0x0060,    755,  4,  3,   2,   2, 10},
+    {0x0061,    758,  8,  9,   1,   6, 10},
+    {0x0062,    767,  8, 12,   1,   3, 10},
+    {0x0063,    779,  7,  9,   1,   6, 10},
+    {0x0064,    788,  8, 12,   1,   3, 10},
+    {0x0065,    800,  8,  9,   1,   6, 10},
+    {0x0066,    809,  6, 12,   2,   3, 10},
+    {0x0067,    821,  8, 12,   1,   6, 10},
+    {0x0068,    833,  8, 12,   1,   3, 10},
+    {0x0069,    845,  7, 12,   1,   3, 10},
+    {0x006A,    857,  4, 15,   2,   3, 10},
+    {0x006B,    872,  8, 12,   1,   3, 10},
+    {0x006C,    884,  7, 12,   1,   3, 10},
+    {0x006D,    896,  7,  9,   1,   6, 10},
+    {0x006E,    905,  8,  9,   1,   6, 10},
+    {0x006F,    914,  8,  9,   1,   6, 10},
+    {0x0070,    923,  8, 12,   1,   6, 10},
+    {0x0071,    935,  8, 12,   1,   6, 10},
+    {0x0072,    947,  6,  9,   3,   6, 10},
+    {0x0073,    956,  8,  9,   1,   6, 10},
+    {0x0074,    965,  6, 11,   1,   4, 10},
+    {0x0075,    976,  8,  9,   1,   6, 10},
+    {0x0076,    985,  8,  9,   1,   6, 10},
+    {0x0077,    994, 10,  9,   0,   6, 10},
+    {0x0078,   1012,  8,  9,   1,   6, 10},
+    {0x0079,   1021,  8, 12,   1,   6, 10},
+    {0x007A,   1033,  8,  9,   1,   6, 10},
+    {0x007B,   1042,  5, 15,   2,   3, 10},
+    {0x007C,   1057,  1, 16,   4,   3, 10},
+    {0x007D,   1073,  5, 15,   2,   3, 10},
+    {0x007E,   1088,  8,  2,   1,   9, 10},
+    {0x00B0,   1090,  5,  5,   2,   3, 10},
+    {0xFFFD,   1095,  8, 15,   1,   1, 10},
+};
+
+const epaper_font_t epaper_font_mono16 = {
+    .glyphs = epaper_font_mono16_glyphs,
+    .bitmap = epaper_font_mono16_bitmap,
+    .glyph_count = 97,
+    .ascent = 15,
+    .line_height = 19,
+    .fallback = NULL,
+};
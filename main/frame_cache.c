@@ -0,0 +1,244 @@
+#include "frame_cache.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "FRAME_CACHE";
+
+#ifndef CONFIG_FRAME_CACHE_BUDGET_KB
+#define CONFIG_FRAME_CACHE_BUDGET_KB 1536
+#endif
+
+typedef struct {
+    char path[FRAME_CACHE_PATH_MAX];
+    off_t size;
+    time_t mtime;
+    bmp_load_opts_t opts;
+    uint16_t width;
+    uint16_t height;
+    size_t bytes;
+    uint32_t stamp;
+    uint8_t *frame;             // NULL for a free slot
+} frame_cache_entry_t;
+
+static frame_cache_entry_t *_entries = NULL;
+static SemaphoreHandle_t _lock = NULL;
+static uint32_t _clock = 0;
+static frame_cache_stats_t _stats;
+
+esp_err_t frame_cache_init(size_t budget)
+{
+    if (_entries != NULL) {
+        return ESP_OK;
+    }
+
+    _entries = heap_caps_calloc(FRAME_CACHE_MAX_ENTRIES, sizeof(frame_cache_entry_t), MALLOC_CAP_8BIT);
+    _lock = xSemaphoreCreateMutex();
+    if (_entries == NULL || _lock == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate the frame cache");
+        frame_cache_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.budget = budget != 0 ? budget : (size_t)CONFIG_FRAME_CACHE_BUDGET_KB * 1024;
+
+    ESP_LOGI(TAG, "Frame cache: %u byte budget, up to %d frames", (unsigned)_stats.budget,
+             FRAME_CACHE_MAX_ENTRIES);
+    return ESP_OK;
+}
+
+static void frame_cache_drop(frame_cache_entry_t *e)
+{
+    heap_caps_free(e->frame);
+    _stats.bytes -= e->bytes;
+    _stats.entries--;
+    memset(e, 0, sizeof(*e));
+}
+
+void frame_cache_deinit(void)
+{
+    if (_entries != NULL) {
+        for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+            heap_caps_free(_entries[i].frame);
+        }
+        heap_caps_free(_entries);
+        _entries = NULL;
+    }
+    if (_lock != NULL) {
+        vSemaphoreDelete(_lock);
+        _lock = NULL;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+static void frame_cache_evict_lru(void)
+{
+    frame_cache_entry_t *victim = NULL;
+    for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+        frame_cache_entry_t *e = &_entries[i];
+        if (e->frame != NULL && (victim == NULL || e->stamp < victim->stamp)) {
+            victim = e;
+        }
+    }
+    if (victim != NULL) {
+        frame_cache_drop(victim);
+        _stats.evictions++;
+    }
+}
+
+// Evicts least recently used entries until bytes more fit in the budget,
+// then returns a free slot; NULL if bytes alone exceed the budget.
+static frame_cache_entry_t *frame_cache_make_room(size_t bytes)
+{
+    if (bytes > _stats.budget) {
+        return NULL;
+    }
+    while (_stats.bytes + bytes > _stats.budget || _stats.entries == FRAME_CACHE_MAX_ENTRIES) {
+        frame_cache_evict_lru();
+    }
+    for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+        if (_entries[i].frame == NULL) {
+            return &_entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t frame_cache_set_budget(size_t budget)
+{
+    if (_entries == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.budget = budget;
+    while (_stats.bytes > budget) {
+        frame_cache_evict_lru();
+    }
+    xSemaphoreGive(_lock);
+    return ESP_OK;
+}
+
+void frame_cache_invalidate(const char *path)
+{
+    if (_entries == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+        frame_cache_entry_t *e = &_entries[i];
+        if (e->frame != NULL && (path == NULL || strcmp(e->path, path) == 0)) {
+            frame_cache_drop(e);
+        }
+    }
+    xSemaphoreGive(_lock);
+}
+
+static frame_cache_entry_t *frame_cache_find(const char *path, const struct stat *st, const bmp_load_opts_t *opts)
+{
+    for (int i = 0; i < FRAME_CACHE_MAX_ENTRIES; i++) {
+        frame_cache_entry_t *e = &_entries[i];
+        if (e->frame != NULL && e->size == st->st_size && e->mtime == st->st_mtime &&
+            e->opts.fit == opts->fit && e->opts.dither == opts->dither && strcmp(e->path, path) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t frame_cache_load(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                           const bmp_load_opts_t *opts, bmp_image_t *image)
+{
+    bmp_load_opts_t key_opts = opts != NULL ? *opts : (bmp_load_opts_t)BMP_LOAD_OPTS_DEFAULT;
+    struct stat st;
+
+    if (_entries == NULL || filename == NULL || frame == NULL || image == NULL ||
+        strlen(filename) >= FRAME_CACHE_PATH_MAX || stat(filename, &st) != 0) {
+        return load_image_into_frame(filename, frame, frame_w, frame_h, opts, image);
+    }
+
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    frame_cache_entry_t *hit = frame_cache_find(filename, &st, &key_opts);
+    if (hit != NULL && (size_t)frame_w * frame_h / 2 >= hit->bytes) {
+        memcpy(frame, hit->frame, hit->bytes);
+        hit->stamp = ++_clock;
+        image->data = frame;
+        image->width = hit->width;
+        image->height = hit->height;
+        image->bits_per_pixel = 4;
+        _stats.hits++;
+        xSemaphoreGive(_lock);
+
+        ESP_LOGI(TAG, "Hit for %s, copied in %lld us", filename, (long long)(esp_timer_get_time() - start));
+        return ESP_OK;
+    }
+    _stats.misses++;
+    xSemaphoreGive(_lock);
+
+    esp_err_t ret = load_image_into_frame(filename, frame, frame_w, frame_h, opts, image);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    size_t bytes = (size_t)image->width * image->height / 2;
+    if (bytes > _stats.budget) {
+        return ESP_OK;
+    }
+    uint8_t *copy = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (copy == NULL) {
+        ESP_LOGW(TAG, "No PSRAM for a %u byte frame, %s not cached", (unsigned)bytes, filename);
+        return ESP_OK;
+    }
+    memcpy(copy, image->data, bytes);
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    // Another request may have cached the same file meanwhile.
+    frame_cache_entry_t *e = frame_cache_find(filename, &st, &key_opts);
+    if (e != NULL) {
+        frame_cache_drop(e);
+    }
+    e = frame_cache_make_room(bytes);
+    if (e != NULL) {
+        strcpy(e->path, filename);
+        e->size = st.st_size;
+        e->mtime = st.st_mtime;
+        e->opts = key_opts;
+        e->width = image->width;
+        e->height = image->height;
+        e->bytes = bytes;
+        e->stamp = ++_clock;
+        e->frame = copy;
+        _stats.bytes += bytes;
+        _stats.entries++;
+        _stats.insertions++;
+        copy = NULL;
+    }
+    xSemaphoreGive(_lock);
+
+    heap_caps_free(copy);
+    return ESP_OK;
+}
+
+esp_err_t frame_cache_get_stats(frame_cache_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (_entries == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    *stats = _stats;
+    xSemaphoreGive(_lock);
+    return ESP_OK;
+}
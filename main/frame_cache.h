@@ -0,0 +1,50 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "bitmap.h"
+
+// Ready-to-send panel frames of recently shown images, kept in PSRAM so
+// showing one again skips reading and decoding the file. An entry is keyed
+// by the path, the file's size and mtime, and the fit and dither options
+// it was decoded with; least recently used frames are dropped to stay
+// within the byte budget.
+
+#define FRAME_CACHE_MAX_ENTRIES     16
+#define FRAME_CACHE_PATH_MAX        128
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t insertions;
+    uint32_t evictions;
+    uint32_t entries;
+    size_t bytes;
+    size_t budget;
+} frame_cache_stats_t;
+
+// Sets up the cache with a budget in bytes; 0 takes the
+// CONFIG_FRAME_CACHE_BUDGET_KB default. Frames are only allocated as
+// images are loaded. Calling it again once the cache exists is a no-op.
+esp_err_t frame_cache_init(size_t budget);
+void frame_cache_deinit(void);
+
+// Changes the budget, evicting least recently used frames to fit.
+esp_err_t frame_cache_set_budget(size_t budget);
+
+// Drops the entries for path, or every entry if path is NULL. Needed when
+// a file is replaced within the mtime resolution of the card (2 s on FAT).
+void frame_cache_invalidate(const char *path);
+
+// load_image_into_frame through the cache: on a hit the cached frame is
+// copied into frame and the file is only stat()ed; on a miss the image is
+// loaded and a copy kept. Works as a plain load when the cache is not set
+// up.
+esp_err_t frame_cache_load(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                           const bmp_load_opts_t *opts, bmp_image_t *image);
+
+esp_err_t frame_cache_get_stats(frame_cache_stats_t *stats);
+
+#endif
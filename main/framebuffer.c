@@ -0,0 +1,124 @@
+#include "framebuffer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static const char *TAG = "FRAMEBUFFER";
+
+static uint8_t *_frames[FB_MAX_FRAMES];
+static int _frame_count = 0;
+static int _front = 0;
+static size_t _frame_size = 0;
+static bool _in_psram = false;
+
+esp_err_t fb_pool_init(size_t frame_size, int count)
+{
+    if (frame_size == 0 || count < 1 || count > FB_MAX_FRAMES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (_frame_count > 0) {
+        return ESP_OK;
+    }
+
+    size_t internal_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    // Frames only ever reach the SPI DMA through the internal staging
+    // buffers in the driver, so PSRAM needs no DMA capability here.
+    _in_psram = true;
+    for (int i = 0; i < count; i++) {
+        _frames[i] = heap_caps_malloc(frame_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (_frames[i] == NULL) {
+            ESP_LOGW(TAG, "PSRAM frame %d unavailable, using internal RAM", i);
+            _frames[i] = heap_caps_malloc(frame_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            _in_psram = false;
+        }
+
+        if (_frames[i] == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate frame %d", i);
+            _frame_count = i;
+            fb_pool_deinit();
+            return ESP_ERR_NO_MEM;
+        }
+
+        memset(_frames[i], 0x11, frame_size);
+    }
+
+    _frame_count = count;
+    _frame_size = frame_size;
+    _front = 0;
+
+    size_t internal_after = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    ESP_LOGI(TAG, "%d x %u byte frames in %s, internal heap %u -> %u bytes free",
+             count, (unsigned)frame_size, _in_psram ? "PSRAM" : "internal RAM",
+             (unsigned)internal_before, (unsigned)internal_after);
+
+    return ESP_OK;
+}
+
+void fb_pool_deinit(void)
+{
+    for (int i = 0; i < FB_MAX_FRAMES; i++) {
+        heap_caps_free(_frames[i]);
+        _frames[i] = NULL;
+    }
+
+    _frame_count = 0;
+    _frame_size = 0;
+    _front = 0;
+}
+
+bool fb_pool_is_ready(void)
+{
+    return _frame_count > 0;
+}
+
+uint8_t *fb_get_front(void)
+{
+    return _frame_count > 0 ? _frames[_front] : NULL;
+}
+
+uint8_t *fb_get_back(void)
+{
+    if (_frame_count == 0) {
+        return NULL;
+    }
+
+    return _frames[(_front + 1) % _frame_count];
+}
+
+void fb_swap(void)
+{
+    if (_frame_count > 0) {
+        _front = (_front + 1) % _frame_count;
+    }
+}
+
+void fb_present(const uint8_t *frame)
+{
+    if (frame != NULL && frame == fb_get_back()) {
+        fb_swap();
+    }
+}
+
+size_t fb_frame_size(void)
+{
+    return _frame_size;
+}
+
+esp_err_t fb_pool_get_stats(fb_pool_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->frames = _frame_count;
+    stats->frame_size = _frame_size;
+    stats->in_psram = _in_psram;
+    // Compared with the static frame buffer that used to live in .bss.
+    stats->internal_saved = _in_psram ? _frame_size : 0;
+    stats->internal_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    stats->psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+
+    return ESP_OK;
+}
@@ -0,0 +1,41 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define FB_MAX_FRAMES       4
+#define FB_DEFAULT_FRAMES   2
+
+typedef struct {
+    int frames;
+    size_t frame_size;
+    bool in_psram;
+    size_t internal_saved;
+    size_t internal_free;
+    size_t psram_free;
+} fb_pool_stats_t;
+
+// Allocates `count` frames of `frame_size` bytes, preferring PSRAM.
+// Calling it again once the pool exists is a no-op.
+esp_err_t fb_pool_init(size_t frame_size, int count);
+void fb_pool_deinit(void);
+bool fb_pool_is_ready(void);
+
+// The front frame is the one last handed to the panel; the back frame is
+// free for decoding or drawing the next image while the front refreshes.
+uint8_t *fb_get_front(void);
+uint8_t *fb_get_back(void);
+void fb_swap(void);
+
+// Called by the async display paths once the transfer has read all of
+// frame: if it is the back frame it becomes the front, so the next image
+// goes into the other one. Buffers outside the pool are left alone.
+void fb_present(const uint8_t *frame);
+
+size_t fb_frame_size(void);
+esp_err_t fb_pool_get_stats(fb_pool_stats_t *stats);
+
+#endif
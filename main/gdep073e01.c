@@ -1,17 +1,45 @@
-#include "epaper_driver.h"
+#include "gdep073e01.h"
 #include "esp_log.h"
 #include <string.h>
 
 static const char *TAG = "GDEP073E01";
 
-__attribute__((unused)) static const uint8_t gdep073e01_init_sequence[] = {
-    0x00, 0x0F,
-    0x61, 0x03, 0x20, 0x01, 0xE0,
-    0x15, 0x00,
-    0x50, 0x11, 0x07,
-    0x60, 0x22
+#define PSR         0x00
+#define PWRR        0x01
+#define POFS        0x03
+#define PON         0x04
+#define BTST1       0x05
+#define BTST2       0x06
+#define BTST3       0x08
+#define PLL         0x30
+#define CDI         0x50
+#define TCON        0x60
+#define TRES        0x61
+#define T_VDCS      0x84
+#define PWS         0xE3
+#define CMDH        0xAA
+
+// Register writes do not assert BUSY, so only PON is waited on. Everything
+// before it is sent as one batch by epaper_run_init_table().
+const epaper_init_cmd_t gdep073e01_init_table[] = {
+    {CMDH,   6, {0x49, 0x55, 0x20, 0x08, 0x09, 0x18}, EPAPER_WAIT_NONE, 0, 0, "CMDH"},
+    {PWRR,   1, {0x3F},                               EPAPER_WAIT_NONE, 0, 0, "PWRR"},
+    {PSR,    2, {0x5F, 0x69},                         EPAPER_WAIT_NONE, 0, 0, "PSR"},
+    {POFS,   4, {0x00, 0x54, 0x00, 0x44},             EPAPER_WAIT_NONE, 0, 0, "POFS"},
+    {BTST1,  4, {0x40, 0x1F, 0x1F, 0x2C},             EPAPER_WAIT_NONE, 0, 0, "BTST1"},
+    {BTST2,  4, {0x6F, 0x1F, 0x17, 0x49},             EPAPER_WAIT_NONE, 0, 0, "BTST2"},
+    {BTST3,  4, {0x6F, 0x1F, 0x1F, 0x22},             EPAPER_WAIT_NONE, 0, 0, "BTST3"},
+    {PLL,    1, {0x00},                               EPAPER_WAIT_NONE, 0, 0, "PLL"},
+    {CDI,    1, {0x3F},                               EPAPER_WAIT_NONE, 0, 0, "CDI"},
+    {TCON,   2, {0x02, 0x00},                         EPAPER_WAIT_NONE, 0, 0, "TCON"},
+    {TRES,   4, {0x03, 0x20, 0x01, 0xE0},             EPAPER_WAIT_NONE, 0, 0, "TRES"},
+    {T_VDCS, 1, {0x01},                               EPAPER_WAIT_NONE, 0, 0, "T_VDCS"},
+    {PWS,    1, {0x2F},                               EPAPER_WAIT_NONE, 0, 0, "PWS"},
+    {PON,    0, {0},                                  EPAPER_WAIT_BUSY, 1000, 0, "PON"},
 };
 
+const size_t gdep073e01_init_table_len = sizeof(gdep073e01_init_table) / sizeof(gdep073e01_init_table[0]);
+
 esp_err_t gdep073e01_init_specific(epaper_handle_t *handle)
 {
     ESP_LOGI(TAG, "Initializing GDEP073E01 specific settings...");
@@ -31,4 +59,4 @@ esp_err_t gdep073e01_clear_white(epaper_handle_t *handle)
     ESP_LOGI(TAG, "Clearing display to white...");
 
     return epaper_clear(handle, EPAPER_COLOR_WHITE);
-}
\ No newline at end of file
+}
@@ -0,0 +1,14 @@
+#ifndef GDEP073E01_H
+#define GDEP073E01_H
+
+#include <stddef.h>
+#include "epaper_driver.h"
+
+extern const epaper_init_cmd_t gdep073e01_init_table[];
+extern const size_t gdep073e01_init_table_len;
+
+esp_err_t gdep073e01_init_specific(epaper_handle_t *handle);
+
+esp_err_t gdep073e01_clear_white(epaper_handle_t *handle);
+
+#endif
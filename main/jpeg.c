@@ -0,0 +1,306 @@
+#include "jpeg.h"
+#include "epaper_driver.h"
+#include "epaper_dither.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "rom/tjpgd.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "JPEG";
+
+// State shared by the decoder callbacks, reached through JDEC.device.
+typedef struct {
+    FILE *file;
+    uint8_t *buf;
+    size_t len;             // valid bytes in buf
+    size_t pos;             // next unread byte in buf
+    uint32_t bytes;
+    uint32_t chunks;
+    int64_t read_us;
+
+    bmp_layout_t layout;    // in decoded (scaled) pixels
+    uint8_t *frame;
+    const uint8_t *color_lut;
+    bool dithered;
+    epaper_dither_ctx_t dither;
+
+    uint8_t *band;          // band_rows rows of layout.sw RGB pixels
+    uint16_t band_rows;
+    uint32_t band_top;      // decoded row held in band row 0
+    uint16_t *xmap;         // band row byte offset per output column
+    uint8_t *line;          // one panel code per output column
+    uint8_t *rgb;           // sampled colours of one output row, dithering only
+    uint32_t next_row;      // next output row to fill
+    int32_t last_sy;        // decoded row behind the previous output row
+    int64_t convert_us;
+} jpeg_loader_t;
+
+static bool jpeg_fill(jpeg_loader_t *ld)
+{
+    int64_t start = esp_timer_get_time();
+
+    ld->pos = 0;
+    ld->len = fread(ld->buf, 1, JPEG_CHUNK_SIZE, ld->file);
+    ld->bytes += ld->len;
+
+    ld->read_us += esp_timer_get_time() - start;
+    ld->chunks++;
+    return ld->len > 0;
+}
+
+// TJpgDec input callback: copies len bytes to buf, or skips them when buf
+// is NULL. Returns the count actually consumed.
+static uint32_t jpeg_input(JDEC *jd, uint8_t *buf, uint32_t len)
+{
+    jpeg_loader_t *ld = jd->device;
+    uint32_t done = 0;
+
+    while (done < len) {
+        if (ld->pos == ld->len && !jpeg_fill(ld)) {
+            break;
+        }
+
+        size_t n = ld->len - ld->pos;
+        if (n > len - done) {
+            n = len - done;
+        }
+        if (buf != NULL) {
+            memcpy(buf + done, ld->buf + ld->pos, n);
+        }
+        ld->pos += n;
+        done += n;
+    }
+    return done;
+}
+
+// Produces every output row whose source row is in the band, in order.
+// Output rows that sample the same source row as the one before are
+// copied unless they have to be dithered again.
+static void jpeg_flush_band(jpeg_loader_t *ld)
+{
+    const bmp_layout_t *layout = &ld->layout;
+    uint32_t stride = layout->dst_w / 2;
+    int64_t start = esp_timer_get_time();
+
+    while (ld->next_row < layout->dh) {
+        uint32_t sy = bmp_src_pos(ld->next_row, layout->sy0, layout->sh, layout->dh);
+        if (sy >= ld->band_top + ld->band_rows) {
+            break;
+        }
+
+        const uint8_t *src = ld->band + (size_t)(sy - ld->band_top) * layout->sw * 3;
+        uint8_t *out = ld->frame + (size_t)(layout->dy0 + ld->next_row) * stride;
+
+        if (ld->dithered) {
+            for (uint16_t i = 0; i < layout->dw; i++) {
+                memcpy(ld->rgb + i * 3, src + ld->xmap[i], 3);
+            }
+            epaper_dither_row(&ld->dither, ld->rgb, ld->line);
+            bmp_pack_row(out + layout->dx0 / 2, ld->line, layout->dw);
+        } else if ((int32_t)sy != ld->last_sy) {
+            for (uint16_t i = 0; i < layout->dw; i++) {
+                const uint8_t *p = src + ld->xmap[i];
+                ld->line[i] = ld->color_lut[EPAPER_COLOR_LUT_INDEX(p[0], p[1], p[2])];
+            }
+            bmp_pack_row(out + layout->dx0 / 2, ld->line, layout->dw);
+        } else {
+            memcpy(out, out - stride, stride);
+        }
+
+        ld->last_sy = sy;
+        ld->next_row++;
+    }
+
+    ld->convert_us += esp_timer_get_time() - start;
+}
+
+// TJpgDec output callback: one MCU of RGB888 at a time, left to right and
+// top to bottom. A block starting a new MCU row completes the band before
+// it. Returning 0 stops the decoder once every output row is filled.
+static uint32_t jpeg_output(JDEC *jd, void *bitmap, JRECT *rect)
+{
+    jpeg_loader_t *ld = jd->device;
+    const bmp_layout_t *layout = &ld->layout;
+
+    if (rect->top != ld->band_top) {
+        jpeg_flush_band(ld);
+        if (ld->next_row >= layout->dh) {
+            return 0;
+        }
+        ld->band_top = rect->top;
+    }
+
+    if ((uint32_t)(rect->bottom - rect->top) >= ld->band_rows) {
+        return 0;
+    }
+
+    // Only the columns that are shown are kept.
+    uint32_t x0 = rect->left > layout->sx0 ? rect->left : layout->sx0;
+    uint32_t x1 = (uint32_t)rect->right + 1 < layout->sx0 + layout->sw ? (uint32_t)rect->right + 1
+                                                                        : layout->sx0 + layout->sw;
+    if (x0 >= x1 || rect->bottom < layout->sy0) {
+        return 1;
+    }
+
+    uint32_t block_w = rect->right - rect->left + 1;
+    const uint8_t *src = (const uint8_t *)bitmap + (x0 - rect->left) * 3;
+    uint8_t *dst = ld->band + (x0 - layout->sx0) * 3;
+    for (uint32_t y = 0; y <= (uint32_t)(rect->bottom - rect->top); y++) {
+        memcpy(dst + (size_t)y * layout->sw * 3, src + y * block_w * 3, (x1 - x0) * 3);
+    }
+    return 1;
+}
+
+esp_err_t load_jpeg_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                               const bmp_load_opts_t *opts, bmp_image_t *image)
+{
+    if (filename == NULL || frame == NULL || image == NULL || (frame_w % 2) || (frame_h % 2)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    static const bmp_load_opts_t defaults = BMP_LOAD_OPTS_DEFAULT;
+    if (opts == NULL) {
+        opts = &defaults;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = ESP_FAIL;
+    jpeg_loader_t ld = {.frame = frame, .last_sy = -1};
+    uint8_t *work = NULL;
+    uint8_t *scratch = NULL;
+    JDEC jd;
+
+    ESP_LOGI(TAG, "Loading JPEG file: %s", filename);
+
+    ld.file = fopen(filename, "rb");
+    if (!ld.file) {
+        ESP_LOGE(TAG, "Failed to open file: %s", filename);
+        return ESP_FAIL;
+    }
+    setvbuf(ld.file, NULL, _IONBF, 0);
+
+    ld.buf = heap_caps_malloc(JPEG_CHUNK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    work = heap_caps_malloc(JPEG_WORK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!ld.buf || !work) {
+        ESP_LOGE(TAG, "Failed to allocate decoder buffers");
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    JRESULT jres = jd_prepare(&jd, jpeg_input, work, JPEG_WORK_SIZE, &ld);
+    if (jres != JDR_OK) {
+        ESP_LOGE(TAG, "Failed to parse JPEG header (%d)", jres);
+        if (jres == JDR_FMT3) {
+            ESP_LOGE(TAG, "Only baseline JPEG is supported");
+            ret = ESP_ERR_NOT_SUPPORTED;
+        }
+        goto cleanup;
+    }
+
+    uint32_t width = jd.width;
+    uint32_t height = jd.height;
+    if (width == 0 || height == 0 || width > BMP_MAX_DIMENSION || height > BMP_MAX_DIMENSION) {
+        ESP_LOGE(TAG, "JPEG dimensions must be 1 to %d pixels", BMP_MAX_DIMENSION);
+        ret = ESP_ERR_NOT_SUPPORTED;
+        goto cleanup;
+    }
+
+    bmp_layout_t *layout = &ld.layout;
+    layout->dst_w = height > width ? frame_h : frame_w;
+    layout->dst_h = height > width ? frame_w : frame_h;
+
+    // The largest decoder scale-down that still leaves at least one
+    // decoded pixel per output pixel. Centred images are never scaled.
+    uint8_t scale = 0;
+    bmp_plan_layout(layout, width, height, opts->fit);
+    if (opts->fit != BMP_FIT_CENTER) {
+        while (scale < 3 && (layout->sw >> (scale + 1)) >= layout->dw && (layout->sh >> (scale + 1)) >= layout->dh) {
+            scale++;
+        }
+    }
+    uint32_t dec_w = width >> scale;
+    uint32_t dec_h = height >> scale;
+    bmp_plan_layout(layout, dec_w, dec_h, opts->fit);
+
+    ESP_LOGI(TAG, "JPEG info: %lux%lu, MCU %ux%u, decoding at 1/%u; placing %lux%lu at %u,%u as %ux%u (%s, %s dithering)",
+             (unsigned long)width, (unsigned long)height, jd.msx * 8, jd.msy * 8, 1u << scale,
+             (unsigned long)layout->sw, (unsigned long)layout->sh, layout->dx0, layout->dy0, layout->dw, layout->dh,
+             bmp_fit_name(opts->fit), epaper_dither_name(opts->dither));
+
+    ld.band_rows = (jd.msy * 8) >> scale;
+    ld.dithered = (opts->dither != EPAPER_DITHER_NONE);
+    size_t rgb_size = ld.dithered ? (size_t)layout->dw * 3 : 0;
+    ld.band = heap_caps_malloc((size_t)ld.band_rows * layout->sw * 3, MALLOC_CAP_8BIT);
+    scratch = heap_caps_malloc(layout->dw * (sizeof(uint16_t) + 1) + rgb_size, MALLOC_CAP_8BIT);
+    ld.color_lut = epaper_color_lut();
+    if (!ld.band || !scratch || !ld.color_lut) {
+        ESP_LOGE(TAG, "Failed to allocate band buffers");
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    ld.xmap = (uint16_t *)scratch;
+    ld.line = scratch + layout->dw * sizeof(uint16_t);
+    ld.rgb = ld.line + layout->dw;
+
+    ret = epaper_dither_begin(&ld.dither, opts->dither, layout->dw);
+    if (ret != ESP_OK) {
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < layout->dw; i++) {
+        ld.xmap[i] = (bmp_src_pos(i, layout->sx0, layout->sw, layout->dw) - layout->sx0) * 3;
+    }
+
+    uint32_t stride = layout->dst_w / 2;
+    if (layout->dw < layout->dst_w || layout->dh < layout->dst_h) {
+        memset(frame, (EPAPER_COLOR_WHITE << 4) | EPAPER_COLOR_WHITE, (size_t)stride * layout->dst_h);
+    }
+
+    jres = jd_decomp(&jd, jpeg_output, scale);
+    if (jres == JDR_OK) {
+        jpeg_flush_band(&ld);
+    }
+    if ((jres != JDR_OK && jres != JDR_INTR) || ld.next_row < layout->dh) {
+        ESP_LOGE(TAG, "Failed to decode image data (%d)", jres);
+        ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    image->data = frame;
+    image->width = layout->dst_w;
+    image->height = layout->dst_h;
+    image->bits_per_pixel = 24;
+
+    bmp_load_stats_t stats = {
+        .src_width = width,
+        .src_height = height,
+        .bits_per_pixel = 24,
+        .fit = opts->fit,
+        .dither = opts->dither,
+        .decode_scale = scale,
+        .file_bytes = ld.bytes,
+        .chunks = ld.chunks,
+        .read_us = ld.read_us,
+        .convert_us = ld.convert_us,
+        .elapsed_us = esp_timer_get_time() - start
+    };
+    bmp_record_load_stats(&stats);
+
+    ret = ESP_OK;
+    ESP_LOGI(TAG, "JPEG file loaded in %lld us (%lu chunks, %lld us reading, %lld us converting)",
+             (long long)stats.elapsed_us, (unsigned long)stats.chunks, (long long)stats.read_us,
+             (long long)stats.convert_us);
+
+cleanup:
+    epaper_dither_end(&ld.dither);
+    heap_caps_free(scratch);
+    heap_caps_free(ld.band);
+    heap_caps_free(work);
+    heap_caps_free(ld.buf);
+    fclose(ld.file);
+    return ret;
+}
@@ -0,0 +1,25 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "bitmap.h"
+
+// Input is read in chunks of this size; the decoder's own work area is
+// JPEG_WORK_SIZE bytes (what the ROM TJpgDec asks for, with some margin).
+#define JPEG_CHUNK_SIZE     BMP_CHUNK_SIZE
+#define JPEG_WORK_SIZE      3200
+
+// Decodes a baseline JPEG with the ROM TJpgDec into frame as packed 4bpp
+// panel colour codes, using the same layout, fit and dither options as
+// load_bmp_into_frame. The decoder's 1/2, 1/4 and 1/8 scaling is used
+// whenever the result still covers the area it is shown in, and the rest
+// of the scaling is nearest-neighbour sampling. Decoded MCUs are gathered
+// into one MCU-high band of RGB, only as wide as the part of the image
+// that is shown, and each band is converted as soon as it is complete;
+// no full-size RGB buffer is ever held. Progressive JPEGs are rejected
+// with ESP_ERR_NOT_SUPPORTED.
+esp_err_t load_jpeg_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                               const bmp_load_opts_t *opts, bmp_image_t *image);
+
+#endif
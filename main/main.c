@@ -8,6 +8,10 @@
 #include "sdio.h"
 #include "bitmap.h"
 #include "epaper_driver.h"
+#include "framebuffer.h"
+#include "frame_cache.h"
+#include "epaper_text.h"
+#include "epaper_rotate.h"
 #include "logger.h"
 #include "config_parser.h"
 #include "wifi_manager.h"
@@ -16,6 +20,15 @@
 
 static const char *TAG = "MAIN";
 
+static void boot_image_refresh_done(esp_err_t result, void *arg)
+{
+    if (result == ESP_OK) {
+        ESP_LOGI(TAG, "Image displayed successfully");
+    } else {
+        ESP_LOGE(TAG, "Failed to display image");
+    }
+}
+
 void app_main(void)
 {
     esp_err_t ret;
@@ -87,6 +100,16 @@ void app_main(void)
         return;
     }
 
+    if (wifi_cfg.rotation >= 0) {
+        epaper_rotation_t rotation;
+        if (epaper_rotation_from_degrees(wifi_cfg.rotation, &rotation) == ESP_OK) {
+            epaper_set_default_rotation(rotation);
+        } else {
+            log_error(TAG, "Invalid ROTATION %d, using %d", wifi_cfg.rotation,
+                      epaper_rotation_degrees(epaper_get_default_rotation()));
+        }
+    }
+
     ret = wifi_manager_init();
     if (ret != ESP_OK) {
         log_error(TAG, "Failed to initialize WiFi");
@@ -112,6 +135,41 @@ void app_main(void)
         log_info(TAG, "Gateway: %s", gateway_str);
     }
 
+    // ----------
+    // e-Paper
+    // ----------
+    epaper_handle_t epaper_cfg = {
+        .cs_pin = EPAPER_CS_PIN,
+        .dc_pin = EPAPER_DC_PIN,
+        .rst_pin = EPAPER_RST_PIN,
+        .busy_pin = EPAPER_BUSY_PIN,
+        .width = 800,
+        .height = 480
+    };
+
+    ESP_LOGI(TAG, "Opening e-Paper session...");
+    ret = epaper_session_open(&epaper_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "e-Paper initialization failed");
+        return;
+    }
+    epaper_handle_t *epaper = epaper_session_get();
+
+    fb_pool_stats_t fb_stats;
+    if (fb_pool_get_stats(&fb_stats) == ESP_OK) {
+        ESP_LOGI(TAG, "Frame buffers: %d in %s, %u bytes of internal RAM saved, %u bytes internal free",
+                 fb_stats.frames, fb_stats.in_psram ? "PSRAM" : "internal RAM",
+                 (unsigned)fb_stats.internal_saved, (unsigned)fb_stats.internal_free);
+    }
+
+    if (frame_cache_init(0) != ESP_OK) {
+        ESP_LOGW(TAG, "Frame cache unavailable, every image is decoded from the card");
+    }
+
+    if (epaper_text_init(EPAPER_TEXT_CACHE_DEFAULT) != ESP_OK) {
+        ESP_LOGW(TAG, "Glyph cache unavailable, text is expanded per draw");
+    }
+
     ESP_LOGI(TAG, "Starting HTTP server...");
     ret = http_server_start();
     if (ret == ESP_OK) {
@@ -122,8 +180,12 @@ void app_main(void)
     }
 
     ESP_LOGI(TAG, "Loading BMP image from SD card...");
-    bmp_image_t image;
-    ret = load_bmp_from_sd("/sdcard/test.bmp", &image);
+    bmp_image_t image = {0};
+    // The HTTP server is already up, so claim the panel before using the
+    // back buffer; an update that got in first wins.
+    uint8_t *frame = epaper_claim_update() == ESP_OK ? fb_get_back() : NULL;
+    ret = frame != NULL ? frame_cache_load("/sdcard/test.bmp", frame, epaper->width, epaper->height, NULL, &image)
+                         : ESP_ERR_NO_MEM;
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "BMP image loaded successfully");
     }else{
@@ -133,35 +195,17 @@ void app_main(void)
     sdio_unmount(&sdio_ctx);
     sdio_deinit(&sdio_ctx);
 
-    // ----------
-    // e-Paper
-    // ----------
-    epaper_handle_t epaper = {
-        .cs_pin = EPAPER_CS_PIN,
-        .dc_pin = EPAPER_DC_PIN,
-        .rst_pin = EPAPER_RST_PIN,
-        .busy_pin = EPAPER_BUSY_PIN,
-        .width = 800,
-        .height = 480
-    };
-
-    ESP_LOGI(TAG, "Initializing e-Paper display...");
-    ret = epaper_init(&epaper);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "e-Paper initialization failed");
-        return;
-    }
-
+    // The refresh runs in the background so the main loop starts without
+    // waiting for it; the session keeps the panel configured afterwards.
     ESP_LOGI(TAG, "Displaying image on e-Paper...");
-    ret = epaper_display_frame(&epaper, image.data);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Image displayed successfully");
-    } else {
+    ret = epaper_display_rotated_async(epaper, image.data, image.width, image.height,
+                                       epaper_default_rotation_for(image.width, image.height),
+                                       boot_image_refresh_done, NULL);
+    epaper_release_update();
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to display image");
     }
 
-    epaper_deinit(&epaper);
-
     while (1) {
         wifi_status_t status = wifi_manager_get_status();
         if (status == WIFI_STATUS_CONNECTED) {
@@ -179,7 +223,8 @@ void app_main(void)
         btn2 = gpio_get_level(BTN2_PIN);
 
         if(!btn0){
-
+            // 直近の表示更新のフェーズ別タイミングをログ出力
+            epaper_dump_timing();
         }else if(!btn2){
             // WiFi再接続とIPアドレス再取得
             ESP_LOGI(TAG, "Button 2 pressed - Reconnecting WiFi...");
@@ -0,0 +1,617 @@
+#include "png.h"
+#include "epaper_driver.h"
+#include "epaper_dither.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "rom/miniz.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "PNG";
+
+#define PNG_COLOR_GREY          0
+#define PNG_COLOR_RGB           2
+#define PNG_COLOR_PALETTE       3
+#define PNG_COLOR_GREY_ALPHA    4
+#define PNG_COLOR_RGBA          6
+
+#define PNG_TYPE(a, b, c, d)    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (d))
+#define PNG_TYPE_IHDR           PNG_TYPE('I', 'H', 'D', 'R')
+#define PNG_TYPE_PLTE           PNG_TYPE('P', 'L', 'T', 'E')
+#define PNG_TYPE_TRNS           PNG_TYPE('t', 'R', 'N', 'S')
+#define PNG_TYPE_IDAT           PNG_TYPE('I', 'D', 'A', 'T')
+
+static const uint8_t _signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+// Everything the chunk parser, the row filters and the converters share.
+// About 1 KB, so it lives on the heap rather than the caller's stack.
+typedef struct {
+    FILE *file;
+    uint8_t *buf;
+    size_t len;             // valid bytes in buf
+    size_t pos;             // next unread byte in buf
+    uint32_t bytes;
+    uint32_t chunks;
+    int64_t read_us;
+
+    uint32_t width;
+    uint32_t height;
+    uint8_t depth;
+    uint8_t color_type;
+    uint8_t channels;
+    uint8_t pixel_bytes;    // filter distance, at least 1
+    uint32_t row_bytes;     // without the filter type byte
+    bool indexed;           // palette, or grey of up to 8 bits
+    bool has_palette;
+    bool has_key;           // tRNS colour key on an RGB image
+    uint8_t key[3];
+    uint8_t rgb[256][3];    // palette entries or grey levels, over white
+    uint8_t codes[256];
+    const uint8_t *color_lut;
+
+    bmp_layout_t layout;
+    uint8_t *frame;
+    bool dithered;
+    epaper_dither_ctx_t dither;
+    uint16_t *xmap;         // pixel index (indexed) or byte offset per output column
+    uint8_t *line;          // one panel code per output column
+    uint8_t *line_rgb;      // sampled colours of one output row, dithering only
+    uint8_t *cur;           // row being assembled, filter byte first
+    uint8_t *prev;          // the row above it, unfiltered
+    uint32_t fill;          // bytes of cur received
+    uint32_t y;             // image row in cur
+    uint32_t next_row;      // next output row to fill
+    int32_t last_sy;
+    int64_t convert_us;
+} png_loader_t;
+
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Composites a channel with its alpha onto white.
+static inline uint8_t png_over_white(uint8_t v, uint8_t a)
+{
+    return (v * a + 255 * (255 - a) + 127) / 255;
+}
+
+static bool png_fill(png_loader_t *ld)
+{
+    int64_t start = esp_timer_get_time();
+
+    ld->pos = 0;
+    ld->len = fread(ld->buf, 1, PNG_CHUNK_SIZE, ld->file);
+    ld->bytes += ld->len;
+
+    ld->read_us += esp_timer_get_time() - start;
+    ld->chunks++;
+    return ld->len > 0;
+}
+
+// Copies len bytes to dst, or skips them when dst is NULL. Long skips
+// (metadata chunks) seek past whatever is not already buffered.
+static bool png_read(png_loader_t *ld, void *dst, uint32_t len)
+{
+    uint8_t *out = dst;
+
+    if (out == NULL && len > ld->len - ld->pos) {
+        uint32_t ahead = len - (ld->len - ld->pos);
+        ld->pos = ld->len = 0;
+        return fseek(ld->file, ahead, SEEK_CUR) == 0;
+    }
+
+    while (len > 0) {
+        if (ld->pos == ld->len && !png_fill(ld)) {
+            return false;
+        }
+
+        size_t n = ld->len - ld->pos;
+        if (n > len) {
+            n = len;
+        }
+        if (out != NULL) {
+            memcpy(out, ld->buf + ld->pos, n);
+            out += n;
+        }
+        ld->pos += n;
+        len -= n;
+    }
+    return true;
+}
+
+static esp_err_t png_parse_header(png_loader_t *ld, const uint8_t *ihdr)
+{
+    ld->width = read_be32(ihdr);
+    ld->height = read_be32(ihdr + 4);
+    ld->depth = ihdr[8];
+    ld->color_type = ihdr[9];
+
+    if (ihdr[10] != 0 || ihdr[11] != 0) {
+        ESP_LOGE(TAG, "Unknown compression or filter method");
+        return ESP_FAIL;
+    }
+    if (ihdr[12] != 0) {
+        ESP_LOGE(TAG, "Interlaced PNG files are not supported");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (ld->width == 0 || ld->height == 0 || ld->width > BMP_MAX_DIMENSION || ld->height > BMP_MAX_DIMENSION) {
+        ESP_LOGE(TAG, "PNG dimensions must be 1 to %d pixels", BMP_MAX_DIMENSION);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint8_t d = ld->depth;
+    bool low_depth = (d == 1 || d == 2 || d == 4 || d == 8);
+    switch (ld->color_type) {
+        case PNG_COLOR_GREY:        ld->channels = 1; break;
+        case PNG_COLOR_PALETTE:     ld->channels = 1; break;
+        case PNG_COLOR_RGB:         ld->channels = 3; low_depth = (d == 8); break;
+        case PNG_COLOR_GREY_ALPHA:  ld->channels = 2; low_depth = (d == 8); break;
+        case PNG_COLOR_RGBA:        ld->channels = 4; low_depth = (d == 8); break;
+        default:
+            ESP_LOGE(TAG, "Invalid colour type %d", ld->color_type);
+            return ESP_FAIL;
+    }
+    if (!low_depth) {
+        ESP_LOGE(TAG, "Unsupported bit depth %d for colour type %d", d, ld->color_type);
+        return d == 16 ? ESP_ERR_NOT_SUPPORTED : ESP_FAIL;
+    }
+
+    ld->row_bytes = (ld->width * ld->channels * d + 7) / 8;
+    ld->pixel_bytes = ld->channels * d >= 8 ? ld->channels * d / 8 : 1;
+    ld->indexed = (ld->color_type == PNG_COLOR_PALETTE || ld->color_type == PNG_COLOR_GREY);
+
+    // Missing palette entries show as white; grey levels become a palette.
+    memset(ld->rgb, 0xFF, sizeof(ld->rgb));
+    if (ld->color_type == PNG_COLOR_GREY) {
+        uint32_t levels = 1u << d;
+        for (uint32_t i = 0; i < levels; i++) {
+            memset(ld->rgb[i], i * 255 / (levels - 1), 3);
+        }
+    }
+    return ESP_OK;
+}
+
+static void png_parse_trns(png_loader_t *ld, const uint8_t *data, uint32_t len)
+{
+    switch (ld->color_type) {
+        case PNG_COLOR_PALETTE:
+            for (uint32_t i = 0; i < len && i < 256; i++) {
+                for (int c = 0; c < 3; c++) {
+                    ld->rgb[i][c] = png_over_white(ld->rgb[i][c], data[i]);
+                }
+            }
+            break;
+        case PNG_COLOR_GREY:
+            if (len >= 2 && ((data[0] << 8) | data[1]) < (1 << ld->depth)) {
+                memset(ld->rgb[data[1]], 0xFF, 3);
+            }
+            break;
+        case PNG_COLOR_RGB:
+            if (len >= 6) {
+                ld->has_key = true;
+                ld->key[0] = data[1];
+                ld->key[1] = data[3];
+                ld->key[2] = data[5];
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static bool png_unfilter(png_loader_t *ld)
+{
+    uint8_t *row = ld->cur + 1;
+    const uint8_t *up = ld->prev + 1;
+    uint32_t n = ld->row_bytes;
+    uint32_t bpp = ld->pixel_bytes;
+
+    switch (ld->cur[0]) {
+        case 0:
+            break;
+        case 1:
+            for (uint32_t i = bpp; i < n; i++) {
+                row[i] += row[i - bpp];
+            }
+            break;
+        case 2:
+            for (uint32_t i = 0; i < n; i++) {
+                row[i] += up[i];
+            }
+            break;
+        case 3:
+            for (uint32_t i = 0; i < bpp; i++) {
+                row[i] += up[i] >> 1;
+            }
+            for (uint32_t i = bpp; i < n; i++) {
+                row[i] += (row[i - bpp] + up[i]) >> 1;
+            }
+            break;
+        case 4:
+            for (uint32_t i = 0; i < bpp; i++) {
+                row[i] += up[i];
+            }
+            for (uint32_t i = bpp; i < n; i++) {
+                int a = row[i - bpp], b = up[i], c = up[i - bpp];
+                int p = a + b - c;
+                int pa = p > a ? p - a : a - p;
+                int pb = p > b ? p - b : b - p;
+                int pc = p > c ? p - c : c - p;
+                row[i] += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+            }
+            break;
+        default:
+            ESP_LOGE(TAG, "Invalid filter type %d on row %lu", ld->cur[0], (unsigned long)ld->y);
+            return false;
+    }
+    return true;
+}
+
+static inline uint8_t png_index(const uint8_t *row, uint32_t x, uint8_t depth)
+{
+    switch (depth) {
+        case 8:  return row[x];
+        case 4:  return (row[x >> 1] >> ((x & 1) ? 0 : 4)) & 0x0F;
+        case 2:  return (row[x >> 2] >> (6 - 2 * (x & 3))) & 0x03;
+        default: return (row[x >> 3] >> (7 - (x & 7))) & 0x01;
+    }
+}
+
+// Colour of a true-colour or alpha pixel at p, composited onto white.
+static inline void png_color(const png_loader_t *ld, const uint8_t *p, uint8_t *rgb)
+{
+    switch (ld->color_type) {
+        case PNG_COLOR_GREY_ALPHA:
+            rgb[0] = rgb[1] = rgb[2] = png_over_white(p[0], p[1]);
+            break;
+        case PNG_COLOR_RGBA:
+            rgb[0] = png_over_white(p[0], p[3]);
+            rgb[1] = png_over_white(p[1], p[3]);
+            rgb[2] = png_over_white(p[2], p[3]);
+            break;
+        default:
+            if (ld->has_key && p[0] == ld->key[0] && p[1] == ld->key[1] && p[2] == ld->key[2]) {
+                rgb[0] = rgb[1] = rgb[2] = 0xFF;
+            } else {
+                memcpy(rgb, p, 3);
+            }
+            break;
+    }
+}
+
+// Produces every output row that samples the image row just unfiltered.
+static void png_emit_rows(png_loader_t *ld)
+{
+    const bmp_layout_t *layout = &ld->layout;
+    const uint8_t *row = ld->cur + 1;
+    uint32_t stride = layout->dst_w / 2;
+    int64_t start = esp_timer_get_time();
+
+    while (ld->next_row < layout->dh &&
+           bmp_src_pos(ld->next_row, layout->sy0, layout->sh, layout->dh) == ld->y) {
+        uint8_t *out = ld->frame + (size_t)(layout->dy0 + ld->next_row) * stride;
+
+        if (ld->dithered) {
+            for (uint16_t i = 0; i < layout->dw; i++) {
+                if (ld->indexed) {
+                    memcpy(ld->line_rgb + i * 3, ld->rgb[png_index(row, ld->xmap[i], ld->depth)], 3);
+                } else {
+                    png_color(ld, row + ld->xmap[i], ld->line_rgb + i * 3);
+                }
+            }
+            epaper_dither_row(&ld->dither, ld->line_rgb, ld->line);
+            bmp_pack_row(out + layout->dx0 / 2, ld->line, layout->dw);
+        } else if ((int32_t)ld->y != ld->last_sy) {
+            if (ld->indexed) {
+                for (uint16_t i = 0; i < layout->dw; i++) {
+                    ld->line[i] = ld->codes[png_index(row, ld->xmap[i], ld->depth)];
+                }
+            } else {
+                for (uint16_t i = 0; i < layout->dw; i++) {
+                    uint8_t c[3];
+                    png_color(ld, row + ld->xmap[i], c);
+                    ld->line[i] = ld->color_lut[EPAPER_COLOR_LUT_INDEX(c[0], c[1], c[2])];
+                }
+            }
+            bmp_pack_row(out + layout->dx0 / 2, ld->line, layout->dw);
+        } else {
+            memcpy(out, out - stride, stride);
+        }
+
+        ld->last_sy = ld->y;
+        ld->next_row++;
+    }
+
+    ld->convert_us += esp_timer_get_time() - start;
+}
+
+// Collects inflated bytes into scanlines; each complete one is unfiltered
+// against the row above and becomes the row above for the next.
+static bool png_feed(png_loader_t *ld, const uint8_t *data, size_t len)
+{
+    uint32_t row_len = 1 + ld->row_bytes;
+
+    while (len > 0 && ld->y < ld->height) {
+        size_t n = row_len - ld->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ld->cur + ld->fill, data, n);
+        ld->fill += n;
+        data += n;
+        len -= n;
+
+        if (ld->fill == row_len) {
+            if (!png_unfilter(ld)) {
+                return false;
+            }
+            png_emit_rows(ld);
+
+            uint8_t *t = ld->prev;
+            ld->prev = ld->cur;
+            ld->cur = t;
+            ld->fill = 0;
+            ld->y++;
+        }
+    }
+    return true;
+}
+
+// Makes IDAT input available, moving on to the next IDAT chunk when the
+// current one is used up. False at the end of the image data.
+static bool png_next_input(png_loader_t *ld, uint32_t *idat_left)
+{
+    while (*idat_left == 0) {
+        uint8_t head[12];   // CRC of the chunk before, then length and type
+        if (!png_read(ld, head, sizeof(head)) || read_be32(head + 8) != PNG_TYPE_IDAT) {
+            return false;
+        }
+        *idat_left = read_be32(head + 4);
+    }
+    return ld->pos < ld->len || png_fill(ld);
+}
+
+static esp_err_t png_inflate(png_loader_t *ld, uint32_t idat_left)
+{
+    tinfl_decompressor *inflator = heap_caps_malloc(sizeof(tinfl_decompressor), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    uint8_t *window = heap_caps_malloc(PNG_WINDOW_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (window == NULL) {
+        window = heap_caps_malloc(PNG_WINDOW_SIZE, MALLOC_CAP_SPIRAM);
+    }
+    if (inflator == NULL || window == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate inflate window");
+        heap_caps_free(inflator);
+        heap_caps_free(window);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    size_t window_pos = 0;
+    tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    tinfl_init(inflator);
+
+    // Stops as soon as the last output row is written; trailing rows that
+    // are cropped away are never inflated.
+    while (status != TINFL_STATUS_DONE && ld->next_row < ld->layout.dh) {
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && (ld->pos == ld->len || idat_left == 0) &&
+            !png_next_input(ld, &idat_left)) {
+            ESP_LOGE(TAG, "Image data ends at row %lu", (unsigned long)ld->y);
+            ret = ESP_FAIL;
+            break;
+        }
+
+        size_t in_len = ld->len - ld->pos < idat_left ? ld->len - ld->pos : idat_left;
+        size_t out_len = PNG_WINDOW_SIZE - window_pos;
+        status = tinfl_decompress(inflator, ld->buf + ld->pos, &in_len, window, window + window_pos, &out_len,
+                                  TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        ld->pos += in_len;
+        idat_left -= in_len;
+
+        if (status < 0) {
+            ESP_LOGE(TAG, "Inflate failed (%d) at row %lu", status, (unsigned long)ld->y);
+            ret = ESP_FAIL;
+            break;
+        }
+        if (!png_feed(ld, window + window_pos, out_len)) {
+            ret = ESP_FAIL;
+            break;
+        }
+        window_pos = (window_pos + out_len) & (PNG_WINDOW_SIZE - 1);
+    }
+
+    if (ret == ESP_OK && ld->next_row < ld->layout.dh) {
+        ESP_LOGE(TAG, "Image data ends at row %lu", (unsigned long)ld->y);
+        ret = ESP_FAIL;
+    }
+
+    heap_caps_free(window);
+    heap_caps_free(inflator);
+    return ret;
+}
+
+esp_err_t load_png_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                              const bmp_load_opts_t *opts, bmp_image_t *image)
+{
+    if (filename == NULL || frame == NULL || image == NULL || (frame_w % 2) || (frame_h % 2)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    static const bmp_load_opts_t defaults = BMP_LOAD_OPTS_DEFAULT;
+    if (opts == NULL) {
+        opts = &defaults;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = ESP_FAIL;
+    uint8_t *scratch = NULL;
+    png_loader_t *ld = heap_caps_calloc(1, sizeof(*ld), MALLOC_CAP_8BIT);
+    if (ld == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ld->frame = frame;
+    ld->last_sy = -1;
+
+    ESP_LOGI(TAG, "Loading PNG file: %s", filename);
+
+    ld->file = fopen(filename, "rb");
+    if (!ld->file) {
+        ESP_LOGE(TAG, "Failed to open file: %s", filename);
+        heap_caps_free(ld);
+        return ESP_FAIL;
+    }
+    setvbuf(ld->file, NULL, _IONBF, 0);
+
+    ld->buf = heap_caps_malloc(PNG_CHUNK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    if (!ld->buf) {
+        ESP_LOGE(TAG, "Failed to allocate read buffer");
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    uint8_t head[8 + 8 + 13];
+    if (!png_read(ld, head, sizeof(head)) || memcmp(head, _signature, sizeof(_signature)) != 0 ||
+        read_be32(head + 12) != PNG_TYPE_IHDR || read_be32(head + 8) != 13) {
+        ESP_LOGE(TAG, "Invalid PNG signature or header");
+        goto cleanup;
+    }
+    ret = png_parse_header(ld, head + 16);
+    if (ret != ESP_OK) {
+        goto cleanup;
+    }
+    ret = ESP_FAIL;
+
+    ESP_LOGI(TAG, "PNG info: %lux%lu, colour type %d, %d bits", (unsigned long)ld->width,
+             (unsigned long)ld->height, ld->color_type, ld->depth);
+
+    // Chunks up to the first IDAT: PLTE and tRNS are used, the rest skipped.
+    uint32_t idat_left = 0;
+    if (!png_read(ld, NULL, 4)) {
+        goto cleanup;
+    }
+    for (;;) {
+        uint8_t chunk[8];
+        if (!png_read(ld, chunk, sizeof(chunk))) {
+            ESP_LOGE(TAG, "No image data");
+            goto cleanup;
+        }
+        uint32_t len = read_be32(chunk);
+        uint32_t type = read_be32(chunk + 4);
+
+        if (type == PNG_TYPE_IDAT) {
+            idat_left = len;
+            break;
+        }
+        if (type == PNG_TYPE_PLTE || type == PNG_TYPE_TRNS) {
+            uint8_t data[768];
+            if (len > sizeof(data) || !png_read(ld, data, len)) {
+                ESP_LOGE(TAG, "Invalid palette");
+                goto cleanup;
+            }
+            if (type == PNG_TYPE_PLTE) {
+                memcpy(ld->rgb, data, len - len % 3);
+                ld->has_palette = true;
+            } else {
+                png_parse_trns(ld, data, len);
+            }
+            len = 0;
+        }
+        if (!png_read(ld, NULL, len + 4)) {
+            goto cleanup;
+        }
+    }
+
+    if (ld->color_type == PNG_COLOR_PALETTE && !ld->has_palette) {
+        ESP_LOGE(TAG, "Palette image without PLTE");
+        goto cleanup;
+    }
+    if (ld->indexed) {
+        for (uint32_t i = 0; i < (1u << ld->depth); i++) {
+            ld->codes[i] = epaper_color_nearest(ld->rgb[i][0], ld->rgb[i][1], ld->rgb[i][2]);
+        }
+    } else {
+        ld->color_lut = epaper_color_lut();
+        if (ld->color_lut == NULL) {
+            ret = ESP_ERR_NO_MEM;
+            goto cleanup;
+        }
+    }
+
+    bmp_layout_t *layout = &ld->layout;
+    layout->dst_w = ld->height > ld->width ? frame_h : frame_w;
+    layout->dst_h = ld->height > ld->width ? frame_w : frame_h;
+    bmp_plan_layout(layout, ld->width, ld->height, opts->fit);
+    ESP_LOGI(TAG, "Placing %lux%lu of the image at %u,%u as %ux%u (%s, %s dithering)",
+             (unsigned long)layout->sw, (unsigned long)layout->sh, layout->dx0, layout->dy0,
+             layout->dw, layout->dh, bmp_fit_name(opts->fit), epaper_dither_name(opts->dither));
+
+    ld->dithered = (opts->dither != EPAPER_DITHER_NONE);
+    size_t row_len = 1 + ld->row_bytes;
+    size_t rgb_size = ld->dithered ? (size_t)layout->dw * 3 : 0;
+    scratch = heap_caps_malloc(2 * row_len + layout->dw * (sizeof(uint16_t) + 1) + rgb_size, MALLOC_CAP_8BIT);
+    if (scratch == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate row buffers");
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    ld->xmap = (uint16_t *)scratch;
+    ld->line = scratch + layout->dw * sizeof(uint16_t);
+    ld->line_rgb = ld->line + layout->dw;
+    ld->cur = ld->line_rgb + rgb_size;
+    ld->prev = ld->cur + row_len;
+    memset(ld->prev, 0, row_len);
+
+    ret = epaper_dither_begin(&ld->dither, opts->dither, layout->dw);
+    if (ret != ESP_OK) {
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < layout->dw; i++) {
+        uint32_t x = bmp_src_pos(i, layout->sx0, layout->sw, layout->dw);
+        ld->xmap[i] = ld->indexed ? x : x * ld->channels;
+    }
+
+    uint32_t stride = layout->dst_w / 2;
+    if (layout->dw < layout->dst_w || layout->dh < layout->dst_h) {
+        memset(frame, (EPAPER_COLOR_WHITE << 4) | EPAPER_COLOR_WHITE, (size_t)stride * layout->dst_h);
+    }
+
+    ret = png_inflate(ld, idat_left);
+    if (ret != ESP_OK) {
+        goto cleanup;
+    }
+
+    image->data = frame;
+    image->width = layout->dst_w;
+    image->height = layout->dst_h;
+    image->bits_per_pixel = ld->channels * ld->depth;
+
+    bmp_load_stats_t stats = {
+        .src_width = ld->width,
+        .src_height = ld->height,
+        .bits_per_pixel = ld->channels * ld->depth,
+        .fit = opts->fit,
+        .dither = opts->dither,
+        .file_bytes = ld->bytes,
+        .chunks = ld->chunks,
+        .read_us = ld->read_us,
+        .convert_us = ld->convert_us,
+        .elapsed_us = esp_timer_get_time() - start
+    };
+    bmp_record_load_stats(&stats);
+
+    ESP_LOGI(TAG, "PNG file loaded in %lld us (%lu chunks, %lld us reading, %lld us converting)",
+             (long long)stats.elapsed_us, (unsigned long)stats.chunks, (long long)stats.read_us,
+             (long long)stats.convert_us);
+
+cleanup:
+    epaper_dither_end(&ld->dither);
+    heap_caps_free(scratch);
+    heap_caps_free(ld->buf);
+    fclose(ld->file);
+    heap_caps_free(ld);
+    return ret;
+}
@@ -0,0 +1,24 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "bitmap.h"
+
+// Input is read in chunks of this size. IDAT data is inflated by the ROM
+// tinfl into a wrapping window of PNG_WINDOW_SIZE bytes (the deflate
+// maximum), and scanlines are unfiltered with only the previous row kept.
+#define PNG_CHUNK_SIZE      BMP_CHUNK_SIZE
+#define PNG_WINDOW_SIZE     32768
+
+// Decodes a non-interlaced PNG into frame as packed 4bpp panel colour
+// codes, with the same layout, fit and dither options as
+// load_bmp_into_frame. Palette and grey images of 1, 2, 4 or 8 bits and
+// 8-bit RGB, grey+alpha and RGBA are supported; transparency (alpha or
+// tRNS) is composited onto white. Palette entries and grey levels are
+// matched to the panel colours once, true colour goes through the
+// 32x32x32 table. Interlaced and 16-bit images give ESP_ERR_NOT_SUPPORTED.
+esp_err_t load_png_into_frame(const char *filename, uint8_t *frame, uint16_t frame_w, uint16_t frame_h,
+                              const bmp_load_opts_t *opts, bmp_image_t *image);
+
+#endif
@@ -1,4 +1,5 @@
 #include "sdio.h"
+#include "spi_shared.h"
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
@@ -25,18 +26,10 @@ esp_err_t init_sd_card(void)
     };
 
     sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-    host.slot = SD_SPI_HOST;
-
-    spi_bus_config_t bus_cfg = {
-        .mosi_io_num = SD_MOSI_PIN,
-        .miso_io_num = SD_MISO_PIN,
-        .sclk_io_num = SD_SCLK_PIN,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
-        .max_transfer_sz = 4000,
-    };
+    host.slot = SPI_SHARED_HOST;
 
-    esp_err_t ret = spi_bus_initialize(SD_SPI_HOST, &bus_cfg, SDSPI_DEFAULT_DMA);
+    // The bus is shared with the e-Paper panel and set up by spi_shared.
+    esp_err_t ret = spi_shared_acquire();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize bus.");
         return ret;
@@ -44,7 +37,7 @@ esp_err_t init_sd_card(void)
 
     sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
     slot_config.gpio_cs = SD_CS_PIN;
-    slot_config.host_id = SD_SPI_HOST;
+    slot_config.host_id = SPI_SHARED_HOST;
 
     ret = esp_vfs_fat_sdspi_mount(MOUNT_POINT, &host, &slot_config, &mount_config, &card);
 
@@ -56,6 +49,7 @@ esp_err_t init_sd_card(void)
             ESP_LOGE(TAG, "Failed to initialize the card (%s). "
                      "Make sure SD card lines have pull-up resistors in place.", esp_err_to_name(ret));
         }
+        spi_shared_release();
         return ret;
     }
 
@@ -137,8 +131,13 @@ esp_err_t deinit_sd_card(void)
         return ret;
     }
 
-    spi_bus_free(SD_SPI_HOST);
+    // Unmounting removed the card's device, so the reference can go.
     card = NULL;
+    ret = spi_shared_release();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to release SPI bus: %s", esp_err_to_name(ret));
+        return ret;
+    }
 
     ESP_LOGI(TAG, "SD card unmounted successfully");
     return ESP_OK;
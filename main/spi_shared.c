@@ -0,0 +1,73 @@
+#include "spi_shared.h"
+#include "driver/spi_master.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "SPI_SHARED";
+
+static SemaphoreHandle_t _lock = NULL;
+static int _users = 0;
+
+esp_err_t spi_shared_acquire(void)
+{
+    if (_lock == NULL) {
+        _lock = xSemaphoreCreateMutex();
+        if (_lock == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    esp_err_t ret = ESP_OK;
+    if (_users == 0) {
+        spi_bus_config_t buscfg = {
+            .miso_io_num = SPI_SHARED_MISO,
+            .mosi_io_num = SPI_SHARED_MOSI,
+            .sclk_io_num = SPI_SHARED_SCLK,
+            .quadwp_io_num = -1,
+            .quadhd_io_num = -1,
+            .max_transfer_sz = SPI_SHARED_MAX_TRANSFER
+        };
+
+        ret = spi_bus_initialize(SPI_SHARED_HOST, &buscfg, SPI_DMA_CH_AUTO);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to initialize SPI bus: %s", esp_err_to_name(ret));
+        }
+    }
+    if (ret == ESP_OK) {
+        _users++;
+    }
+
+    xSemaphoreGive(_lock);
+    return ret;
+}
+
+esp_err_t spi_shared_release(void)
+{
+    if (_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+
+    esp_err_t ret = ESP_OK;
+    if (_users == 0) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (_users > 1) {
+        _users--;
+    } else {
+        // Fails while a device is still attached; the bus then stays up and
+        // the reference is kept, so nothing is left pointing at a freed bus.
+        ret = spi_bus_free(SPI_SHARED_HOST);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to free SPI bus: %s", esp_err_to_name(ret));
+        } else {
+            _users = 0;
+        }
+    }
+
+    xSemaphoreGive(_lock);
+    return ret;
+}
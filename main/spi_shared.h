@@ -0,0 +1,28 @@
+#ifndef SPI_SHARED_H
+#define SPI_SHARED_H
+
+#include "esp_err.h"
+
+// SPI2 carries both the SD card and the panel (SCLK/MOSI shared, MISO only
+// used by the card). This module is the bus's only owner: whoever needs it
+// takes a reference before adding its device and gives it back after
+// removing the device, and the bus is freed with the last reference. The
+// bus is always set up with the one configuration below, whichever user
+// comes first.
+
+#define SPI_SHARED_HOST             SPI2_HOST
+#define SPI_SHARED_SCLK             7
+#define SPI_SHARED_MOSI             9
+#define SPI_SHARED_MISO             8
+
+// Largest single transaction on the bus. The panel sends each pixel chunk
+// as one transaction, so this must not be smaller than its chunk size.
+#define SPI_SHARED_MAX_TRANSFER     4096
+
+esp_err_t spi_shared_acquire(void);
+
+// Only call once the caller's device has been removed from the bus; the
+// last release frees it and reports if the driver refused.
+esp_err_t spi_shared_release(void);
+
+#endif
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Convert a BDF bitmap font into a C font table for epaper_text.
+
+Glyph rows are stored 1bpp, MSB first, padded to whole bytes. Each byte
+holds four pixel pairs, and every pair expands to exactly one byte of the
+panel's 4bpp layout, so the firmware expands a row with a 4-entry table.
+The glyph table is sorted by code point for binary search.
+
+    python3 tools/bdf2font.py font.bdf font_name [--ranges 0x20-0x7e,0x3000-0x30ff] > main/font_name.c
+
+Japanese needs a BDF with JIS X 0208 coverage (Shinonome, k12x10, ...).
+"""
+
+import argparse
+import sys
+
+
+def parse_ranges(text):
+    ranges = []
+    for part in text.split(","):
+        lo, _, hi = part.partition("-")
+        lo = int(lo, 0)
+        ranges.append((lo, int(hi, 0) if hi else lo))
+    return ranges
+
+
+def parse_bdf(path):
+    glyphs = []
+    ascent = descent = None
+    glyph = None
+    bitmap = None
+
+    with open(path, encoding="latin-1") as f:
+        for line in f:
+            words = line.split()
+            if not words:
+                continue
+            key = words[0]
+
+            if bitmap is not None:
+                if key == "ENDCHAR":
+                    glyph["rows"] = bitmap
+                    glyphs.append(glyph)
+                    glyph = bitmap = None
+                else:
+                    bitmap.append(bytes.fromhex(key))
+                continue
+
+            if key == "FONT_ASCENT":
+                ascent = int(words[1])
+            elif key == "FONT_DESCENT":
+                descent = int(words[1])
+            elif key == "STARTCHAR":
+                glyph = {}
+            elif key == "ENCODING":
+                glyph["cp"] = int(words[1])
+            elif key == "DWIDTH":
+                glyph["advance"] = int(words[1])
+            elif key == "BBX":
+                glyph["w"], glyph["h"], glyph["x"], glyph["y"] = map(int, words[1:5])
+            elif key == "BITMAP":
+                bitmap = []
+
+    if ascent is None or descent is None:
+        sys.exit("%s: FONT_ASCENT/FONT_DESCENT missing" % path)
+
+    return ascent, descent, glyphs
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("bdf")
+    ap.add_argument("name")
+    ap.add_argument("--ranges", default="0x20-0x7e,0xb0,0xfffd")
+    ap.add_argument("--fallback", help="C name of a font to search when a glyph is missing")
+    args = ap.parse_args()
+
+    ranges = parse_ranges(args.ranges)
+    ascent, descent, glyphs = parse_bdf(args.bdf)
+    glyphs = [g for g in glyphs if g.get("cp", -1) >= 0 and any(lo <= g["cp"] <= hi for lo, hi in ranges)]
+    glyphs.sort(key=lambda g: g["cp"])
+
+    out = []
+    out.append("// Generated by tools/bdf2font.py from %s. Do not edit." % args.bdf.split("/")[-1])
+    out.append('#include "epaper_text.h"')
+    out.append("")
+    if args.fallback:
+        out.append("extern const epaper_font_t %s;" % args.fallback)
+        out.append("")
+
+    out.append("static const uint8_t %s_bitmap[] = {" % args.name)
+    offset = 0
+    for g in glyphs:
+        row_bytes = (g["w"] + 7) // 8
+        data = []
+        for row in g["rows"]:
+            # Some fonts pad rows beyond the glyph width; keep the left-most bytes.
+            data.extend(row[:row_bytes].ljust(row_bytes, b"\0"))
+        g["offset"] = offset
+        offset += len(data)
+        if data:
+            out.append("    // U+%04X" % g["cp"])
+            for i in range(0, len(data), 12):
+                out.append("    " + " ".join("0x%02X," % b for b in data[i:i + 12]))
+    out.append("};")
+    out.append("")
+
+    out.append("static const epaper_glyph_t %s_glyphs[] = {" % args.name)
+    for g in glyphs:
+        top = ascent - (g["h"] + g["y"])
+        out.append("    {0x%04X, %6u, %2d, %2d, %3d, %3d, %2d}," %
+                   (g["cp"], g["offset"], g["w"], g["h"], g["x"], top, g["advance"]))
+    out.append("};")
+    out.append("")
+
+    out.append("const epaper_font_t %s = {" % args.name)
+    out.append("    .glyphs = %s_glyphs," % args.name)
+    out.append("    .bitmap = %s_bitmap," % args.name)
+    out.append("    .glyph_count = %d," % len(glyphs))
+    out.append("    .ascent = %d," % ascent)
+    out.append("    .line_height = %d," % (ascent + descent))
+    out.append("    .fallback = %s," % ("&" + args.fallback if args.fallback else "NULL"))
+    out.append("};")
+
+    print("\n".join(out))
+    print("%s: %d glyphs, %d bitmap bytes" % (args.name, len(glyphs), offset), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()